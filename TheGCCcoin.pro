@@ -204,6 +204,15 @@ HEADERS += \
     src/util.h \
     src/uint256.h \
     src/kernel.h \
+    src/walletscan.h \
+    src/bloom.h \
+    src/secp256k1.h \
+    src/jsonwriter.h \
+    src/addrindex.h \
+    src/chainstats.h \
+    src/orphans.h \
+    src/replay.h \
+    src/mempooldb.h \
     src/scrypt_mine.h \
     src/pbkdf2.h \
     src/serialize.h \
@@ -218,6 +227,7 @@ HEADERS += \
     src/script.h \
     src/init.h \
     src/irc.h \
+    src/hashmap.h \
     src/mruset.h \
     src/json/json_spirit_writer_template.h \
     src/json/json_spirit_writer.h \
@@ -274,6 +284,7 @@ HEADERS += \
     src/sph_fugue.h \
     src/sph_hamsi.h \
     src/sph_types.h \
+    src/sph_aesni.h \
     src/stealthtext.h \
     src/qt/httpsocket.h \
     src/qt/qcircleprogressbar.h \
@@ -442,11 +453,21 @@ SOURCES += \
     src/qt/rpcconsole.cpp \
     src/noui.cpp \
     src/kernel.cpp \
+    src/walletscan.cpp \
+    src/bloom.cpp \
+    src/secp256k1.cpp \
+    src/jsonwriter.cpp \
+    src/addrindex.cpp \
+    src/chainstats.cpp \
+    src/orphans.cpp \
+    src/replay.cpp \
+    src/mempooldb.cpp \
     src/scrypt-x86.S \
     src/scrypt-x86_64.S \
     src/scrypt_mine.cpp \
     src/pbkdf2.cpp \
     src/aes_helper.c \
+    src/aesni.c \
     src/blake.c \
     src/bmw.c \
     src/cubehash.c \
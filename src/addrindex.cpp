@@ -0,0 +1,325 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addrindex.h"
+#include "chainstats.h"
+#include "net.h"
+#include "txdb.h"
+
+using namespace std;
+
+bool fAddrIndex = false;
+int nAddrIndexHeight = -1;
+
+class CAddrIndexIdVisitor : public boost::static_visitor<bool>
+{
+private:
+    CAddrIndexId *id;
+public:
+    CAddrIndexIdVisitor(CAddrIndexId *idIn) : id(idIn) { }
+
+    bool operator()(const CKeyID &keyID) const
+    {
+        id->nAddrType = CAddrIndexId::ADDR_KEY;
+        id->hash = keyID;
+        return true;
+    }
+
+    bool operator()(const CScriptID &scriptID) const
+    {
+        id->nAddrType = CAddrIndexId::ADDR_SCRIPT;
+        id->hash = scriptID;
+        return true;
+    }
+
+    bool operator()(const CNoDestination &no) const { return false; }
+    bool operator()(const CStealthAddress &stxAddr) const { return false; }
+};
+
+bool CAddrIndexId::Set(const CTxDestination& dest)
+{
+    nAddrType = ADDR_NONE;
+    hash = 0;
+    return boost::apply_visitor(CAddrIndexIdVisitor(this), dest);
+}
+
+bool CAddrIndexId::SetScript(const CScript& scriptPubKey)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return false;
+    return Set(dest);
+}
+
+bool InitAddrIndex(CTxDB& txdb)
+{
+    int nHeight = -1;
+    uint256 hashBlock = 0;
+    bool fFound = txdb.ReadAddrIndexBest(nHeight, hashBlock);
+
+    if (!fAddrIndex)
+    {
+        // A stale index would go wrong as soon as the chain moves on without it
+        if (fFound)
+        {
+            printf("InitAddrIndex() : -addrindex is off, removing address index at height %d\n", nHeight);
+            if (!txdb.WipeAddrIndex())
+                return false;
+        }
+        nAddrIndexHeight = -1;
+        return true;
+    }
+
+    if (fFound && nHeight >= 0)
+    {
+        // The chain may have been rebuilt or reorganized past the index while
+        // it was kept. Its records are for blocks no longer there, so start over
+        CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end() || mi->second->nHeight != nHeight || !mi->second->IsInMainChain())
+        {
+            printf("InitAddrIndex() : address index at height %d is not on the best chain, rebuilding\n", nHeight);
+            if (!txdb.WipeAddrIndex())
+                return false;
+            fFound = false;
+        }
+    }
+
+    nAddrIndexHeight = fFound ? nHeight : -1;
+    printf("InitAddrIndex() : address index at height %d, best chain at %d\n", nAddrIndexHeight, nBestHeight);
+    return true;
+}
+
+bool AddrIndexReadSpent(CTxDB& txdb, const CTransaction& tx, vector<CTxOut>& vSpent)
+{
+    vSpent.clear();
+    if (tx.IsCoinBase())
+        return true;
+
+    vSpent.reserve(tx.vin.size());
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        CTransaction txPrev;
+        if (!txdb.ReadDiskTx(txin.prevout.hash, txPrev) || txin.prevout.n >= txPrev.vout.size())
+            return error("AddrIndexReadSpent() : cannot read %s", txin.prevout.ToString().c_str());
+        vSpent.push_back(txPrev.vout[txin.prevout.n]);
+    }
+    return true;
+}
+
+// vSpentHeight holds the heights the outputs in vSpent were created at, -1 if unknown
+static bool AddrIndexWriteTx(CTxDB& txdb, const CTransaction& tx, int nHeight, const vector<CTxOut>& vSpent, const vector<int>& vSpentHeight)
+{
+    uint256 hashTx = tx.GetHash();
+
+    for (unsigned int i = 0; i < vSpent.size() && i < tx.vin.size(); i++)
+    {
+        CAddrIndexId id;
+        if (!id.SetScript(vSpent[i].scriptPubKey))
+            continue;
+
+        const COutPoint& prevout = tx.vin[i].prevout;
+        if (!txdb.WriteAddrIndex(CAddrIndexKey(id, nHeight, hashTx, i, true), CAddrIndexValue(vSpent[i].nValue, vSpentHeight[i])))
+            return error("AddrIndexConnectTx() : WriteAddrIndex failed");
+        if (!txdb.EraseAddrUnspent(id, prevout))
+            return error("AddrIndexConnectTx() : EraseAddrUnspent failed");
+    }
+
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        const CTxOut& txout = tx.vout[i];
+        CAddrIndexId id;
+        if (txout.IsEmpty() || !id.SetScript(txout.scriptPubKey))
+            continue;
+
+        if (!txdb.WriteAddrIndex(CAddrIndexKey(id, nHeight, hashTx, i, false), CAddrIndexValue(txout.nValue, -1)))
+            return error("AddrIndexConnectTx() : WriteAddrIndex failed");
+        if (!txdb.WriteAddrUnspent(id, COutPoint(hashTx, i), CAddrUnspent(txout.nValue, nHeight, txout.scriptPubKey)))
+            return error("AddrIndexConnectTx() : WriteAddrUnspent failed");
+    }
+
+    return true;
+}
+
+bool AddrIndexConnectTx(CTxDB& txdb, const CTransaction& tx, int nHeight, const vector<CTxOut>& vSpent)
+{
+    vector<int> vSpentHeight(vSpent.size(), -1);
+    for (unsigned int i = 0; i < vSpent.size() && i < tx.vin.size(); i++)
+    {
+        CAddrIndexId id;
+        CAddrUnspent unspent;
+        if (id.SetScript(vSpent[i].scriptPubKey) && txdb.ReadAddrUnspent(id, tx.vin[i].prevout, unspent))
+            vSpentHeight[i] = unspent.nHeight;
+    }
+    return AddrIndexWriteTx(txdb, tx, nHeight, vSpent, vSpentHeight);
+}
+
+bool CAddrIndexChunk::ConnectTx(const CTransaction& tx, int nHeight, const vector<CTxOut>& vSpent)
+{
+    vector<int> vSpentHeight(vSpent.size(), -1);
+    for (unsigned int i = 0; i < vSpent.size() && i < tx.vin.size(); i++)
+    {
+        const COutPoint& prevout = tx.vin[i].prevout;
+        map<COutPoint, int>::iterator mi = mapHeight.find(prevout);
+        if (mi != mapHeight.end())
+        {
+            vSpentHeight[i] = mi->second;
+            mapHeight.erase(mi);
+            continue;
+        }
+        CAddrIndexId id;
+        CAddrUnspent unspent;
+        if (id.SetScript(vSpent[i].scriptPubKey) && txdbRead.ReadAddrUnspent(id, prevout, unspent))
+            vSpentHeight[i] = unspent.nHeight;
+    }
+
+    if (!AddrIndexWriteTx(txdb, tx, nHeight, vSpent, vSpentHeight))
+        return false;
+
+    uint256 hashTx = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        if (!tx.vout[i].IsEmpty())
+            mapHeight[COutPoint(hashTx, i)] = nHeight;
+    return true;
+}
+
+bool AddrIndexDisconnectTx(CTxDB& txdb, const CTransaction& tx, int nHeight, const vector<CTxOut>& vSpent)
+{
+    uint256 hashTx = tx.GetHash();
+
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        const CTxOut& txout = tx.vout[i];
+        CAddrIndexId id;
+        if (txout.IsEmpty() || !id.SetScript(txout.scriptPubKey))
+            continue;
+
+        if (!txdb.EraseAddrIndex(CAddrIndexKey(id, nHeight, hashTx, i, false)) || !txdb.EraseAddrUnspent(id, COutPoint(hashTx, i)))
+            return error("AddrIndexDisconnectTx() : erase failed");
+    }
+
+    for (unsigned int i = 0; i < vSpent.size() && i < tx.vin.size(); i++)
+    {
+        const COutPoint& prevout = tx.vin[i].prevout;
+        const CTxOut& txout = vSpent[i];
+        CAddrIndexId id;
+        if (!id.SetScript(txout.scriptPubKey))
+            continue;
+
+        CAddrIndexKey key(id, nHeight, hashTx, i, true);
+        CAddrIndexValue value;
+        if (!txdb.ReadAddrIndex(key, value))
+            return error("AddrIndexDisconnectTx() : spend record for %s not found", prevout.ToString().c_str());
+        if (!txdb.EraseAddrIndex(key))
+            return error("AddrIndexDisconnectTx() : EraseAddrIndex failed");
+        if (value.nPrevHeight >= 0 && !txdb.WriteAddrUnspent(id, prevout, CAddrUnspent(txout.nValue, value.nPrevHeight, txout.scriptPubKey)))
+            return error("AddrIndexDisconnectTx() : WriteAddrUnspent failed");
+    }
+
+    return true;
+}
+
+static bool AddrIndexBuildChunk(CTxDB& txdb, CTxDB& txdbRead, const vector<CBlockIndex*>& vChunk)
+{
+    CAddrIndexChunk chunk(txdb, txdbRead);
+    BOOST_FOREACH(CBlockIndex* pindex, vChunk)
+    {
+        if (fShutdown)
+            return false;
+
+        CBlock block;
+        if (!block.ReadFromDisk(pindex))
+            return error("AddrIndexBuildChunk() : ReadFromDisk failed at height %d", pindex->nHeight);
+
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        {
+            // Previous transactions are committed already, so read them
+            // without scanning the chunk's batch
+            vector<CTxOut> vSpent;
+            if (!AddrIndexReadSpent(txdbRead, tx, vSpent) || !chunk.ConnectTx(tx, pindex->nHeight, vSpent))
+                return false;
+        }
+    }
+    return true;
+}
+
+static void ThreadAddrIndexBuild2()
+{
+    {
+        LOCK(cs_main);
+        if (nAddrIndexHeight < 0)
+        {
+            CTxDB txdb;
+            if (!txdb.WipeAddrIndex())
+                return;
+        }
+    }
+
+    int64 nStart = GetTimeMillis();
+    int nStartHeight = nAddrIndexHeight;
+    while (!fShutdown)
+    {
+        int nFromHeight;
+        vector<CBlockIndex*> vChunk;
+        {
+            LOCK(cs_main);
+            nFromHeight = nAddrIndexHeight;
+            if (nFromHeight >= nBestHeight)
+                break;
+            for (int nHeight = nFromHeight + 1; nHeight <= nBestHeight && vChunk.size() < ADDRINDEX_BUILD_CHUNK; nHeight++)
+                vChunk.push_back(chainStats.GetBlockByHeight(nHeight));
+        }
+
+        // Read and index the chunk without holding cs_main
+        CTxDB txdb;
+        CTxDB txdbRead("r");
+        txdb.TxnBegin();
+        bool fOk = AddrIndexBuildChunk(txdb, txdbRead, vChunk);
+        if (fShutdown)
+            return;
+
+        {
+            LOCK(cs_main);
+            // If the chain reorganized under us the chunk is thrown away (the
+            // batch dies with txdb) and read again from the new best chain
+            if (nAddrIndexHeight != nFromHeight || !vChunk.back()->IsInMainChain())
+                continue;
+            if (!fOk)
+            {
+                printf("ThreadAddrIndexBuild() : indexing blocks %d-%d failed\n", nFromHeight + 1, vChunk.back()->nHeight);
+                return;
+            }
+            if (!txdb.WriteAddrIndexBest(vChunk.back()->nHeight, vChunk.back()->GetBlockHash()) || !txdb.TxnCommit())
+            {
+                printf("ThreadAddrIndexBuild() : commit failed\n");
+                return;
+            }
+            nAddrIndexHeight = vChunk.back()->nHeight;
+        }
+        printf("ThreadAddrIndexBuild() : indexed up to height %d\n", vChunk.back()->nHeight);
+    }
+
+    if (!fShutdown)
+        printf("ThreadAddrIndexBuild() : indexed %d blocks  %"PRI64d"ms\n", nAddrIndexHeight - nStartHeight, GetTimeMillis() - nStart);
+}
+
+void ThreadAddrIndexBuild(void* parg)
+{
+    // Make this thread recognisable as the address index thread
+    RenameThread("bitcoin-addrindex");
+
+    try
+    {
+        vnThreadsRunning[THREAD_ADDRINDEX]++;
+        ThreadAddrIndexBuild2();
+        vnThreadsRunning[THREAD_ADDRINDEX]--;
+    }
+    catch (std::exception& e) {
+        vnThreadsRunning[THREAD_ADDRINDEX]--;
+        PrintException(&e, "ThreadAddrIndexBuild()");
+    } catch (...) {
+        vnThreadsRunning[THREAD_ADDRINDEX]--;
+        PrintException(NULL, "ThreadAddrIndexBuild()");
+    }
+    printf("ThreadAddrIndexBuild exited\n");
+}
@@ -0,0 +1,200 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_ADDRINDEX_H
+#define BITCOIN_ADDRINDEX_H
+
+#include "main.h"
+
+class CTxDB;
+
+// Blocks the background builder indexes per LevelDB batch
+static const unsigned int ADDRINDEX_BUILD_CHUNK = 500;
+
+extern bool fAddrIndex;
+extern int nAddrIndexHeight;
+
+/** Identifies an address in the index: the key or script hash that
+ * ExtractDestination finds in an output script. Pay-to-pubkey outputs
+ * (coinstakes) land under the same id as pay-to-pubkey-hash outputs.
+ */
+class CAddrIndexId
+{
+public:
+    enum
+    {
+        ADDR_NONE   = 0,
+        ADDR_KEY    = 1,
+        ADDR_SCRIPT = 2,
+    };
+
+    unsigned char nAddrType;
+    uint160 hash;
+
+    CAddrIndexId()
+    {
+        nAddrType = ADDR_NONE;
+        hash = 0;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nAddrType);
+        READWRITE(hash);
+    )
+
+    bool IsNull() const { return nAddrType == ADDR_NONE; }
+
+    bool Set(const CTxDestination& dest);
+    bool SetScript(const CScript& scriptPubKey);
+
+    friend bool operator==(const CAddrIndexId& a, const CAddrIndexId& b)
+    {
+        return (a.nAddrType == b.nAddrType && a.hash == b.hash);
+    }
+
+    friend bool operator<(const CAddrIndexId& a, const CAddrIndexId& b)
+    {
+        return (a.nAddrType < b.nAddrType || (a.nAddrType == b.nAddrType && a.hash < b.hash));
+    }
+};
+
+/** History record key. The height is stored big-endian so LevelDB keeps an
+ * address's records in chain order and height ranges are a single seek.
+ */
+class CAddrIndexKey
+{
+public:
+    CAddrIndexId id;
+    int nHeight;
+    uint256 txhash;
+    unsigned int nIndex; // vout index for credits, vin index for spends
+    bool fSpend;
+
+    CAddrIndexKey()
+    {
+        nHeight = 0;
+        txhash = 0;
+        nIndex = 0;
+        fSpend = false;
+    }
+
+    CAddrIndexKey(const CAddrIndexId& idIn, int nHeightIn, const uint256& txhashIn, unsigned int nIndexIn, bool fSpendIn)
+    {
+        id = idIn;
+        nHeight = nHeightIn;
+        txhash = txhashIn;
+        nIndex = nIndexIn;
+        fSpend = fSpendIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(id);
+        unsigned char pchHeight[4];
+        pchHeight[0] = (unsigned int)nHeight >> 24;
+        pchHeight[1] = (unsigned int)nHeight >> 16;
+        pchHeight[2] = (unsigned int)nHeight >> 8;
+        pchHeight[3] = (unsigned int)nHeight;
+        READWRITE(FLATDATA(pchHeight));
+        if (fRead)
+            const_cast<CAddrIndexKey*>(this)->nHeight = (pchHeight[0] << 24) | (pchHeight[1] << 16) | (pchHeight[2] << 8) | pchHeight[3];
+        READWRITE(txhash);
+        READWRITE(nIndex);
+        READWRITE(fSpend);
+    )
+};
+
+/** History record value. Spends remember the height of the output they
+ * consumed so DisconnectBlock can put it back into the unspent set.
+ */
+class CAddrIndexValue
+{
+public:
+    int64 nValue;
+    int nPrevHeight;
+
+    CAddrIndexValue()
+    {
+        nValue = 0;
+        nPrevHeight = -1;
+    }
+
+    CAddrIndexValue(int64 nValueIn, int nPrevHeightIn)
+    {
+        nValue = nValueIn;
+        nPrevHeight = nPrevHeightIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nValue);
+        READWRITE(nPrevHeight);
+    )
+};
+
+/** Unspent output of an address */
+class CAddrUnspent
+{
+public:
+    int64 nValue;
+    int nHeight;
+    CScript scriptPubKey;
+
+    CAddrUnspent()
+    {
+        nValue = 0;
+        nHeight = -1;
+    }
+
+    CAddrUnspent(int64 nValueIn, int nHeightIn, const CScript& scriptPubKeyIn)
+    {
+        nValue = nValueIn;
+        nHeight = nHeightIn;
+        scriptPubKey = scriptPubKeyIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nValue);
+        READWRITE(nHeight);
+        READWRITE(scriptPubKey);
+    )
+};
+
+// Load the persisted index height. Drops the index if -addrindex is off, or
+// if the block it was built up to is no longer on the best chain
+bool InitAddrIndex(CTxDB& txdb);
+
+// Read the outputs spent by tx.vin, in order, from the tx index (none for coinbase)
+bool AddrIndexReadSpent(CTxDB& txdb, const CTransaction& tx, std::vector<CTxOut>& vSpent);
+
+// Queue index updates for tx at nHeight into txdb's active batch.
+// vSpent holds the outputs spent by tx.vin, as AddrIndexReadSpent gives them.
+bool AddrIndexConnectTx(CTxDB& txdb, const CTransaction& tx, int nHeight, const std::vector<CTxOut>& vSpent);
+bool AddrIndexDisconnectTx(CTxDB& txdb, const CTransaction& tx, int nHeight, const std::vector<CTxOut>& vSpent);
+
+/** Indexes a run of consecutive blocks into one batch for the background
+ * builder. Looking up a spent output in the unspent set would scan the
+ * growing batch, so the heights of outputs created in the run are kept
+ * here, and older ones are read from txdbRead, which has no batch.
+ */
+class CAddrIndexChunk
+{
+private:
+    CTxDB& txdb;
+    CTxDB& txdbRead;
+    std::map<COutPoint, int> mapHeight;
+
+public:
+    CAddrIndexChunk(CTxDB& txdbIn, CTxDB& txdbReadIn) : txdb(txdbIn), txdbRead(txdbReadIn) { }
+
+    // As AddrIndexConnectTx, for transactions given in chain order
+    bool ConnectTx(const CTransaction& tx, int nHeight, const std::vector<CTxOut>& vSpent);
+};
+
+// Index blocks connected before -addrindex was turned on, without holding
+// cs_main while reading them; exits once the index reaches the best block
+void ThreadAddrIndexBuild(void* parg);
+
+#endif
@@ -77,29 +77,61 @@ double CAddrInfo::GetChance(int64 nNow) const
     return fChance;
 }
 
+void CAddrMan::Clear()
+{
+    vInfo.clear();
+    vFreeIds.clear();
+    mapAddr.clear();
+    vRandom.clear();
+    nTried = 0;
+    nNew = 0;
+    for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++)
+        vnTriedSize[n] = 0;
+    for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++)
+        vnNewSize[n] = 0;
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int *pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    CHashMap<CNetAddr, int>::iterator it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return NULL;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
-    return NULL;
+    return &vInfo[(*it).second];
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
+    int nId;
+    if (vFreeIds.empty())
+    {
+        nId = vInfo.size();
+        vInfo.push_back(CAddrInfo(addr, addrSource));
+    } else {
+        nId = vFreeIds.back();
+        vFreeIds.pop_back();
+        vInfo[nId] = CAddrInfo(addr, addrSource);
+    }
     mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    vInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &vInfo[nId];
+}
+
+void CAddrMan::Delete(int nId)
+{
+    CAddrInfo &info = vInfo[nId];
+    assert(info.nRandomPos >= 0 && !info.fInTried && info.nRefCount == 0);
+
+    SwapRandom(info.nRandomPos, vRandom.size()-1);
+    vRandom.pop_back();
+    mapAddr.erase(info);
+    info = CAddrInfo();
+    vFreeIds.push_back(nId);
+    nNew--;
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -112,34 +144,73 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
-
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    vInfo[nId1].nRandomPos = nRndPos2;
+    vInfo[nId2].nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
 }
 
+int CAddrMan::GetTriedBucket(CAddrInfo& info) const
+{
+    if (info.nTriedBucket < 0)
+        info.nTriedBucket = info.GetTriedBucket(nKey);
+    return info.nTriedBucket;
+}
+
+int CAddrMan::GetNewBucket(CAddrInfo& info) const
+{
+    if (info.nSourceBucket < 0)
+        info.nSourceBucket = info.GetNewBucket(nKey);
+    return info.nSourceBucket;
+}
+
+void CAddrMan::AddToNew(int nId, int nUBucket)
+{
+    CAddrInfo &info = vInfo[nId];
+    assert(vnNewSize[nUBucket] < ADDRMAN_NEW_BUCKET_SIZE && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS);
+
+    vvNew[nUBucket][vnNewSize[nUBucket]++] = nId;
+    info.vnNewBuckets[info.nRefCount++] = nUBucket;
+}
+
+void CAddrMan::RemoveFromNew(int nId, int nUBucket)
+{
+    CAddrInfo &info = vInfo[nId];
+
+    int* pbucket = vvNew[nUBucket];
+    int* pend = pbucket + vnNewSize[nUBucket];
+    int* pentry = std::find(pbucket, pend, nId);
+    assert(pentry != pend);
+    *pentry = *(pend - 1);
+    vnNewSize[nUBucket]--;
+
+    int* pref = std::find(info.vnNewBuckets, info.vnNewBuckets + info.nRefCount, nUBucket);
+    assert(pref != info.vnNewBuckets + info.nRefCount);
+    *pref = info.vnNewBuckets[--info.nRefCount];
+
+    if (info.nRefCount == 0 && !info.fInTried)
+        Delete(nId);
+}
+
 int CAddrMan::SelectTried(int nKBucket)
 {
-    std::vector<int> &vTried = vvTried[nKBucket];
+    int* vTried = vvTried[nKBucket];
+    int nSize = vnTriedSize[nKBucket];
 
     // random shuffle the first few elements (using the entire list)
     // find the least recently tried among them
     int64 nOldest = -1;
     int nOldestPos = -1;
-    for (unsigned int i = 0; i < ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT && i < vTried.size(); i++)
+    for (int i = 0; i < ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT && i < nSize; i++)
     {
-        int nPos = GetRandInt(vTried.size() - i) + i;
+        int nPos = GetRandInt(nSize - i) + i;
         int nTemp = vTried[nPos];
         vTried[nPos] = vTried[i];
         vTried[i] = nTemp;
-        assert(nOldest == -1 || mapInfo.count(nTemp) == 1);
-        if (nOldest == -1 || mapInfo[nTemp].nLastSuccess < mapInfo[nOldest].nLastSuccess) {
+        if (nOldest == -1 || vInfo[nTemp].nLastSuccess < vInfo[nOldest].nLastSuccess) {
            nOldest = nTemp;
-           nOldestPos = nPos;
+           nOldestPos = i;
         }
     }
 
@@ -148,114 +219,81 @@ int CAddrMan::SelectTried(int nKBucket)
 
 int CAddrMan::ShrinkNew(int nUBucket)
 {
-    assert(nUBucket >= 0 && (unsigned int)nUBucket < vvNew.size());
-    std::set<int> &vNew = vvNew[nUBucket];
+    assert(nUBucket >= 0 && nUBucket < ADDRMAN_NEW_BUCKET_COUNT);
+    const int* vNew = vvNew[nUBucket];
+    int nSize = vnNewSize[nUBucket];
 
     // first look for deletable items
-    for (std::set<int>::iterator it = vNew.begin(); it != vNew.end(); it++)
+    for (int i = 0; i < nSize; i++)
     {
-        assert(mapInfo.count(*it));
-        CAddrInfo &info = mapInfo[*it];
-        if (info.IsTerrible())
+        if (vInfo[vNew[i]].IsTerrible())
         {
-            if (--info.nRefCount == 0)
-            {
-                SwapRandom(info.nRandomPos, vRandom.size()-1);
-                vRandom.pop_back();
-                mapAddr.erase(info);
-                mapInfo.erase(*it);
-                nNew--;
-            }
-            vNew.erase(it);
+            RemoveFromNew(vNew[i], nUBucket);
             return 0;
         }
     }
 
     // otherwise, select four randomly, and pick the oldest of those to replace
-    int n[4] = {GetRandInt(vNew.size()), GetRandInt(vNew.size()), GetRandInt(vNew.size()), GetRandInt(vNew.size())};
-    int nI = 0;
     int nOldest = -1;
-    for (std::set<int>::iterator it = vNew.begin(); it != vNew.end(); it++)
+    for (int i = 0; i < 4; i++)
     {
-        if (nI == n[0] || nI == n[1] || nI == n[2] || nI == n[3])
-        {
-            assert(nOldest == -1 || mapInfo.count(*it) == 1);
-            if (nOldest == -1 || mapInfo[*it].nTime < mapInfo[nOldest].nTime)
-                nOldest = *it;
-        }
-        nI++;
+        int nId = vNew[GetRandInt(nSize)];
+        if (nOldest == -1 || vInfo[nId].nTime < vInfo[nOldest].nTime)
+            nOldest = nId;
     }
-    assert(mapInfo.count(nOldest) == 1);
-    CAddrInfo &info = mapInfo[nOldest];
-    if (--info.nRefCount == 0)
-    {
-        SwapRandom(info.nRandomPos, vRandom.size()-1);
-        vRandom.pop_back();
-        mapAddr.erase(info);
-        mapInfo.erase(nOldest);
-        nNew--;
-    }
-    vNew.erase(nOldest);
+    RemoveFromNew(nOldest, nUBucket);
 
     return 1;
 }
 
 void CAddrMan::MakeTried(CAddrInfo& info, int nId, int nOrigin)
 {
-    assert(vvNew[nOrigin].count(nId) == 1);
+    assert(std::find(info.vnNewBuckets, info.vnNewBuckets + info.nRefCount, nOrigin) != info.vnNewBuckets + info.nRefCount);
 
-    // remove the entry from all new buckets
-    for (std::vector<std::set<int> >::iterator it = vvNew.begin(); it != vvNew.end(); it++)
-    {
-        if ((*it).erase(nId))
-            info.nRefCount--;
-    }
+    // remove the entry from all new buckets; it is marked tried first so
+    // that dropping the last reference does not delete it
+    info.fInTried = true;
+    while (info.nRefCount)
+        RemoveFromNew(nId, info.vnNewBuckets[info.nRefCount - 1]);
     nNew--;
 
-    assert(info.nRefCount == 0);
-
     // what tried bucket to move the entry to
-    int nKBucket = info.GetTriedBucket(nKey);
-    std::vector<int> &vTried = vvTried[nKBucket];
+    int nKBucket = GetTriedBucket(info);
+    int* vTried = vvTried[nKBucket];
 
     // first check whether there is place to just add it
-    if (vTried.size() < ADDRMAN_TRIED_BUCKET_SIZE)
+    if (vnTriedSize[nKBucket] < ADDRMAN_TRIED_BUCKET_SIZE)
     {
-        vTried.push_back(nId);
+        vTried[vnTriedSize[nKBucket]++] = nId;
         nTried++;
-        info.fInTried = true;
         return;
     }
 
     // otherwise, find an item to evict
     int nPos = SelectTried(nKBucket);
+    int nIdOld = vTried[nPos];
 
     // find which new bucket it belongs to
-    assert(mapInfo.count(vTried[nPos]) == 1);
-    int nUBucket = mapInfo[vTried[nPos]].GetNewBucket(nKey);
-    std::set<int> &vNew = vvNew[nUBucket];
+    CAddrInfo& infoOld = vInfo[nIdOld];
+    int nUBucket = GetNewBucket(infoOld);
 
     // remove the to-be-replaced tried entry from the tried set
-    CAddrInfo& infoOld = mapInfo[vTried[nPos]];
     infoOld.fInTried = false;
-    infoOld.nRefCount = 1;
     // do not update nTried, as we are going to move something else there immediately
 
     // check whether there is place in that one,
-    if (vNew.size() < ADDRMAN_NEW_BUCKET_SIZE)
+    if (vnNewSize[nUBucket] < ADDRMAN_NEW_BUCKET_SIZE)
     {
         // if so, move it back there
-        vNew.insert(vTried[nPos]);
+        AddToNew(nIdOld, nUBucket);
     } else {
         // otherwise, move it to the new bucket nId came from (there is certainly place there)
-        vvNew[nOrigin].insert(vTried[nPos]);
+        AddToNew(nIdOld, nOrigin);
     }
     nNew++;
 
     vTried[nPos] = nId;
     // we just overwrote an entry in vTried; no need to update nTried
-    info.fInTried = true;
-    return;
 }
 
 void CAddrMan::Good_(const CService &addr, int64 nTime)
@@ -285,23 +323,13 @@ void CAddrMan::Good_(const CService &addr, int64 nTime)
     if (info.fInTried)
         return;
 
-    // find a bucket it is in now
-    int nRnd = GetRandInt(vvNew.size());
-    int nUBucket = -1;
-    for (unsigned int n = 0; n < vvNew.size(); n++)
-    {
-        int nB = (n+nRnd) % vvNew.size();
-        std::set<int> &vNew = vvNew[nB];
-        if (vNew.count(nId))
-        {
-            nUBucket = nB;
-            break;
-        }
-    }
-
-    // if no bucket is found, something bad happened;
+    // if it is in no bucket, something bad happened;
     // TODO: maybe re-add the node, but for now, just bail out
-    if (nUBucket == -1) return;
+    if (info.nRefCount == 0)
+        return;
+
+    // pick a bucket it is in now
+    int nUBucket = info.vnNewBuckets[GetRandInt(info.nRefCount)];
 
     printf("Moving %s to tried\n", addr.ToString().c_str());
 
@@ -309,7 +337,7 @@ void CAddrMan::Good_(const CService &addr, int64 nTime)
     MakeTried(info, nId, nUBucket);
 }
 
-bool CAddrMan::Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePenalty)
+bool CAddrMan::Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePenalty, int nUBucket)
 {
     if (!addr.IsRoutable())
         return false;
@@ -355,14 +383,15 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePen
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source);
-    std::set<int> &vNew = vvNew[nUBucket];
-    if (!vNew.count(nId))
+    if (nUBucket < 0)
+        nUBucket = pinfo->GetNewBucket(nKey, source);
+    if (fNew)
+        pinfo->nSourceBucket = nUBucket;
+    if (std::find(pinfo->vnNewBuckets, pinfo->vnNewBuckets + pinfo->nRefCount, nUBucket) == pinfo->vnNewBuckets + pinfo->nRefCount)
     {
-        pinfo->nRefCount++;
-        if (vNew.size() == ADDRMAN_NEW_BUCKET_SIZE)
+        if (vnNewSize[nUBucket] == ADDRMAN_NEW_BUCKET_SIZE)
             ShrinkNew(nUBucket);
-        vvNew[nUBucket].insert(nId);
+        AddToNew(nId, nUBucket);
     }
     return fNew;
 }
@@ -386,9 +415,9 @@ void CAddrMan::Attempt_(const CService &addr, int64 nTime)
     info.nAttempts++;
 }
 
-CAddress CAddrMan::Select_(int nUnkBias)
+CAddress CAddrMan::Select_(int nUnkBias) const
 {
-    if (size() == 0)
+    if (vRandom.size() == 0)
         return CAddress();
 
     double nCorTried = sqrt(nTried) * (100.0 - nUnkBias);
@@ -399,12 +428,10 @@ CAddress CAddrMan::Select_(int nUnkBias)
         double fChanceFactor = 1.0;
         while(1)
         {
-            int nKBucket = GetRandInt(vvTried.size());
-            std::vector<int> &vTried = vvTried[nKBucket];
-            if (vTried.size() == 0) continue;
-            int nPos = GetRandInt(vTried.size());
-            assert(mapInfo.count(vTried[nPos]) == 1);
-            CAddrInfo &info = mapInfo[vTried[nPos]];
+            int nKBucket = GetRandInt(ADDRMAN_TRIED_BUCKET_COUNT);
+            if (vnTriedSize[nKBucket] == 0) continue;
+            int nPos = GetRandInt(vnTriedSize[nKBucket]);
+            const CAddrInfo &info = vInfo[vvTried[nKBucket][nPos]];
             if (GetRandInt(1<<30) < fChanceFactor*info.GetChance()*(1<<30))
                 return info;
             fChanceFactor *= 1.2;
@@ -414,15 +441,10 @@ CAddress CAddrMan::Select_(int nUnkBias)
         double fChanceFactor = 1.0;
         while(1)
         {
-            int nUBucket = GetRandInt(vvNew.size());
-            std::set<int> &vNew = vvNew[nUBucket];
-            if (vNew.size() == 0) continue;
-            int nPos = GetRandInt(vNew.size());
-            std::set<int>::iterator it = vNew.begin();
-            while (nPos--)
-                it++;
-            assert(mapInfo.count(*it) == 1);
-            CAddrInfo &info = mapInfo[*it];
+            int nUBucket = GetRandInt(ADDRMAN_NEW_BUCKET_COUNT);
+            if (vnNewSize[nUBucket] == 0) continue;
+            int nPos = GetRandInt(vnNewSize[nUBucket]);
+            const CAddrInfo &info = vInfo[vvNew[nUBucket][nPos]];
             if (GetRandInt(1<<30) < fChanceFactor*info.GetChance()*(1<<30))
                 return info;
             fChanceFactor *= 1.2;
@@ -431,17 +453,18 @@ CAddress CAddrMan::Select_(int nUnkBias)
 }
 
 #ifdef DEBUG_ADDRMAN
-int CAddrMan::Check_()
+int CAddrMan::Check_() const
 {
     std::set<int> setTried;
     std::map<int, int> mapNew;
 
     if (vRandom.size() != nTried + nNew) return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++)
+    for (unsigned int n = 0; n < vInfo.size(); n++)
     {
-        int n = (*it).first;
-        CAddrInfo &info = (*it).second;
+        const CAddrInfo &info = vInfo[n];
+        if (info.nRandomPos < 0)
+            continue;
         if (info.fInTried)
         {
 
@@ -453,8 +476,9 @@ int CAddrMan::Check_()
             if (!info.nRefCount) return -4;
             mapNew[n] = info.nRefCount;
         }
-        if (mapAddr[info] != n) return -5;
-        if (info.nRandomPos<0 || info.nRandomPos>=vRandom.size() || vRandom[info.nRandomPos] != n) return -14;
+        CHashMap<CNetAddr, int>::const_iterator it = mapAddr.find(info);
+        if (it == mapAddr.end() || (*it).second != (int)n) return -5;
+        if (info.nRandomPos>=vRandom.size() || vRandom[info.nRandomPos] != n) return -14;
         if (info.nLastTry < 0) return -6;
         if (info.nLastSuccess < 0) return -8;
     }
@@ -462,47 +486,50 @@ int CAddrMan::Check_()
     if (setTried.size() != nTried) return -9;
     if (mapNew.size() != nNew) return -10;
 
-    for (int n=0; n<vvTried.size(); n++)
+    for (int n=0; n<ADDRMAN_TRIED_BUCKET_COUNT; n++)
     {
-        std::vector<int> &vTried = vvTried[n];
-        for (std::vector<int>::iterator it = vTried.begin(); it != vTried.end(); it++)
+        for (int i = 0; i < vnTriedSize[n]; i++)
         {
-            if (!setTried.count(*it)) return -11;
-            setTried.erase(*it);
+            if (!setTried.count(vvTried[n][i])) return -11;
+            setTried.erase(vvTried[n][i]);
         }
     }
 
-    for (int n=0; n<vvNew.size(); n++)
+    for (int n=0; n<ADDRMAN_NEW_BUCKET_COUNT; n++)
     {
-        std::set<int> &vNew = vvNew[n];
-        for (std::set<int>::iterator it = vNew.begin(); it != vNew.end(); it++)
+        for (int i = 0; i < vnNewSize[n]; i++)
         {
-            if (!mapNew.count(*it)) return -12;
-            if (--mapNew[*it] == 0)
-                mapNew.erase(*it);
+            int nId = vvNew[n][i];
+            if (!mapNew.count(nId)) return -12;
+            const CAddrInfo &info = vInfo[nId];
+            if (std::find(info.vnNewBuckets, info.vnNewBuckets + info.nRefCount, n) == info.vnNewBuckets + info.nRefCount) return -16;
+            if (--mapNew[nId] == 0)
+                mapNew.erase(nId);
         }
     }
 
     if (setTried.size()) return -13;
     if (mapNew.size()) return -15;
+    if (mapAddr.size() != vRandom.size()) return -17;
 
     return 0;
 }
 #endif
 
-void CAddrMan::GetAddr_(std::vector<CAddress> &vAddr)
+void CAddrMan::GetAddr_(std::vector<CAddress> &vAddr) const
 {
     int nNodes = ADDRMAN_GETADDR_MAX_PCT*vRandom.size()/100;
     if (nNodes > ADDRMAN_GETADDR_MAX)
         nNodes = ADDRMAN_GETADDR_MAX;
 
-    // perform a random shuffle over the first nNodes elements of vRandom (selecting from all)
+    // perform a random shuffle over the first nNodes elements of a copy of
+    // vRandom (selecting from all), leaving the tables to concurrent readers
+    std::vector<int> vIds(vRandom);
     for (int n = 0; n<nNodes; n++)
     {
-        int nRndPos = GetRandInt(vRandom.size() - n) + n;
-        SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
-        vAddr.push_back(mapInfo[vRandom[n]]);
+        int nRndPos = GetRandInt(vIds.size() - n) + n;
+        std::swap(vIds[n], vIds[nRndPos]);
+        vAddr.push_back(vInfo[vIds[n]]);
     }
 }
 
@@ -8,14 +8,60 @@
 #include "protocol.h"
 #include "util.h"
 #include "sync.h"
+#include "hashmap.h"
 
-
+#include <deque>
 #include <map>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
 #include <openssl/rand.h>
 
 
+// total number of buckets for tried addresses
+#define ADDRMAN_TRIED_BUCKET_COUNT 64
+
+// maximum allowed number of entries in buckets for tried addresses
+#define ADDRMAN_TRIED_BUCKET_SIZE 64
+
+// total number of buckets for new addresses
+#define ADDRMAN_NEW_BUCKET_COUNT 256
+
+// maximum allowed number of entries in buckets for new addresses
+#define ADDRMAN_NEW_BUCKET_SIZE 64
+
+// over how many buckets entries with tried addresses from a single group (/16 for IPv4) are spread
+#define ADDRMAN_TRIED_BUCKETS_PER_GROUP 4
+
+// over how many buckets entries with new addresses originating from a single group are spread
+#define ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP 32
+
+// in how many buckets for entries with new addresses a single address may occur
+#define ADDRMAN_NEW_BUCKETS_PER_ADDRESS 4
+
+// how many entries in a bucket with tried addresses are inspected, when selecting one to replace
+#define ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT 4
+
+// how old addresses can maximally be
+#define ADDRMAN_HORIZON_DAYS 30
+
+// after how many failed attempts we give up on a new node
+#define ADDRMAN_RETRIES 3
+
+// how many successive failures are allowed ...
+#define ADDRMAN_MAX_FAILURES 10
+
+// ... in at least this many days
+#define ADDRMAN_MIN_FAIL_DAYS 7
+
+// the maximum percentage of nodes to return in a getaddr call
+#define ADDRMAN_GETADDR_MAX_PCT 23
+
+// the maximum number of nodes to return in a getaddr call
+#define ADDRMAN_GETADDR_MAX 2500
+
 /** Extended statistics about a CAddress */
 class CAddrInfo : public CAddress
 {
@@ -35,10 +81,17 @@ private:
     // reference count in new sets (memory only)
     int nRefCount;
 
+    // the new buckets this entry is in, the first nRefCount are valid (memory only)
+    int vnNewBuckets[ADDRMAN_NEW_BUCKETS_PER_ADDRESS];
+
+    // GetTriedBucket and GetNewBucket for the default source, -1 until needed (memory only)
+    int nTriedBucket;
+    int nSourceBucket;
+
     // in tried set? (memory only)
     bool fInTried;
 
-    // position in vRandom
+    // position in vRandom, -1 for a free slot of CAddrMan::vInfo
     int nRandomPos;
 
     friend class CAddrMan;
@@ -59,6 +112,8 @@ public:
         nLastTry = 0;
         nAttempts = 0;
         nRefCount = 0;
+        nTriedBucket = -1;
+        nSourceBucket = -1;
         fInTried = false;
         nRandomPos = -1;
     }
@@ -116,69 +171,31 @@ public:
 //        tried ones) is evicted from it, back to the "new" buckets.
 //    * Bucket selection is based on cryptographic hashing, using a randomly-generated 256-bit key, which should not
 //      be observable by adversaries.
-//    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
-//      consistency checks for the entire data structure.
-
-// total number of buckets for tried addresses
-#define ADDRMAN_TRIED_BUCKET_COUNT 64
-
-// maximum allowed number of entries in buckets for tried addresses
-#define ADDRMAN_TRIED_BUCKET_SIZE 64
-
-// total number of buckets for new addresses
-#define ADDRMAN_NEW_BUCKET_COUNT 256
-
-// maximum allowed number of entries in buckets for new addresses
-#define ADDRMAN_NEW_BUCKET_SIZE 64
-
-// over how many buckets entries with tried addresses from a single group (/16 for IPv4) are spread
-#define ADDRMAN_TRIED_BUCKETS_PER_GROUP 4
-
-// over how many buckets entries with new addresses originating from a single group are spread
-#define ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP 32
-
-// in how many buckets for entries with new addresses a single address may occur
-#define ADDRMAN_NEW_BUCKETS_PER_ADDRESS 4
-
-// how many entries in a bucket with tried addresses are inspected, when selecting one to replace
-#define ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT 4
-
-// how old addresses can maximally be
-#define ADDRMAN_HORIZON_DAYS 30
-
-// after how many failed attempts we give up on a new node
-#define ADDRMAN_RETRIES 3
-
-// how many successive failures are allowed ...
-#define ADDRMAN_MAX_FAILURES 10
-
-// ... in at least this many days
-#define ADDRMAN_MIN_FAIL_DAYS 7
-
-// the maximum percentage of nodes to return in a getaddr call
-#define ADDRMAN_GETADDR_MAX_PCT 23
-
-// the maximum number of nodes to return in a getaddr call
-#define ADDRMAN_GETADDR_MAX 2500
+//    * Several indexes are kept for high performance: entries live in a flat table indexed by nId, buckets are
+//      fixed-size arrays, entries remember which buckets they are in, and addresses are found through a salted
+//      hash table. Defining DEBUG_ADDRMAN will introduce frequent (and expensive) consistency checks for the
+//      entire data structure.
+//  * Selecting and reading take the lock shared; bucket hashes for incoming addresses are computed under the
+//    shared lock too, so a flood of addr messages holds the exclusive lock only to update the tables.
 
 /** Stochastical (IP) address manager */
 class CAddrMan
 {
 private:
-    // critical section to protect the inner data structures
-    mutable CCriticalSection cs;
+    // protects the inner data structures; taken shared by readers
+    mutable boost::shared_mutex cs;
 
     // secret key to randomize bucket select with
     std::vector<unsigned char> nKey;
 
-    // last used nId
-    int nIdCount;
+    // table with information about all nIds, indexed by nId
+    std::deque<CAddrInfo> vInfo;
 
-    // table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    // free slots of vInfo
+    std::vector<int> vFreeIds;
 
     // find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    CHashMap<CNetAddr, int> mapAddr;
 
     // address verification tokens
     std::map<CNetAddr, uint64> verificationToken;
@@ -193,17 +210,22 @@ private:
     // number of "tried" entries
     int nTried;
 
-    // list of "tried" buckets
-    std::vector<std::vector<int> > vvTried;
+    // "tried" buckets, the first vnTriedSize[n] entries of vvTried[n] are valid
+    int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_TRIED_BUCKET_SIZE];
+    int vnTriedSize[ADDRMAN_TRIED_BUCKET_COUNT];
 
     // number of (unique) "new" entries
     int nNew;
 
-    // list of "new" buckets
-    std::vector<std::set<int> > vvNew;
+    // "new" buckets, the first vnNewSize[n] entries of vvNew[n] are valid
+    int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_NEW_BUCKET_SIZE];
+    int vnNewSize[ADDRMAN_NEW_BUCKET_COUNT];
 
 protected:
 
+    // Empty all tables.
+    void Clear();
+
     // Find an entry.
     CAddrInfo* Find(const CNetAddr& addr, int *pnId = NULL);
 
@@ -211,9 +233,22 @@ protected:
     // nTime and nServices of found node is updated, if necessary.
     CAddrInfo* Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId = NULL);
 
+    // Delete an entry that is in no bucket.
+    void Delete(int nId);
+
     // Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    // Cached bucket calculations.
+    int GetTriedBucket(CAddrInfo& info) const;
+    int GetNewBucket(CAddrInfo& info) const;
+
+    // Put an entry in a "new" bucket, which must have room and not have it yet.
+    void AddToNew(int nId, int nUBucket);
+
+    // Take an entry out of a "new" bucket, deleting it if that was its last one.
+    void RemoveFromNew(int nId, int nUBucket);
+
     // Return position in given bucket to replace.
     int SelectTried(int nKBucket);
 
@@ -223,14 +258,14 @@ protected:
     int ShrinkNew(int nUBucket);
 
     // Move an entry from the "new" table(s) to the "tried" table
-    // @pre vvUnkown[nOrigin].count(nId) != 0
+    // @pre nOrigin is one of info.vnNewBuckets
     void MakeTried(CAddrInfo& info, int nId, int nOrigin);
 
     // Mark an entry "good", possibly moving it from "new" to "tried".
     void Good_(const CService &addr, int64 nTime);
 
-    // Add an entry to the "new" table.
-    bool Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePenalty);
+    // Add an entry to the "new" table, in bucket nUBucket (GetNewBucket of addr and source, or -1 to compute it).
+    bool Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePenalty, int nUBucket = -1);
 
     // Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, int64 nTime);
@@ -238,212 +273,232 @@ protected:
 
     // Select an address to connect to.
     // nUnkBias determines how much to favor new addresses over tried ones (min=0, max=100)
-    CAddress Select_(int nUnkBias);
+    CAddress Select_(int nUnkBias) const;
 
 #ifdef DEBUG_ADDRMAN
     // Perform consistency check. Returns an error code or zero.
-    int Check_();
+    int Check_() const;
 #endif
 
     // Select several addresses at once.
-    void GetAddr_(std::vector<CAddress> &vAddr);
+    void GetAddr_(std::vector<CAddress> &vAddr) const;
 
     // Mark an entry as currently-connected-to.
     void Connected_(const CService &addr, int64 nTime);
 
+    // Consistency check, with cs held
+    void Check() const
+    {
+#ifdef DEBUG_ADDRMAN
+        int err;
+        if ((err=Check_()))
+            printf("ADDRMAN CONSISTENCY CHECK FAILED!!! err=%i\n", err);
+#endif
+    }
+
 public:
 
-    IMPLEMENT_SERIALIZE
-    (({
-        // serialized format:
-        // * version byte (currently 0)
-        // * nKey
-        // * nNew
-        // * nTried
-        // * number of "new" buckets
-        // * all nNew addrinfos in vvNew
-        // * all nTried addrinfos in vvTried
-        // * for each bucket:
-        //   * number of elements
-        //   * for each element: index
-        //
-        // Notice that vvTried, mapAddr and vVector are never encoded explicitly;
-        // they are instead reconstructed from the other information.
-        //
-        // vvNew is serialized, but only used if ADDRMAN_UNKOWN_BUCKET_COUNT didn't change,
-        // otherwise it is reconstructed as well.
-        //
-        // This format is more complex, but significantly smaller (at most 1.5 MiB), and supports
-        // changes to the ADDRMAN_ parameters without breaking the on-disk structure.
+    // serialized format:
+    // * version byte (currently 0)
+    // * nKey
+    // * nNew
+    // * nTried
+    // * number of "new" buckets
+    // * all nNew addrinfos in vvNew
+    // * all nTried addrinfos in vvTried
+    // * for each bucket:
+    //   * number of elements
+    //   * for each element: index
+    //
+    // Notice that vvTried, mapAddr and vVector are never encoded explicitly;
+    // they are instead reconstructed from the other information.
+    //
+    // vvNew is serialized, but only used if ADDRMAN_UNKOWN_BUCKET_COUNT didn't change,
+    // otherwise it is reconstructed as well.
+    //
+    // This format is more complex, but significantly smaller (at most 1.5 MiB), and supports
+    // changes to the ADDRMAN_ parameters without breaking the on-disk structure.
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nStreamVersion) const
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
+
+        // entries are serialized with the format version, not the stream's
+        unsigned char nVersion = 0;
+        s << nVersion;
+        s << nKey;
+        s << nNew;
+        s << nTried;
+
+        int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT;
+        s << nUBuckets;
+        std::vector<int> vUnkIds(vInfo.size(), -1);
+        int nIds = 0;
+        for (unsigned int nId = 0; nId < vInfo.size(); nId++)
+        {
+            if (nIds == nNew) break; // this means nNew was wrong, oh ow
+            const CAddrInfo &info = vInfo[nId];
+            if (info.nRandomPos >= 0 && info.nRefCount)
+            {
+                vUnkIds[nId] = nIds;
+                ::Serialize(s, info, nType, nVersion);
+                nIds++;
+            }
+        }
+        nIds = 0;
+        for (unsigned int nId = 0; nId < vInfo.size(); nId++)
+        {
+            if (nIds == nTried) break; // this means nTried was wrong, oh ow
+            const CAddrInfo &info = vInfo[nId];
+            if (info.nRandomPos >= 0 && info.fInTried)
+            {
+                ::Serialize(s, info, nType, nVersion);
+                nIds++;
+            }
+        }
+        for (int nUBucket = 0; nUBucket < ADDRMAN_NEW_BUCKET_COUNT; nUBucket++)
         {
-            LOCK(cs);
-            unsigned char nVersion = 0;
-            READWRITE(nVersion);
-            READWRITE(nKey);
-            READWRITE(nNew);
-            READWRITE(nTried);
-
-            CAddrMan *am = const_cast<CAddrMan*>(this);
-            if (fWrite)
+            int nSize = vnNewSize[nUBucket];
+            s << nSize;
+            for (int i = 0; i < nSize; i++)
             {
-                int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT;
-                READWRITE(nUBuckets);
-                std::map<int, int> mapUnkIds;
-                int nIds = 0;
-                for (std::map<int, CAddrInfo>::iterator it = am->mapInfo.begin(); it != am->mapInfo.end(); it++)
-                {
-                    if (nIds == nNew) break; // this means nNew was wrong, oh ow
-                    mapUnkIds[(*it).first] = nIds;
-                    CAddrInfo &info = (*it).second;
-                    if (info.nRefCount)
-                    {
-                        READWRITE(info);
-                        nIds++;
-                    }
-                }
-                nIds = 0;
-                for (std::map<int, CAddrInfo>::iterator it = am->mapInfo.begin(); it != am->mapInfo.end(); it++)
-                {
-                    if (nIds == nTried) break; // this means nTried was wrong, oh ow
-                    CAddrInfo &info = (*it).second;
-                    if (info.fInTried)
-                    {
-                        READWRITE(info);
-                        nIds++;
-                    }
-                }
-                for (std::vector<std::set<int> >::iterator it = am->vvNew.begin(); it != am->vvNew.end(); it++)
-                {
-                    const std::set<int> &vNew = (*it);
-                    int nSize = vNew.size();
-                    READWRITE(nSize);
-                    for (std::set<int>::iterator it2 = vNew.begin(); it2 != vNew.end(); it2++)
-                    {
-                        int nIndex = mapUnkIds[*it2];
-                        READWRITE(nIndex);
-                    }
-                }
+                int nIndex = vUnkIds[vvNew[nUBucket][i]];
+                s << nIndex;
+            }
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nStreamVersion)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs);
+
+        Clear();
+        unsigned char nVersion = 0;
+        s >> nVersion;
+        s >> nKey;
+        s >> nNew;
+        s >> nTried;
+
+        int nUBuckets = 0;
+        s >> nUBuckets;
+        int nUnk = nNew;
+        for (int n = 0; n < nUnk; n++)
+        {
+            vInfo.push_back(CAddrInfo());
+            CAddrInfo &info = vInfo.back();
+            ::Unserialize(s, info, nType, nVersion);
+            mapAddr[info] = n;
+            info.nRandomPos = vRandom.size();
+            vRandom.push_back(n);
+            if (nUBuckets != ADDRMAN_NEW_BUCKET_COUNT)
+            {
+                int nUBucket = GetNewBucket(info);
+                if (vnNewSize[nUBucket] < ADDRMAN_NEW_BUCKET_SIZE)
+                    AddToNew(n, nUBucket);
+            }
+        }
+        int nLost = 0;
+        int nTriedIn = nTried;
+        for (int n = 0; n < nTriedIn; n++)
+        {
+            CAddrInfo info;
+            ::Unserialize(s, info, nType, nVersion);
+            int nKBucket = GetTriedBucket(info);
+            if (vnTriedSize[nKBucket] < ADDRMAN_TRIED_BUCKET_SIZE)
+            {
+                int nId = vInfo.size();
+                info.nRandomPos = vRandom.size();
+                info.fInTried = true;
+                vRandom.push_back(nId);
+                vInfo.push_back(info);
+                mapAddr[info] = nId;
+                vvTried[nKBucket][vnTriedSize[nKBucket]++] = nId;
             } else {
-                int nUBuckets = 0;
-                READWRITE(nUBuckets);
-                am->nIdCount = 0;
-                am->mapInfo.clear();
-                am->mapAddr.clear();
-                am->vRandom.clear();
-                am->vvTried = std::vector<std::vector<int> >(ADDRMAN_TRIED_BUCKET_COUNT, std::vector<int>(0));
-                am->vvNew = std::vector<std::set<int> >(ADDRMAN_NEW_BUCKET_COUNT, std::set<int>());
-                for (int n = 0; n < am->nNew; n++)
-                {
-                    CAddrInfo &info = am->mapInfo[n];
-                    READWRITE(info);
-                    am->mapAddr[info] = n;
-                    info.nRandomPos = vRandom.size();
-                    am->vRandom.push_back(n);
-                    if (nUBuckets != ADDRMAN_NEW_BUCKET_COUNT)
-                    {
-                        am->vvNew[info.GetNewBucket(am->nKey)].insert(n);
-                        info.nRefCount++;
-                    }
-                }
-                am->nIdCount = am->nNew;
-                int nLost = 0;
-                for (int n = 0; n < am->nTried; n++)
-                {
-                    CAddrInfo info;
-                    READWRITE(info);
-                    std::vector<int> &vTried = am->vvTried[info.GetTriedBucket(am->nKey)];
-                    if (vTried.size() < ADDRMAN_TRIED_BUCKET_SIZE)
-                    {
-                        info.nRandomPos = vRandom.size();
-                        info.fInTried = true;
-                        am->vRandom.push_back(am->nIdCount);
-                        am->mapInfo[am->nIdCount] = info;
-                        am->mapAddr[info] = am->nIdCount;
-                        vTried.push_back(am->nIdCount);
-                        am->nIdCount++;
-                    } else {
-                        nLost++;
-                    }
-                }
-                am->nTried -= nLost;
-                for (int b = 0; b < nUBuckets; b++)
-                {
-                    std::set<int> &vNew = am->vvNew[b];
-                    int nSize = 0;
-                    READWRITE(nSize);
-                    for (int n = 0; n < nSize; n++)
-                    {
-                        int nIndex = 0;
-                        READWRITE(nIndex);
-                        CAddrInfo &info = am->mapInfo[nIndex];
-                        if (nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS)
-                        {
-                            info.nRefCount++;
-                            vNew.insert(nIndex);
-                        }
-                    }
-                }
+                nLost++;
+            }
+        }
+        nTried -= nLost;
+        for (int b = 0; b < nUBuckets; b++)
+        {
+            int nSize = 0;
+            s >> nSize;
+            for (int n = 0; n < nSize; n++)
+            {
+                int nIndex = 0;
+                s >> nIndex;
+                if (nUBuckets != ADDRMAN_NEW_BUCKET_COUNT || nIndex < 0 || nIndex >= nUnk)
+                    continue;
+                CAddrInfo &info = vInfo[nIndex];
+                if (info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && vnNewSize[b] < ADDRMAN_NEW_BUCKET_SIZE &&
+                    std::find(info.vnNewBuckets, info.vnNewBuckets + info.nRefCount, b) == info.vnNewBuckets + info.nRefCount)
+                    AddToNew(nIndex, b);
             }
         }
-    });)
 
-    CAddrMan() : vRandom(0), vvTried(ADDRMAN_TRIED_BUCKET_COUNT, std::vector<int>(0)), vvNew(ADDRMAN_NEW_BUCKET_COUNT, std::set<int>())
+        // entries that ended up in no bucket cannot be kept
+        for (int n = 0; n < nUnk; n++)
+            if (vInfo[n].nRandomPos >= 0 && vInfo[n].nRefCount == 0)
+                Delete(n);
+        Check();
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CDataStream ss(nType, nVersion);
+        Serialize(ss, nType, nVersion);
+        return ss.size();
+    }
+
+    CAddrMan() : vRandom(0)
     {
          nKey.resize(32);
          RAND_bytes(&nKey[0], 32);
 
-         nIdCount = 0;
-         nTried = 0;
-         nNew = 0;
+         Clear();
     }
 
     // Return the number of (unique) addresses in all tables.
-    int size()
+    int size() const
     {
+        boost::shared_lock<boost::shared_mutex> lock(cs);
         return vRandom.size();
     }
 
-    // Consistency check
-    void Check()
-    {
-#ifdef DEBUG_ADDRMAN
-        {
-            LOCK(cs);
-            int err;
-            if ((err=Check_()))
-                printf("ADDRMAN CONSISTENCY CHECK FAILED!!! err=%i\n", err);
-        }
-#endif
-    }
-
     // Add a single address.
     bool Add(const CAddress &addr, const CNetAddr& source, int64 nTimePenalty = 0)
     {
-        bool fRet = false;
-        {
-            LOCK(cs);
-            Check();
-            fRet |= Add_(addr, source, nTimePenalty);
-            Check();
-        }
-        if (fRet)
-            printf("Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort().c_str(), source.ToString().c_str(), nTried, nNew);
-        return fRet;
+        return Add(std::vector<CAddress>(1, addr), source, nTimePenalty);
     }
 
     // Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr& source, int64 nTimePenalty = 0)
     {
+        // the bucket hashes only need the key
+        std::vector<int> vnBucket(vAddr.size(), -1);
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs);
+            for (unsigned int i = 0; i < vAddr.size(); i++)
+                if (vAddr[i].IsRoutable())
+                    vnBucket[i] = CAddrInfo(vAddr[i], source).GetNewBucket(nKey);
+        }
+
         int nAdd = 0;
+        int nTriedNow, nNewNow;
         {
-            LOCK(cs);
+            boost::unique_lock<boost::shared_mutex> lock(cs);
             Check();
-            for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
-                nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+            for (unsigned int i = 0; i < vAddr.size(); i++)
+                if (vnBucket[i] >= 0)
+                    nAdd += Add_(vAddr[i], source, nTimePenalty, vnBucket[i]) ? 1 : 0;
             Check();
+            nTriedNow = nTried;
+            nNewNow = nNew;
         }
-        if (nAdd)
-            printf("Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString().c_str(), nTried, nNew);
+        if (nAdd == 1 && vAddr.size() == 1)
+            printf("Added %s from %s: %i tried, %i new\n", vAddr[0].ToStringIPPort().c_str(), source.ToString().c_str(), nTriedNow, nNewNow);
+        else if (nAdd)
+            printf("Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString().c_str(), nTriedNow, nNewNow);
         return nAdd > 0;
     }
 
@@ -451,7 +506,7 @@ public:
     void Good(const CService &addr, int64 nTime = GetAdjustedTime())
     {
         {
-            LOCK(cs);
+            boost::unique_lock<boost::shared_mutex> lock(cs);
             Check();
             Good_(addr, nTime);
             Check();
@@ -462,7 +517,7 @@ public:
     void Attempt(const CService &addr, int64 nTime = GetAdjustedTime())
     {
         {
-            LOCK(cs);
+            boost::unique_lock<boost::shared_mutex> lock(cs);
             Check();
             Attempt_(addr, nTime);
             Check();
@@ -472,19 +527,16 @@ public:
     void SetReconnectToken(const CNetAddr &addr, uint64 reconnect_token)
     {
         {
-            LOCK(cs);
-            Check();
+            boost::unique_lock<boost::shared_mutex> lock(cs);
             reconnectToken[addr] = reconnect_token;
-            Check();
         }
     }
 
-    bool GetReconnectToken(const CNetAddr &addr, uint64& reconnect_token)
+    bool GetReconnectToken(const CNetAddr &addr, uint64& reconnect_token) const
     {
         bool result = false;
         {
-            LOCK(cs);
-            Check();
+            boost::shared_lock<boost::shared_mutex> lock(cs);
             std::map<
                 CNetAddr,
                 uint64
@@ -497,7 +549,6 @@ public:
                 reconnect_token = found->second;
                 result = true;
             }
-            Check();
         }
         return result;
     }
@@ -505,19 +556,16 @@ public:
     void SetVerificationToken(const CNetAddr &addr, uint64 verification_token)
     {
         {
-            LOCK(cs);
-            Check();
+            boost::unique_lock<boost::shared_mutex> lock(cs);
             verificationToken[addr] = verification_token;
-            Check();
         }
     }
 
-    bool CheckVerificationToken(const CNetAddr &addr, uint64 verification_token)
+    bool CheckVerificationToken(const CNetAddr &addr, uint64 verification_token) const
     {
         bool result = false;
         {
-            LOCK(cs);
-            Check();
+            boost::shared_lock<boost::shared_mutex> lock(cs);
             std::map<
                 CNetAddr,
                 uint64
@@ -529,7 +577,6 @@ public:
             ) {
                 result = verification_token == found->second;
             }
-            Check();
         }
         return result;
     }
@@ -537,28 +584,26 @@ public:
 
     // Choose an address to connect to.
     // nUnkBias determines how much "new" entries are favored over "tried" ones (0-100).
-    CAddress Select(int nUnkBias = 50)
+    CAddress Select(int nUnkBias = 50) const
     {
         CAddress addrRet;
         {
-            LOCK(cs);
+            boost::shared_lock<boost::shared_mutex> lock(cs);
             Check();
             addrRet = Select_(nUnkBias);
-            Check();
         }
         return addrRet;
     }
 
     // Return a bunch of addresses, selected at random.
-    std::vector<CAddress> GetAddr()
+    std::vector<CAddress> GetAddr() const
     {
-        Check();
         std::vector<CAddress> vAddr;
         {
-            LOCK(cs);
+            boost::shared_lock<boost::shared_mutex> lock(cs);
+            Check();
             GetAddr_(vAddr);
         }
-        Check();
         return vAddr;
     }
 
@@ -566,7 +611,7 @@ public:
     void Connected(const CService &addr, int64 nTime = GetAdjustedTime())
     {
         {
-            LOCK(cs);
+            boost::unique_lock<boost::shared_mutex> lock(cs);
             Check();
             Connected_(addr, nTime);
             Check();
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2009-2012 The Bitcoin developers
+ * Distributed under the MIT/X11 software license, see the accompanying
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.
+ */
+
+#include "sph_aesni.h"
+
+#if SPH_AESNI
+#include <cpuid.h>
+#endif
+
+/* -1 until the CPU has been asked */
+static int aesni_supported = -1;
+static int aesni_enabled = 1;
+
+int
+sph_aesni_supported(void)
+{
+#if SPH_AESNI
+	if (aesni_supported < 0) {
+		unsigned eax, ebx, ecx, edx;
+
+		aesni_supported = __get_cpuid(1, &eax, &ebx, &ecx, &edx)
+			&& (ecx & bit_AES) && (ecx & bit_SSSE3);
+	}
+	return aesni_supported;
+#else
+	return 0;
+#endif
+}
+
+int
+sph_aesni_enabled(void)
+{
+	return aesni_enabled && sph_aesni_supported();
+}
+
+void
+sph_aesni_enable(int enable)
+{
+	aesni_enabled = enable;
+}
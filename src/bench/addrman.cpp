@@ -0,0 +1,90 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addrman.h"
+#include "bench.h"
+
+using namespace std;
+
+static CAddress RandomAddress(int64 nTime)
+{
+    // 20.0.0.0 - 99.255.255.255 holds no special ranges
+    struct in_addr ip;
+    ip.s_addr = htonl(((20 + GetRandInt(80)) << 24) | GetRandInt(1 << 24));
+    CAddress addr(CService(CNetAddr(ip), 8333));
+    addr.nTime = nTime;
+    return addr;
+}
+
+// As from addr messages of up to 1000 entries from many peers
+static void RandomAddrMessages(vector<vector<CAddress> >& vvAddr, vector<CNetAddr>& vSource, int nMessages, int64 nNow)
+{
+    for (int i = 0; i < nMessages; i++)
+    {
+        vector<CAddress> vAddr;
+        int64 nTime = nNow - GetRandInt(86400);
+        for (int j = 0; j < 1000; j++)
+            vAddr.push_back(RandomAddress(nTime));
+        vvAddr.push_back(vAddr);
+        vSource.push_back(RandomAddress(nNow));
+    }
+}
+
+// One iteration takes one addr message
+static void AddrMan_Add(CBenchState& state)
+{
+    int64 nNow = GetAdjustedTime();
+    vector<vector<CAddress> > vvAddr;
+    vector<CNetAddr> vSource;
+    RandomAddrMessages(vvAddr, vSource, 200, nNow);
+
+    CAddrMan addrman;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        addrman.Add(vvAddr[n % vvAddr.size()], vSource[n % vvAddr.size()], 2 * 60 * 60);
+        n++;
+    }
+}
+BENCHMARK(AddrMan_Add);
+
+static void AddrMan_Good(CBenchState& state)
+{
+    int64 nNow = GetAdjustedTime();
+    vector<vector<CAddress> > vvAddr;
+    vector<CNetAddr> vSource;
+    RandomAddrMessages(vvAddr, vSource, 200, nNow);
+    CAddrMan addrman;
+    for (unsigned int i = 0; i < vvAddr.size(); i++)
+        addrman.Add(vvAddr[i], vSource[i], 2 * 60 * 60);
+
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        const vector<CAddress>& vAddr = vvAddr[n / 1000 % vvAddr.size()];
+        addrman.Good(vAddr[n % 1000], nNow);
+        n++;
+    }
+}
+BENCHMARK(AddrMan_Good);
+
+// From tables filled as a long running node has them
+static void AddrMan_Select(CBenchState& state)
+{
+    int64 nNow = GetAdjustedTime();
+    vector<vector<CAddress> > vvAddr;
+    vector<CNetAddr> vSource;
+    RandomAddrMessages(vvAddr, vSource, 200, nNow);
+    CAddrMan addrman;
+    for (unsigned int i = 0; i < vvAddr.size(); i++)
+        addrman.Add(vvAddr[i], vSource[i], 2 * 60 * 60);
+    for (unsigned int i = 0; i < vvAddr.size(); i += 4)
+        for (unsigned int j = 0; j < vvAddr[i].size(); j++)
+            addrman.Good(vvAddr[i][j], nNow);
+
+    while (state.KeepRunning())
+        if (!addrman.Select(50).IsValid())
+            printf("AddrMan_Select : nothing selected\n");
+}
+BENCHMARK(AddrMan_Select);
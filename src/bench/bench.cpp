@@ -0,0 +1,91 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "jsonwriter.h"
+
+using namespace std;
+
+bool CBenchState::NextBatch()
+{
+    int64 nNow = GetTimeMicros();
+    if (nBatchSize == 0)
+    {
+        nStart = nNow;
+        nBatchSize = 1;
+    }
+    else
+    {
+        int64 nBatchTime = nNow - nBatchStart;
+        nIterations += nBatchSize;
+        if (nBatchTime >= BENCH_MIN_BATCH_TIME)
+        {
+            double dTime = (double)nBatchTime / nBatchSize;
+            if (nBatches == 0 || dTime < dMinTime)
+                dMinTime = dTime;
+            if (nBatches == 0 || dTime > dMaxTime)
+                dMaxTime = dTime;
+            nBatches++;
+        }
+        if (nNow - nStart >= nMaxTime)
+        {
+            nElapsed = nNow - nStart;
+            if (nBatches == 0)
+                dMinTime = dMaxTime = GetMeanTime();
+            return false;
+        }
+        if (nBatchTime < BENCH_MIN_BATCH_TIME)
+            nBatchSize *= 2;
+    }
+    nLeft = nBatchSize - 1;
+    nBatchStart = GetTimeMicros();
+    return true;
+}
+
+CBenchRunner::BenchmarkMap& CBenchRunner::Benchmarks()
+{
+    // Filled by static constructors, so it cannot be a static member
+    static BenchmarkMap benchmarks;
+    return benchmarks;
+}
+
+CBenchRunner::CBenchRunner(const string& strName, BenchFunction func)
+{
+    Benchmarks()[strName] = func;
+}
+
+void CBenchRunner::RunAll(const string& strFilter, int64 nTime, string& strJSON)
+{
+    CJSONWriter out(strJSON);
+    out.BeginObject();
+    out.Pair("version", FormatFullVersion());
+    out.Pair("time", GetTime());
+    out.Pair("benchmark_time_us", nTime);
+    out.Key("benchmarks");
+    out.BeginArray();
+
+    fprintf(stderr, "%-32s %12s %14s %14s %14s\n", "#benchmark", "iterations", "mean(us)", "min(us)", "max(us)");
+    for (BenchmarkMap::const_iterator it = Benchmarks().begin(); it != Benchmarks().end(); ++it)
+    {
+        if (it->first.find(strFilter) == string::npos)
+            continue;
+        CBenchState state(nTime);
+        it->second(state);
+        fprintf(stderr, "%-32s %12"PRI64u" %14.3f %14.3f %14.3f\n", it->first.c_str(), state.nIterations,
+                state.GetMeanTime(), state.dMinTime, state.dMaxTime);
+
+        out.BeginObject();
+        out.Pair("name", it->first);
+        out.Key("iterations"); out.UInt(state.nIterations);
+        out.Key("batches"); out.UInt(state.nBatches);
+        out.Pair("total_us", state.nElapsed);
+        out.Pair("mean_us", state.GetMeanTime());
+        out.Pair("min_us", state.dMinTime);
+        out.Pair("max_us", state.dMaxTime);
+        out.EndObject();
+    }
+
+    out.EndArray();
+    out.EndObject();
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BENCH_H
+#define BITCOIN_BENCH_H
+
+#include <map>
+#include <string>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+#include "util.h"
+
+// Batches shorter than this are too close to the clock's resolution to
+// say how long one iteration takes on its own
+static const int64 BENCH_MIN_BATCH_TIME = 10 * 1000;
+
+/** One run of a benchmark.
+ *
+ * A benchmark is a function that does its setup, then repeats the code
+ * being measured while KeepRunning() returns true:
+ *
+ *     static void Example(CBenchState& state)
+ *     {
+ *         ...
+ *         while (state.KeepRunning())
+ *             ...
+ *     }
+ *     BENCHMARK(Example);
+ *
+ * Iterations are timed in batches, doubled until a batch takes
+ * BENCH_MIN_BATCH_TIME, until the time given to the benchmark is over.
+ * Besides the mean, the fastest and slowest batches are kept; the
+ * fastest is the least disturbed by the rest of the system.
+ */
+class CBenchState
+{
+private:
+    int64 nMaxTime;
+    int64 nStart;
+    int64 nBatchStart;
+    uint64 nBatchSize;
+    uint64 nLeft;
+
+public:
+    uint64 nIterations;
+    uint64 nBatches;    // long enough to time
+    int64 nElapsed;
+    double dMinTime;    // per iteration, microseconds
+    double dMaxTime;
+
+    CBenchState(int64 nMaxTimeIn) : nMaxTime(nMaxTimeIn), nStart(0), nBatchStart(0), nBatchSize(0), nLeft(0),
+                                    nIterations(0), nBatches(0), nElapsed(0), dMinTime(0), dMaxTime(0) {}
+
+    bool KeepRunning()
+    {
+        if (nLeft > 0)
+        {
+            nLeft--;
+            return true;
+        }
+        return NextBatch();
+    }
+
+    bool NextBatch();
+    double GetMeanTime() const { return nIterations == 0 ? 0 : (double)nElapsed / nIterations; }
+};
+
+typedef void (*BenchFunction)(CBenchState&);
+
+/** The benchmarks linked in, by name. BENCHMARK adds one */
+class CBenchRunner
+{
+private:
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& Benchmarks();
+
+public:
+    CBenchRunner(const std::string& strName, BenchFunction func);
+
+    // Run those whose name contains strFilter for nTime microseconds each,
+    // writing the results to strJSON
+    static void RunAll(const std::string& strFilter, int64 nTime, std::string& strJSON);
+};
+
+#define BENCHMARK(n) static CBenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include "bench.h"
+#include "db.h"
+#include "main.h"
+#include "txdb.h"
+#include "wallet.h"
+
+using namespace std;
+
+CWallet* pwalletMain;
+CClientUIInterface uiInterface;
+
+extern void noui_connect();
+
+void Shutdown(void* parg)
+{
+  exit(0);
+}
+
+void StartShutdown()
+{
+  exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stdout, "Usage: bench_TheGCCcoin [options]\n\n"
+                        "Options:\n"
+                        "  -filter=<text>    Run only the benchmarks whose name contains <text>\n"
+                        "  -time=<ms>        Run each benchmark for <ms> milliseconds (default: 1000)\n"
+                        "  -output=<file>    Write the JSON results to <file> instead of stdout\n");
+        return 0;
+    }
+
+    // Signatures are verified each time rather than found in the cache
+    SoftSetArg("-maxsigcachesize", "0");
+
+    // The block index and transaction database go to a scratch directory
+    boost::filesystem::path pathBench = boost::filesystem::temp_directory_path() /
+                                        boost::filesystem::unique_path("bench_TheGCCcoin_%%%%%%%%");
+    boost::filesystem::create_directories(pathBench);
+    mapArgs["-datadir"] = pathBench.string();
+    fPrintToDebugger = true; // don't want to write to debug.log file
+    noui_connect();
+    bitdb.MakeMock();
+    if (!LoadBlockIndex(true))
+    {
+        fprintf(stderr, "Error: loading the block index failed\n");
+        return 1;
+    }
+
+    string strJSON;
+    CBenchRunner::RunAll(GetArg("-filter", ""), GetArg("-time", 1000) * 1000, strJSON);
+    strJSON += "\n";
+
+    int nRet = 0;
+    if (mapArgs.count("-output"))
+    {
+        boost::filesystem::ofstream file(mapArgs["-output"]);
+        file << strJSON;
+        if (!file.good())
+        {
+            fprintf(stderr, "Error: cannot write %s\n", mapArgs["-output"].c_str());
+            nRet = 1;
+        }
+    }
+    else
+        fputs(strJSON.c_str(), stdout);
+
+    CTxDB().Close();
+    bitdb.Flush(true);
+    boost::filesystem::remove_all(pathBench);
+    return nRet;
+}
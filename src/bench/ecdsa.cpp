@@ -0,0 +1,112 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <openssl/ecdsa.h>
+
+#include "bench.h"
+#include "key.h"
+#include "secp256k1.h"
+
+using namespace std;
+
+static const int BENCH_ECDSA_KEYS = 100;
+
+struct CBenchSignatures
+{
+    vector<CKey> vKey;
+    vector<CPubKey> vPubKey;
+    vector<vector<unsigned char> > vSig;
+    vector<uint256> vHash;
+
+    CBenchSignatures()
+    {
+        vKey.resize(BENCH_ECDSA_KEYS);
+        for (int i = 0; i < BENCH_ECDSA_KEYS; i++)
+        {
+            vKey[i].MakeNewKey(true);
+            vHash.push_back(GetRandHash());
+            vector<unsigned char> vchSig;
+            vKey[i].Sign(vHash[i], vchSig);
+            vPubKey.push_back(vKey[i].GetPubKey());
+            vSig.push_back(vchSig);
+        }
+    }
+};
+
+static void ECDSA_Sign(CBenchState& state)
+{
+    CBenchSignatures sigs;
+    vector<unsigned char> vchSig;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        sigs.vKey[n % BENCH_ECDSA_KEYS].Sign(sigs.vHash[n % BENCH_ECDSA_KEYS], vchSig);
+        n++;
+    }
+}
+BENCHMARK(ECDSA_Sign);
+
+// CKey::Verify, as scripts check signatures
+static void ECDSA_Verify(CBenchState& state)
+{
+    CBenchSignatures sigs;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        int i = n++ % BENCH_ECDSA_KEYS;
+        CKey key;
+        key.SetPubKey(sigs.vPubKey[i]);
+        if (!key.Verify(sigs.vHash[i], sigs.vSig[i]))
+            printf("ECDSA_Verify : signature %d failed\n", i);
+    }
+}
+BENCHMARK(ECDSA_Verify);
+
+// The native verifier alone
+static void ECDSA_VerifyPubKey(CBenchState& state)
+{
+    CBenchSignatures sigs;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        int i = n++ % BENCH_ECDSA_KEYS;
+        if (!sigs.vPubKey[i].Verify(sigs.vHash[i], sigs.vSig[i]))
+            printf("ECDSA_VerifyPubKey : signature %d failed\n", i);
+    }
+}
+BENCHMARK(ECDSA_VerifyPubKey);
+
+// For comparison with what the native verifier replaced
+static void ECDSA_VerifyOpenSSL(CBenchState& state)
+{
+    CBenchSignatures sigs;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        int i = n++ % BENCH_ECDSA_KEYS;
+        CKey key;
+        key.SetPubKey(sigs.vPubKey[i]);
+        ECDSA_verify(0, (unsigned char*)&sigs.vHash[i], sizeof(sigs.vHash[i]), &sigs.vSig[i][0], sigs.vSig[i].size(), key.GetECKey());
+    }
+}
+BENCHMARK(ECDSA_VerifyOpenSSL);
+
+// One iteration checks all BENCH_ECDSA_KEYS signatures at once
+static void ECDSA_VerifyBatch(CBenchState& state)
+{
+    CBenchSignatures sigs;
+    vector<vector<unsigned char> > vchPubKey;
+    for (int i = 0; i < BENCH_ECDSA_KEYS; i++)
+        vchPubKey.push_back(sigs.vPubKey[i].Raw());
+    vector<bool> vfValid;
+    while (state.KeepRunning())
+    {
+        CECBatchVerifier batch;
+        for (int i = 0; i < BENCH_ECDSA_KEYS; i++)
+            batch.Add(&vchPubKey[i][0], vchPubKey[i].size(), &sigs.vSig[i][0], sigs.vSig[i].size(), sigs.vHash[i]);
+        if (!batch.Verify(vfValid))
+            printf("ECDSA_VerifyBatch : batch failed\n");
+    }
+}
+BENCHMARK(ECDSA_VerifyBatch);
@@ -0,0 +1,47 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <map>
+
+#include "bench.h"
+#include "hashmap.h"
+
+using namespace std;
+
+// Lookups at block index size
+static const int BENCH_MAP_ENTRIES = 500000;
+
+static void Map_Find(CBenchState& state)
+{
+    vector<uint256> vKeys;
+    map<uint256, int> stdmap;
+    for (int i = 0; i < BENCH_MAP_ENTRIES; i++)
+    {
+        vKeys.push_back(GetRandHash());
+        stdmap[vKeys[i]] = i;
+    }
+
+    int64 nSum = 0;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+        nSum += stdmap.find(vKeys[n++ % vKeys.size()])->second;
+}
+BENCHMARK(Map_Find);
+
+static void HashMap_Find(CBenchState& state)
+{
+    vector<uint256> vKeys;
+    CHashMap<uint256, int> hashmap;
+    for (int i = 0; i < BENCH_MAP_ENTRIES; i++)
+    {
+        vKeys.push_back(GetRandHash());
+        hashmap[vKeys[i]] = i;
+    }
+
+    int64 nSum = 0;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+        nSum += hashmap.find(vKeys[n++ % vKeys.size()])->second;
+}
+BENCHMARK(HashMap_Find);
@@ -0,0 +1,66 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "json/json_spirit_writer_template.h"
+#include "json/json_spirit_value.h"
+
+#include "bench.h"
+#include "jsonwriter.h"
+
+using namespace std;
+using namespace json_spirit;
+
+// A listtransactions sized result, built as a tree and written, against
+// streamed; one iteration writes all of it
+static const int BENCH_JSON_ENTRIES = 20000;
+
+static void JSON_ListTransactionsTree(CBenchState& state)
+{
+    uint256 hash = ~uint256(0);
+    while (state.KeepRunning())
+    {
+        Array arr;
+        for (int i = 0; i < BENCH_JSON_ENTRIES; i++)
+        {
+            Object entry;
+            entry.push_back(Pair("account", ""));
+            entry.push_back(Pair("address", "SNb2WP4gEWyTaVFC9Xhz8qFZPW9p6XvUXH"));
+            entry.push_back(Pair("category", "receive"));
+            entry.push_back(Pair("amount", (double)(i * 1234567LL) / (double)COIN));
+            entry.push_back(Pair("confirmations", i));
+            entry.push_back(Pair("blockhash", hash.GetHex()));
+            entry.push_back(Pair("txid", hash.GetHex()));
+            entry.push_back(Pair("time", (boost::int64_t)1400000000 + i));
+            arr.push_back(entry);
+        }
+        string strTree = write_string(Value(arr), false);
+    }
+}
+BENCHMARK(JSON_ListTransactionsTree);
+
+static void JSON_ListTransactionsStream(CBenchState& state)
+{
+    uint256 hash = ~uint256(0);
+    while (state.KeepRunning())
+    {
+        string strStream;
+        CJSONWriter out(strStream);
+        out.BeginArray();
+        for (int i = 0; i < BENCH_JSON_ENTRIES; i++)
+        {
+            out.BeginObject();
+            out.Pair("account", "");
+            out.Pair("address", "SNb2WP4gEWyTaVFC9Xhz8qFZPW9p6XvUXH");
+            out.Pair("category", "receive");
+            out.Key("amount"); out.Amount(i * 1234567LL);
+            out.Pair("confirmations", i);
+            out.Key("blockhash"); out.Hash(hash);
+            out.Key("txid"); out.Hash(hash);
+            out.Pair("time", (int64)1400000000 + i);
+            out.EndObject();
+        }
+        out.EndArray();
+    }
+}
+BENCHMARK(JSON_ListTransactionsStream);
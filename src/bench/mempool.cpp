@@ -0,0 +1,53 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "keystore.h"
+#include "main.h"
+#include "txdb.h"
+
+using namespace std;
+
+static const int BENCH_MEMPOOL_SPENDS = 1000;
+
+// Relaying a payment whose input is unconfirmed: the parent is in the
+// memory pool, so this is all of accept but the disk read. One iteration
+// accepts a transaction and takes it out again
+static void MemPool_Accept(CBenchState& state)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    CTransaction txFund;
+    txFund.nTime = GetAdjustedTime() - 60 * 60;
+    txFund.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    for (int i = 0; i < BENCH_MEMPOOL_SPENDS; i++)
+        txFund.vout.push_back(CTxOut(COIN, scriptPubKey));
+    mempool.addUnchecked(txFund.GetHash(), txFund);
+
+    vector<CTransaction> vSpend(BENCH_MEMPOOL_SPENDS);
+    for (int i = 0; i < BENCH_MEMPOOL_SPENDS; i++)
+    {
+        vSpend[i].vin.push_back(CTxIn(COutPoint(txFund.GetHash(), i)));
+        vSpend[i].vout.push_back(CTxOut(COIN - CENT, scriptPubKey));
+        if (!SignSignature(keystore, txFund, vSpend[i], 0))
+            printf("MemPool_Accept : SignSignature failed\n");
+    }
+
+    CTxDB txdb("r");
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        CTransaction& tx = vSpend[n++ % vSpend.size()];
+        if (!mempool.accept(txdb, tx, true, NULL))
+            printf("MemPool_Accept : accept failed\n");
+        mempool.remove(tx);
+    }
+    mempool.remove(txFund);
+}
+BENCHMARK(MemPool_Accept);
@@ -0,0 +1,69 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+
+using namespace std;
+
+// A full block of ordinary payments: two signed inputs, two outputs each
+static CBlock BenchBlock()
+{
+    CBlock block;
+    block.nTime = 1400000000;
+    block.nBits = 0x1e0fffff;
+    block.hashPrevBlock = GetRandHash();
+    CTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    txCoinBase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG));
+    block.vtx.push_back(txCoinBase);
+    for (int i = 0; i < 2000; i++)
+    {
+        CTransaction tx;
+        tx.nTime = block.nTime;
+        for (int j = 0; j < 2; j++)
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), j), CScript() << vector<unsigned char>(72, 2) << vector<unsigned char>(33, 3)));
+        for (int j = 0; j < 2; j++)
+            tx.vout.push_back(CTxOut(GetRandInt(100) * CENT, txCoinBase.vout[0].scriptPubKey));
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void Block_Serialize(CBenchState& state)
+{
+    CBlock block = BenchBlock();
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    while (state.KeepRunning())
+    {
+        ss.clear();
+        ss << block;
+    }
+}
+BENCHMARK(Block_Serialize);
+
+static void Block_Deserialize(CBenchState& state)
+{
+    CBlock block = BenchBlock();
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssBlock);
+        ss >> block;
+    }
+}
+BENCHMARK(Block_Deserialize);
+
+static void Block_MerkleRoot(CBenchState& state)
+{
+    CBlock block = BenchBlock();
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+BENCHMARK(Block_MerkleRoot);
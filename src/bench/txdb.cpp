@@ -0,0 +1,52 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "txdb.h"
+
+using namespace std;
+
+// Transaction index records, written 1000 at a time as a connected block
+// would. Each iteration writes one record
+static void TxDB_WriteTxIndex(CBenchState& state)
+{
+    CTxDB txdb("r+");
+    CTxIndex txindex(CDiskTxPos(1, 1, 1), 2);
+    uint256 hash = GetRandHash();
+    unsigned int n = 0;
+    txdb.TxnBegin();
+    while (state.KeepRunning())
+    {
+        hash ^= ++n;
+        txdb.UpdateTxIndex(hash, txindex);
+        if (n % 1000 == 0)
+        {
+            txdb.TxnCommit();
+            txdb.TxnBegin();
+        }
+    }
+    txdb.TxnCommit();
+}
+BENCHMARK(TxDB_WriteTxIndex);
+
+// Random lookups among 100000 records, a tenth of them missing
+static void TxDB_ReadTxIndex(CBenchState& state)
+{
+    CTxDB txdb("r+");
+    CTxIndex txindex(CDiskTxPos(1, 1, 1), 2);
+    vector<uint256> vHash;
+    txdb.TxnBegin();
+    for (int i = 0; i < 100000; i++)
+    {
+        vHash.push_back(GetRandHash());
+        if (i % 10 != 0)
+            txdb.UpdateTxIndex(vHash.back(), txindex);
+    }
+    txdb.TxnCommit();
+
+    unsigned int n = 0;
+    while (state.KeepRunning())
+        txdb.ReadTxIndex(vHash[n++ % vHash.size()], txindex);
+}
+BENCHMARK(TxDB_ReadTxIndex);
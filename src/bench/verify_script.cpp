@@ -0,0 +1,138 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "keystore.h"
+#include "main.h"
+
+using namespace std;
+
+extern uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+
+// A transaction spending scriptPubKey, signed from keystore
+static void BenchSpend(const CKeyStore& keystore, const CScript& scriptPubKey, CTransaction& txTo)
+{
+    CTransaction txFrom;
+    txFrom.vout.push_back(CTxOut(COIN, scriptPubKey));
+    txTo.vin.push_back(CTxIn(COutPoint(txFrom.GetHash(), 0)));
+    txTo.vout.push_back(CTxOut(COIN, scriptPubKey));
+    if (!SignSignature(keystore, txFrom, txTo, 0))
+        printf("BenchSpend : SignSignature failed\n");
+}
+
+static void VerifyScript_Bench(CBenchState& state, const CKeyStore& keystore, const CScript& scriptPubKey)
+{
+    CTransaction txTo;
+    BenchSpend(keystore, scriptPubKey, txTo);
+    while (state.KeepRunning())
+        if (!VerifyScript(txTo.vin[0].scriptSig, scriptPubKey, txTo, 0, true, 0))
+            printf("VerifyScript_Bench : failed\n");
+}
+
+static void VerifyScript_P2PKH(CBenchState& state)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    VerifyScript_Bench(state, keystore, scriptPubKey);
+}
+BENCHMARK(VerifyScript_P2PKH);
+
+static void VerifyScript_P2SHMultisig(CBenchState& state)
+{
+    CBasicKeyStore keystore;
+    vector<CKey> keys(3);
+    for (unsigned int i = 0; i < keys.size(); i++)
+    {
+        keys[i].MakeNewKey(true);
+        keystore.AddKey(keys[i]);
+    }
+    CScript scriptRedeem;
+    scriptRedeem.SetMultisig(2, keys);
+    keystore.AddCScript(scriptRedeem);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(scriptRedeem.GetID());
+    VerifyScript_Bench(state, keystore, scriptPubKey);
+}
+BENCHMARK(VerifyScript_P2SHMultisig);
+
+// The general interpreter on the same pay-to-pubkey-hash spend, for
+// what the template path saves
+static void EvalScript_P2PKH(CBenchState& state)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    CTransaction txTo;
+    BenchSpend(keystore, scriptPubKey, txTo);
+
+    vector<vector<unsigned char> > stack;
+    while (state.KeepRunning())
+    {
+        stack.clear();
+        if (!EvalScript(stack, txTo.vin[0].scriptSig, txTo, 0, 0) || !EvalScript(stack, scriptPubKey, txTo, 0, 0))
+            printf("EvalScript_P2PKH : failed\n");
+    }
+}
+BENCHMARK(EvalScript_P2PKH);
+
+// Arithmetic and stack opcodes, without signatures
+static void EvalScript_Arithmetic(CBenchState& state)
+{
+    CScript script;
+    for (int i = 0; i < 50; i++)
+        script << OP_1 << OP_ADD << OP_DUP << OP_1SUB << OP_MAX;
+    CTransaction txTo;
+    vector<vector<unsigned char> > stack;
+    while (state.KeepRunning())
+    {
+        stack.clear();
+        stack.push_back(vector<unsigned char>(1, 1));
+        EvalScript(stack, script, txTo, 0, 0);
+    }
+}
+BENCHMARK(EvalScript_Arithmetic);
+
+// A consolidation of many inputs, each signed with SIGHASH_ALL; one
+// iteration hashes all of them
+static CTransaction BenchConsolidation(CScript& scriptCode)
+{
+    CTransaction tx;
+    for (int i = 0; i < 500; i++)
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript() << vector<unsigned char>(72) << vector<unsigned char>(33)));
+    tx.vout.push_back(CTxOut(1, CScript() << OP_DUP << OP_HASH160 << vector<unsigned char>(20) << OP_EQUALVERIFY << OP_CHECKSIG));
+    scriptCode = tx.vout[0].scriptPubKey;
+    return tx;
+}
+
+static void SignatureHash_Consolidation(CBenchState& state)
+{
+    CScript scriptCode;
+    CTransaction tx = BenchConsolidation(scriptCode);
+    uint256 hash = 0;
+    while (state.KeepRunning())
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+            hash ^= SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL);
+}
+BENCHMARK(SignatureHash_Consolidation);
+
+static void SignatureHash_ConsolidationCached(CBenchState& state)
+{
+    CScript scriptCode;
+    CTransaction tx = BenchConsolidation(scriptCode);
+    uint256 hash = 0;
+    while (state.KeepRunning())
+    {
+        CSignatureHashCache sighashcache(tx);
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+            hash ^= SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL);
+    }
+}
+BENCHMARK(SignatureHash_ConsolidationCached);
@@ -0,0 +1,71 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "wallet.h"
+
+using namespace std;
+
+// An in memory wallet paid nTx times, each to one of 100 keys with a
+// change output not its own, in amounts from a satoshi to a thousand coins
+static void BenchWallet(CWallet& wallet, int nTx)
+{
+    vector<CScript> vScript;
+    for (int i = 0; i < 100; i++)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        wallet.AddKey(key);
+        CScript script;
+        script.SetDestination(key.GetPubKey().GetID());
+        vScript.push_back(script);
+    }
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CScript scriptOther;
+    scriptOther.SetDestination(keyOther.GetPubKey().GetID());
+
+    LOCK(wallet.cs_wallet);
+    for (int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.nTime = 1400000000;
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+        tx.vout.push_back(CTxOut(GetRand(1000 * COIN) >> GetRandInt(40), vScript[i % vScript.size()]));
+        tx.vout.push_back(CTxOut(COIN, scriptOther));
+        CWalletTx& wtx = wallet.mapWallet[tx.GetHash()];
+        wtx = CWalletTx(&wallet, tx);
+    }
+}
+
+static void Wallet_AvailableCoins(CBenchState& state)
+{
+    CWallet wallet;
+    BenchWallet(wallet, 10000);
+    vector<COutput> vCoins;
+    while (state.KeepRunning())
+        wallet.AvailableCoins(vCoins, false);
+}
+BENCHMARK(Wallet_AvailableCoins);
+
+// What SelectCoins does past AvailableCoins, for payments of assorted sizes
+static void Wallet_SelectCoins(CBenchState& state)
+{
+    CWallet wallet;
+    BenchWallet(wallet, 1000);
+    vector<COutput> vCoins;
+    wallet.AvailableCoins(vCoins, false);
+
+    set<pair<const CWalletTx*, unsigned int> > setCoins;
+    int64 nValue;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        int64 nTarget = (n++ % 20 + 1) * 7 * COIN / 3;
+        setCoins.clear();
+        if (!wallet.SelectCoinsMinConf(nTarget, 1400000000, 0, 0, vCoins, setCoins, nValue))
+            printf("Wallet_SelectCoins : nothing selected for %"PRI64d"\n", nTarget);
+    }
+}
+BENCHMARK(Wallet_SelectCoins);
@@ -10,6 +10,7 @@
 #include "base58.h"
 #include "bitcoinrpc.h"
 #include "db.h"
+#include "jsonwriter.h"
 
 #undef printf
 #include <boost/asio.hpp>
@@ -24,6 +25,7 @@
 #include <boost/asio/ssl.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/shared_ptr.hpp>
+#include <deque>
 #include <list>
 
 #define printf OutputDebugStringF
@@ -39,7 +41,9 @@ static std::string strRPCUserColonPass;
 
 const Object emptyobj;
 
-void ThreadRPCServer3(void* parg);
+void ThreadRPCWorker(void* parg);
+
+class AcceptedConnection;
 
 static inline unsigned short GetDefaultRPCPort()
 {
@@ -228,6 +232,194 @@ Value stop(const Array& params, bool fHelp)
 }
 
 
+/** Per-method call statistics for getrpcinfo */
+class CRPCMetrics
+{
+private:
+    struct CMethodStats
+    {
+        int64 nCalls;
+        int64 nErrors;
+        int64 nTotalMicros;
+        int64 nMaxMicros;
+
+        CMethodStats() : nCalls(0), nErrors(0), nTotalMicros(0), nMaxMicros(0) {}
+    };
+
+    mutable CCriticalSection cs;
+    map<string, CMethodStats> mapMethods;
+    int64 nRequests;
+    int64 nBatches;
+    int64 nBatchCalls;
+
+public:
+    CRPCMetrics() : nRequests(0), nBatches(0), nBatchCalls(0) {}
+
+    void RecordCall(const string& strMethod, int64 nMicros, bool fError)
+    {
+        LOCK(cs);
+        CMethodStats& stats = mapMethods[strMethod];
+        stats.nCalls++;
+        if (fError)
+            stats.nErrors++;
+        stats.nTotalMicros += nMicros;
+        stats.nMaxMicros = max(stats.nMaxMicros, nMicros);
+    }
+
+    void RecordRequest(unsigned int nBatchSize)
+    {
+        LOCK(cs);
+        nRequests++;
+        if (nBatchSize > 0)
+        {
+            nBatches++;
+            nBatchCalls += nBatchSize;
+        }
+    }
+
+    void ToJSON(Object& result) const
+    {
+        LOCK(cs);
+        result.push_back(Pair("requests", (boost::int64_t)nRequests));
+        result.push_back(Pair("batches", (boost::int64_t)nBatches));
+        result.push_back(Pair("batchcalls", (boost::int64_t)nBatchCalls));
+
+        Object methods;
+        for (map<string, CMethodStats>::const_iterator it = mapMethods.begin(); it != mapMethods.end(); ++it)
+        {
+            const CMethodStats& stats = it->second;
+            Object entry;
+            entry.push_back(Pair("calls", (boost::int64_t)stats.nCalls));
+            entry.push_back(Pair("errors", (boost::int64_t)stats.nErrors));
+            entry.push_back(Pair("avgmicros", (boost::int64_t)(stats.nTotalMicros / stats.nCalls)));
+            entry.push_back(Pair("maxmicros", (boost::int64_t)stats.nMaxMicros));
+            methods.push_back(Pair(it->first, entry));
+        }
+        result.push_back(Pair("methods", methods));
+    }
+};
+
+static CRPCMetrics rpcMetrics;
+
+void CRPCWorkQueue::SetMaxDepth(size_t nMaxDepthIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nMaxDepth = nMaxDepthIn;
+}
+
+bool CRPCWorkQueue::Push(AcceptedConnection* conn, int64 nIdleSince)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (queue.size() >= nMaxDepth)
+        {
+            nRejected++;
+            return false;
+        }
+        CRPCQueuedConnection item;
+        item.conn = conn;
+        item.nIdleSince = nIdleSince;
+        queue.push_back(item);
+        nPeakDepth = max(nPeakDepth, queue.size());
+    }
+    cond.notify_one();
+    return true;
+}
+
+bool CRPCWorkQueue::Park(AcceptedConnection* conn, int64 nIdleSince)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (parked.size() >= nMaxDepth)
+        {
+            nParkedClosed++;
+            return false;
+        }
+        CRPCQueuedConnection item;
+        item.conn = conn;
+        item.nIdleSince = nIdleSince;
+        parked.push_back(item);
+    }
+    cond.notify_one();
+    return true;
+}
+
+bool CRPCWorkQueue::Pop(CRPCQueuedConnection& item)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (queue.empty() && parked.empty())
+    {
+        if (fShutdown)
+            return false;
+        cond.timed_wait(lock, boost::posix_time::milliseconds(250));
+    }
+    if (fShutdown)
+        return false;
+    std::deque<CRPCQueuedConnection>& from = queue.empty() ? parked : queue;
+    item = from.front();
+    from.pop_front();
+    nActive++;
+    return true;
+}
+
+void CRPCWorkQueue::Done()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nActive--;
+}
+
+bool CRPCWorkQueue::Waiting()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return !queue.empty() || !parked.empty();
+}
+
+void CRPCWorkQueue::WorkerStarted()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nWorkers++;
+}
+
+void CRPCWorkQueue::Drain(std::vector<AcceptedConnection*>& vConn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    BOOST_FOREACH(const CRPCQueuedConnection& item, queue)
+        vConn.push_back(item.conn);
+    BOOST_FOREACH(const CRPCQueuedConnection& item, parked)
+        vConn.push_back(item.conn);
+    queue.clear();
+    parked.clear();
+}
+
+void CRPCWorkQueue::ToJSON(Object& result)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    result.push_back(Pair("threads", nWorkers));
+    result.push_back(Pair("active", nActive));
+    result.push_back(Pair("workqueue", (int)nMaxDepth));
+    result.push_back(Pair("queuedepth", (int)queue.size()));
+    result.push_back(Pair("peakqueuedepth", (int)nPeakDepth));
+    result.push_back(Pair("rejected", (boost::int64_t)nRejected));
+    result.push_back(Pair("parked", (int)parked.size()));
+    result.push_back(Pair("parkedclosed", (boost::int64_t)nParkedClosed));
+}
+
+static CRPCWorkQueue rpcWorkQueue;
+
+Value getrpcinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "Returns RPC server worker pool, queue and per-method latency statistics.");
+
+    Object result;
+    rpcWorkQueue.ToJSON(result);
+    rpcMetrics.ToJSON(result);
+    return result;
+}
+
+
 
 //
 // Call Table
@@ -239,17 +431,21 @@ static const CRPCCommand vRPCCommands[] =
   //  ------------------------  -----------------------  ------  --------
     { "help",                   &help,                   true,   true },
     { "stop",                   &stop,                   true,   true },
+    { "getrpcinfo",             &getrpcinfo,             true,   true },
     { "getbestblockhash",       &getbestblockhash,       true,   false },
     { "getblockcount",          &getblockcount,          true,   false },
     { "getconnectioncount",     &getconnectioncount,     true,   false },
     { "getpeerinfo",            &getpeerinfo,            true,   false },
+    { "getorphaninfo",          &getorphaninfo,          true,   false },
     { "getdifficulty",          &getdifficulty,          true,   false },
+    { "getchainstats",          &getchainstats,          true,   false },
     { "getgenerate",            &getgenerate,            true,   false },
     { "setgenerate",            &setgenerate,            true,   false },
     { "gethashespersec",        &gethashespersec,        true,   false },
     { "getinfo",                &getinfo,                true,   false },
     { "getsubsidy",             &getsubsidy,             true,   false },
     { "getmininginfo",          &getmininginfo,          true,   false },
+    { "getnetworkhashps",       &getnetworkhashps,       true,   false },
     { "getnewaddress",          &getnewaddress,          true,   false },
     { "getnewpubkey",           &getnewpubkey,           true,   false },
     { "getaccountaddress",      &getaccountaddress,      true,   false },
@@ -291,13 +487,16 @@ static const CRPCCommand vRPCCommands[] =
     { "submitblock",            &submitblock,            false,  false },
     { "listsinceblock",         &listsinceblock,         false,  false },
     { "dumpprivkey",            &dumpprivkey,            false,  false },
-    { "importprivkey",          &importprivkey,          false,  false },
+    { "importprivkey",          &importprivkey,          false,  true },
     { "listunspent",            &listunspent,            false,  false },
     { "getrawtransaction",      &getrawtransaction,      false,  false },
     { "createrawtransaction",   &createrawtransaction,   false,  false },
     { "decoderawtransaction",   &decoderawtransaction,   false,  false },
     { "signrawtransaction",     &signrawtransaction,     false,  false },
     { "sendrawtransaction",     &sendrawtransaction,     false,  false },
+    { "getaddressbalance",      &getaddressbalance,      false,  false },
+    { "getaddressutxos",        &getaddressutxos,        false,  false },
+    { "getaddresshistory",      &getaddresshistory,      false,  false },
     { "decryptsend",            &decryptsend,            false,  false },
     { "getcheckpoint",          &getcheckpoint,          true,   false },
     { "reservebalance",         &reservebalance,         false,  true},
@@ -311,10 +510,24 @@ static const CRPCCommand vRPCCommands[] =
     { "importstealthaddress",   &importstealthaddress,   false,  false},
     { "sendtostealthaddress",   &sendtostealthaddress,   false,  false},
     { "clearwallettransactions",&clearwallettransactions,false,  false},
-    { "scanforalltxns",         &scanforalltxns,         false,  false},
+    { "scanforalltxns",         &scanforalltxns,         false,  true},
+    { "abortrescan",            &abortrescan,            true,   true },
     { "scanforstealthtxns",     &scanforstealthtxns,     false,  false},
 };
 
+// Commands with a streaming implementation for large results
+static const struct
+{
+    const char* name;
+    rpcstreamfn_type streamer;
+} vRPCStreamCommands[] =
+{
+    { "getblock",               &getblock_stream },
+    { "getblockbynumber",       &getblockbynumber_stream },
+    { "getrawtransaction",      &getrawtransaction_stream },
+    { "listtransactions",       &listtransactions_stream },
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -325,6 +538,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamers[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].streamer;
 }
 
 const CRPCCommand *CRPCTable::operator[](string name) const
@@ -393,10 +608,12 @@ static string HTTPReply(int nStatus, const string& strMsg, bool keepalive)
             "</HTML>\r\n", rfc1123Time().c_str(), FormatFullVersion().c_str());
     const char *cStatus;
          if (nStatus == HTTP_OK) cStatus = "OK";
+    else if (nStatus == HTTP_NO_CONTENT) cStatus = "No Content";
     else if (nStatus == HTTP_BAD_REQUEST) cStatus = "Bad Request";
     else if (nStatus == HTTP_FORBIDDEN) cStatus = "Forbidden";
     else if (nStatus == HTTP_NOT_FOUND) cStatus = "Not Found";
     else if (nStatus == HTTP_INTERNAL_SERVER_ERROR) cStatus = "Internal Server Error";
+    else if (nStatus == HTTP_SERVICE_UNAVAILABLE) cStatus = "Service Unavailable";
     else cStatus = "";
     return strprintf(
             "HTTP/1.1 %d %s\r\n"
@@ -635,6 +852,10 @@ public:
     virtual std::iostream& stream() = 0;
     virtual std::string peer_address_to_string() const = 0;
     virtual void close() = 0;
+
+    // True if a read would not block for long: buffered data, data on the
+    // socket, or an error/EOF the next read will report
+    virtual bool wait_readable(int nTimeoutMillis) = 0;
 };
 
 template <typename Protocol>
@@ -644,9 +865,10 @@ public:
     AcceptedConnectionImpl(
             asio::io_service& io_service,
             ssl::context &context,
-            bool fUseSSL) :
+            bool fUseSSLIn) :
         sslStream(io_service, context),
-        _d(sslStream, fUseSSL),
+        fUseSSL(fUseSSLIn),
+        _d(sslStream, fUseSSLIn),
         _stream(_d)
     {
     }
@@ -666,10 +888,29 @@ public:
         _stream.close();
     }
 
+    virtual bool wait_readable(int nTimeoutMillis)
+    {
+        // Pipelined requests usually sit in the stream buffer already
+        if (_stream.rdbuf()->in_avail() > 0)
+            return true;
+        if (fUseSSL && SSL_pending(sslStream.native_handle()) > 0)
+            return true;
+
+        SOCKET hSocket = sslStream.lowest_layer().native_handle();
+        fd_set fdsetRecv;
+        FD_ZERO(&fdsetRecv);
+        FD_SET(hSocket, &fdsetRecv);
+        struct timeval timeout;
+        timeout.tv_sec = nTimeoutMillis / 1000;
+        timeout.tv_usec = (nTimeoutMillis % 1000) * 1000;
+        return select(hSocket + 1, &fdsetRecv, NULL, NULL, &timeout) != 0;
+    }
+
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
+    bool fUseSSL;
     SSLIOStreamDevice<Protocol> _d;
     iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
 };
@@ -762,9 +1003,12 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol,
         delete conn;
     }
 
-    // start HTTP client thread
-    else if (!NewThread(ThreadRPCServer3, conn)) {
-        printf("Failed to create RPC server client thread\n");
+    // hand it to the worker pool
+    else if (!rpcWorkQueue.Push(conn, GetTime()))
+    {
+        printf("ThreadRPCServer work queue full, refusing %s\n", conn->peer_address_to_string().c_str());
+        if (!fUseSSL)
+            conn->stream() << HTTPReply(HTTP_SERVICE_UNAVAILABLE, "", false) << std::flush;
         delete conn;
     }
 
@@ -891,11 +1135,26 @@ void ThreadRPCServer2(void* parg)
         return;
     }
 
+    rpcWorkQueue.SetMaxDepth(max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1));
+    int nThreads = max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
+    for (int i = 0; i < nThreads; i++)
+        if (!NewThread(ThreadRPCWorker, NULL))
+            printf("Failed to create RPC worker thread\n");
+
     vnThreadsRunning[THREAD_RPCLISTENER]--;
     while (!fShutdown)
         io_service.run_one();
     vnThreadsRunning[THREAD_RPCLISTENER]++;
     StopRequests();
+
+    // Workers stop taking connections on shutdown; close whatever is left
+    vector<AcceptedConnection*> vConn;
+    rpcWorkQueue.Drain(vConn);
+    BOOST_FOREACH(AcceptedConnection* conn, vConn)
+    {
+        conn->close();
+        delete conn;
+    }
 }
 
 class JSONRequest
@@ -904,8 +1163,10 @@ public:
     Value id;
     string strMethod;
     Array params;
+    bool fVersion2;     // "jsonrpc": "2.0" request
+    bool fNotification; // 2.0 request without an id, gets no reply
 
-    JSONRequest() { id = Value::null; }
+    JSONRequest() { id = Value::null; fVersion2 = false; fNotification = false; }
     void parse(const Value& valRequest);
 };
 
@@ -919,6 +1180,17 @@ void JSONRequest::parse(const Value& valRequest)
     // Parse id now so errors from here on will have the id
     id = find_value(request, "id");
 
+    Value valVersion = find_value(request, "jsonrpc");
+    fVersion2 = (valVersion.type() == str_type && valVersion.get_str() == "2.0");
+    if (fVersion2)
+    {
+        // An explicit "id": null is still a call, only a missing id is a notification
+        fNotification = true;
+        BOOST_FOREACH(const Pair& pair, request)
+            if (pair.name_ == "id")
+                fNotification = false;
+    }
+
     // Parse method
     Value valMethod = find_value(request, "method");
     if (valMethod.type() == null_type)
@@ -926,7 +1198,7 @@ void JSONRequest::parse(const Value& valRequest)
     if (valMethod.type() != str_type)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Method must be a string");
     strMethod = valMethod.get_str();
-    if (strMethod != "getwork" && strMethod != "getblocktemplate")
+    if (fDebug && strMethod != "getwork" && strMethod != "getblocktemplate")
         printf("ThreadRPCServer method=%s\n", strMethod.c_str());
 
     // Parse params
@@ -939,138 +1211,299 @@ void JSONRequest::parse(const Value& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
 }
 
-static Object JSONRPCExecOne(const Value& req)
+static Object JSONRPCReplyObj(const JSONRequest& jreq, const Value& result, const Value& error)
+{
+    if (!jreq.fVersion2)
+        return JSONRPCReplyObj(result, error, jreq.id);
+
+    // 2.0 replies carry either result or error, never both
+    Object reply;
+    reply.push_back(Pair("jsonrpc", "2.0"));
+    if (error.type() != null_type)
+        reply.push_back(Pair("error", error));
+    else
+        reply.push_back(Pair("result", result));
+    reply.push_back(Pair("id", jreq.id));
+    return reply;
+}
+
+// Result JSON of jreq, streamed when the command supports it
+static string JSONRPCExecResult(const JSONRequest& jreq)
+{
+    string strResult;
+    if (!tableRPC.executeStream(jreq.strMethod, jreq.params, strResult))
+        strResult = write_string(tableRPC.execute(jreq.strMethod, jreq.params), false);
+    return strResult;
+}
+
+// Appends the same text write_string() gives for JSONRPCReplyObj(jreq, result, null)
+static void JSONRPCAppendReply(const JSONRequest& jreq, const string& strResult, string& strReply)
 {
-    Object rpc_result;
+    if (jreq.fVersion2)
+        strReply += "{\"jsonrpc\":\"2.0\",\"result\":";
+    else
+        strReply += "{\"result\":";
+    strReply += strResult;
+    if (!jreq.fVersion2)
+        strReply += ",\"error\":null";
+    strReply += ",\"id\":";
+    strReply += write_string(jreq.id, false);
+    strReply += "}";
+}
 
+// Appends the reply to req to strReply, returns false for notifications
+static bool JSONRPCExecOne(const Value& req, string& strReply)
+{
     JSONRequest jreq;
     try {
         jreq.parse(req);
 
-        Value result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, Value::null, jreq.id);
+        string strResult = JSONRPCExecResult(jreq);
+        if (!jreq.fNotification)
+            JSONRPCAppendReply(jreq, strResult, strReply);
     }
     catch (Object& objError)
     {
-        rpc_result = JSONRPCReplyObj(Value::null, objError, jreq.id);
+        if (!jreq.fNotification)
+            strReply += write_string(Value(JSONRPCReplyObj(jreq, Value::null, objError)), false);
     }
     catch (std::exception& e)
     {
-        rpc_result = JSONRPCReplyObj(Value::null,
-                                     JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        if (!jreq.fNotification)
+            strReply += write_string(Value(JSONRPCReplyObj(jreq, Value::null, JSONRPCError(RPC_PARSE_ERROR, e.what()))), false);
     }
 
-    return rpc_result;
+    return !jreq.fNotification;
 }
 
-static string JSONRPCExecBatch(const Array& vReq)
+// Whether req names a command that runs under cs_main and cs_wallet
+static bool JSONRPCNeedsLocks(const Value& req)
 {
-    Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
-
-    return write_string(Value(ret), false) + "\n";
+    if (req.type() != obj_type)
+        return false;
+    Value valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && !pcmd->unlocked;
 }
 
-static CCriticalSection cs_THREAD_RPCHANDLER;
+// Calls per batch run under one acquisition of cs_main and cs_wallet
+static const unsigned int RPC_BATCH_LOCK_CHUNK = 64;
 
-void ThreadRPCServer3(void* parg)
+static string JSONRPCExecBatch(const Array& vReq)
 {
-    // Make this thread recognisable as the RPC handler
-    RenameThread("bitcoin-rpchand");
+    if (vReq.empty())
+        throw JSONRPCError(RPC_INVALID_REQUEST, "Empty batch");
 
+    // Built as text so streamed results are not parsed back into a tree
+    string strReply = "[";
+    bool fAny = false;
+    unsigned int i = 0;
+    while (i < vReq.size())
     {
-        LOCK(cs_THREAD_RPCHANDLER);
-        vnThreadsRunning[THREAD_RPCHANDLER]++;
-    }
-    AcceptedConnection *conn = (AcceptedConnection *) parg;
-
-    bool fRun = true;
-    LOOP {
-        if (fShutdown || !fRun)
+        if (!JSONRPCNeedsLocks(vReq[i]))
         {
-            conn->close();
-            delete conn;
+            string strOne;
+            if (JSONRPCExecOne(vReq[i++], strOne))
             {
-                LOCK(cs_THREAD_RPCHANDLER);
-                --vnThreadsRunning[THREAD_RPCHANDLER];
+                if (fAny)
+                    strReply += ",";
+                strReply += strOne;
+                fAny = true;
             }
-            return;
+            continue;
         }
-        map<string, string> mapHeaders;
-        string strRequest;
-
-        ReadHTTP(conn->stream(), mapHeaders, strRequest);
 
-        // Check authorization
-        if (mapHeaders.count("authorization") == 0)
+        // Run a stretch of locking calls under a single lock acquisition
+        // (CRPCTable::execute takes them again recursively), letting go
+        // between stretches so block processing is not held off for long
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        for (unsigned int nRun = 0; nRun < RPC_BATCH_LOCK_CHUNK && i < vReq.size() && JSONRPCNeedsLocks(vReq[i]); nRun++)
         {
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
-            break;
-        }
-        if (!HTTPAuthorized(mapHeaders))
-        {
-            printf("ThreadRPCServer incorrect password attempt from %s\n", conn->peer_address_to_string().c_str());
-            /* Deter brute-forcing short passwords.
-               If this results in a DOS the user really
-               shouldn't have their RPC port exposed.*/
-            if (mapArgs["-rpcpassword"].size() < 20)
-                Sleep(250);
-
-            conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
-            break;
+            string strOne;
+            if (JSONRPCExecOne(vReq[i++], strOne))
+            {
+                if (fAny)
+                    strReply += ",";
+                strReply += strOne;
+                fAny = true;
+            }
         }
-        if (mapHeaders["connection"] == "close")
-            fRun = false;
+    }
+
+    // A batch of notifications only gets no reply at all
+    if (!fAny)
+        return "";
+    return strReply + "]\n";
+}
 
+string JSONRPCExecRequest(const Value& valRequest, Value& id)
+{
+    // singleton request
+    if (valRequest.type() == obj_type)
+    {
+        rpcMetrics.RecordRequest(0);
+        id = find_value(valRequest.get_obj(), "id");
         JSONRequest jreq;
-        try
+        jreq.parse(valRequest);
+
+        string strResult = JSONRPCExecResult(jreq);
+
+        string strReply;
+        if (!jreq.fNotification)
         {
-            LOCK(cs_THREAD_RPCHANDLER);
+            JSONRPCAppendReply(jreq, strResult, strReply);
+            strReply += "\n";
+        }
+        return strReply;
+    }
 
-            // Parse request
-            Value valRequest;
-            if (!read_string(strRequest, valRequest))
-                throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+    // array of requests
+    if (valRequest.type() == array_type)
+    {
+        rpcMetrics.RecordRequest(valRequest.get_array().size());
+        return JSONRPCExecBatch(valRequest.get_array());
+    }
 
-            string strReply;
+    throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+}
 
-            // singleton request
-            if (valRequest.type() == obj_type) {
-                jreq.parse(valRequest);
+// Read one HTTP request from conn and answer it. Returns true if the
+// connection stays open for further (possibly pipelined) requests.
+static bool RPCServeRequest(AcceptedConnection* conn)
+{
+    map<string, string> mapHeaders;
+    string strRequest;
 
-                Value result = tableRPC.execute(jreq.strMethod, jreq.params);
+    ReadHTTP(conn->stream(), mapHeaders, strRequest);
 
-                // Send reply
-                strReply = JSONRPCReply(result, Value::null, jreq.id);
+    // Client went away
+    if (conn->stream().fail() && mapHeaders.empty())
+        return false;
 
-            // array of requests
-            } else if (valRequest.type() == array_type)
-                strReply = JSONRPCExecBatch(valRequest.get_array());
-            else
-                throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+    // Check authorization
+    if (mapHeaders.count("authorization") == 0)
+    {
+        conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
+        return false;
+    }
+    if (!HTTPAuthorized(mapHeaders))
+    {
+        printf("ThreadRPCServer incorrect password attempt from %s\n", conn->peer_address_to_string().c_str());
+        /* Deter brute-forcing short passwords.
+           If this results in a DOS the user really
+           shouldn't have their RPC port exposed.*/
+        if (mapArgs["-rpcpassword"].size() < 20)
+            Sleep(250);
+
+        conn->stream() << HTTPReply(HTTP_UNAUTHORIZED, "", false) << std::flush;
+        return false;
+    }
+    bool fKeepAlive = (mapHeaders["connection"] != "close");
 
-            conn->stream() << HTTPReply(HTTP_OK, strReply, fRun) << std::flush;
-        }
-        catch (Object& objError)
-        {
-            ErrorReply(conn->stream(), objError, jreq.id);
+    Value id = Value::null;
+    try
+    {
+        // Parse request
+        Value valRequest;
+        if (!read_string(strRequest, valRequest))
+            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+
+        string strReply = JSONRPCExecRequest(valRequest, id);
+
+        conn->stream() << HTTPReply(strReply.empty() ? HTTP_NO_CONTENT : HTTP_OK, strReply, fKeepAlive) << std::flush;
+    }
+    catch (Object& objError)
+    {
+        ErrorReply(conn->stream(), objError, id);
+        return false;
+    }
+    catch (std::exception& e)
+    {
+        ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), id);
+        return false;
+    }
+
+    return fKeepAlive && conn->stream().good();
+}
+
+// Serve item.conn until it closes, times out or goes idle while other
+// connections are waiting, in which case it goes back into the queue
+static void RPCServeConnection(CRPCQueuedConnection item, int64 nKeepAlive)
+{
+    AcceptedConnection* conn = item.conn;
+    LOOP
+    {
+        if (fShutdown)
             break;
+
+        // Wait briefly when others are waiting so an idle client cannot pin this worker
+        if (conn->wait_readable(rpcWorkQueue.Waiting() ? 20 : 250))
+        {
+            bool fOpen = false;
+            try
+            {
+                fOpen = RPCServeRequest(conn);
+            }
+            catch (std::exception& e) {
+                PrintExceptionContinue(&e, "ThreadRPCWorker()");
+            }
+            if (!fOpen)
+                break;
+            item.nIdleSince = GetTime();
+            continue;
         }
-        catch (std::exception& e)
+
+        if (GetTime() - item.nIdleSince > nKeepAlive)
+            break;
+        if (rpcWorkQueue.Waiting())
         {
-            ErrorReply(conn->stream(), JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+            if (rpcWorkQueue.Park(conn, item.nIdleSince))
+                return;
             break;
         }
     }
 
+    conn->close();
     delete conn;
+}
+
+static CCriticalSection cs_THREAD_RPCHANDLER;
+
+void ThreadRPCWorker(void* parg)
+{
+    // Make this thread recognisable as the RPC handler
+    RenameThread("bitcoin-rpchand");
+
+    {
+        LOCK(cs_THREAD_RPCHANDLER);
+        vnThreadsRunning[THREAD_RPCHANDLER]++;
+    }
+    rpcWorkQueue.WorkerStarted();
+    int64 nKeepAlive = GetArg("-rpckeepalive", DEFAULT_RPC_KEEPALIVE);
+
+    CRPCQueuedConnection item;
+    while (rpcWorkQueue.Pop(item))
+    {
+        RPCServeConnection(item, nKeepAlive);
+        rpcWorkQueue.Done();
+    }
+
     {
         LOCK(cs_THREAD_RPCHANDLER);
         vnThreadsRunning[THREAD_RPCHANDLER]--;
     }
 }
 
+static void CheckSafeMode(const CRPCCommand *pcmd)
+{
+    string strWarning = GetWarnings("rpc");
+    if (strWarning != "" && !GetBoolArg("-disablesafemode") &&
+        !pcmd->okSafeMode)
+        throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
+}
+
 json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
 {
     // Find method
@@ -1079,11 +1512,10 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
 
     // Observe safe mode
-    string strWarning = GetWarnings("rpc");
-    if (strWarning != "" && !GetBoolArg("-disablesafemode") &&
-        !pcmd->okSafeMode)
-        throw JSONRPCError(RPC_FORBIDDEN_BY_SAFE_MODE, string("Safe mode: ") + strWarning);
+    CheckSafeMode(pcmd);
 
+    // Latency includes waiting for the locks, which is what callers see
+    int64 nStart = GetTimeMicros();
     try
     {
         // Execute
@@ -1096,10 +1528,68 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
                 result = pcmd->actor(params, false);
             }
         }
+        rpcMetrics.RecordCall(strMethod, GetTimeMicros() - nStart, false);
         return result;
     }
+    catch (Object& objError)
+    {
+        rpcMetrics.RecordCall(strMethod, GetTimeMicros() - nStart, true);
+        throw;
+    }
+    catch (std::exception& e)
+    {
+        rpcMetrics.RecordCall(strMethod, GetTimeMicros() - nStart, true);
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
+Value JSONWriterValue(const std::string& strJSON)
+{
+    Value value;
+    if (!read_string(strJSON, value))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Error parsing streamed JSON");
+    return value;
+}
+
+bool CRPCTable::executeStream(const std::string &strMethod, const json_spirit::Array &params, std::string& strResult) const
+{
+    map<string, rpcstreamfn_type>::const_iterator it = mapStreamers.find(strMethod);
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (it == mapStreamers.end() || !pcmd)
+        return false;
+
+    CheckSafeMode(pcmd);
+
+    size_t nResultStart = strResult.size();
+    CJSONWriter out(strResult);
+    int64 nStart = GetTimeMicros();
+    try
+    {
+        bool fStreamed;
+        if (pcmd->unlocked)
+            fStreamed = it->second(params, out);
+        else {
+            LOCK2(cs_main, pwalletMain->cs_wallet);
+            fStreamed = it->second(params, out);
+        }
+        if (!fStreamed)
+        {
+            strResult.resize(nResultStart);
+            return false;
+        }
+        rpcMetrics.RecordCall(strMethod, GetTimeMicros() - nStart, false);
+        return true;
+    }
+    catch (Object& objError)
+    {
+        strResult.resize(nResultStart);
+        rpcMetrics.RecordCall(strMethod, GetTimeMicros() - nStart, true);
+        throw;
+    }
     catch (std::exception& e)
     {
+        strResult.resize(nResultStart);
+        rpcMetrics.RecordCall(strMethod, GetTimeMicros() - nStart, true);
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
 }
@@ -1208,6 +1698,8 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "getblockbynumber"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getblockhash"           && n > 0) ConvertTo<boost::int64_t>(params[0]);
+    if (strMethod == "getnetworkhashps"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
+    if (strMethod == "getchainstats"          && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "move"                   && n > 2) ConvertTo<double>(params[2]);
     if (strMethod == "move"                   && n > 3) ConvertTo<boost::int64_t>(params[3]);
     if (strMethod == "sendfrom"               && n > 2) ConvertTo<double>(params[2]);
@@ -1229,6 +1721,12 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "listunspent"            && n > 1) ConvertTo<boost::int64_t>(params[1]);
     if (strMethod == "listunspent"            && n > 2) ConvertTo<Array>(params[2]);
     if (strMethod == "getrawtransaction"      && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "getaddressutxos"        && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "getaddressutxos"        && n > 2) ConvertTo<boost::int64_t>(params[2]);
+    if (strMethod == "getaddresshistory"      && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "getaddresshistory"      && n > 2) ConvertTo<boost::int64_t>(params[2]);
+    if (strMethod == "getaddresshistory"      && n > 3) ConvertTo<boost::int64_t>(params[3]);
+    if (strMethod == "getaddresshistory"      && n > 4) ConvertTo<boost::int64_t>(params[4]);
     if (strMethod == "createrawtransaction"   && n > 0) ConvertTo<Array>(params[0]);
     if (strMethod == "createrawtransaction"   && n > 1) ConvertTo<Object>(params[1]);
     if (strMethod == "signrawtransaction"     && n > 1) ConvertTo<Array>(params[1], true);
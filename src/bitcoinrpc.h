@@ -9,6 +9,7 @@
 #include <string>
 #include <list>
 #include <map>
+#include <deque>
 
 class CBlockIndex;
 
@@ -23,11 +24,13 @@ class CBlockIndex;
 enum HTTPStatusCode
 {
     HTTP_OK                    = 200,
+    HTTP_NO_CONTENT            = 204,
     HTTP_BAD_REQUEST           = 400,
     HTTP_UNAUTHORIZED          = 401,
     HTTP_FORBIDDEN             = 403,
     HTTP_NOT_FOUND             = 404,
     HTTP_INTERNAL_SERVER_ERROR = 500,
+    HTTP_SERVICE_UNAVAILABLE   = 503,
 };
 
 // Bitcoin RPC error codes
@@ -68,9 +71,77 @@ enum RPCErrorCode
 
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
+// Connections are served by a fixed pool of worker threads fed from a bounded queue
+static const int DEFAULT_RPC_THREADS = 4;
+static const int DEFAULT_RPC_WORKQUEUE = 64;
+// Seconds an idle keep-alive connection is kept open
+static const int DEFAULT_RPC_KEEPALIVE = 30;
+
+class AcceptedConnection;
+
+struct CRPCQueuedConnection
+{
+    AcceptedConnection* conn;
+    int64 nIdleSince; // time of the last request served on it
+};
+
+/** Connections waiting for an RPC worker. New connections wait in a queue
+ * bounded by -rpcworkqueue and are refused once it is full. Idle keep-alive
+ * connections a worker hands back are parked in a separate list of the
+ * same bound, so they never crowd out new clients; a worker with nothing
+ * pending picks them up again to see whether they sent anything.
+ */
+class CRPCWorkQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<CRPCQueuedConnection> queue;
+    std::deque<CRPCQueuedConnection> parked;
+    size_t nMaxDepth;
+    size_t nPeakDepth;
+    int64 nRejected;
+    int64 nParkedClosed;
+    int nWorkers;
+    int nActive;
+
+public:
+    CRPCWorkQueue() : nMaxDepth(DEFAULT_RPC_WORKQUEUE), nPeakDepth(0), nRejected(0), nParkedClosed(0), nWorkers(0), nActive(0) {}
+
+    void SetMaxDepth(size_t nMaxDepthIn);
+
+    // A new connection. False if the queue is full, the caller refuses it then
+    bool Push(AcceptedConnection* conn, int64 nIdleSince);
+
+    // An idle keep-alive connection. False if too many are parked already,
+    // the caller closes it then
+    bool Park(AcceptedConnection* conn, int64 nIdleSince);
+
+    // Blocks until a connection is available, new ones first; false once shutting down
+    bool Pop(CRPCQueuedConnection& item);
+    void Done();
+
+    // Whether connections are waiting, pending or parked, so a worker should
+    // not sit on an idle one
+    bool Waiting();
+
+    void WorkerStarted();
+
+    // Returns all waiting connections so the caller can close them
+    void Drain(std::vector<AcceptedConnection*>& vConn);
+
+    void ToJSON(json_spirit::Object& result);
+};
+
 void ThreadRPCServer(void* parg);
 int CommandLineRPC(int argc, char *argv[]);
 
+// Run a JSON-RPC request body, a single call or a batch, and return the
+// reply text, empty if it was made of notifications only. Throws the error
+// object of a single call that failed, or of a malformed request; id is set
+// to the request's id for that error reply.
+std::string JSONRPCExecRequest(const json_spirit::Value& valRequest, json_spirit::Value& id);
+
 /** Convert parameter values for RPC call from strings to command-specific JSON objects. */
 json_spirit::Array RPCConvertValues(const std::string &strMethod, const std::vector<std::string> &strParams);
 
@@ -90,6 +161,17 @@ void RPCTypeCheck(const json_spirit::Object& o,
 
 typedef json_spirit::Value(*rpcfn_type)(const json_spirit::Array& params, bool fHelp);
 
+class CJSONWriter;
+
+// Optional streaming implementation of a command for large results: writes
+// the result with out and returns true, or returns false to leave these
+// params to the regular actor. Output must match the actor's byte for byte.
+typedef bool(*rpcstreamfn_type)(const json_spirit::Array& params, CJSONWriter& out);
+
+// Parse text written by a CJSONWriter. Actors that have a streaming
+// implementation build their tree result with it, so both share one serializer.
+json_spirit::Value JSONWriterValue(const std::string& strJSON);
+
 class CRPCCommand
 {
 public:
@@ -106,6 +188,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamers;
 public:
     CRPCTable();
     const CRPCCommand* operator[](std::string name) const;
@@ -119,6 +202,15 @@ public:
      * @throws an exception (json_spirit::Value) when an error happens.
      */
     json_spirit::Value execute(const std::string &method, const json_spirit::Array &params) const;
+
+    /**
+     * Execute a method through its streaming implementation, if it has one.
+     * @param strResult  The result JSON is appended here
+     * @returns false if the method has no streaming implementation or it
+     *          declined the params, strResult is left alone then.
+     * @throws the same as execute()
+     */
+    bool executeStream(const std::string &method, const json_spirit::Array &params, std::string& strResult) const;
 };
 
 extern const CRPCTable tableRPC;
@@ -128,7 +220,7 @@ extern int64 AmountFromValue(const json_spirit::Value& value);
 extern json_spirit::Value ValueFromAmount(int64 amount);
 extern double GetDifficulty(const CBlockIndex* blockindex = NULL);
 
-extern double GetPoSKernelPS();
+extern double GetPoSKernelPS(int nBlocks = 72);
 
 extern std::string HexBits(unsigned int nBits);
 extern std::string HelpRequiringPassphrase();
@@ -141,6 +233,7 @@ extern std::vector<unsigned char> ParseHexO(const json_spirit::Object& o, std::s
 
 extern json_spirit::Value getconnectioncount(const json_spirit::Array& params, bool fHelp); // in rpcnet.cpp
 extern json_spirit::Value getpeerinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getorphaninfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHelp); // in rpcdump.cpp
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendalert(const json_spirit::Array& params, bool fHelp);
@@ -173,6 +266,7 @@ extern json_spirit::Value addmultisigaddress(const json_spirit::Array& params, b
 extern json_spirit::Value listreceivedbyaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listreceivedbyaccount(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listtransactions(const json_spirit::Array& params, bool fHelp);
+extern bool listtransactions_stream(const json_spirit::Array& params, CJSONWriter& out);
 extern json_spirit::Value listaddressgroupings(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listaccounts(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listsinceblock(const json_spirit::Array& params, bool fHelp);
@@ -201,17 +295,24 @@ extern json_spirit::Value decoderawtransaction(const json_spirit::Array& params,
 
 extern json_spirit::Value signrawtransaction(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendrawtransaction(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressbalance(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddressutxos(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getaddresshistory(const json_spirit::Array& params, bool fHelp);
+extern bool getrawtransaction_stream(const json_spirit::Array& params, CJSONWriter& out);
 // in rpcblockchain.cpp
 extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value decryptsend(const json_spirit::Array& params, bool fHelp);
 // in rpcblockchain.cpp
 extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getchainstats(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockbynumber(const json_spirit::Array& params, bool fHelp);
+extern bool getblock_stream(const json_spirit::Array& params, CJSONWriter& out);
+extern bool getblockbynumber_stream(const json_spirit::Array& params, CJSONWriter& out);
 extern json_spirit::Value getcheckpoint(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnewstealthaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value liststealthaddresses(const json_spirit::Array& params, bool fHelp);
@@ -219,6 +320,7 @@ extern json_spirit::Value importstealthaddress(const json_spirit::Array& params,
 extern json_spirit::Value sendtostealthaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value clearwallettransactions(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value scanforalltxns(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value abortrescan(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value scanforstealthtxns(const json_spirit::Array& params, bool fHelp);
 
 #endif
@@ -0,0 +1,91 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bloom.h"
+
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double fpRate)
+{
+    double logFpRate = log(fpRate);
+    // Optimal number of hash functions for the false positive rate
+    nHashFuncs = max(1, min((int)floor(logFpRate / log(0.5) + 0.5), 50));
+    // Three generations of half the requested size are live at once
+    nEntriesPerGeneration = (max(nElements, 2U) + 1) / 2;
+    uint64 nMaxElements = nEntriesPerGeneration * 3;
+    // Bits per filter for that rate with nHashFuncs functions: -k * n / ln(1 - p^(1/k))
+    uint64 nFilterBits = (uint64)ceil(-1.0 * nHashFuncs * nMaxElements / log(1.0 - exp(logFpRate / nHashFuncs)));
+    // Each 64 bit word of a position is split over two planes of the generation number
+    vData.resize(((nFilterBits + 63) / 64) * 2);
+    reset();
+}
+
+void CRollingBloomFilter::reset()
+{
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+    fill(vData.begin(), vData.end(), 0);
+    RAND_bytes((unsigned char*)pnSalt1, sizeof(pnSalt1));
+    RAND_bytes((unsigned char*)pnSalt2, sizeof(pnSalt2));
+}
+
+// Position of the i-th probe: the word pair in the upper half, the bit
+// from the middle of the mixed value
+static inline void Probe(uint64 nHash1, uint64 nHash2, int i, size_t nPairs, size_t& nPair, int& nBit)
+{
+    uint64 x = (nHash1 + i * nHash2) * 0x9e3779b97f4a7c15ULL;
+    nPair = (size_t)(((x >> 32) * nPairs) >> 32);
+    nBit = (int)((x >> 26) & 63);
+}
+
+void CRollingBloomFilter::InsertHash(uint64 nHash1, uint64 nHash2)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration)
+    {
+        nEntriesThisGeneration = 0;
+        nGeneration++;
+        if (nGeneration == 4)
+            nGeneration = 1;
+        // Clear the bits of the generation about to be reused
+        uint64 nGenerationMask1 = 0 - (uint64)(nGeneration & 1);
+        uint64 nGenerationMask2 = 0 - (uint64)(nGeneration >> 1);
+        for (size_t p = 0; p < vData.size(); p += 2)
+        {
+            uint64 p1 = vData[p], p2 = vData[p + 1];
+            uint64 mask = (p1 ^ nGenerationMask1) | (p2 ^ nGenerationMask2);
+            vData[p] = p1 & mask;
+            vData[p + 1] = p2 & mask;
+        }
+    }
+    nEntriesThisGeneration++;
+
+    size_t nPairs = vData.size() / 2;
+    for (int i = 0; i < nHashFuncs; i++)
+    {
+        size_t nPair;
+        int nBit;
+        Probe(nHash1, nHash2, i, nPairs, nPair, nBit);
+        uint64 nMask = (uint64)1 << nBit;
+        vData[nPair * 2] = (vData[nPair * 2] & ~nMask) | ((uint64)(nGeneration & 1) << nBit);
+        vData[nPair * 2 + 1] = (vData[nPair * 2 + 1] & ~nMask) | ((uint64)(nGeneration >> 1) << nBit);
+    }
+}
+
+bool CRollingBloomFilter::ContainsHash(uint64 nHash1, uint64 nHash2) const
+{
+    size_t nPairs = vData.size() / 2;
+    for (int i = 0; i < nHashFuncs; i++)
+    {
+        size_t nPair;
+        int nBit;
+        Probe(nHash1, nHash2, i, nPairs, nPair, nBit);
+        // Generation zero means the bit is not set
+        if (!(((vData[nPair * 2] | vData[nPair * 2 + 1]) >> nBit) & 1))
+            return false;
+    }
+    return true;
+}
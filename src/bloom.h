@@ -0,0 +1,59 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOOM_H
+#define BITCOIN_BLOOM_H
+
+#include <vector>
+
+#include "hashmap.h"
+
+/** Probabilistic set of the most recent inserts, for "has this peer already
+ * seen it" questions where an occasional false yes is harmless.
+ *
+ * At least the last nElements inserts (and at most the last 1.5 * nElements)
+ * are always reported present; anything else is reported present with
+ * probability about fpRate. Every filter bit carries a two bit generation
+ * number, so forgetting the oldest third is one pass over the table rather
+ * than a second filter. Costs about 2 * 1.44 * log2(1/fpRate) * 1.5 bits per
+ * element: 11 bytes at one in a million, against over 100 for a set of CInv.
+ *
+ * Keys provide GetSaltedHash like CHashMap keys; the salts are random per
+ * filter so peers cannot aim false positives at one another.
+ */
+class CRollingBloomFilter
+{
+private:
+    int nEntriesPerGeneration;
+    int nEntriesThisGeneration;
+    int nGeneration;
+    int nHashFuncs;
+    std::vector<uint64> vData;
+    unsigned int pnSalt1[HASH_SALT_WORDS];
+    unsigned int pnSalt2[HASH_SALT_WORDS];
+
+    void InsertHash(uint64 nHash1, uint64 nHash2);
+    bool ContainsHash(uint64 nHash1, uint64 nHash2) const;
+
+public:
+    CRollingBloomFilter(unsigned int nElements, double fpRate);
+
+    template<typename T>
+    void insert(const T& key)
+    {
+        InsertHash(key.GetSaltedHash(pnSalt1), key.GetSaltedHash(pnSalt2));
+    }
+
+    template<typename T>
+    bool contains(const T& key) const
+    {
+        return ContainsHash(key.GetSaltedHash(pnSalt1), key.GetSaltedHash(pnSalt2));
+    }
+
+    // Forget everything and draw new salts
+    void reset();
+
+    size_t GetMemoryUsage() const { return vData.size() * sizeof(uint64); }
+};
+
+#endif
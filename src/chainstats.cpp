@@ -0,0 +1,214 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainstats.h"
+#include "main.h"
+
+#include <math.h>
+
+using namespace std;
+
+CChainStats chainStats;
+
+double GetDifficultyFromBits(unsigned int nBits)
+{
+    int nShift = (nBits >> 24) & 0xff;
+
+    double dDiff =
+        (double)0x0000ffff / (double)(nBits & 0x00ffffff);
+
+    while (nShift < 29)
+    {
+        dDiff *= 256.0;
+        nShift++;
+    }
+    while (nShift > 29)
+    {
+        dDiff /= 256.0;
+        nShift--;
+    }
+
+    return dDiff;
+}
+
+uint256 CChainStats::DifficultyFixed(unsigned int nBits)
+{
+    unsigned int nMantissa = nBits & 0x00ffffff;
+    if (nMantissa == 0)
+        return 0;
+
+    // 0x0000ffff / mantissa * 256^(29 - exponent). Exponents below 11 are
+    // targets under 2^80, which no block reaches; they are clamped so that
+    // a sum over any chain still fits in 256 bits
+    int nShift = DIFFICULTY_FRACTION_BITS + 8 * (29 - max((int)((nBits >> 24) & 0xff), 11));
+    uint256 nDifficulty = 0x0000ffff;
+    if (nShift >= 0)
+        nDifficulty <<= nShift;
+    else
+        nDifficulty >>= -nShift;
+    return nDifficulty / nMantissa;
+}
+
+// Sum of the difficulties of vEntries[nFirst] up to the newest
+double CChainStats::DifficultySum(const vector<CEntry>& vEntries, int nFirst)
+{
+    uint256 nSum = vEntries.back().nDifficultySum;
+    if (nFirst > 0)
+        nSum -= vEntries[nFirst - 1].nDifficultySum;
+    return ldexp(nSum.getdouble(), -DIFFICULTY_FRACTION_BITS);
+}
+
+bool CChainStats::Connect(CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (pindex->nHeight != (int)vChain.size() || (!vChain.empty() && pindex->pprev != vChain.back()))
+        return error("CChainStats::Connect() : block %d does not extend tip %d", pindex->nHeight, (int)vChain.size() - 1);
+
+    vector<CEntry>& vEntries = pindex->IsProofOfStake() ? vProofOfStake : vProofOfWork;
+    CEntry entry;
+    entry.pindex = pindex;
+    entry.nDifficultySum = DifficultyFixed(pindex->nBits);
+    if (!vEntries.empty())
+        entry.nDifficultySum += vEntries.back().nDifficultySum;
+
+    vChain.push_back(pindex);
+    vEntries.push_back(entry);
+    return true;
+}
+
+bool CChainStats::Disconnect(CBlockIndex* pindex)
+{
+    LOCK(cs);
+    if (vChain.empty() || vChain.back() != pindex)
+        return error("CChainStats::Disconnect() : block %d is not the tip", pindex->nHeight);
+
+    vector<CEntry>& vEntries = pindex->IsProofOfStake() ? vProofOfStake : vProofOfWork;
+    vChain.pop_back();
+    vEntries.pop_back();
+    return true;
+}
+
+void CChainStats::Clear()
+{
+    LOCK(cs);
+    vChain.clear();
+    vProofOfWork.clear();
+    vProofOfStake.clear();
+}
+
+void CChainStats::Rebuild(CBlockIndex* pindexTip)
+{
+    vector<CBlockIndex*> vPath;
+    for (CBlockIndex* pindex = pindexTip; pindex; pindex = pindex->pprev)
+        vPath.push_back(pindex);
+
+    LOCK(cs);
+    Clear();
+    vChain.reserve(vPath.size());
+    BOOST_REVERSE_FOREACH(CBlockIndex* pindex, vPath)
+        Connect(pindex);
+}
+
+int CChainStats::Height() const
+{
+    LOCK(cs);
+    return (int)vChain.size() - 1;
+}
+
+CBlockIndex* CChainStats::GetBlockByHeight(int nHeight) const
+{
+    LOCK(cs);
+    if (nHeight < 0 || nHeight >= (int)vChain.size())
+        return NULL;
+    return vChain[nHeight];
+}
+
+CBlockIndex* CChainStats::GetLastBlockIndex(bool fProofOfStake) const
+{
+    LOCK(cs);
+    const vector<CEntry>& vEntries = Entries(fProofOfStake);
+    if (!vEntries.empty())
+        return vEntries.back().pindex;
+    return vChain.empty() ? NULL : vChain.front();
+}
+
+double CChainStats::GetAverageDifficulty(bool fProofOfStake, int nBlocks) const
+{
+    LOCK(cs);
+    const vector<CEntry>& vEntries = Entries(fProofOfStake);
+    int nCount = min(nBlocks, (int)vEntries.size());
+    if (nCount <= 0)
+        return 0;
+
+    int nFirst = vEntries.size() - nCount;
+    return DifficultySum(vEntries, nFirst) / nCount;
+}
+
+double CChainStats::GetAverageSpacing(bool fProofOfStake, int nBlocks) const
+{
+    LOCK(cs);
+    const vector<CEntry>& vEntries = Entries(fProofOfStake);
+    int nCount = min(nBlocks, (int)vEntries.size());
+    if (nCount <= 1)
+        return 0;
+
+    int nFirst = vEntries.size() - nCount;
+    return (double)(vEntries.back().pindex->GetBlockTime() - vEntries[nFirst].pindex->GetBlockTime()) / (nCount - 1);
+}
+
+double CChainStats::GetPoSKernelPS(int nBlocks) const
+{
+    LOCK(cs);
+    int nCount = min(nBlocks, (int)vProofOfStake.size());
+    if (nCount <= 0)
+        return 0;
+
+    // Stake intervals telescope: the sum of the spacings between consecutive
+    // stakes in the window is just newest minus oldest stake time.
+    int nFirst = vProofOfStake.size() - nCount;
+    int nStakesTime = vProofOfStake.back().pindex->nTime - vProofOfStake[nFirst].pindex->nTime;
+    double dStakeKernelsTried = DifficultySum(vProofOfStake, nFirst) * 4294967296.0;
+
+    return nStakesTime ? dStakeKernelsTried / nStakesTime : 0;
+}
+
+int64 CChainStats::GetNetworkHashPS(int nBlocks) const
+{
+    LOCK(cs);
+    if (vChain.empty())
+        return 0;
+
+    int nHeight = vChain.size() - 1;
+
+    // If lookup is -1, then use blocks since last difficulty change.
+    if (nBlocks <= 0)
+        nBlocks = nHeight % 2016 + 1;
+
+    // If lookup is larger than chain, then set it to chain length.
+    if (nBlocks > nHeight)
+        nBlocks = nHeight;
+
+    double timeDiff = vChain.back()->GetBlockTime() - vChain[nHeight - nBlocks]->GetBlockTime();
+    if (nBlocks == 0 || timeDiff == 0)
+        return 0;
+    double timePerBlock = timeDiff / nBlocks;
+
+    const vector<CEntry>& vEntries = Entries(false);
+    double dDifficulty = vEntries.empty() ? 1.0 : GetDifficultyFromBits(vEntries.back().pindex->nBits);
+    return (int64)((dDifficulty * 4294967296.0) / timePerBlock);
+}
+
+int64 CChainStats::GetMoneySupplyChange(int nBlocks) const
+{
+    LOCK(cs);
+    if (vChain.empty())
+        return 0;
+
+    int nHeight = vChain.size() - 1;
+    if (nBlocks > nHeight)
+        return vChain.back()->nMoneySupply;
+    if (nBlocks <= 0)
+        return 0;
+    return vChain.back()->nMoneySupply - vChain[nHeight - nBlocks]->nMoneySupply;
+}
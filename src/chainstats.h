@@ -0,0 +1,95 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_CHAINSTATS_H
+#define BITCOIN_CHAINSTATS_H
+
+#include "sync.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <vector>
+
+class CBlockIndex;
+
+// Number of proof-of-stake blocks GetPoSKernelPS() averages over by default
+static const int CHAINSTATS_DEFAULT_POS_WINDOW = 72;
+
+// Floating point difficulty for a compact target, minimum difficulty = 1.0
+double GetDifficultyFromBits(unsigned int nBits);
+
+/** Rolling statistics over the main chain.
+ *
+ * Every block connected to the best chain appends one entry holding prefix
+ * sums from the genesis block; disconnecting pops it again. Any window over
+ * the last N blocks (or the last N proof-of-work / proof-of-stake blocks) is
+ * then the difference of two entries, so the mining and staking RPCs no
+ * longer walk pprev on every call. Kept in step with pindexBest by
+ * SetBestChain and Reorganize under cs_main.
+ */
+class CChainStats
+{
+private:
+    struct CEntry
+    {
+        CBlockIndex* pindex;
+        uint256 nDifficultySum; // sum of DifficultyFixed() for blocks of this kind
+    };
+
+    // GetDifficultyFromBits() in fixed point with DIFFICULTY_FRACTION_BITS
+    // fraction bits, so prefix sums stay exact however long the chain
+    static const int DIFFICULTY_FRACTION_BITS = 64;
+    static uint256 DifficultyFixed(unsigned int nBits);
+    static double DifficultySum(const std::vector<CEntry>& vEntries, int nFirst);
+
+    mutable CCriticalSection cs;
+    std::vector<CBlockIndex*> vChain;   // main chain by height
+    std::vector<CEntry> vProofOfWork;   // main chain proof-of-work blocks, oldest first
+    std::vector<CEntry> vProofOfStake;  // main chain proof-of-stake blocks, oldest first
+
+    const std::vector<CEntry>& Entries(bool fProofOfStake) const
+    {
+        return fProofOfStake ? vProofOfStake : vProofOfWork;
+    }
+
+public:
+    // Append pindex, which must extend the current tip
+    bool Connect(CBlockIndex* pindex);
+
+    // Remove pindex, which must be the current tip
+    bool Disconnect(CBlockIndex* pindex);
+
+    // Reset and refill from the genesis block up to pindexTip following pprev.
+    // Also how callers recover when Connect or Disconnect refuses a block
+    void Rebuild(CBlockIndex* pindexTip);
+
+    void Clear();
+
+    int Height() const;
+
+    // Main chain block at nHeight, or NULL if out of range
+    CBlockIndex* GetBlockByHeight(int nHeight) const;
+
+    // Most recent main chain block of the given kind, genesis if there is none
+    CBlockIndex* GetLastBlockIndex(bool fProofOfStake) const;
+
+    // Average difficulty of the last nBlocks blocks of the given kind
+    double GetAverageDifficulty(bool fProofOfStake, int nBlocks) const;
+
+    // Average spacing in seconds between the last nBlocks blocks of the given kind
+    double GetAverageSpacing(bool fProofOfStake, int nBlocks) const;
+
+    // Estimated stake kernels tried per second over the last nBlocks proof-of-stake blocks
+    double GetPoSKernelPS(int nBlocks=CHAINSTATS_DEFAULT_POS_WINDOW) const;
+
+    // Estimated network hashes per second over the last nBlocks blocks
+    // (-1 or 0 means since the last 2016-block boundary)
+    int64 GetNetworkHashPS(int nBlocks) const;
+
+    // Change in money supply over the last nBlocks blocks
+    int64 GetMoneySupplyChange(int nBlocks) const;
+};
+
+extern CChainStats chainStats;
+
+#endif
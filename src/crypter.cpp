@@ -18,6 +18,7 @@ bool CCrypter::SetKeyFromPassphrase(const SecureString& strKeyData, const std::v
     if (nRounds < 1 || chSalt.size() != WALLET_CRYPTO_SALT_SIZE)
         return false;
 
+    FreeContext();
     int i = 0;
     if (nDerivationMethod == 0)
         i = EVP_BytesToKey(EVP_aes_256_cbc(), EVP_sha512(), &chSalt[0],
@@ -39,6 +40,7 @@ bool CCrypter::SetKey(const CKeyingMaterial& chNewKey, const std::vector<unsigne
     if (chNewKey.size() != WALLET_CRYPTO_KEY_SIZE || chNewIV.size() != WALLET_CRYPTO_KEY_SIZE)
         return false;
 
+    FreeContext();
     memcpy(&chKey[0], &chNewKey[0], sizeof chKey);
     memcpy(&chIV[0], &chNewIV[0], sizeof chIV);
 
@@ -46,6 +48,43 @@ bool CCrypter::SetKey(const CKeyingMaterial& chNewKey, const std::vector<unsigne
     return true;
 }
 
+bool CCrypter::SetIV(const uint256& nIV)
+{
+    if (!fKeySet)
+        return false;
+
+    memcpy(&chIV[0], &nIV, sizeof chIV);
+    return true;
+}
+
+void CCrypter::FreeContext()
+{
+    // EVP_CIPHER_CTX_free cleanses the expanded key
+    if (ctx)
+        EVP_CIPHER_CTX_free(ctx);
+    ctx = NULL;
+    nCtxMode = 0;
+}
+
+bool CCrypter::InitContext(int nMode)
+{
+    if (!ctx)
+    {
+        ctx = EVP_CIPHER_CTX_new();
+        if (!ctx)
+            return false;
+    }
+
+    // Once the context holds the key for this direction only the IV is set
+    bool fOk;
+    if (nCtxMode == nMode)
+        fOk = EVP_CipherInit_ex(ctx, NULL, NULL, NULL, chIV, nMode == 1);
+    else
+        fOk = EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, chKey, chIV, nMode == 1);
+    nCtxMode = fOk ? nMode : 0;
+    return fOk;
+}
+
 bool CCrypter::Encrypt(const CKeyingMaterial& vchPlaintext, std::vector<unsigned char> &vchCiphertext)
 {
     if (!fKeySet)
@@ -57,17 +96,15 @@ bool CCrypter::Encrypt(const CKeyingMaterial& vchPlaintext, std::vector<unsigned
     int nCLen = nLen + AES_BLOCK_SIZE, nFLen = 0;
     vchCiphertext = std::vector<unsigned char> (nCLen);
 
-    EVP_CIPHER_CTX ctx;
-
-    bool fOk = true;
+    bool fOk = InitContext(1);
+    if (fOk) fOk = EVP_EncryptUpdate(ctx, &vchCiphertext[0], &nCLen, &vchPlaintext[0], nLen);
+    if (fOk) fOk = EVP_EncryptFinal_ex(ctx, (&vchCiphertext[0])+nCLen, &nFLen);
 
-    EVP_CIPHER_CTX_init(&ctx);
-    if (fOk) fOk = EVP_EncryptInit_ex(&ctx, EVP_aes_256_cbc(), NULL, chKey, chIV);
-    if (fOk) fOk = EVP_EncryptUpdate(&ctx, &vchCiphertext[0], &nCLen, &vchPlaintext[0], nLen);
-    if (fOk) fOk = EVP_EncryptFinal_ex(&ctx, (&vchCiphertext[0])+nCLen, &nFLen);
-    EVP_CIPHER_CTX_cleanup(&ctx);
-
-    if (!fOk) return false;
+    if (!fOk)
+    {
+        FreeContext();
+        return false;
+    }
 
     vchCiphertext.resize(nCLen + nFLen);
     return true;
@@ -84,17 +121,15 @@ bool CCrypter::Decrypt(const std::vector<unsigned char>& vchCiphertext, CKeyingM
 
     vchPlaintext = CKeyingMaterial(nPLen);
 
-    EVP_CIPHER_CTX ctx;
-
-    bool fOk = true;
-
-    EVP_CIPHER_CTX_init(&ctx);
-    if (fOk) fOk = EVP_DecryptInit_ex(&ctx, EVP_aes_256_cbc(), NULL, chKey, chIV);
-    if (fOk) fOk = EVP_DecryptUpdate(&ctx, &vchPlaintext[0], &nPLen, &vchCiphertext[0], nLen);
-    if (fOk) fOk = EVP_DecryptFinal_ex(&ctx, (&vchPlaintext[0])+nPLen, &nFLen);
-    EVP_CIPHER_CTX_cleanup(&ctx);
+    bool fOk = InitContext(2);
+    if (fOk) fOk = EVP_DecryptUpdate(ctx, &vchPlaintext[0], &nPLen, &vchCiphertext[0], nLen);
+    if (fOk) fOk = EVP_DecryptFinal_ex(ctx, (&vchPlaintext[0])+nPLen, &nFLen);
 
-    if (!fOk) return false;
+    if (!fOk)
+    {
+        FreeContext();
+        return false;
+    }
 
     vchPlaintext.resize(nPLen + nFLen);
     return true;
@@ -4,6 +4,8 @@
 #ifndef __CRYPTER_H__
 #define __CRYPTER_H__
 
+#include <openssl/evp.h>
+
 #include "allocators.h" /* for SecureString */
 #include "key.h"
 #include "serialize.h"
@@ -78,7 +80,10 @@ public:
 
 typedef std::vector<unsigned char, secure_allocator<unsigned char> > CKeyingMaterial;
 
-/** Encryption/decryption context with key information */
+/** Encryption/decryption context with key information.
+ * The cipher context, with the expanded key, is kept between calls, so
+ * decrypting many secrets under one key only changes the IV.
+ */
 class CCrypter
 {
 private:
@@ -86,14 +91,28 @@ private:
     unsigned char chIV[WALLET_CRYPTO_KEY_SIZE];
     bool fKeySet;
 
+    EVP_CIPHER_CTX* ctx;
+    // Direction ctx holds chKey for: 0 none, 1 encrypt, 2 decrypt
+    int nCtxMode;
+
+    bool InitContext(int nMode);
+    void FreeContext();
+
+    // Not copyable, as ctx is owned
+    CCrypter(const CCrypter&);
+    CCrypter& operator=(const CCrypter&);
+
 public:
     bool SetKeyFromPassphrase(const SecureString &strKeyData, const std::vector<unsigned char>& chSalt, const unsigned int nRounds, const unsigned int nDerivationMethod);
     bool Encrypt(const CKeyingMaterial& vchPlaintext, std::vector<unsigned char> &vchCiphertext);
     bool Decrypt(const std::vector<unsigned char>& vchCiphertext, CKeyingMaterial& vchPlaintext);
     bool SetKey(const CKeyingMaterial& chNewKey, const std::vector<unsigned char>& chNewIV);
+    // Keep the key, change the IV
+    bool SetIV(const uint256& nIV);
 
     void CleanKey()
     {
+        FreeContext();
         memset(&chKey, 0, sizeof chKey);
         memset(&chIV, 0, sizeof chIV);
         fKeySet = false;
@@ -102,6 +121,8 @@ public:
     CCrypter()
     {
         fKeySet = false;
+        ctx = NULL;
+        nCtxMode = 0;
 
         // Try to keep the key data out of swap (and be a bit over-careful to keep the IV that we don't even use out of swap)
         // Note that this does nothing about suspend-to-disk (which will put all our key data on disk)
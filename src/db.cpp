@@ -37,6 +37,9 @@ void CDBEnv::EnvShutdown()
         return;
 
     fDbEnvInit = false;
+    for (map<string, CDBJournal*>::iterator mi = mapJournal.begin(); mi != mapJournal.end(); mi++)
+        delete (*mi).second;
+    mapJournal.clear();
     int ret = dbenv.close(0);
     if (ret != 0)
         printf("EnvShutdown exception: %s (%d)\n", DbEnv::strerror(ret), ret);
@@ -214,8 +217,8 @@ void CDBEnv::CheckpointLSN(std::string strFile)
 }
 
 
-CDB::CDB(const char *pszFile, const char* pszMode) :
-    pdb(NULL), activeTxn(NULL)
+CDB::CDB(const char *pszFile, const char* pszMode, bool fJournal) :
+    pdb(NULL), activeTxn(NULL), pjournal(NULL), fJournalTxn(false)
 {
     int ret;
     if (pszFile == NULL)
@@ -233,6 +236,8 @@ CDB::CDB(const char *pszFile, const char* pszMode) :
             throw runtime_error("env open failed");
 
         strFile = pszFile;
+        if (fJournal && !bitdb.IsMock())
+            pjournal = bitdb.GetJournal(strFile);
         ++bitdb.mapFileUseCount[strFile];
         pdb = bitdb.mapDb[strFile];
         if (pdb == NULL)
@@ -261,6 +266,7 @@ CDB::CDB(const char *pszFile, const char* pszMode) :
                 pdb = NULL;
                 --bitdb.mapFileUseCount[strFile];
                 strFile = "";
+                pjournal = NULL;
                 throw runtime_error(strprintf("CDB() : can't open database file %s, error %d", pszFile, ret));
             }
 
@@ -292,8 +298,24 @@ void CDB::Close()
     if (activeTxn)
         activeTxn->abort();
     activeTxn = NULL;
+    fJournalTxn = false;
+    vJournalTxn.clear();
     pdb = NULL;
 
+    if (pjournal)
+    {
+        // The journal stands in for the checkpoint: the last handle to
+        // close makes every write so far durable, in one fsync
+        bool fLast;
+        {
+            LOCK(bitdb.cs_db);
+            fLast = (--bitdb.mapFileUseCount[strFile] == 0);
+        }
+        if (fLast)
+            pjournal->Commit();
+        return;
+    }
+
     // Flush database activity from memory pool to disk log
     unsigned int nMinutes = 0;
     if (fReadOnly)
@@ -311,6 +333,114 @@ void CDB::Close()
     }
 }
 
+CDBJournal::LookupResult CDB::ReadJournal(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    CDBJournal::data_type vchKey(ssKey.begin(), ssKey.end());
+    CDBJournal::data_type vchValue;
+    CDBJournal::LookupResult result = CDBJournal::NOT_FOUND;
+
+    // The active transaction's own writes come first
+    for (vector<CDBJournal::CRecord>::reverse_iterator it = vJournalTxn.rbegin(); it != vJournalTxn.rend(); it++)
+    {
+        if ((*it).vchKey == vchKey)
+        {
+            result = (*it).fErase ? CDBJournal::ERASED : CDBJournal::FOUND;
+            vchValue = (*it).vchValue;
+            break;
+        }
+    }
+    if (result == CDBJournal::NOT_FOUND)
+        result = pjournal->Lookup(vchKey, vchValue);
+
+    if (result == CDBJournal::FOUND)
+    {
+        ssValue.clear();
+        if (!vchValue.empty())
+            ssValue.write(&vchValue[0], vchValue.size());
+    }
+    return result;
+}
+
+bool CDB::WriteJournal(const CDataStream& ssKey, const CDataStream* pssValue)
+{
+    vector<CDBJournal::CRecord> vRecords(1);
+    CDBJournal::CRecord& record = vRecords[0];
+    record.fErase = (pssValue == NULL);
+    record.vchKey.assign(ssKey.begin(), ssKey.end());
+    if (pssValue)
+        record.vchValue.assign(pssValue->begin(), pssValue->end());
+
+    if (fJournalTxn)
+    {
+        vJournalTxn.push_back(record);
+        return true;
+    }
+    return pjournal->Append(vRecords);
+}
+
+bool CDB::CanIterate()
+{
+    if (!vJournalTxn.empty())
+        return error("CDB::CanIterate() : %s has uncommitted journaled writes", strFile.c_str());
+    return ApplyJournal();
+}
+
+bool CDB::ApplyJournal()
+{
+    if (!pdb || !pjournal)
+        return true;
+    return pjournal->Apply(pdb);
+}
+
+CDBJournal* CDBEnv::GetJournal(const string& strFile)
+{
+    LOCK(cs_db);
+    CDBJournal*& pjournal = mapJournal[strFile];
+    if (pjournal == NULL)
+    {
+        pjournal = new CDBJournal();
+        if (!pjournal->Open(pathEnv / (strFile + ".journal")))
+        {
+            // Fall back to writing the database directly
+            delete pjournal;
+            pjournal = NULL;
+            mapJournal.erase(strFile);
+        }
+    }
+    return pjournal;
+}
+
+uint64 CDBEnv::GetJournalSize(const string& strFile)
+{
+    LOCK(cs_db);
+    map<string, CDBJournal*>::iterator mi = mapJournal.find(strFile);
+    if (mi == mapJournal.end())
+        return 0;
+    return (*mi).second->GetSize();
+}
+
+bool CDBEnv::ApplyJournal(const string& strFile)
+{
+    LOCK(cs_db);
+    if (!mapJournal.count(strFile))
+        return true;
+    try {
+        CDB db(strFile.c_str(), "r+", true);
+        return db.ApplyJournal();
+    }
+    catch (std::exception &e) {
+        return error("CDBEnv::ApplyJournal() : %s", e.what());
+    }
+}
+
+void CDBEnv::TruncateJournal(const string& strFile)
+{
+    LOCK(cs_db);
+    map<string, CDBJournal*>::iterator mi = mapJournal.find(strFile);
+    if (mi != mapJournal.end())
+        (*mi).second->Truncate();
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
@@ -344,8 +474,11 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
             if (!bitdb.mapFileUseCount.count(strFile) || bitdb.mapFileUseCount[strFile] == 0)
             {
                 // Flush log data to the dat file
+                if (!bitdb.ApplyJournal(strFile))
+                    return false;
                 bitdb.CloseDb(strFile);
                 bitdb.CheckpointLSN(strFile);
+                bitdb.TruncateJournal(strFile);
                 bitdb.mapFileUseCount.erase(strFile);
 
                 bool fSuccess = true;
@@ -447,7 +580,8 @@ void CDBEnv::Flush(bool fShutdown)
             printf("%s refcount=%d\n", strFile.c_str(), nRefCount);
             if (nRefCount == 0)
             {
-                // Move log data to the dat file
+                // Move journal and log data to the dat file
+                bool fJournalApplied = ApplyJournal(strFile);
                 CloseDb(strFile);
                 printf("%s checkpoint\n", strFile.c_str());
                 dbenv.txn_checkpoint(0, 0, 0);
@@ -456,6 +590,8 @@ void CDBEnv::Flush(bool fShutdown)
                     if (!fMockDb)
                         dbenv.lsn_reset(strFile.c_str(), 0);
                 }
+                if (fJournalApplied)
+                    TruncateJournal(strFile);
                 printf("%s closed\n", strFile.c_str());
                 mapFileUseCount.erase(mi++);
             }
@@ -477,6 +613,258 @@ void CDBEnv::Flush(bool fShutdown)
 
 
 
+//
+// CDBJournal
+//
+
+// Record: size, payload (flags, key, value), first four bytes of the payload's hash
+bool CDBJournal::Open(const boost::filesystem::path& path)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    pathJournal = path;
+    mapPending.clear();
+
+    // Load the complete batches a previous run did not merge
+    uint64 nGood = 0;
+    int nRecords = 0;
+    FILE* filein = fopen(pathJournal.string().c_str(), "rb");
+    if (filein)
+    {
+        uint64 nPos = 0;
+        vector<CRecord> vBatch;
+        while (true)
+        {
+            unsigned int nSize, nCheck;
+            if (fread(&nSize, sizeof(nSize), 1, filein) != 1 || nSize > MAX_SIZE)
+                break;
+            data_type vchPayload(nSize);
+            if (nSize && fread(&vchPayload[0], 1, nSize, filein) != nSize)
+                break;
+            if (fread(&nCheck, sizeof(nCheck), 1, filein) != 1 ||
+                nCheck != (unsigned int)Hash(vchPayload.begin(), vchPayload.end()).Get64())
+                break;
+            nPos += sizeof(nSize) + nSize + sizeof(nCheck);
+
+            CDataStream ssPayload(vchPayload.begin(), vchPayload.end(), SER_DISK, CLIENT_VERSION);
+            unsigned char nFlags;
+            CRecord record;
+            try {
+                ssPayload >> nFlags >> record.vchKey >> record.vchValue;
+            }
+            catch (std::exception &e) {
+                break;
+            }
+            record.fErase = (nFlags & RECORD_ERASE);
+            vBatch.push_back(record);
+            if (nFlags & RECORD_LAST)
+            {
+                BOOST_FOREACH(const CRecord& recordBatch, vBatch)
+                    mapPending[recordBatch.vchKey] = recordBatch;
+                nRecords += vBatch.size();
+                vBatch.clear();
+                nGood = nPos;
+            }
+        }
+        fclose(filein);
+
+        // Drop a batch torn by a crash, so appends follow complete ones
+        try {
+            if (boost::filesystem::file_size(pathJournal) != nGood)
+            {
+                printf("CDBJournal::Open() : discarding incomplete batch at the end of %s\n", pathJournal.string().c_str());
+                boost::filesystem::resize_file(pathJournal, nGood);
+            }
+        }
+        catch (const boost::filesystem::filesystem_error &e) {
+            return error("CDBJournal::Open() : %s", e.what());
+        }
+    }
+
+    file = fopen(pathJournal.string().c_str(), "ab");
+    if (!file)
+        return error("CDBJournal::Open() : can't open %s", pathJournal.string().c_str());
+    nBytes = nGood;
+    nBytesApplied = 0;
+    if (nRecords)
+        printf("CDBJournal::Open() : %d records to merge from %s\n", nRecords, pathJournal.string().c_str());
+    return true;
+}
+
+void CDBJournal::Close()
+{
+    Commit();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fSyncing)
+        condSynced.wait(lock);
+    if (file)
+        fclose(file);
+    file = NULL;
+}
+
+bool CDBJournal::Append(const vector<CRecord>& vRecords)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!file)
+        return false;
+
+    CDataStream ssRecords(SER_DISK, CLIENT_VERSION);
+    for (unsigned int i = 0; i < vRecords.size(); i++)
+    {
+        const CRecord& record = vRecords[i];
+        unsigned char nFlags = (record.fErase ? RECORD_ERASE : 0) | (i + 1 == vRecords.size() ? RECORD_LAST : 0);
+        CDataStream ssPayload(SER_DISK, CLIENT_VERSION);
+        ssPayload << nFlags << record.vchKey << record.vchValue;
+        unsigned int nSize = ssPayload.size();
+        unsigned int nCheck = (unsigned int)Hash(ssPayload.begin(), ssPayload.end()).Get64();
+        ssRecords << nSize;
+        ssRecords.write(&ssPayload[0], nSize);
+        ssRecords << nCheck;
+    }
+    // Flushed, so only a crash of the system, not of the process, can lose
+    // a batch before Commit
+    if (fwrite(&ssRecords[0], 1, ssRecords.size(), file) != ssRecords.size() || fflush(file) != 0)
+    {
+        // Cut off the part of the batch that got out, and reopen so that no
+        // buffered rest of it lands behind later batches
+        while (fSyncing)
+            condSynced.wait(lock);
+        fclose(file);
+        file = NULL;
+        try {
+            boost::filesystem::resize_file(pathJournal, nBytes);
+        }
+        catch (const boost::filesystem::filesystem_error &e) {
+            return error("CDBJournal::Append() : write to %s failed, and can't truncate it: %s", pathJournal.string().c_str(), e.what());
+        }
+        file = fopen(pathJournal.string().c_str(), "ab");
+        return error("CDBJournal::Append() : write to %s failed", pathJournal.string().c_str());
+    }
+
+    BOOST_FOREACH(const CRecord& record, vRecords)
+        mapPending[record.vchKey] = record;
+    nAppended += vRecords.size();
+    nBytes += ssRecords.size();
+    return true;
+}
+
+bool CDBJournal::Commit()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    uint64 nTarget = nAppended;
+    while (nSynced < nTarget)
+    {
+        // Whoever finds no fsync running starts one for everything
+        // appended by then; the others wait for it
+        if (fSyncing)
+        {
+            condSynced.wait(lock);
+            continue;
+        }
+        if (!file)
+            return false;
+        fSyncing = true;
+        uint64 nSyncing = nAppended;
+        lock.unlock();
+        FileCommit(file);
+        lock.lock();
+        fSyncing = false;
+        nSynced = nSyncing;
+        condSynced.notify_all();
+    }
+    return true;
+}
+
+CDBJournal::LookupResult CDBJournal::Lookup(const data_type& vchKey, data_type& vchValue)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    map<data_type, CRecord>::const_iterator mi = mapPending.find(vchKey);
+    if (mi == mapPending.end())
+        return NOT_FOUND;
+    if ((*mi).second.fErase)
+        return ERASED;
+    vchValue = (*mi).second.vchValue;
+    return FOUND;
+}
+
+bool CDBJournal::Apply(Db* pdb)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (mapPending.empty())
+    {
+        nBytesApplied = nBytes;
+        return true;
+    }
+
+    // In transactions of a bounded number of records, to stay within the
+    // environment's lock limits. Records stay pending until all are in,
+    // and the journal keeps them until the database is checkpointed.
+    int64 nStart = GetTimeMillis();
+    map<data_type, CRecord>::iterator mi = mapPending.begin();
+    while (mi != mapPending.end())
+    {
+        DbTxn* ptxn = bitdb.TxnBegin();
+        if (!ptxn)
+            return error("CDBJournal::Apply() : TxnBegin failed");
+        for (int n = 0; n < 1000 && mi != mapPending.end(); n++, mi++)
+        {
+            CRecord& record = (*mi).second;
+            Dbt datKey(&record.vchKey[0], record.vchKey.size());
+            int ret;
+            if (record.fErase)
+            {
+                ret = pdb->del(ptxn, &datKey, 0);
+                if (ret == DB_NOTFOUND)
+                    ret = 0;
+            }
+            else
+            {
+                Dbt datValue(record.vchValue.empty() ? NULL : &record.vchValue[0], record.vchValue.size());
+                ret = pdb->put(ptxn, &datKey, &datValue, 0);
+            }
+            if (ret != 0)
+            {
+                ptxn->abort();
+                return error("CDBJournal::Apply() : error %d writing %s", ret, pathJournal.string().c_str());
+            }
+        }
+        if (ptxn->commit(0) != 0)
+            return error("CDBJournal::Apply() : TxnCommit failed");
+    }
+
+    printf("CDBJournal::Apply() : merged %"PRIszu" records  %"PRI64d"ms\n", mapPending.size(), GetTimeMillis() - nStart);
+    mapPending.clear();
+    nBytesApplied = nBytes;
+    return true;
+}
+
+bool CDBJournal::Truncate()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!file || !mapPending.empty() || nBytesApplied != nBytes)
+        return false;
+    if (nBytes == 0)
+        return true;
+
+    // Appends go to the end of the file, wherever that is
+    fflush(file);
+    try {
+        boost::filesystem::resize_file(pathJournal, 0);
+    }
+    catch (const boost::filesystem::filesystem_error &e) {
+        return error("CDBJournal::Truncate() : %s", e.what());
+    }
+    nBytes = nBytesApplied = 0;
+    return true;
+}
+
+uint64 CDBJournal::GetSize()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nBytes;
+}
+
+
+
 //
 // CAddrDB
 //
@@ -13,6 +13,9 @@
 
 #include <db_cxx.h>
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 class CAddress;
 class CAddrMan;
 class CBlockLocator;
@@ -29,6 +32,93 @@ extern unsigned int nWalletDBUpdated;
 void ThreadFlushWalletDB(void* parg);
 bool BackupWallet(const CWallet& wallet, const std::string& strDest);
 
+/** The journal is merged into the database once it is this large, even if
+ * the database never goes idle */
+static const uint64 DB_JOURNAL_COMPACT_SIZE = 16 * 1024 * 1024;
+
+/** Write-ahead journal in front of a Berkeley database (wallet.dat).
+ *
+ * Writes and erases are appended to <file>.journal and served from memory
+ * until CDBEnv merges them into the database, which it does in the
+ * background when the file is idle, then empties the journal. Commit makes
+ * everything appended so far durable with a single fsync that every thread
+ * committing meanwhile shares, instead of a database checkpoint per write.
+ * Records are appended in batches, each flushed to the operating system, so
+ * a crash of the process loses nothing appended and a crash of the system
+ * only what was not committed. After a crash only complete batches are
+ * loaded again.
+ */
+class CDBJournal
+{
+public:
+    typedef std::vector<char, zero_after_free_allocator<char> > data_type;
+
+    // A write or erase of a serialized key
+    struct CRecord
+    {
+        bool fErase;
+        data_type vchKey;
+        data_type vchValue;
+    };
+
+    enum LookupResult
+    {
+        NOT_FOUND,
+        FOUND,
+        ERASED,
+    };
+
+private:
+    enum
+    {
+        RECORD_ERASE = 1,
+        RECORD_LAST = 2, // last of a batch
+    };
+
+    boost::filesystem::path pathJournal;
+    FILE* file;
+    boost::mutex mutex;
+    boost::condition_variable condSynced;
+
+    // Latest record for each key not yet in the database
+    std::map<data_type, CRecord> mapPending;
+
+    // Records appended, and how many of them are known to be on disk
+    uint64 nAppended;
+    uint64 nSynced;
+    bool fSyncing;
+
+    // Size of the journal file, and what it was when last merged
+    uint64 nBytes;
+    uint64 nBytesApplied;
+
+public:
+    CDBJournal() : file(NULL), nAppended(0), nSynced(0), fSyncing(false), nBytes(0), nBytesApplied(0) {}
+    ~CDBJournal() { Close(); }
+
+    // Open the journal, loading what a previous run left in it
+    bool Open(const boost::filesystem::path& path);
+    void Close();
+
+    // Append records as one batch; on failure the file is cut back to
+    // the batches before it
+    bool Append(const std::vector<CRecord>& vRecords);
+
+    // Make all appended records durable
+    bool Commit();
+
+    LookupResult Lookup(const data_type& vchKey, data_type& vchValue);
+
+    // Write the pending records to the database
+    bool Apply(Db* pdb);
+
+    // Empty the journal once the database has been checkpointed with
+    // everything in it; does nothing if records came in since Apply
+    bool Truncate();
+
+    uint64 GetSize();
+};
+
 
 class CDBEnv
 {
@@ -46,6 +136,7 @@ public:
     DbEnv dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    std::map<std::string, CDBJournal*> mapJournal;
 
     CDBEnv();
     ~CDBEnv();
@@ -80,6 +171,14 @@ public:
     void CloseDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
+    // Journal of strFile, opened on first use; call with cs_db held
+    CDBJournal* GetJournal(const std::string& strFile);
+    uint64 GetJournalSize(const std::string& strFile);
+    // Merging a journal into its database: ApplyJournal before CloseDb,
+    // TruncateJournal after the checkpoint. Call with cs_db held.
+    bool ApplyJournal(const std::string& strFile);
+    void TruncateJournal(const std::string& strFile);
+
     DbTxn *TxnBegin(int flags=DB_TXN_WRITE_NOSYNC)
     {
         DbTxn* ptxn = NULL;
@@ -101,14 +200,30 @@ protected:
     std::string strFile;
     DbTxn *activeTxn;
     bool fReadOnly;
+    // Journal of the file, if it has one; writes go there instead
+    CDBJournal* pjournal;
+    // Writes of the transaction active on a journaled file
+    bool fJournalTxn;
+    std::vector<CDBJournal::CRecord> vJournalTxn;
 
-    explicit CDB(const char* pszFile, const char* pszMode="r+");
+    explicit CDB(const char* pszFile, const char* pszMode="r+", bool fJournal=false);
     ~CDB() { Close(); }
+
+    // Journaled files
+    CDBJournal::LookupResult ReadJournal(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteJournal(const CDataStream& ssKey, const CDataStream* pssValue);
+    // Cursors see only the database: merge the journal into it first. Writes
+    // of this handle's active transaction are not in either yet, so there is
+    // no cursor until it commits.
+    bool CanIterate();
 public:
     void Close();
+    // Write journaled records to the database
+    bool ApplyJournal();
 private:
     CDB(const CDB&);
     void operator=(const CDB&);
+    friend class CDBEnv;
 
 protected:
     template<typename K, typename T>
@@ -121,6 +236,24 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (pjournal)
+        {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            CDBJournal::LookupResult result = ReadJournal(ssKey, ssValue);
+            if (result == CDBJournal::ERASED)
+                return false;
+            if (result == CDBJournal::FOUND)
+            {
+                try {
+                    ssValue >> value;
+                }
+                catch (std::exception &e) {
+                    return false;
+                }
+                return true;
+            }
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -158,12 +291,19 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (pjournal)
+        {
+            if (!fOverwrite && Exists(key))
+                return false;
+            return WriteJournal(ssKey, &ssValue);
+        }
+        Dbt datKey(&ssKey[0], ssKey.size());
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -187,6 +327,8 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (pjournal)
+            return WriteJournal(ssKey, NULL);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -207,6 +349,13 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (pjournal)
+        {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            CDBJournal::LookupResult result = ReadJournal(ssKey, ssValue);
+            if (result != CDBJournal::NOT_FOUND)
+                return (result == CDBJournal::FOUND);
+        }
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -221,6 +370,8 @@ protected:
     {
         if (!pdb)
             return NULL;
+        if (!CanIterate())
+            return NULL;
         Dbc* pcursor = NULL;
         int ret = pdb->cursor(NULL, &pcursor, 0);
         if (ret != 0)
@@ -270,8 +421,13 @@ protected:
 public:
     bool TxnBegin()
     {
-        if (!pdb || activeTxn)
+        if (!pdb || activeTxn || fJournalTxn)
             return false;
+        if (pjournal)
+        {
+            fJournalTxn = true;
+            return true;
+        }
         DbTxn* ptxn = bitdb.TxnBegin();
         if (!ptxn)
             return false;
@@ -281,6 +437,13 @@ public:
 
     bool TxnCommit()
     {
+        if (pdb && fJournalTxn)
+        {
+            fJournalTxn = false;
+            bool fOk = vJournalTxn.empty() || pjournal->Append(vJournalTxn);
+            vJournalTxn.clear();
+            return fOk;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -290,6 +453,12 @@ public:
 
     bool TxnAbort()
     {
+        if (pdb && fJournalTxn)
+        {
+            fJournalTxn = false;
+            vJournalTxn.clear();
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -35,6 +35,11 @@
 #include <limits.h>
 
 #include "sph_echo.h"
+#include "sph_aesni.h"
+
+#if SPH_AESNI
+#include <wmmintrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C"{
@@ -719,11 +724,89 @@ echo_small_compress(sph_echo_small_context *sc)
 	COMPRESS_SMALL(sc);
 }
 
+#if SPH_AESNI
+
+/*
+ * Bytes times two in GF(2^8), as the 'abx' terms of MIX_COLUMN1.
+ */
+static SPH_TARGET_AESNI __m128i
+echo_xtime(__m128i x)
+{
+	__m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+
+	return _mm_xor_si128(_mm_add_epi8(x, x),
+		_mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+/*
+ * COMPRESS_BIG with each 128-bit word in a register. The first of the
+ * two AES rounds of BIG_SUB_WORDS is keyed by the counter, incremented
+ * as a 32-bit lane: the caller makes sure C0 does not wrap within the
+ * block. BIG_SHIFT_ROWS is a renaming of the words.
+ */
+static SPH_TARGET_AESNI void
+echo_big_compress_aesni(sph_echo_big_context *sc)
+{
+	__m128i W[16], T[16];
+	__m128i *V = (__m128i *)&sc->u;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+	__m128i K = _mm_set_epi32((int)sc->C3, (int)sc->C2,
+		(int)sc->C1, (int)sc->C0);
+	int u, r, c;
+
+	for (u = 0; u < 8; u ++) {
+		W[u] = _mm_loadu_si128(V + u);
+		W[u + 8] = _mm_loadu_si128((const __m128i *)sc->buf + u);
+	}
+	for (r = 0; r < 10; r ++) {
+		for (u = 0; u < 16; u ++) {
+			W[u] = _mm_aesenc_si128(W[u], K);
+			W[u] = _mm_aesenc_si128(W[u], zero);
+			K = _mm_add_epi32(K, one);
+		}
+		for (u = 0; u < 16; u ++)
+			T[u] = W[((((u >> 2) + (u & 3)) & 3) << 2) + (u & 3)];
+		for (c = 0; c < 16; c += 4) {
+			__m128i a = T[c + 0];
+			__m128i b = T[c + 1];
+			__m128i x = T[c + 2];
+			__m128i d = T[c + 3];
+			__m128i ab = _mm_xor_si128(a, b);
+			__m128i bc = _mm_xor_si128(b, x);
+			__m128i cd = _mm_xor_si128(x, d);
+			__m128i abx = echo_xtime(ab);
+			__m128i bcx = echo_xtime(bc);
+			__m128i cdx = echo_xtime(cd);
+
+			W[c + 0] = _mm_xor_si128(abx, _mm_xor_si128(bc, d));
+			W[c + 1] = _mm_xor_si128(bcx, _mm_xor_si128(a, cd));
+			W[c + 2] = _mm_xor_si128(cdx, _mm_xor_si128(ab, d));
+			W[c + 3] = _mm_xor_si128(_mm_xor_si128(abx, bcx),
+				_mm_xor_si128(_mm_xor_si128(cdx, ab), x));
+		}
+	}
+	for (u = 0; u < 8; u ++) {
+		__m128i m = _mm_loadu_si128((const __m128i *)sc->buf + u);
+
+		_mm_storeu_si128(V + u, _mm_xor_si128(_mm_loadu_si128(V + u),
+			_mm_xor_si128(m, _mm_xor_si128(W[u], W[u + 8]))));
+	}
+}
+
+#endif
+
 static void
 echo_big_compress(sph_echo_big_context *sc)
 {
 	DECL_STATE_BIG
 
+#if SPH_AESNI
+	if (sph_aesni_enabled() && sc->C0 <= SPH_C32(0xFFFFFFFF) - 160) {
+		echo_big_compress_aesni(sc);
+		return;
+	}
+#endif
 	COMPRESS_BIG(sc);
 }
 
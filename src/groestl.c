@@ -34,6 +34,12 @@
 #include <string.h>
 
 #include "sph_groestl.h"
+#include "sph_aesni.h"
+
+#if SPH_AESNI
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
 
 #ifdef __cplusplus
 extern "C"{
@@ -2870,6 +2876,278 @@ groestl_small_close(sph_groestl_small_context *sc,
 	groestl_small_init(sc, (unsigned)out_len << 3);
 }
 
+/*
+ * The AES-NI code keeps the 8x16 byte matrix by rows, one register for
+ * each, instead of by columns. AESENCLAST with a zero key then gives
+ * SubBytes after AES ShiftRows; one PSHUFB per row undoes ShiftRows and
+ * does ShiftBytes. MixBytes multiplies whole rows by the circulant
+ * coefficients with SSE2. Only the big (512-bit) functions use it.
+ */
+#define GROESTL_AESNI   (SPH_AESNI && USE_LE)
+
+#if GROESTL_AESNI
+
+/*
+ * PSHUFB masks for rows 0 to 7 of P and Q: byte d of the row after
+ * ShiftBytes is byte (d + shift) mod 16 before it, read back through
+ * the AES ShiftRows that AESENCLAST applied.
+ */
+static const unsigned char groestl_shift_p[8][16] __attribute__((aligned(16))) = {
+	{  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+	{ 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0 },
+	{ 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13 },
+	{  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10 },
+	{  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7 },
+	{  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4 },
+	{ 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1 },
+	{ 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2 }
+};
+
+static const unsigned char groestl_shift_q[8][16] __attribute__((aligned(16))) = {
+	{ 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0 },
+	{  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10 },
+	{  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4 },
+	{ 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2 },
+	{  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+	{ 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13 },
+	{  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7 },
+	{ 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1 }
+};
+
+static SPH_TARGET_AESNI __m128i
+groestl_xtime(__m128i x)
+{
+	__m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+
+	return _mm_xor_si128(_mm_add_epi8(x, x),
+		_mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+/*
+ * Transpose of the 8x8 matrix of 16-bit words in x[0..7]; its own
+ * inverse.
+ */
+static SPH_TARGET_AESNI void
+groestl_transpose(__m128i *x)
+{
+	__m128i b0, b1, b2, b3, b4, b5, b6, b7;
+	__m128i c0, c1, c2, c3, c4, c5, c6, c7;
+
+	b0 = _mm_unpacklo_epi16(x[0], x[1]);
+	b1 = _mm_unpackhi_epi16(x[0], x[1]);
+	b2 = _mm_unpacklo_epi16(x[2], x[3]);
+	b3 = _mm_unpackhi_epi16(x[2], x[3]);
+	b4 = _mm_unpacklo_epi16(x[4], x[5]);
+	b5 = _mm_unpackhi_epi16(x[4], x[5]);
+	b6 = _mm_unpacklo_epi16(x[6], x[7]);
+	b7 = _mm_unpackhi_epi16(x[6], x[7]);
+	c0 = _mm_unpacklo_epi32(b0, b2);
+	c1 = _mm_unpackhi_epi32(b0, b2);
+	c2 = _mm_unpacklo_epi32(b1, b3);
+	c3 = _mm_unpackhi_epi32(b1, b3);
+	c4 = _mm_unpacklo_epi32(b4, b6);
+	c5 = _mm_unpackhi_epi32(b4, b6);
+	c6 = _mm_unpacklo_epi32(b5, b7);
+	c7 = _mm_unpackhi_epi32(b5, b7);
+	x[0] = _mm_unpacklo_epi64(c0, c4);
+	x[1] = _mm_unpackhi_epi64(c0, c4);
+	x[2] = _mm_unpacklo_epi64(c1, c5);
+	x[3] = _mm_unpackhi_epi64(c1, c5);
+	x[4] = _mm_unpacklo_epi64(c2, c6);
+	x[5] = _mm_unpackhi_epi64(c2, c6);
+	x[6] = _mm_unpacklo_epi64(c3, c7);
+	x[7] = _mm_unpackhi_epi64(c3, c7);
+}
+
+/*
+ * Rows from the 128 bytes of 16 columns: each load of two columns is
+ * interleaved into 8 words of row bytes, then the words transposed.
+ */
+static SPH_TARGET_AESNI void
+groestl_load_rows(__m128i *R, const unsigned char *src)
+{
+	const __m128i pair = _mm_set_epi8(
+		15, 7, 14, 6, 13, 5, 12, 4, 11, 3, 10, 2, 9, 1, 8, 0);
+	int u;
+
+	for (u = 0; u < 8; u ++)
+		R[u] = _mm_shuffle_epi8(
+			_mm_loadu_si128((const __m128i *)src + u), pair);
+	groestl_transpose(R);
+}
+
+static SPH_TARGET_AESNI void
+groestl_store_rows(unsigned char *dst, __m128i *R)
+{
+	const __m128i unpair = _mm_set_epi8(
+		15, 13, 11, 9, 7, 5, 3, 1, 14, 12, 10, 8, 6, 4, 2, 0);
+	int u;
+
+	groestl_transpose(R);
+	for (u = 0; u < 8; u ++)
+		_mm_storeu_si128((__m128i *)dst + u,
+			_mm_shuffle_epi8(R[u], unpair));
+}
+
+/*
+ * Row i of the result is the sum over j of R[j] times coefficient
+ * (j - i) mod 8 of the circulant (02 02 03 04 05 03 05 07). With
+ * t[i] = R[i] + R[i+1], x[i] = t[i] + t[i+3] and
+ * y[i] = t[i] + t[i+2] + R[i+6], that is
+ * y[i+4] + 02 * (y[i+7] + 02 * x[i+3]): two doublings a row.
+ */
+#define GROESTL_MIX_BYTES(R)   do { \
+		__m128i t0, t1, t2, t3, t4, t5, t6, t7; \
+		__m128i x0, x1, x2, x3, x4, x5, x6, x7; \
+		__m128i y0, y1, y2, y3, y4, y5, y6, y7; \
+		t0 = _mm_xor_si128(R[0], R[1]); \
+		t1 = _mm_xor_si128(R[1], R[2]); \
+		t2 = _mm_xor_si128(R[2], R[3]); \
+		t3 = _mm_xor_si128(R[3], R[4]); \
+		t4 = _mm_xor_si128(R[4], R[5]); \
+		t5 = _mm_xor_si128(R[5], R[6]); \
+		t6 = _mm_xor_si128(R[6], R[7]); \
+		t7 = _mm_xor_si128(R[7], R[0]); \
+		x0 = _mm_xor_si128(t0, t3); \
+		x1 = _mm_xor_si128(t1, t4); \
+		x2 = _mm_xor_si128(t2, t5); \
+		x3 = _mm_xor_si128(t3, t6); \
+		x4 = _mm_xor_si128(t4, t7); \
+		x5 = _mm_xor_si128(t5, t0); \
+		x6 = _mm_xor_si128(t6, t1); \
+		x7 = _mm_xor_si128(t7, t2); \
+		y0 = _mm_xor_si128(_mm_xor_si128(t0, t2), R[6]); \
+		y1 = _mm_xor_si128(_mm_xor_si128(t1, t3), R[7]); \
+		y2 = _mm_xor_si128(_mm_xor_si128(t2, t4), R[0]); \
+		y3 = _mm_xor_si128(_mm_xor_si128(t3, t5), R[1]); \
+		y4 = _mm_xor_si128(_mm_xor_si128(t4, t6), R[2]); \
+		y5 = _mm_xor_si128(_mm_xor_si128(t5, t7), R[3]); \
+		y6 = _mm_xor_si128(_mm_xor_si128(t6, t0), R[4]); \
+		y7 = _mm_xor_si128(_mm_xor_si128(t7, t1), R[5]); \
+		R[0] = _mm_xor_si128(y4, groestl_xtime(_mm_xor_si128(y7, \
+			groestl_xtime(x3)))); \
+		R[1] = _mm_xor_si128(y5, groestl_xtime(_mm_xor_si128(y0, \
+			groestl_xtime(x4)))); \
+		R[2] = _mm_xor_si128(y6, groestl_xtime(_mm_xor_si128(y1, \
+			groestl_xtime(x5)))); \
+		R[3] = _mm_xor_si128(y7, groestl_xtime(_mm_xor_si128(y2, \
+			groestl_xtime(x6)))); \
+		R[4] = _mm_xor_si128(y0, groestl_xtime(_mm_xor_si128(y3, \
+			groestl_xtime(x7)))); \
+		R[5] = _mm_xor_si128(y1, groestl_xtime(_mm_xor_si128(y4, \
+			groestl_xtime(x0)))); \
+		R[6] = _mm_xor_si128(y2, groestl_xtime(_mm_xor_si128(y5, \
+			groestl_xtime(x1)))); \
+		R[7] = _mm_xor_si128(y3, groestl_xtime(_mm_xor_si128(y6, \
+			groestl_xtime(x2)))); \
+	} while (0)
+
+#define GROESTL_SUB_SHIFT(R, shift, i)   do { \
+		R[i] = _mm_shuffle_epi8(_mm_aesenclast_si128(R[i], zero), \
+			_mm_load_si128((const __m128i *)shift[i])); \
+	} while (0)
+
+#define GROESTL_SUB_SHIFT_ALL(R, shift)   do { \
+		GROESTL_SUB_SHIFT(R, shift, 0); \
+		GROESTL_SUB_SHIFT(R, shift, 1); \
+		GROESTL_SUB_SHIFT(R, shift, 2); \
+		GROESTL_SUB_SHIFT(R, shift, 3); \
+		GROESTL_SUB_SHIFT(R, shift, 4); \
+		GROESTL_SUB_SHIFT(R, shift, 5); \
+		GROESTL_SUB_SHIFT(R, shift, 6); \
+		GROESTL_SUB_SHIFT(R, shift, 7); \
+	} while (0)
+
+/*
+ * The permutations work on a local copy, which the compiler keeps in
+ * registers.
+ */
+static SPH_TARGET_AESNI void
+groestl_perm_big_p(__m128i *state)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i pc = _mm_set_epi32((int)0xF0E0D0C0, (int)0xB0A09080,
+		0x70605040, 0x30201000);
+	__m128i R[8];
+	int r;
+
+	memcpy(R, state, sizeof R);
+	for (r = 0; r < 14; r ++) {
+		R[0] = _mm_xor_si128(R[0],
+			_mm_xor_si128(pc, _mm_set1_epi8((char)r)));
+		GROESTL_SUB_SHIFT_ALL(R, groestl_shift_p);
+		GROESTL_MIX_BYTES(R);
+	}
+	memcpy(state, R, sizeof R);
+}
+
+static SPH_TARGET_AESNI void
+groestl_perm_big_q(__m128i *state)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8((char)0xFF);
+	const __m128i qc = _mm_xor_si128(ones, _mm_set_epi32((int)0xF0E0D0C0,
+		(int)0xB0A09080, 0x70605040, 0x30201000));
+	__m128i R[8];
+	int r;
+
+	memcpy(R, state, sizeof R);
+	for (r = 0; r < 14; r ++) {
+		R[0] = _mm_xor_si128(R[0], ones);
+		R[1] = _mm_xor_si128(R[1], ones);
+		R[2] = _mm_xor_si128(R[2], ones);
+		R[3] = _mm_xor_si128(R[3], ones);
+		R[4] = _mm_xor_si128(R[4], ones);
+		R[5] = _mm_xor_si128(R[5], ones);
+		R[6] = _mm_xor_si128(R[6], ones);
+		R[7] = _mm_xor_si128(R[7],
+			_mm_xor_si128(qc, _mm_set1_epi8((char)r)));
+		GROESTL_SUB_SHIFT_ALL(R, groestl_shift_q);
+		GROESTL_MIX_BYTES(R);
+	}
+	memcpy(state, R, sizeof R);
+}
+
+/*
+ * COMPRESS_BIG on the state and message as bytes, column after column.
+ */
+static SPH_TARGET_AESNI void
+groestl_big_compress_aesni(unsigned char *h, const unsigned char *m)
+{
+	__m128i H[8], G[8], M[8];
+	int u;
+
+	groestl_load_rows(H, h);
+	groestl_load_rows(M, m);
+	for (u = 0; u < 8; u ++)
+		G[u] = _mm_xor_si128(H[u], M[u]);
+	groestl_perm_big_p(G);
+	groestl_perm_big_q(M);
+	for (u = 0; u < 8; u ++)
+		H[u] = _mm_xor_si128(H[u], _mm_xor_si128(G[u], M[u]));
+	groestl_store_rows(h, H);
+}
+
+/*
+ * FINAL_BIG likewise.
+ */
+static SPH_TARGET_AESNI void
+groestl_big_final_aesni(unsigned char *h)
+{
+	__m128i H[8], X[8];
+	int u;
+
+	groestl_load_rows(H, h);
+	for (u = 0; u < 8; u ++)
+		X[u] = H[u];
+	groestl_perm_big_p(X);
+	for (u = 0; u < 8; u ++)
+		H[u] = _mm_xor_si128(H[u], X[u]);
+	groestl_store_rows(h, H);
+}
+
+#endif
+
 static void
 groestl_big_init(sph_groestl_big_context *sc, unsigned out_size)
 {
@@ -2908,6 +3186,9 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 {
 	unsigned char *buf;
 	size_t ptr;
+#if GROESTL_AESNI
+	int aesni;
+#endif
 	DECL_STATE_BIG
 
 	buf = sc->buf;
@@ -2919,6 +3200,9 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 		return;
 	}
 
+#if GROESTL_AESNI
+	aesni = sph_aesni_enabled();
+#endif
 	READ_STATE_BIG(sc);
 	while (len > 0) {
 		size_t clen;
@@ -2931,6 +3215,12 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 		data = (const unsigned char *)data + clen;
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
+#if GROESTL_AESNI
+			if (aesni)
+				groestl_big_compress_aesni(
+					(unsigned char *)H, buf);
+			else
+#endif
 			COMPRESS_BIG;
 #if SPH_64
 			sc->count ++;
@@ -2994,6 +3284,11 @@ groestl_big_close(sph_groestl_big_context *sc,
 #endif
 	groestl_big_core(sc, pad, pad_len);
 	READ_STATE_BIG(sc);
+#if GROESTL_AESNI
+	if (sph_aesni_enabled())
+		groestl_big_final_aesni((unsigned char *)H);
+	else
+#endif
 	FINAL_BIG;
 #if SPH_GROESTL_64
 	for (u = 0; u < 8; u ++)
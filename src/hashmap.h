@@ -0,0 +1,309 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_HASHMAP_H
+#define BITCOIN_HASHMAP_H
+
+#include <assert.h>
+#include <string.h>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+
+#include <openssl/rand.h>
+
+#include "uint256.h"
+
+/** Secret key for the salted hashes of hash table keys. Keys provide
+ * uint64 GetSaltedHash(const unsigned int* pnSalt) const, reading at most
+ * HASH_SALT_WORDS words of the salt.
+ */
+static const int HASH_SALT_WORDS = 20;
+
+/** STL-like unordered map for keys that are, or start with, a hash:
+ * uint256, COutPoint, CInv.
+ *
+ * Open addressing with linear probing over a compact array of slots that
+ * keep part of the hash next to a pointer to the entry, so a miss rarely
+ * touches an entry and a hit usually touches exactly one. Peers choose the
+ * hashes we look up, so the hash is keyed with a random salt that is
+ * redrawn on every rehash.
+ *
+ * Unlike std::map, iteration order is arbitrary and insertion may
+ * invalidate iterators. Entries are never moved, so references and
+ * pointers to keys and values stay valid until the entry is erased, and
+ * erasing leaves every other iterator valid (map.erase(it++) works).
+ */
+template <typename K, typename V> class CHashMap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private:
+    struct CSlot
+    {
+        value_type* pentry;     // NULL if empty, pDeleted() if erased
+        unsigned int nTag;      // low bits of the mixed hash
+    };
+
+    CSlot* pslots;
+    size_type nSlots;           // power of two, or 0
+    int nShift;                 // 64 - log2(nSlots)
+    size_type nSize;
+    size_type nDeleted;
+    unsigned int pnSalt[HASH_SALT_WORDS];
+
+    static value_type* pDeleted()
+    {
+        static char chDeleted;
+        return (value_type*)&chDeleted;
+    }
+
+    static bool IsEntry(const CSlot& slot)
+    {
+        return slot.pentry != NULL && slot.pentry != pDeleted();
+    }
+
+    uint64 Mix(const K& key) const
+    {
+        return key.GetSaltedHash(pnSalt) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    size_type Find(const K& key, uint64 nMixed) const
+    {
+        if (nSlots == 0)
+            return nSlots;
+        unsigned int nTag = (unsigned int)nMixed;
+        for (size_type i = (size_type)(nMixed >> nShift); ; i = (i + 1) & (nSlots - 1))
+        {
+            const CSlot& slot = pslots[i];
+            if (slot.pentry == NULL)
+                return nSlots;
+            if (slot.nTag == nTag && slot.pentry != pDeleted() && slot.pentry->first == key)
+                return i;
+        }
+    }
+
+    size_type Place(value_type* pentry, uint64 nMixed)
+    {
+        size_type i = (size_type)(nMixed >> nShift);
+        while (pslots[i].pentry != NULL)
+            i = (i + 1) & (nSlots - 1);
+        pslots[i].pentry = pentry;
+        pslots[i].nTag = (unsigned int)nMixed;
+        return i;
+    }
+
+    // Rebuild without erased slots at no more than half load, so the next
+    // rebuild is at least a quarter of the table's inserts away
+    void Rehash(size_type nCount)
+    {
+        size_type nNewSlots = 16;
+        while (nNewSlots < nCount * 2)
+            nNewSlots *= 2;
+        CSlot* pold = pslots;
+        size_type nOldSlots = nSlots;
+
+        pslots = new CSlot[nNewSlots];
+        memset(pslots, 0, nNewSlots * sizeof(CSlot));
+        nSlots = nNewSlots;
+        nShift = 64;
+        for (size_type n = nNewSlots; n > 1; n >>= 1)
+            nShift--;
+        nDeleted = 0;
+        RAND_bytes((unsigned char*)pnSalt, sizeof(pnSalt));
+
+        for (size_type i = 0; i < nOldSlots; i++)
+            if (IsEntry(pold[i]))
+                Place(pold[i].pentry, Mix(pold[i].pentry->first));
+        delete[] pold;
+    }
+
+    void Init()
+    {
+        pslots = NULL;
+        nSlots = 0;
+        nShift = 64;
+        nSize = 0;
+        nDeleted = 0;
+        memset(pnSalt, 0, sizeof(pnSalt));
+    }
+
+public:
+    class iterator;
+    class const_iterator;
+    friend class iterator;
+    friend class const_iterator;
+
+    class iterator : public std::iterator<std::forward_iterator_tag, value_type>
+    {
+    private:
+        CSlot* pslot;
+        CSlot* pend;
+        friend class CHashMap;
+        friend class const_iterator;
+
+        iterator(CSlot* pslotIn, CSlot* pendIn) : pslot(pslotIn), pend(pendIn)
+        {
+            while (pslot != pend && !IsEntry(*pslot))
+                pslot++;
+        }
+
+    public:
+        iterator() : pslot(NULL), pend(NULL) { }
+        value_type& operator*() const { return *pslot->pentry; }
+        value_type* operator->() const { return pslot->pentry; }
+        iterator& operator++()
+        {
+            do
+                pslot++;
+            while (pslot != pend && !IsEntry(*pslot));
+            return *this;
+        }
+        iterator operator++(int) { iterator ret = *this; ++*this; return ret; }
+        friend bool operator==(const iterator& a, const iterator& b) { return a.pslot == b.pslot; }
+        friend bool operator!=(const iterator& a, const iterator& b) { return a.pslot != b.pslot; }
+    };
+
+    class const_iterator : public std::iterator<std::forward_iterator_tag, const value_type>
+    {
+    private:
+        const CSlot* pslot;
+        const CSlot* pend;
+        friend class CHashMap;
+
+        const_iterator(const CSlot* pslotIn, const CSlot* pendIn) : pslot(pslotIn), pend(pendIn)
+        {
+            while (pslot != pend && !IsEntry(*pslot))
+                pslot++;
+        }
+
+    public:
+        const_iterator() : pslot(NULL), pend(NULL) { }
+        const_iterator(const iterator& it) : pslot(it.pslot), pend(it.pend) { }
+        const value_type& operator*() const { return *pslot->pentry; }
+        const value_type* operator->() const { return pslot->pentry; }
+        const_iterator& operator++()
+        {
+            do
+                pslot++;
+            while (pslot != pend && !IsEntry(*pslot));
+            return *this;
+        }
+        const_iterator operator++(int) { const_iterator ret = *this; ++*this; return ret; }
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.pslot == b.pslot; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.pslot != b.pslot; }
+    };
+
+    CHashMap() { Init(); }
+
+    CHashMap(const CHashMap& other)
+    {
+        Init();
+        *this = other;
+    }
+
+    CHashMap& operator=(const CHashMap& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            for (const_iterator it = other.begin(); it != other.end(); ++it)
+                insert(*it);
+        }
+        return *this;
+    }
+
+    ~CHashMap()
+    {
+        clear();
+    }
+
+    iterator begin() { return iterator(pslots, pslots + nSlots); }
+    iterator end() { return iterator(pslots + nSlots, pslots + nSlots); }
+    const_iterator begin() const { return const_iterator(pslots, pslots + nSlots); }
+    const_iterator end() const { return const_iterator(pslots + nSlots, pslots + nSlots); }
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const K& key)
+    {
+        return iterator(pslots + Find(key, Mix(key)), pslots + nSlots);
+    }
+
+    const_iterator find(const K& key) const
+    {
+        return const_iterator(pslots + Find(key, Mix(key)), pslots + nSlots);
+    }
+
+    size_type count(const K& key) const
+    {
+        return Find(key, Mix(key)) != nSlots ? 1 : 0;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        size_type i = Find(value.first, Mix(value.first));
+        if (i != nSlots)
+            return std::make_pair(iterator(pslots + i, pslots + nSlots), false);
+
+        if ((nSize + nDeleted + 1) * 4 > nSlots * 3)
+            Rehash(nSize + 1);
+        value_type* pentry = new value_type(value);
+        i = Place(pentry, Mix(value.first));
+        nSize++;
+        return std::make_pair(iterator(pslots + i, pslots + nSlots), true);
+    }
+
+    V& operator[](const K& key)
+    {
+        size_type i = Find(key, Mix(key));
+        if (i != nSlots)
+            return pslots[i].pentry->second;
+        return insert(value_type(key, V())).first->second;
+    }
+
+    void erase(iterator it)
+    {
+        CSlot* pslot = it.pslot;
+        assert(pslot != pslots + nSlots && IsEntry(*pslot));
+        delete pslot->pentry;
+        pslot->pentry = pDeleted();
+        nSize--;
+        nDeleted++;
+    }
+
+    size_type erase(const K& key)
+    {
+        size_type i = Find(key, Mix(key));
+        if (i == nSlots)
+            return 0;
+        erase(iterator(pslots + i, pslots + nSlots));
+        return 1;
+    }
+
+    void clear()
+    {
+        for (size_type i = 0; i < nSlots; i++)
+            if (IsEntry(pslots[i]))
+                delete pslots[i].pentry;
+        delete[] pslots;
+        Init();
+    }
+
+    void swap(CHashMap& other)
+    {
+        std::swap(pslots, other.pslots);
+        std::swap(nSlots, other.nSlots);
+        std::swap(nShift, other.nShift);
+        std::swap(nSize, other.nSize);
+        std::swap(nDeleted, other.nDeleted);
+        for (int i = 0; i < HASH_SALT_WORDS; i++)
+            std::swap(pnSalt[i], other.pnSalt[i]);
+    }
+};
+
+#endif
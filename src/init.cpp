@@ -11,6 +11,10 @@
 #include "util.h"
 #include "ui_interface.h"
 #include "checkpoints.h"
+#include "addrindex.h"
+#include "mempooldb.h"
+#include "orphans.h"
+#include "replay.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -83,6 +87,7 @@ void Shutdown(void* parg)
         nTransactionsUpdated++;
         bitdb.Flush(false);
         StopNode();
+        DumpMempool();
         bitdb.Flush(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
@@ -353,6 +358,10 @@ std::string HelpMessage()
         "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n" +
         "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n" +
         "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n" +
+        "  -maxorphantxmem=<n>    " + _("Maximum memory for orphan transactions, <n>*1000 bytes (default: 10000)") + "\n" +
+        "  -maxorphantxmempeer=<n> " + _("Maximum memory for orphan transactions from one peer, <n>*1000 bytes (default: 2000)") + "\n" +
+        "  -maxorphanblockmem=<n> " + _("Maximum memory for orphan blocks, <n>*1000 bytes (default: 64000)") + "\n" +
+        "  -maxorphanblockmempeer=<n> " + _("Maximum memory for orphan blocks from one peer, <n>*1000 bytes (default: 32000)") + "\n" +
 #ifdef USE_UPNP
 #if USE_UPNP
         "  -upnp                  " + _("Use UPnP to map the listening port (default: 1 when listening)") + "\n" +
@@ -384,6 +393,9 @@ std::string HelpMessage()
         "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 57603 or testnet: 46503)") + "\n" +
         "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n" +
         "  -rpcconnect=<ip>       " + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n" +
+        "  -rpcthreads=<n>        " + _("Number of threads serving RPC connections (default: 4)") + "\n" +
+        "  -rpcworkqueue=<n>      " + _("Connections waiting for an RPC thread before new ones are refused (default: 64)") + "\n" +
+        "  -rpckeepalive=<n>      " + _("Seconds an idle RPC keep-alive connection stays open (default: 30)") + "\n" +
         "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n" +
 		"  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n" +
         "  -upgradewallet         " + _("Upgrade wallet to latest format") + "\n" +
@@ -393,6 +405,12 @@ std::string HelpMessage()
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n" +
+        "  -replay=<file>         " + _("Replay the blocks of a bootstrap.dat or blk000?.dat file into an empty data directory, with no network, report the validation throughput and exit") + "\n" +
+        "  -replaystart=<n>       " + _("Connect the blocks up to height <n> before measuring (default: 0)") + "\n" +
+        "  -replaystop=<n>        " + _("Stop replaying at height <n> (default: end of file)") + "\n" +
+        "  -replayreport=<file>   " + _("Also write the replay report to <file> as JSON") + "\n" +
+        "  -addrindex             " + _("Maintain an address index for the getaddress* RPC calls (default: 0)") + "\n" +
+        "  -persistmempool        " + _("Keep the memory pool in mempool.dat across restarts (default: 1)") + "\n" +
 
         "\n" + _("Block creation options:") + "\n" +
         "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n" +
@@ -483,6 +501,9 @@ bool AppInit2()
         SoftSetBoolArg("-rescan", true);
     }
 
+    // -replay measures validation alone: nothing is listened on, tor is not started
+    bool fReplay = mapArgs.count("-replay") > 0;
+
     // ********************************************************* Step 3: parameter-to-internal-flags
 
     fDebug = GetBoolArg("-debug");
@@ -510,6 +531,9 @@ bool AppInit2()
 #if !defined(QT_GUI)
     fServer = true;
 #endif
+
+    fAddrIndex = GetBoolArg("-addrindex");
+
     fPrintToConsole = GetBoolArg("-printtoconsole");
     fPrintToDebugger = GetBoolArg("-printtodebugger");
     fLogTimestamps = GetBoolArg("-logtimestamps");
@@ -521,6 +545,11 @@ bool AppInit2()
             nConnectTimeout = nNewTimeout;
     }
 
+    orphanTxPool.SetLimits(GetArg("-maxorphantxmem", DEFAULT_MAX_ORPHAN_TX_MEMORY / 1000) * 1000,
+                           GetArg("-maxorphantxmempeer", DEFAULT_MAX_ORPHAN_TX_MEMORY_PEER / 1000) * 1000);
+    orphanBlockPool.SetLimits(GetArg("-maxorphanblockmem", DEFAULT_MAX_ORPHAN_BLOCK_MEMORY / 1000) * 1000,
+                              GetArg("-maxorphanblockmempeer", DEFAULT_MAX_ORPHAN_BLOCK_MEMORY_PEER / 1000) * 1000);
+
     // l.0 llog setup [
 
     llogSetup();
@@ -546,6 +575,9 @@ bool AppInit2()
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    if (!ECC_InitSanityCheck())
+        return InitError(_("Elliptic curve cryptography sanity check failure. Aborting."));
+
     std::string strDataDir = GetDataDir().string();
 
     // Make sure only a single Bitcoin process is using the data directory.
@@ -671,7 +703,7 @@ bool AppInit2()
     fNameLookup = GetBoolArg("-dns", true);
 
     bool fBound = false;
-    if (true) {
+    if (!fReplay) {
         if (true) {
             do {
                 CService addrBind;
@@ -690,7 +722,7 @@ bool AppInit2()
     //x x.1 disable-tor [
 
     // start up tor
-    if (!(mapArgs.count("-tor") && mapArgs["-tor"] != "0"))
+    if (!fReplay && !(mapArgs.count("-tor") && mapArgs["-tor"] != "0"))
     {
         if (!NewThread(StartTor, NULL))
             InitError(_("Error: could not start tor"));
@@ -803,6 +835,29 @@ bool AppInit2()
     }
     printf(" block index %15"PRI64d"ms\n", GetTimeMillis() - nStart);
 
+    if (fReplay)
+    {
+        // From the genesis block, so every run validates the same blocks
+        if (nBestHeight != 0)
+            return InitError(_("-replay needs an empty data directory"));
+        CBlockReplay replay(GetArg("-replaystart", 0), GetArg("-replaystop", -1));
+        if (!replay.Run(mapArgs["-replay"]))
+            return InitError(strprintf(_("Nothing was replayed from %s"), mapArgs["-replay"].c_str()));
+        string strReport = replay.GetReport();
+        printf("%s", strReport.c_str());
+        fprintf(stdout, "%s", strReport.c_str());
+        if (mapArgs.count("-replayreport"))
+        {
+            FILE* file = fopen(mapArgs["-replayreport"].c_str(), "w");
+            if (!file)
+                return InitError(strprintf(_("Cannot write %s"), mapArgs["-replayreport"].c_str()));
+            string strJSON = replay.GetReportJSON();
+            fwrite(strJSON.data(), 1, strJSON.size(), file);
+            fclose(file);
+        }
+        return false;
+    }
+
     if (GetBoolArg("-printblockindex") || GetBoolArg("-printblocktree"))
     {
         PrintBlockTree();
@@ -813,7 +868,7 @@ bool AppInit2()
     {
         string strMatch = mapArgs["-printblock"];
         int nFound = 0;
-        for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+        for (CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
         {
             uint256 hash = (*mi).first;
             if (strncmp(hash.ToString().c_str(), strMatch.c_str(), strMatch.size()) == 0)
@@ -911,8 +966,11 @@ bool AppInit2()
         uiInterface.InitMessage(_("Rescanning..."));
         printf("Rescanning last %i blocks (from block %i)...\n", pindexBest->nHeight - pindexRescan->nHeight, pindexRescan->nHeight);
         nStart = GetTimeMillis();
-        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+        bool fFailed;
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true, NULL, &fFailed);
         printf(" rescan      %15"PRI64d"ms\n", GetTimeMillis() - nStart);
+        if (fFailed)
+            InitWarning(_("Warning: rescan could not read a block, wallet transactions may be missing."));
     }
 
     // ********************************************************* Step 9: import blocks
@@ -976,6 +1034,12 @@ bool AppInit2()
     if (fServer)
         NewThread(ThreadRPCServer, NULL);
 
+    if (fAddrIndex && nAddrIndexHeight < nBestHeight)
+        NewThread(ThreadAddrIndexBuild, NULL);
+
+    if (GetBoolArg("-persistmempool", true))
+        NewThread(ThreadMempoolPersist, NULL);
+
     // ********************************************************* Step 12: finished
 
     uiInterface.InitMessage(_("Done loading"));
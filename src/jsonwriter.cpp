@@ -0,0 +1,180 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonwriter.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <wctype.h>
+
+using namespace std;
+
+static const char pszHexDigits[] = "0123456789abcdef";
+
+void CJSONWriter::Separate()
+{
+    if (fAfterKey)
+    {
+        fAfterKey = false;
+        return;
+    }
+    if (!vNeedComma.empty())
+    {
+        if (vNeedComma.back())
+            str += ',';
+        vNeedComma.back() = true;
+    }
+}
+
+void CJSONWriter::WriteEscaped(const char* psz, size_t nLen)
+{
+    // Mirrors json_spirit's add_esc_chars
+    str += '"';
+    for (size_t i = 0; i < nLen; i++)
+    {
+        char c = psz[i];
+        switch (c)
+        {
+            case '"':  str += "\\\""; continue;
+            case '\\': str += "\\\\"; continue;
+            case '\b': str += "\\b";  continue;
+            case '\f': str += "\\f";  continue;
+            case '\n': str += "\\n";  continue;
+            case '\r': str += "\\r";  continue;
+            case '\t': str += "\\t";  continue;
+        }
+
+        const wint_t unsigned_c((c >= 0) ? c : 256 + c);
+        if (iswprint(unsigned_c))
+        {
+            str += c;
+        }
+        else
+        {
+            char pszEsc[7] = { '\\', 'u', '0', '0',
+                               "0123456789ABCDEF"[(unsigned_c >> 4) & 0xf],
+                               "0123456789ABCDEF"[unsigned_c & 0xf], 0 };
+            str.append(pszEsc, 6);
+        }
+    }
+    str += '"';
+}
+
+void CJSONWriter::BeginObject()
+{
+    Separate();
+    str += '{';
+    vNeedComma.push_back(false);
+}
+
+void CJSONWriter::EndObject()
+{
+    assert(!vNeedComma.empty() && !fAfterKey);
+    vNeedComma.pop_back();
+    str += '}';
+}
+
+void CJSONWriter::BeginArray()
+{
+    Separate();
+    str += '[';
+    vNeedComma.push_back(false);
+}
+
+void CJSONWriter::EndArray()
+{
+    assert(!vNeedComma.empty() && !fAfterKey);
+    vNeedComma.pop_back();
+    str += ']';
+}
+
+void CJSONWriter::Key(const char* pszKey)
+{
+    assert(!fAfterKey);
+    Separate();
+    WriteEscaped(pszKey, strlen(pszKey));
+    str += ':';
+    fAfterKey = true;
+}
+
+void CJSONWriter::String(const char* pszValue)
+{
+    Separate();
+    WriteEscaped(pszValue, strlen(pszValue));
+}
+
+void CJSONWriter::Int(int64 n)
+{
+    Separate();
+    char buf[32];
+    int nLen = snprintf(buf, sizeof(buf), "%"PRI64d, n);
+    str.append(buf, nLen);
+}
+
+void CJSONWriter::UInt(uint64 n)
+{
+    Separate();
+    char buf[32];
+    int nLen = snprintf(buf, sizeof(buf), "%"PRI64u, n);
+    str.append(buf, nLen);
+}
+
+void CJSONWriter::Bool(bool f)
+{
+    Separate();
+    str += f ? "true" : "false";
+}
+
+void CJSONWriter::Null()
+{
+    Separate();
+    str += "null";
+}
+
+void CJSONWriter::Real(double d)
+{
+    Separate();
+    char buf[400]; // %f of the largest double has 309 integer digits
+    int nLen = snprintf(buf, sizeof(buf), "%.8f", d);
+    str.append(buf, nLen);
+}
+
+void CJSONWriter::Amount(int64 nAmount)
+{
+    // Goes through the same double as ValueFromAmount so large amounts
+    // round exactly like the json_spirit output
+    Real((double)nAmount / (double)COIN);
+}
+
+void CJSONWriter::Hash(const uint256& hash)
+{
+    Separate();
+    const unsigned char* p = (const unsigned char*)&hash;
+    char buf[sizeof(uint256) * 2 + 2];
+    buf[0] = '"';
+    for (unsigned int i = 0; i < sizeof(uint256); i++)
+    {
+        unsigned char c = p[sizeof(uint256) - i - 1];
+        buf[1 + i * 2] = pszHexDigits[c >> 4];
+        buf[2 + i * 2] = pszHexDigits[c & 0xf];
+    }
+    buf[sizeof(buf) - 1] = '"';
+    str.append(buf, sizeof(buf));
+}
+
+void CJSONWriter::Hex(const unsigned char* pbegin, const unsigned char* pend)
+{
+    Separate();
+    size_t nStart = str.size();
+    str.resize(nStart + (pend - pbegin) * 2 + 2);
+    char* p = &str[nStart];
+    *p++ = '"';
+    for (const unsigned char* pc = pbegin; pc != pend; pc++)
+    {
+        *p++ = pszHexDigits[*pc >> 4];
+        *p++ = pszHexDigits[*pc & 0xf];
+    }
+    *p = '"';
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_JSONWRITER_H
+#define BITCOIN_JSONWRITER_H
+
+#include "util.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+/** Streaming JSON writer for large RPC results.
+ *
+ * Appends compact JSON text to a string as it is produced instead of
+ * building a json_spirit tree first. The output is byte for byte what
+ * json_spirit::write_string(value, false) gives for the same members in the
+ * same order, including string escaping and the fixed 8 decimal reals, so
+ * streamed RPC replies look exactly like the ones they replace.
+ */
+class CJSONWriter
+{
+private:
+    std::string& str;
+    std::vector<bool> vNeedComma; // one per open object or array
+    bool fAfterKey;
+
+    void Separate();
+    void WriteEscaped(const char* psz, size_t nLen);
+
+public:
+    CJSONWriter(std::string& strOut) : str(strOut), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    void Key(const char* pszKey);
+    void Key(const std::string& strKey) { Key(strKey.c_str()); }
+
+    void String(const std::string& strValue) { Separate(); WriteEscaped(strValue.data(), strValue.size()); }
+    void String(const char* pszValue);
+    void Int(int64 n);
+    void UInt(uint64 n);
+    void Bool(bool f);
+    void Null();
+    // Formats like json_spirit reals: fixed with 8 decimals
+    void Real(double d);
+    // Same text as ValueFromAmount(nAmount) written through json_spirit
+    void Amount(int64 nAmount);
+    // uint256::GetHex() as a JSON string
+    void Hash(const uint256& hash);
+    // HexStr(pbegin, pend) as a JSON string
+    void Hex(const unsigned char* pbegin, const unsigned char* pend);
+    template<typename T>
+    void Hex(const T itbegin, const T itend)
+    {
+        if (itbegin == itend)
+            Hex((const unsigned char*)NULL, (const unsigned char*)NULL);
+        else
+            Hex((const unsigned char*)&itbegin[0], (const unsigned char*)&itbegin[0] + (itend - itbegin));
+    }
+    // Already serialized JSON value, e.g. from write_string
+    void Raw(const std::string& strJSON) { Separate(); str += strJSON; }
+    void Raw(const char* pszJSON, size_t nLen) { Separate(); str.append(pszJSON, nLen); }
+
+    // Length of the text written so far
+    size_t Size() const { return str.size(); }
+
+    // Key plus value in one call, for object members
+    void Pair(const char* pszKey, const std::string& strValue) { Key(pszKey); String(strValue); }
+    void Pair(const char* pszKey, const char* pszValue) { Key(pszKey); String(pszValue); }
+    void Pair(const char* pszKey, int n) { Key(pszKey); Int(n); }
+    void Pair(const char* pszKey, int64 n) { Key(pszKey); Int(n); }
+    void Pair(const char* pszKey, bool f) { Key(pszKey); Bool(f); }
+    void Pair(const char* pszKey, double d) { Key(pszKey); Real(d); }
+};
+
+#endif
@@ -262,6 +262,26 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier
     return true;
 }
 
+// 512 bits hold the product of a 256-bit target and a weight of at most 128
+// bits. A negative product is beaten by any hash, one past 256 bits by none.
+bool CheckStakeKernelProduct(const uint256& hashProofOfStake, const uint256& bnCoinDayWeight, bool fWeightNegative, unsigned int nBits, unsigned int nTargetMultiplier)
+{
+    bool fTargetNegative;
+    bool fTargetOverflow;
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits, &fTargetNegative, &fTargetOverflow);
+
+    // An overflowing target may have been shifted out to zero, but is not
+    bool fProductZero = bnCoinDayWeight == 0 || (bnTargetPerCoinDay == 0 && !fTargetOverflow);
+    bool fProductNegative = !fProductZero && fWeightNegative != fTargetNegative;
+    bool fProductOverflow = !fProductZero && fTargetOverflow;
+    if (fProductNegative)
+        return false;
+    if (fProductOverflow)
+        return true;
+    return uint512(hashProofOfStake) <= uint512(bnCoinDayWeight) * uint512(bnTargetPerCoinDay) * nTargetMultiplier;
+}
+
 // ppcoin kernel protocol
 // coinstake must meet hash target according to the protocol:
 // kernel (input 0) must meet the formula or something similar
@@ -301,8 +321,6 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     if (nTimeBlockFrom + GetStakeMinAge(nTimeBlockFrom) > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
 
-    CBigNum bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
     int64 nValueIn = txPrev.vout[prevout.n].nValue;
 
     // v0.3 protocol kernel hash weight starts from 0 at the min age
@@ -314,7 +332,9 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     else
         nTimeWeight = min((int64)nTimeTx - txPrev.nTime, (int64)GetStakeMaxAge(nTimeTx) + GetStakeMinAge(nTimeTx)) - GetStakeMinAge(nTimeTx);
 
-    CBigNum bnCoinDayWeight = CBigNum(nValueIn) * nTimeWeight / COIN / (24 * 60 * 60);
+    // By magnitude and sign, as the division rounds toward zero
+    bool fWeightNegative = (nValueIn < 0) != (nTimeWeight < 0);
+    uint256 bnCoinDayWeight = uint256(nValueIn < 0 ? -(uint64)nValueIn : nValueIn) * uint256(nTimeWeight < 0 ? -(uint64)nTimeWeight : nTimeWeight) / COIN / (24 * 60 * 60);
 
 	// printf(">>> CheckStakeKernelHash: nTimeWeight = %"PRI64d"\n", nTimeWeight);
     // Calculate hash
@@ -354,7 +374,6 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
 
     // Now check if proof-of-stake hash meets target protocol
     // The nTargetMultiplier of 10 is a calibration for stealth
-    CBigNum bnProduct = bnCoinDayWeight * bnTargetPerCoinDay * nTargetMultiplier;
 
 
 
@@ -367,16 +386,15 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     */
 
 
-    if (CBigNum(hashProofOfStake) > bnProduct)
+    if (!CheckStakeKernelProduct(hashProofOfStake, bnCoinDayWeight, fWeightNegative, nBits, nTargetMultiplier))
 	{
 		if(fDebug)
 		{
-		 printf(">>> bnCoinDayWeight = %s, bnTargetPerCoinDay=%s\n>>> too small:<bnProduct=%s>\n", 
+		 printf(">>> bnCoinDayWeight = %s, nBits=%08x\n>>> too small\n", 
 			bnCoinDayWeight.ToString().c_str(),
-                        bnTargetPerCoinDay.ToString().c_str(),
-                        bnProduct.ToString().c_str()); 
+                        nBits); 
 		 printf(">>> CheckStakeKernelHash - hashProofOfStake too much\n");
-		 printf(">>> hashProofOfStake too much: %s\n", CBigNum(hashProofOfStake).ToString().c_str());
+		 printf(">>> hashProofOfStake too much: %s\n", hashProofOfStake.ToString().c_str());
 		}
         return false;
 	}
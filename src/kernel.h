@@ -17,6 +17,10 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Check whether hashProofOfStake is within the coin day weight times the
+// target of nBits times nTargetMultiplier, as CBigNum arithmetic has it
+bool CheckStakeKernelProduct(const uint256& hashProofOfStake, const uint256& bnCoinDayWeight, bool fWeightNegative, unsigned int nBits, unsigned int nTargetMultiplier);
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake=false);
@@ -8,6 +8,7 @@
 #include <openssl/obj_mac.h>
 
 #include "key.h"
+#include "secp256k1.h"
 
 // Generate a private key from just the secret parameter
 int EC_KEY_regenerate_key(EC_KEY *eckey, BIGNUM *priv_key)
@@ -160,6 +161,7 @@ CKey::CKey(const CKey& b)
     if (pkey == NULL)
         throw key_error("CKey::CKey(const CKey&) : EC_KEY_dup failed");
     fSet = b.fSet;
+    fCompressedPubKey = b.fCompressedPubKey;
 }
 
 CKey& CKey::operator=(const CKey& b)
@@ -167,6 +169,7 @@ CKey& CKey::operator=(const CKey& b)
     if (!EC_KEY_copy(pkey, b.pkey))
         throw key_error("CKey::operator=(const CKey&) : EC_KEY_copy failed");
     fSet = b.fSet;
+    fCompressedPubKey = b.fCompressedPubKey;
     return (*this);
 }
 
@@ -244,7 +247,7 @@ void CKey::MakeNewKey(bool fCompressed)
     fSet = true;
 }
 
-bool CKey::SetPrivKey(const CPrivKey& vchPrivKey)
+bool CKey::SetPrivKey(const CPrivKey& vchPrivKey, bool fSkipCheck)
 {
     const unsigned char* pbegin = &vchPrivKey[0];
     if (d2i_ECPrivateKey(&pkey, &pbegin, vchPrivKey.size()))
@@ -252,7 +255,7 @@ bool CKey::SetPrivKey(const CPrivKey& vchPrivKey)
         // In testing, d2i_ECPrivateKey can return true
         // but fill in pkey with a key that fails
         // EC_KEY_check_key, so:
-        if (EC_KEY_check_key(pkey))
+        if (fSkipCheck || EC_KEY_check_key(pkey))
         {
             fSet = true;
             return true;
@@ -290,6 +293,24 @@ bool CKey::SetSecret(const CSecret& vchSecret, bool fCompressed)
     return true;
 }
 
+bool CKey::SetKeyPair(const CSecret& vchSecret, const CPubKey& vchPubKey)
+{
+    Reset();
+    if (vchSecret.size() != 32 || !SetPubKey(vchPubKey))
+        return false;
+    BIGNUM *bn = BN_bin2bn(&vchSecret[0],32,BN_new());
+    if (bn == NULL)
+        throw key_error("CKey::SetKeyPair() : BN_bin2bn failed");
+    bool fOk = EC_KEY_set_private_key(pkey, bn);
+    BN_clear_free(bn);
+    if (!fOk)
+    {
+        Reset();
+        return false;
+    }
+    return true;
+}
+
 CSecret CKey::GetSecret(bool &fCompressed) const
 {
     CSecret vchRet;
@@ -428,33 +449,36 @@ bool CKey::SetCompactSignature(uint256 hash, const std::vector<unsigned char>& v
     int nV = vchSig[0];
     if (nV<27 || nV>=35)
         return false;
-    ECDSA_SIG *sig = ECDSA_SIG_new();
-    BN_bin2bn(&vchSig[1],32,sig->r);
-    BN_bin2bn(&vchSig[33],32,sig->s);
-
-    EC_KEY_free(pkey);
-    pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    bool fCompressed = false;
     if (nV >= 31)
     {
-        SetCompressedPubKey();
+        fCompressed = true;
         nV -= 4;
     }
-    if (ECDSA_SIG_recover_key_GFp(pkey, sig, (unsigned char*)&hash, sizeof(hash), nV - 27, 0) == 1)
-    {
-        fSet = true;
-        ECDSA_SIG_free(sig);
-        return true;
-    }
-    return false;
+    CECPoint point;
+    if (!ECRecoverCompact(hash, &vchSig[1], nV - 27, point))
+        return false;
+    std::vector<unsigned char> vchPubKey;
+    ECSerializePubKey(point, fCompressed, vchPubKey);
+    Reset();
+    return SetPubKey(CPubKey(vchPubKey));
 }
 
-bool CKey::Verify(uint256 hash, const std::vector<unsigned char>& vchSig)
+bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
 {
-    // -1 = error, 0 = bad sig, 1 = good
-    if (ECDSA_verify(0, (unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) != 1)
+    if (vchPubKey.empty() || vchSig.empty())
         return false;
+    CECPoint point;
+    if (!ECParsePubKey(&vchPubKey[0], vchPubKey.size(), point))
+        return false;
+    return ECVerify(point, hash, &vchSig[0], vchSig.size());
+}
 
-    return true;
+bool CKey::Verify(uint256 hash, const std::vector<unsigned char>& vchSig)
+{
+    if (!fSet)
+        return false;
+    return GetPubKey().Verify(hash, vchSig);
 }
 
 bool CKey::VerifyCompact(uint256 hash, const std::vector<unsigned char>& vchSig)
@@ -490,5 +514,5 @@ bool ECC_InitSanityCheck() {
     EC_KEY_free(pkey);
 
     // TODO Is there more EC functionality that could be missing?
-    return true;
+    return ECSelfTest();
 }
@@ -96,6 +96,9 @@ public:
     std::vector<unsigned char> Raw() const {
         return vchPubKey;
     }
+
+    // Check a DER signature of hash, without going through OpenSSL
+    bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 };
 
 
@@ -132,8 +135,13 @@ public:
     bool IsCompressed() const;
 
     void MakeNewKey(bool fCompressed);
-    bool SetPrivKey(const CPrivKey& vchPrivKey);
+    // fSkipCheck leaves checking that the secret matches the public key to
+    // the caller, as the wallet does when loading keys
+    bool SetPrivKey(const CPrivKey& vchPrivKey, bool fSkipCheck=false);
     bool SetSecret(const CSecret& vchSecret, bool fCompressed = false);
+    // Set from a secret and the public key known to go with it, without
+    // the EC multiplication SetSecret does to derive the public key
+    bool SetKeyPair(const CSecret& vchSecret, const CPubKey& vchPubKey);
     CSecret GetSecret(bool &fCompressed) const;
     CPrivKey GetPrivKey() const;
     bool SetPubKey(const CPubKey& vchPubKey);
@@ -161,7 +169,9 @@ public:
     bool IsValid();
 
     static bool CheckSignatureElement(const unsigned char *vch, int len, bool half);
-    bool ECC_InitSanityCheck(void);
 };
 
+// Check that the OpenSSL curve and the verification code both work
+bool ECC_InitSanityCheck();
+
 #endif
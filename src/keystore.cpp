@@ -60,6 +60,16 @@ bool CBasicKeyStore::GetCScript(const CScriptID &hash, CScript& redeemScriptOut)
     return false;
 }
 
+void CBasicKeyStore::GetCScripts(std::set<CScriptID> &setScripts) const
+{
+    setScripts.clear();
+    {
+        LOCK(cs_KeyStore);
+        for (ScriptMap::const_iterator mi = mapScripts.begin(); mi != mapScripts.end(); mi++)
+            setScripts.insert((*mi).first);
+    }
+}
+
 bool CCryptoKeyStore::SetCrypted()
 {
     {
@@ -81,12 +91,27 @@ bool CCryptoKeyStore::LockKeyStore()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        crypterKeys.CleanKey();
+        mapSecretCache.clear();
     }
 
     NotifyStatusChanged(this);
     return true;
 }
 
+// Keys Unlock decrypts to check the master key; the rest are checked as
+// GetKey first decrypts them
+static const unsigned int UNLOCK_CHECK_KEYS = 4;
+
+static bool DecryptKey(CCrypter& crypter, const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, CSecret& vchSecret)
+{
+    if (vchCryptedSecret.empty() || !crypter.SetIV(vchPubKey.GetHash()))
+        return false;
+    if (!crypter.Decrypt(vchCryptedSecret, *((CKeyingMaterial*)&vchSecret)))
+        return false;
+    return vchSecret.size() == 32;
+}
+
 bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 {
     {
@@ -94,24 +119,31 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
         if (!SetCrypted())
             return false;
 
+        CCrypter crypter;
+        if (!crypter.SetKey(vMasterKeyIn, std::vector<unsigned char>(WALLET_CRYPTO_KEY_SIZE)))
+            return false;
+        unsigned int nChecked = 0;
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi)
+        for (; mi != mapCryptedKeys.end() && nChecked < UNLOCK_CHECK_KEYS; ++mi)
         {
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
+            // Stealth keys wait for their secret
+            if (vchCryptedSecret.empty())
+                continue;
             CSecret vchSecret;
-            if(!DecryptSecret(vMasterKeyIn, vchCryptedSecret, vchPubKey.GetHash(), vchSecret))
-                return false;
-            if (vchSecret.size() != 32)
+            if (!DecryptKey(crypter, vchPubKey, vchCryptedSecret, vchSecret))
                 return false;
             CKey key;
             key.SetPubKey(vchPubKey);
             key.SetSecret(vchSecret);
-            if (key.GetPubKey() == vchPubKey)
-                break;
-            return false;
+            if (key.GetPubKey() != vchPubKey)
+                return false;
+            nChecked++;
         }
         vMasterKey = vMasterKeyIn;
+        crypterKeys.SetKey(vMasterKey, std::vector<unsigned char>(WALLET_CRYPTO_KEY_SIZE));
+        mapSecretCache.clear();
     }
     NotifyStatusChanged(this);
     return true;
@@ -148,6 +180,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey &vchPubKey, const std::vector<
             return false;
 
         mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+        mapSecretCache.erase(vchPubKey.GetID());
     }
     return true;
 }
@@ -163,14 +196,21 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
         if (mi != mapCryptedKeys.end())
         {
             const CPubKey &vchPubKey = (*mi).second.first;
+            std::map<CKeyID, CSecret>::const_iterator ci = mapSecretCache.find(address);
+            if (ci != mapSecretCache.end())
+                return keyOut.SetKeyPair((*ci).second, vchPubKey);
+
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
             CSecret vchSecret;
-            if (!DecryptSecret(vMasterKey, vchCryptedSecret, vchPubKey.GetHash(), vchSecret))
-                return false;
-            if (vchSecret.size() != 32)
+            if (vMasterKey.empty() || !DecryptKey(crypterKeys, vchPubKey, vchCryptedSecret, vchSecret))
                 return false;
+            keyOut.Reset();
             keyOut.SetPubKey(vchPubKey);
             keyOut.SetSecret(vchSecret);
+            // Unlock only checked a few keys against the master key
+            if (keyOut.GetPubKey() != vchPubKey)
+                return error("CCryptoKeyStore::GetKey() : secret does not match key %s", address.ToString().c_str());
+            mapSecretCache[address] = vchSecret;
             return true;
         }
     }
@@ -208,6 +248,8 @@ bool CCryptoKeyStore::EncryptKeys(CKeyingMaterial& vMasterKeyIn)
             if (!key.SetSecret(mKey.second.first, mKey.second.second))
                 return false;
             const CPubKey vchPubKey = key.GetPubKey();
+            if (vchPubKey.GetID() != mKey.first)
+                return error("CCryptoKeyStore::EncryptKeys() : secret does not match key %s", mKey.first.ToString().c_str());
             std::vector<unsigned char> vchCryptedSecret;
             bool fCompressed;
             if (!EncryptSecret(vMasterKeyIn, key.GetSecret(fCompressed), vchPubKey.GetHash(), vchCryptedSecret))
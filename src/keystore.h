@@ -87,6 +87,10 @@ public:
             {
                 keyOut.Reset();
                 keyOut.SetSecret((*mi).second.first, (*mi).second.second);
+                // Keys are loaded without checking the secret against the
+                // public key; this is where a corrupt one shows
+                if (keyOut.GetPubKey().GetID() != address)
+                    return error("CBasicKeyStore::GetKey() : secret does not match key %s", address.ToString().c_str());
                 return true;
             }
         }
@@ -95,6 +99,7 @@ public:
     virtual bool AddCScript(const CScript& redeemScript);
     virtual bool HaveCScript(const CScriptID &hash) const;
     virtual bool GetCScript(const CScriptID &hash, CScript& redeemScriptOut) const;
+    void GetCScripts(std::set<CScriptID> &setScripts) const;
 };
 
 typedef std::map<CKeyID, std::pair<CPubKey, std::vector<unsigned char> > > CryptedKeyMap;
@@ -116,6 +121,11 @@ protected:
 
     CKeyingMaterial vMasterKey;
 
+    // While unlocked, a crypter keyed with vMasterKey and the secrets
+    // decrypted so far, which live in locked memory. Used under cs_KeyStore
+    mutable CCrypter crypterKeys;
+    mutable std::map<CKeyID, CSecret> mapSecretCache;
+
     // will encrypt previously unencrypted keys
     bool EncryptKeys(CKeyingMaterial& vMasterKeyIn);
 
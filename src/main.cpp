@@ -12,6 +12,9 @@
 #include "init.h" 
 #include "ui_interface.h"
 #include "kernel.h"
+#include "addrindex.h"
+#include "chainstats.h"
+#include "orphans.h"
 #include "stealthaddress.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -40,16 +43,16 @@ CCriticalSection cs_main;
 CTxMemPool mempool;
 unsigned int nTransactionsUpdated = 0;
 
-map<uint256, CBlockIndex*> mapBlockIndex;
+CHashMap<uint256, CBlockIndex*> mapBlockIndex;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 uint256 hashGenesisBlock = hashGenesisBlockOfficial;
-static CBigNum bnProofOfWorkLimit(~uint256(0) >> 20);
+static uint256 bnProofOfWorkLimit(~uint256(0) >> 20);
 
-CBigNum bnProofOfStakeLimit(~uint256(0) >> 2);
-CBigNum bnProofOfStakeLimitV2(~uint256(0) >> 8);
+uint256 bnProofOfStakeLimit(~uint256(0) >> 2);
+uint256 bnProofOfStakeLimitV2(~uint256(0) >> 8);
 
-static CBigNum bnProofOfWorkLimitTestNet(~uint256(0) >> 16);
-static CBigNum bnProofOfStakeLimitTestNet(~uint256(0) >> 30);
+static uint256 bnProofOfWorkLimitTestNet(~uint256(0) >> 16);
+static uint256 bnProofOfStakeLimitTestNet(~uint256(0) >> 30);
 
 unsigned int nStakeMinAge = 60 * 60 * 24 * 3;	//minimum age for coin age:  15 day
 unsigned int nStakeMaxAge = 60 * 60 * 24 * 10;	//stake age of full weight:  30 day
@@ -62,23 +65,18 @@ int64 nChainStartTime =1488585034 ;
 int nCoinbaseMaturity = 40;
 CBlockIndex* pindexGenesisBlock = NULL;
 int nBestHeight = -1;
-CBigNum bnBestChainTrust = 0;
-CBigNum bnBestInvalidTrust = 0;
+uint512 nBestChainTrust = 0;
+uint512 nBestInvalidTrust = 0;
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
 int64 nTimeBestReceived = 0;
+CValidationStats validationStats;
 
 
 CMedianFilter<int> cPeerBlockCounts(5, 0); // Amount of blocks that other nodes claim to have
 
-map<uint256, CBlock*> mapOrphanBlocks;
-multimap<uint256, CBlock*> mapOrphanBlocksByPrev;
-set<pair<COutPoint, unsigned int> > setStakeSeenOrphan;
 map<uint256, uint256> mapProofOfStake;
 
-map<uint256, CDataStream*> mapOrphanTransactions;
-map<uint256, map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
-
 // Constant stuff for coinbase transactions we create:
 CScript COINBASE_FLAGS;
 
@@ -359,7 +357,7 @@ void UnregisterWallet(CWallet* pwalletIn)
 }
 
 // check whether the passed transaction is from us
-bool static IsFromMe(CTransaction& tx)
+bool static IsFromMe(const CTransaction& tx)
 {
     BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
         if (pwallet->IsFromMe(tx))
@@ -383,6 +381,13 @@ void static EraseFromWallets(uint256 hash)
         pwallet->EraseFromWallet(hash);
 }
 
+// let wallets look for stealth payments in all of a block's transactions at once
+void static ScanBlockForStealth(const CBlock& block)
+{
+    BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
+        pwallet->ScanBlockForStealth(block.vtx);
+}
+
 // make sure all wallets know about the given transaction, in the given block
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock, bool fUpdate, bool fConnect)
 {
@@ -446,70 +451,41 @@ void ResendWalletTransactions()
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CDataStream& vMsg)
+bool AddOrphanTx(const CTransactionRef& ptx, const CNetAddr& addrFrom)
 {
-    CTransaction tx;
-    CDataStream(vMsg) >> tx;
-    uint256 hash = tx.GetHash();
-    if (mapOrphanTransactions.count(hash))
+    uint256 hash = ptx->GetHash();
+    if (orphanTxPool.Have(hash))
         return false;
 
-    CDataStream* pvMsg = new CDataStream(vMsg);
-
     // Ignore big transactions, to avoid a
     // send-big-orphans memory exhaustion attack. If a peer has a legitimate
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    if (pvMsg->size() > 5000)
+    unsigned int nSize = ptx->GetSize();
+    if (nSize > MAX_ORPHAN_TX_SIZE)
     {
-        printf("ignoring large orphan tx (size: %"PRIszu", hash: %s)\n", pvMsg->size(), hash.ToString().substr(0,10).c_str());
-        delete pvMsg;
+        printf("ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString().substr(0,10).c_str());
         return false;
     }
 
-    mapOrphanTransactions[hash] = pvMsg;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(make_pair(hash, pvMsg));
-
-    printf("stored orphan tx %s (mapsz %"PRIszu")\n", hash.ToString().substr(0,10).c_str(),
-        mapOrphanTransactions.size());
-    return true;
-}
-
-void static EraseOrphanTx(uint256 hash)
-{
-    if (!mapOrphanTransactions.count(hash))
-        return;
-    const CDataStream* pvMsg = mapOrphanTransactions[hash];
-    CTransaction tx;
-    CDataStream(*pvMsg) >> tx;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    set<uint256> setParents;
+    BOOST_FOREACH(const CTxIn& txin, ptx->vin)
+        setParents.insert(txin.prevout.hash);
+    if (!orphanTxPool.Add(hash, ptx, vector<uint256>(setParents.begin(), setParents.end()), addrFrom, GetTime()))
     {
-        mapOrphanTransactionsByPrev[txin.prevout.hash].erase(hash);
-        if (mapOrphanTransactionsByPrev[txin.prevout.hash].empty())
-            mapOrphanTransactionsByPrev.erase(txin.prevout.hash);
+        printf("orphan tx %s from %s not kept, over the orphan memory limits\n", hash.ToString().substr(0,10).c_str(), addrFrom.ToString().c_str());
+        return false;
     }
-    delete pvMsg;
-    mapOrphanTransactions.erase(hash);
+
+    printf("stored orphan tx %s (mapsz %u)\n", hash.ToString().substr(0,10).c_str(),
+        orphanTxPool.size());
+    return true;
 }
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+bool AddOrphanTx(const CTransaction& tx, const CNetAddr& addrFrom)
 {
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, CDataStream*>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
+    return AddOrphanTx(MakeTransactionRef(tx), addrFrom);
 }
 
 // mapOrphanTransactions ]
@@ -707,7 +683,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     }
 
     // Is the tx in a block that's in the main chain
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -827,10 +803,25 @@ int64 CTransaction::GetMinFee(unsigned int nBlockSize, bool fAllowFree,
     return nMinFee;
 }
 
+CTransactionRef MakeTransactionRef(const CTransaction& tx)
+{
+    boost::shared_ptr<CTransaction> ptx(new CTransaction(tx));
+    ptx->SetShared();
+    return ptx;
+}
+
+CTransactionRef MakeTransactionRef(CDataStream& s)
+{
+    boost::shared_ptr<CTransaction> ptx(new CTransaction());
+    s >> *ptx;
+    ptx->SetShared();
+    return ptx;
+}
+
 // CTxMemPool [
 // accept [
 
-bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
+bool CTxMemPool::accept(CTxDB& txdb, const CTransaction& tx, CTransactionRef ptx,
                         bool fCheckInputs, bool* pfMissingInputs)
 {
     if (pfMissingInputs)
@@ -863,7 +854,7 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
             return false;
 
     // Check for conflicts with in-memory transactions
-    CTransaction* ptxOld = NULL;
+    const CTransaction* ptxOld = NULL;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
         COutPoint outpoint = tx.vin[i].prevout;
@@ -913,7 +904,7 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
         // reasonable number of ECDSA signature verifications.
 
         int64 nFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
-        unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        unsigned int nSize = tx.GetSize();
 
         // Don't accept it if it can't get into a block
         int64 txMinFee = tx.GetMinFee(1000, false, GMF_RELAY, nSize);
@@ -956,20 +947,21 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
     }
 
     // Store transaction in memory
+    uint256 hashOld = ptxOld ? ptxOld->GetHash() : 0;
     {
         LOCK(cs);
         if (ptxOld)
         {
-            printf("CTxMemPool::accept() : replacing tx %s with new version\n", ptxOld->GetHash().ToString().c_str());
+            printf("CTxMemPool::accept() : replacing tx %s with new version\n", hashOld.ToString().c_str());
             remove(*ptxOld);
         }
-        addUnchecked(hash, tx);
+        addUnchecked(hash, ptx ? ptx : MakeTransactionRef(tx));
     }
 
     ///// are we sure this is ok when loading transactions or restoring block txes
     // If updated, erase old tx from wallet
     if (ptxOld)
-        EraseFromWallets(ptxOld->GetHash());
+        EraseFromWallets(hashOld);
 
     printf("CTxMemPool::accept() : accepted %s (poolsz %"PRIszu")\n",
            hash.ToString().substr(0,10).c_str(),
@@ -1017,14 +1009,15 @@ bool CTransaction::AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs, bool* pfMi
 // CTransaction ]
 // CTxMemPool [
 
-bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTransactionRef& ptx)
 {
     // Add to memory pool without checking anything.  Don't call this directly,
     // call CTxMemPool::accept to properly check the transaction first.
     {
-        mapTx[hash] = tx;
-        for (unsigned int i = 0; i < tx.vin.size(); i++)
-            mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+        mapTx[hash] = ptx;
+        mapTime[hash] = GetTime();
+        for (unsigned int i = 0; i < ptx->vin.size(); i++)
+            mapNextTx[ptx->vin[i].prevout] = CInPoint(ptx.get(), i);
         nTransactionsUpdated++;
     }
     return true;
@@ -1042,7 +1035,7 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
             if (fRecursive)
             {
                 for (unsigned int i = 0; i < tx.vout.size(); i++){
-                    std::map<COutPoint, CInPoint>:: iterator it =
+                    CHashMap<COutPoint, CInPoint>:: iterator it =
                                                        mapNextTx.find(COutPoint(hash, i));
                     if (it != mapNextTx.end())
                             remove(*it->second.ptx, true);
@@ -1051,6 +1044,7 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
             mapTx.erase(hash);
+            mapTime.erase(hash);
             nTransactionsUpdated++;
         }
     }
@@ -1062,7 +1056,7 @@ bool CTxMemPool::removeConflicts(const CTransaction &tx)
     // Remove transactions which depend on inputs of tx, recursively
     LOCK(cs);
     BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
+        CHashMap<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
         if (it != mapNextTx.end()) {
             const CTransaction &txConflict = *it->second.ptx;
             if (txConflict != tx)
@@ -1077,6 +1071,7 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapTime.clear();
     ++nTransactionsUpdated;
 }
 
@@ -1086,7 +1081,7 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+    for (CHashMap<uint256, CTransactionRef>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
         vtxid.push_back((*mi).first);
 }
 
@@ -1100,7 +1095,7 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex* &pindexRet) const
         return 0;
 
     // Find the block it claims to be in
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1195,7 +1190,7 @@ int CTxIndex::GetDepthInMainChain() const
     if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
         return 0;
     // Find the block in the index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1312,8 +1307,9 @@ bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
 uint256 static GetOrphanRoot(const CBlock* pblock)
 {
     // Work back to the first block in the orphan chain
-    while (mapOrphanBlocks.count(pblock->hashPrevBlock))
-        pblock = mapOrphanBlocks[pblock->hashPrevBlock];
+    const CBlock* pblockPrev;
+    while ((pblockPrev = orphanBlockPool.Get(pblock->hashPrevBlock)) != NULL)
+        pblock = pblockPrev;
     return pblock->GetHash();
 }
 
@@ -1324,8 +1320,9 @@ uint256 static GetOrphanRoot(const CBlock* pblock)
 uint256 WantedByOrphan(const CBlock* pblockOrphan)
 {
     // Work back to the first block in the orphan chain
-    while (mapOrphanBlocks.count(pblockOrphan->hashPrevBlock))
-        pblockOrphan = mapOrphanBlocks[pblockOrphan->hashPrevBlock];
+    const CBlock* pblockPrev;
+    while ((pblockPrev = orphanBlockPool.Get(pblockOrphan->hashPrevBlock)) != NULL)
+        pblockOrphan = pblockPrev;
     return pblockOrphan->hashPrevBlock;
 }
 
@@ -1441,7 +1438,7 @@ unsigned int GetStakeMaxAge(unsigned int nTime)
       return nStakeMaxAge;
 }
 
-static CBigNum GetProofOfStakeLimit(unsigned int nTime)
+static uint256 GetProofOfStakeLimit(unsigned int nTime)
 {
 	if (nTime > VERSION2_SWITCH_TIME)
         return bnProofOfStakeLimitV2;
@@ -1454,11 +1451,12 @@ static const int64 nTargetSpacingWorkMax = 3 * nStakeTargetSpacing;
 
 //
 // maximum nBits value could possible be required nTime after
-// minimum proof-of-work required was nBase
+// minimum proof-of-work required was nBase, the bits of a block
+// already accepted
 //
-unsigned int ComputeMaxBits(CBigNum bnTargetLimit, unsigned int nBase, int64 nTime)
+unsigned int ComputeMaxBits(uint256 bnTargetLimit, unsigned int nBase, int64 nTime)
 {
-    CBigNum bnResult;
+    uint256 bnResult;
     bnResult.SetCompact(nBase);
     bnResult *= 2;
     while (nTime > 0 && bnResult < bnTargetLimit)
@@ -1507,7 +1505,7 @@ const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfSta
 
 unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake) 
 {
-    CBigNum bnTargetLimit = bnProofOfWorkLimit;
+    uint256 bnTargetLimit = bnProofOfWorkLimit;
 
     if(fProofOfStake)
     {
@@ -1539,13 +1537,14 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
 
     // ppcoin: target change every block
     // ppcoin: retarget with exponential moving toward target spacing
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexPrev->nBits);
+    // (wider than a target, the proof-of-stake limit times the spacing
+    // does not fit in 256 bits)
+    uint512 bnNew(uint256().SetCompact(pindexPrev->nBits));
 
     int64 nTargetSpacing = fProofOfStake? nStakeTargetSpacing : min(nTargetSpacingWorkMax, (int64) nStakeTargetSpacing * (1 + pindexLast->nHeight - pindexPrev->nHeight));
     int64 nInterval = nTargetTimespan / nTargetSpacing;
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
+    bnNew *= (unsigned int)((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
+    bnNew /= uint512((nInterval + 1) * nTargetSpacing);
 	
 	/*
 	printf(">> Height = %d, fProofOfStake = %d, nInterval = %"PRI64d", nTargetSpacing = %"PRI64d", nActualSpacing = %"PRI64d"\n", 
@@ -1554,10 +1553,10 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
 		pindexPrev->GetBlockTime(), pindexPrev->nHeight, pindexPrevPrev->GetBlockTime(), pindexPrevPrev->nHeight);  
 	*/
 
-    if (bnNew > bnTargetLimit)
-        bnNew = bnTargetLimit;
+    if (bnNew > uint512(bnTargetLimit))
+        return bnTargetLimit.GetCompact();
 
-    return bnNew.GetCompact();
+    return bnNew.trim256().GetCompact();
 }
 
 // GetNextTargetRequired ]
@@ -1565,15 +1564,17 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits)
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative;
+    bool fOverflow;
+    uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > bnProofOfWorkLimit)
+    if (fNegative || fOverflow || bnTarget == 0 || bnTarget > bnProofOfWorkLimit)
         return error("CheckProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (hash > bnTarget.getuint256())
+    if (hash > bnTarget)
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -1615,19 +1616,19 @@ bool IsInitialBlockDownload()
 
 void static InvalidChainFound(CBlockIndex* pindexNew)
 {
-    if (pindexNew->bnChainTrust > bnBestInvalidTrust)
+    if (pindexNew->nChainTrust > nBestInvalidTrust)
     {
-        bnBestInvalidTrust = pindexNew->bnChainTrust;
-        CTxDB().WriteBestInvalidTrust(bnBestInvalidTrust);
+        nBestInvalidTrust = pindexNew->nChainTrust;
+        CTxDB().WriteBestInvalidTrust(nBestInvalidTrust);
         uiInterface.NotifyBlocksChanged();
     }
 
-    printf("InvalidChainFound: invalid block=%s  height=%d  trust=%s  date=%s\n",
+    printf("InvalidChainFound: invalid block=%s  height=%d  log2_trust=%.8g  date=%s\n",
       pindexNew->GetBlockHash().ToString().substr(0,20).c_str(), pindexNew->nHeight,
-      pindexNew->bnChainTrust.ToString().c_str(), DateTimeStrFormat("%x %H:%M:%S",
+      log(pindexNew->nChainTrust.getdouble())/log(2.0), DateTimeStrFormat("%x %H:%M:%S",
       pindexNew->GetBlockTime()).c_str());
-    printf("InvalidChainFound:  current best=%s  height=%d  trust=%s  date=%s\n",
-      hashBestChain.ToString().substr(0,20).c_str(), nBestHeight, bnBestChainTrust.ToString().c_str(),
+    printf("InvalidChainFound:  current best=%s  height=%d  log2_trust=%.8g  date=%s\n",
+      hashBestChain.ToString().substr(0,20).c_str(), nBestHeight, log(nBestChainTrust.getdouble())/log(2.0),
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()).c_str());
 }
 
@@ -1685,7 +1686,7 @@ bool CTransaction::DisconnectInputs(CTxDB& txdb)
 // FetchInputs [
 
 bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTestPool,
-                               bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid)
+                               bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid) const
 {
     // FetchInputs can return false either because we just haven't seen some inputs
     // (in which case the transaction should be stored as an orphan)
@@ -1817,7 +1818,7 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
 
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                                  map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash)
+                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash) const
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -1856,6 +1857,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
         // The first loop above does all the inexpensive checks.
         // Only if ALL inputs pass do we perform expensive ECDSA signature checks.
         // Helps prevent CPU exhaustion attacks.
+        CSignatureHashCache sighashcache(*this);
         for (unsigned int i = 0; i < vin.size(); i++)
         {
             COutPoint prevout = vin[i].prevout;
@@ -1940,13 +1942,15 @@ bool CTransaction::ClientConnectInputs()
     {
         LOCK(mempool.cs);
         int64 nValueIn = 0;
+        CSignatureHashCache sighashcache(*this);
         for (unsigned int i = 0; i < vin.size(); i++)
         {
             // Get prev tx from single transactions in memory
             COutPoint prevout = vin[i].prevout;
-            if (!mempool.exists(prevout.hash))
+            CTransactionRef ptxPrev = mempool.get(prevout.hash);
+            if (!ptxPrev)
                 return false;
-            CTransaction& txPrev = mempool.lookup(prevout.hash);
+            const CTransaction& txPrev = *ptxPrev;
 
             if (prevout.n >= txPrev.vout.size())
                 return false;
@@ -1986,10 +1990,30 @@ bool CTransaction::ClientConnectInputs()
 
 bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
+    bool fIndexAddr = fAddrIndex && pindex->nHeight == nAddrIndexHeight;
+
     // Disconnect in reverse order
     for (int i = vtx.size()-1; i >= 0; i--)
+    {
+        if (fIndexAddr)
+        {
+            // Before DisconnectInputs, while the previous transactions are
+            // still in the tx index
+            vector<CTxOut> vSpent;
+            if (!AddrIndexReadSpent(txdb, vtx[i], vSpent) || !AddrIndexDisconnectTx(txdb, vtx[i], pindex->nHeight, vSpent))
+                return error("DisconnectBlock() : AddrIndexDisconnectTx failed");
+        }
         if (!vtx[i].DisconnectInputs(txdb))
             return false;
+    }
+
+    // Memory is put back by TxnAbort if the db transaction fails
+    if (fIndexAddr)
+    {
+        if (!txdb.WriteAddrIndexBest(pindex->nHeight - 1, pindex->pprev ? pindex->pprev->GetBlockHash() : 0))
+            return error("DisconnectBlock() : WriteAddrIndexBest failed");
+        nAddrIndexHeight = pindex->nHeight - 1;
+    }
 
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
@@ -2014,7 +2038,10 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 {
     // Check it again in case a previous version let a bad block in
-    if (!CheckBlock(!fJustCheck, !fJustCheck))
+    int64 nTimeStart = GetTimeMicros();
+    bool fChecked = CheckBlock(!fJustCheck, !fJustCheck);
+    validationStats.nCheckBlockTime += GetTimeMicros() - nTimeStart;
+    if (!fChecked)
         return false;
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -2041,6 +2068,12 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     else
         nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(vtx.size());
 
+    // Blocks below the address index height are left to ThreadAddrIndexBuild
+    bool fIndexAddr = fAddrIndex && !fJustCheck && pindex->nHeight == nAddrIndexHeight + 1;
+
+    // Signatures of all transactions are checked together after the loop
+    CSignatureBatch sigbatch;
+
     map<uint256, CTxIndex> mapQueuedChanges;
     int64 nFees = 0;
     int64 nValueIn = 0;
@@ -2073,7 +2106,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         else
         {
             bool fInvalid;
-            if (!tx.FetchInputs(txdb, mapQueuedChanges, true, false, mapInputs, fInvalid))
+            nTimeStart = GetTimeMicros();
+            bool fFetched = tx.FetchInputs(txdb, mapQueuedChanges, true, false, mapInputs, fInvalid);
+            validationStats.nFetchInputsTime += GetTimeMicros() - nTimeStart;
+            if (!fFetched)
                 return false;
 
             if (fStrictPayToScriptHash)
@@ -2106,13 +2142,42 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             // O.1 llog ConnectInputs ]
 
 
-            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash))
+            nTimeStart = GetTimeMicros();
+            bool fConnected = tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, fStrictPayToScriptHash);
+            validationStats.nConnectInputsTime += GetTimeMicros() - nTimeStart;
+            if (!fConnected)
                 return false;
         }
 
+        if (fIndexAddr)
+        {
+            vector<CTxOut> vSpent;
+            if (!tx.IsCoinBase())
+            {
+                vSpent.reserve(tx.vin.size());
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                    vSpent.push_back(mapInputs[txin.prevout.hash].second.vout[txin.prevout.n]);
+            }
+            if (!AddrIndexConnectTx(txdb, tx, pindex->nHeight, vSpent))
+                return error("ConnectBlock() : AddrIndexConnectTx failed");
+        }
+
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
     }
 
+    nTimeStart = GetTimeMicros();
+    bool fVerified = sigbatch.Verify();
+    validationStats.nVerifySignaturesTime += GetTimeMicros() - nTimeStart;
+    if (!fVerified)
+        return DoS(100, error("ConnectBlock() : signature check failed"));
+
+    if (fIndexAddr)
+    {
+        if (!txdb.WriteAddrIndexBest(pindex->nHeight, pindex->GetBlockHash()))
+            return error("ConnectBlock() : WriteAddrIndexBest failed");
+        nAddrIndexHeight = pindex->nHeight;
+    }
+
     // ppcoin: track money supply and mint amount info
     pindex->nMint = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
@@ -2156,9 +2221,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     }
 
     // Watch for transactions paying to me
+    ScanBlockForStealth(*this);
     BOOST_FOREACH(CTransaction& tx, vtx)
         SyncWithWallets(tx, this, true);
 
+    validationStats.nBlocks++;
+    validationStats.nTransactions += vtx.size();
+    validationStats.nSigOps += nSigOps;
     return true;
 }
 
@@ -2242,18 +2311,34 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
         return error("Reorganize() : WriteHashBestChain failed");
 
     // Make sure it's successfully written to disk before changing memory structure
-    if (!txdb.TxnCommit())
+    int64 nTimeStart = GetTimeMicros();
+    bool fCommitted = txdb.TxnCommit();
+    validationStats.nCommitTime += GetTimeMicros() - nTimeStart;
+    if (!fCommitted)
         return error("Reorganize() : TxnCommit failed");
 
     // Disconnect shorter branch
+    bool fChainStats = true;
     BOOST_FOREACH(CBlockIndex* pindex, vDisconnect)
+    {
         if (pindex->pprev)
             pindex->pprev->pnext = NULL;
+        if (fChainStats && !chainStats.Disconnect(pindex))
+            fChainStats = false;
+    }
 
     // Connect longer branch
     BOOST_FOREACH(CBlockIndex* pindex, vConnect)
+    {
         if (pindex->pprev)
             pindex->pprev->pnext = pindex;
+        if (fChainStats && !chainStats.Connect(pindex))
+            fChainStats = false;
+    }
+
+    // The chain is committed whatever the statistics say; bring them back in step
+    if (!fChainStats)
+        chainStats.Rebuild(pindexNew);
 
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
@@ -2283,11 +2368,16 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
         InvalidChainFound(pindexNew);
         return false;
     }
-    if (!txdb.TxnCommit())
+    int64 nTimeStart = GetTimeMicros();
+    bool fCommitted = txdb.TxnCommit();
+    validationStats.nCommitTime += GetTimeMicros() - nTimeStart;
+    if (!fCommitted)
         return error("SetBestChain() : TxnCommit failed");
 
     // Add to current best branch
     pindexNew->pprev->pnext = pindexNew;
+    if (!chainStats.Connect(pindexNew))
+        chainStats.Rebuild(pindexNew);
 
     // Delete redundant memory transactions
     BOOST_FOREACH(CTransaction& tx, vtx)
@@ -2312,6 +2402,8 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
         if (!txdb.TxnCommit())
             return error("SetBestChain() : TxnCommit failed");
         pindexGenesisBlock = pindexNew;
+        if (!chainStats.Connect(pindexNew))
+            chainStats.Rebuild(pindexNew);
     }
     else if (hashPrevBlock == hashBestChain)
     {
@@ -2328,7 +2420,7 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
 
         // Reorganize is costly in terms of db load, as it works in a single db transaction.
         // Try to limit how much needs to be done inside
-        while (pindexIntermediate->pprev && pindexIntermediate->pprev->bnChainTrust > pindexBest->bnChainTrust)
+        while (pindexIntermediate->pprev && pindexIntermediate->pprev->nChainTrust > pindexBest->nChainTrust)
         {
             vpindexSecondary.push_back(pindexIntermediate);
             pindexIntermediate = pindexIntermediate->pprev;
@@ -2377,11 +2469,11 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     pindexBest = pindexNew;
     pblockindexFBBHLast = NULL;
     nBestHeight = pindexBest->nHeight;
-    bnBestChainTrust = pindexNew->bnChainTrust;
+    nBestChainTrust = pindexNew->nChainTrust;
     nTimeBestReceived = GetTime();
     nTransactionsUpdated++;
-    printf("SetBestChain: new best=%s  height=%d  trust=%s  date=%s\n",
-      hashBestChain.ToString().c_str(), nBestHeight, bnBestChainTrust.ToString().c_str(),
+    printf("SetBestChain: new best=%s  height=%d  log2_trust=%.8g  date=%s\n",
+      hashBestChain.ToString().c_str(), nBestHeight, log(nBestChainTrust.getdouble())/log(2.0),
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()).c_str());
 
 	printf("Stake checkpoint: %x\n", pindexBest->nStakeModifierChecksum);
@@ -2430,10 +2522,10 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
 // age (trust score) of competing branches.
 bool CTransaction::GetCoinAge(CTxDB& txdb, uint64& nCoinAge) const
 {
-    CBigNum bnCentSecond = 0;  // coin age in the unit of cent-seconds
+    uint256 bnCentSecond = 0;  // coin age in the unit of cent-seconds
     nCoinAge = 0;
 
-    CBigNum bnSeconds ; // age of coins (not coin age)
+    int64 nSeconds; // age of coins (not coin age)
 
     if (IsCoinBase())
         return true;
@@ -2456,18 +2548,18 @@ bool CTransaction::GetCoinAge(CTxDB& txdb, uint64& nCoinAge) const
             continue; // only count coins meeting min age requirement
 
         int64 nValueIn = txPrev.vout[txin.prevout.n].nValue;
-        bnSeconds = min(CBigNum(nTime-txPrev.nTime), MAX_COIN_SECONDS);
-        bnCentSecond += CBigNum(nValueIn) * bnSeconds / CENT;
+        nSeconds = min((int64)(nTime-txPrev.nTime), MAX_COIN_SECONDS);
+        bnCentSecond += uint256(nValueIn) * uint256(nSeconds) / CENT;
 
         if (fDebug && GetBoolArg("-printcoinage"))
             printf("coin age nValueIn=%"PRI64d" nTimeDiff=%d bnCentSecond=%s\n", nValueIn, nTime - txPrev.nTime, bnCentSecond.ToString().c_str());
     }
 
 
-    CBigNum bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
+    uint256 bnCoinDay = bnCentSecond * CENT / COIN / (24 * 60 * 60);
     if (fDebug && GetBoolArg("-printcoinage"))
         printf("coin age bnCoinDay=%s\n", bnCoinDay.ToString().c_str());
-    nCoinAge = bnCoinDay.getuint64();
+    nCoinAge = bnCoinDay.Get64();
     return true;
 }
 
@@ -2520,7 +2612,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
     if (!pindexNew)
         return error("AddToBlockIndex() : new CBlockIndex failed");
     pindexNew->phashBlock = &hash;
-    map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
+    CHashMap<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
@@ -2528,12 +2620,12 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
     }
 
     // index: new ]
-    // index: set bnChainTrust [
+    // index: set nChainTrust [
 
     // ppcoin: compute chain trust score
-    pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
+    pindexNew->nChainTrust = (pindexNew->pprev ? pindexNew->pprev->nChainTrust : 0) + uint512(pindexNew->GetBlockTrust());
 
-    // index: set bnChainTrust ]
+    // index: set nChainTrust ]
     // index: stake: unused - stake entropy bit [
 
     // ppcoin: compute stake entropy bit for stake modifier
@@ -2569,7 +2661,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
     // mapBlockIndex: add index [
 
     // Add to mapBlockIndex
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
@@ -2588,11 +2680,11 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
     // txdb: write index ]
     // chain: set best [
 
-    llogLog(L"txdb/write", L"bnChainTrust", pindexNew->bnChainTrust.GetHex().c_str());
-    llogLog(L"txdb/write", L"bnBestChainTrust", bnBestChainTrust.GetHex().c_str());
+    llogLog(L"txdb/write", L"nChainTrust", pindexNew->nChainTrust.GetHex().c_str());
+    llogLog(L"txdb/write", L"nBestChainTrust", nBestChainTrust.GetHex().c_str());
 
     // New best
-    if (pindexNew->bnChainTrust > bnBestChainTrust)
+    if (pindexNew->nChainTrust > nBestChainTrust)
         if (!SetBestChain(txdb, pindexNew))
             return false;
 
@@ -2741,7 +2833,7 @@ bool CBlock::AcceptBlock()
         return error("AcceptBlock() : block already in mapBlockIndex");
 
     // Get prev block index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("AcceptBlock() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -2858,22 +2950,29 @@ bool CBlock::AcceptBlock()
 
 // GetBlockTrust [
 
-CBigNum CBlockIndex::GetBlockTrust() const
+uint256 CBlockIndex::GetBlockTrust() const
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
-    if (bnTarget <= 0)
+    bool fNegative;
+    bool fOverflow;
+    uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
+    if (fNegative || bnTarget == 0)
         return 0;
 
     if (IsProofOfStake())
     {
-        // Return trust score as usual
-        return (CBigNum(1)<<256) / (bnTarget+1);
+        // Return trust score as usual: 2**256 / (bnTarget+1), which is
+        // ~bnTarget / (bnTarget+1) + 1 without needing a 257th bit
+        if (fOverflow)
+            return 0;
+        return (~bnTarget / (bnTarget + 1)) + 1;
     }
     else
     {
         // Calculate work amount for block
-        CBigNum bnPoWTrust = (bnProofOfWorkLimit / (bnTarget+1));
+        if (fOverflow)
+            return 1;
+        uint256 bnPoWTrust = (bnProofOfWorkLimit / (bnTarget + 1));
         return bnPoWTrust > 1 ? bnPoWTrust : 1;
     }
 } 
@@ -2908,7 +3007,7 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool fIsBootstrap)
     uint256 hash = pblock->GetHash();
     if (mapBlockIndex.count(hash))
         return error("ProcessBlock() : already have block %d %s", mapBlockIndex[hash]->nHeight, hash.ToString().substr(0,20).c_str());
-    if (mapOrphanBlocks.count(hash))
+    if (orphanBlockPool.Have(hash))
         return error("ProcessBlock() : already have block (orphan) %s", hash.ToString().substr(0,20).c_str());
 
     // Check for duplicate ]
@@ -2917,13 +3016,16 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool fIsBootstrap)
     // Limited duplicity on stake: prevents block flood attack
     // Duplicate stake allowed only when there is orphan child block
     // xst: or on bootstrap, which happens in very rare cases
-    if (pblock->IsProofOfStake() && setStakeSeen.count(pblock->GetProofOfStake()) && !mapOrphanBlocksByPrev.count(hash) && !Checkpoints::WantedByPendingSyncCheckpoint(hash) & !fIsBootstrap)
+    if (pblock->IsProofOfStake() && setStakeSeen.count(pblock->GetProofOfStake()) && !orphanBlockPool.HaveChildren(hash) && !Checkpoints::WantedByPendingSyncCheckpoint(hash) & !fIsBootstrap)
         return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString().c_str(), pblock->GetProofOfStake().second, hash.ToString().c_str());
 
     // pblock->CheckBlock [
 
     // Preliminary checks
-    if (!pblock->CheckBlock())
+    int64 nTimeStart = GetTimeMicros();
+    bool fChecked = pblock->CheckBlock();
+    validationStats.nCheckBlockTime += GetTimeMicros() - nTimeStart;
+    if (!fChecked)
         return error("ProcessBlock() : CheckBlock FAILED");
 
     // pblock->CheckBlock ]
@@ -2981,9 +3083,13 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool fIsBootstrap)
     {
         // Extra checks to prevent "fill up memory by spamming with bogus blocks"
         int64 deltaTime = pblock->GetBlockTime() - pcheckpoint->nTime;
-        CBigNum bnNewBlock;
-        bnNewBlock.SetCompact(pblock->nBits);
-        CBigNum bnRequired;
+        // A negative target is no bigger than any, one too wide for 256
+        // bits is bigger than all
+        bool fNegative;
+        bool fOverflow;
+        uint256 bnNewBlock;
+        bnNewBlock.SetCompact(pblock->nBits, &fNegative, &fOverflow);
+        uint256 bnRequired;
         const CBlockIndex* LastBlock = GetLastBlockIndex(pcheckpoint, true);
         int nThisHeight = LastBlock->nHeight + 1;
         unsigned int nLastBits = LastBlock->nBits;
@@ -2998,7 +3104,7 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool fIsBootstrap)
         else
             bnRequired.SetCompact(ComputeMinWork(nLastBits, deltaTime));
 
-        if (bnNewBlock > bnRequired)
+        if (!fNegative && (fOverflow || bnNewBlock > bnRequired))
         {
             if (pfrom)
                 pfrom->Misbehaving(100);
@@ -3014,28 +3120,26 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool fIsBootstrap)
     if (!mapBlockIndex.count(pblock->hashPrevBlock))
     {
         printf("ProcessBlock: ORPHAN BLOCK, prev=%s\n", pblock->hashPrevBlock.ToString().substr(0,20).c_str());
-        CBlock* pblock2 = new CBlock(*pblock);
         // ppcoin: check proof-of-stake
-        if (pblock2->IsProofOfStake())
-        {
-            // Limited duplicity on stake: prevents block flood attack
-            // Duplicate stake allowed only when there is orphan child block
-            if (setStakeSeenOrphan.count(pblock2->GetProofOfStake()) && !mapOrphanBlocksByPrev.count(hash) && !Checkpoints::WantedByPendingSyncCheckpoint(hash))
-                return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s", pblock2->GetProofOfStake().first.ToString().c_str(), pblock2->GetProofOfStake().second, hash.ToString().c_str());
-            else
-                setStakeSeenOrphan.insert(pblock2->GetProofOfStake());
-        }
-        mapOrphanBlocks.insert(make_pair(hash, pblock2));
-        mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrevBlock, pblock2));
+        // Limited duplicity on stake: prevents block flood attack
+        // Duplicate stake allowed only when there is orphan child block
+        if (pblock->IsProofOfStake() && orphanBlockPool.HaveStake(pblock->GetProofOfStake()) && !orphanBlockPool.HaveChildren(hash) && !Checkpoints::WantedByPendingSyncCheckpoint(hash))
+            return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s", pblock->GetProofOfStake().first.ToString().c_str(), pblock->GetProofOfStake().second, hash.ToString().c_str());
+
+        // Kept within the orphan memory limits, which may push out older
+        // orphans of the same peer; we still ask for what is missing
+        CNetAddr addrFrom = pfrom ? (CNetAddr)pfrom->addr : CNetAddr();
+        if (!orphanBlockPool.Add(hash, *pblock, vector<uint256>(1, pblock->hashPrevBlock), addrFrom, GetTime()))
+            printf("ProcessBlock: orphan block %s not kept, over the orphan memory limits\n", hash.ToString().substr(0,20).c_str());
 
         // Ask this guy to fill in what we're missing
         if (pfrom)
         {
-            pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(pblock2));
+            pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(pblock));
             // ppcoin: getblocks may not obtain the ancestor block rejected
             // earlier by duplicate-stake check so we ask for it again directly
             if (!IsInitialBlockDownload())
-                pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock2)));
+                pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock)));
         }
         return true;
     }
@@ -3049,19 +3153,14 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock, bool fIsBootstrap)
     vWorkQueue.push_back(hash);
     for (unsigned int i = 0; i < vWorkQueue.size(); i++)
     {
-        uint256 hashPrev = vWorkQueue[i];
-        for (multimap<uint256, CBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(hashPrev);
-             mi != mapOrphanBlocksByPrev.upper_bound(hashPrev);
-             ++mi)
+        vector<uint256> vChildren;
+        orphanBlockPool.GetChildren(vWorkQueue[i], vChildren);
+        BOOST_FOREACH(const uint256& hashOrphan, vChildren)
         {
-            CBlock* pblockOrphan = (*mi).second;
-            if (pblockOrphan->AcceptBlock())
-                vWorkQueue.push_back(pblockOrphan->GetHash());
-            mapOrphanBlocks.erase(pblockOrphan->GetHash());
-            setStakeSeenOrphan.erase(pblockOrphan->GetProofOfStake());
-            delete pblockOrphan;
+            if (orphanBlockPool.Get(hashOrphan)->AcceptBlock())
+                vWorkQueue.push_back(hashOrphan);
+            orphanBlockPool.Resolve(hashOrphan);
         }
-        mapOrphanBlocksByPrev.erase(hashPrev);
     }
 
     printf("ProcessBlock: ACCEPTED\n");
@@ -3155,12 +3254,9 @@ bool CBlock::CheckBlockSignature() const
         if (whichType == TX_PUBKEY)
         {
             valtype& vchPubKey = vSolutions[0];
-            CKey key;
-            if (!key.SetPubKey(vchPubKey))
-                return false;
             if (vchBlockSig.empty())
                 return false;
-            return key.Verify(GetHash(), vchBlockSig);
+            return CPubKey(vchPubKey).Verify(GetHash(), vchBlockSig);
         }
     }
     else
@@ -3176,12 +3272,9 @@ bool CBlock::CheckBlockSignature() const
             {
                 // Verify
                 valtype& vchPubKey = vSolutions[0];
-                CKey key;
-                if (!key.SetPubKey(vchPubKey))
-                    continue;
                 if (vchBlockSig.empty())
                     continue;
-                if(!key.Verify(GetHash(), vchBlockSig))
+                if (!CPubKey(vchPubKey).Verify(GetHash(), vchBlockSig))
                     continue;
 
                 return true;
@@ -3330,7 +3423,7 @@ bool LoadBlockIndex(bool fAllowNew)
 
         // This will figure out a valid hash and Nonce if you're
         // creating a different genesis block:
-            uint256 hashTarget = CBigNum().SetCompact(block.nBits).getuint256();
+            uint256 hashTarget = uint256().SetCompact(block.nBits);
             while (block.GetHash() > hashTarget)
                {
                    ++block.nNonce;
@@ -3394,7 +3487,7 @@ void PrintBlockTree()
 {
     // pre-compute tree structure
     map<CBlockIndex*, vector<CBlockIndex*> > mapNext;
-    for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    for (CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
     {
         CBlockIndex* pindex = (*mi).second;
         mapNext[pindex->pprev].push_back(pindex);
@@ -3467,7 +3560,7 @@ void PrintBlockTree()
 // PrintBlockTree ]
 // LoadExternalBlockFile [
 
-bool LoadExternalBlockFile(FILE* fileIn)
+bool LoadExternalBlockFile(FILE* fileIn, CExternalBlockHook* phook)
 {
     int64 nStart = GetTimeMillis();
 
@@ -3508,8 +3601,14 @@ bool LoadExternalBlockFile(FILE* fileIn)
                 blkdat >> nSize;
                 if (nSize > 0 && nSize <= MAX_BLOCK_SIZE)
                 {
+                    if (phook && !phook->BeforeRead())
+                        break;
                     CBlock block;
+                    int64 nTimeStart = GetTimeMicros();
                     blkdat >> block;
+                    validationStats.nDeserializeTime += GetTimeMicros() - nTimeStart;
+                    if (phook)
+                        phook->BeforeProcess(block);
                     if (ProcessBlock(NULL, &block, true))
                     // if (ProcessBlock(NULL, &block))
                     {
@@ -3619,13 +3718,13 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
            txInMap = (mempool.exists(inv.hash));
         }
         return txInMap ||
-               mapOrphanTransactions.count(inv.hash) ||
+               orphanTxPool.Have(inv.hash) ||
                txdb.ContainsTx(inv.hash);
         }
 
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash) ||
-               mapOrphanBlocks.count(inv.hash);
+               orphanBlockPool.Have(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -4026,8 +4125,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 
             if (!fAlreadyHave)
                 pfrom->AskFor(inv);
-            else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
-                pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(mapOrphanBlocks[inv.hash]));
+            else if (inv.type == MSG_BLOCK && orphanBlockPool.Have(inv.hash)) {
+                pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(orphanBlockPool.Get(inv.hash)));
             } else if (nInv == nLastBlock) {
                 // In case we are on a very long side-chain, it is possible that we already have
                 // the last block in an inv bundle sent in response to getblocks. Try to detect
@@ -4066,7 +4165,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             if (inv.type == MSG_BLOCK)
             {
                 // Send block from disk
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+                CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
                     CBlock block;
@@ -4089,22 +4188,19 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             else if (inv.IsKnownType())
             {
                 // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TX) {
-                        LOCK(mempool.cs);
-                        if (mempool.exists(inv.hash)) {
-                           CTransaction tx = mempool.lookup(inv.hash);
+                boost::shared_ptr<const CDataStream> pss = FindRelayed(inv);
+                if (pss)
+                    pfrom->PushMessage(inv.GetCommand(), *pss);
+                else if (inv.type == MSG_TX) {
+                        CTransactionRef ptx;
+                        {
+                            LOCK(mempool.cs);
+                            ptx = mempool.get(inv.hash);
+                        }
+                        if (ptx) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
+                        ss.reserve(ptx->GetSize());
+                        ss << *ptx;
                         pfrom->PushMessage("tx", ss);
                     }
                 }
@@ -4194,7 +4290,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+            CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
             if (mi == mapBlockIndex.end())
                 return true;
             pindex = (*mi).second;
@@ -4226,17 +4322,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         vector<uint256> vEraseQueue;
         CDataStream vMsg(vRecv);
         CTxDB txdb("r");
-        CTransaction tx;
-        vRecv >> tx;
+        // Shared from here by the memory pool or the orphans
+        CTransactionRef ptx = MakeTransactionRef(vRecv);
+        const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
         bool fMissingInputs = false;
-        if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs))
+        if (mempool.accept(txdb, ptx, true, &fMissingInputs))
         {
             SyncWithWallets(tx, NULL, true);
-            RelayTransaction(tx, inv.hash);
+            RelayTransaction(tx, inv.hash, vMsg);
             mapAlreadyAskedFor.erase(inv);
             vWorkQueue.push_back(inv.hash);
             vEraseQueue.push_back(inv.hash);
@@ -4244,22 +4341,21 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             // Recursively process any orphan transactions that depended on this one
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
-                uint256 hashPrev = vWorkQueue[i];
-                for (map<uint256, CDataStream*>::iterator mi = mapOrphanTransactionsByPrev[hashPrev].begin();
-                     mi != mapOrphanTransactionsByPrev[hashPrev].end();
-                     ++mi)
+                vector<uint256> vChildren;
+                orphanTxPool.GetChildren(vWorkQueue[i], vChildren);
+                BOOST_FOREACH(const uint256& hashOrphan, vChildren)
                 {
-                    const CDataStream& vMsg = *((*mi).second);
-                    CTransaction tx;
-                    CDataStream(vMsg) >> tx;
-                    CInv inv(MSG_TX, tx.GetHash());
+                    // Stays in the pool until vEraseQueue is done
+                    CTransactionRef ptxOrphan = *orphanTxPool.Get(hashOrphan);
+                    const CTransaction& tx = *ptxOrphan;
+                    CInv inv(MSG_TX, hashOrphan);
                     bool fMissingInputs2 = false;
 
-                    if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs2))
+                    if (mempool.accept(txdb, ptxOrphan, true, &fMissingInputs2))
                     {
                         printf("   accepted orphan tx %s\n", inv.hash.ToString().substr(0,10).c_str());
                         SyncWithWallets(tx, NULL, true);
-                        RelayMessage(inv, vMsg);
+                        RelayTransaction(tx, inv.hash);
                         mapAlreadyAskedFor.erase(inv);
                         vWorkQueue.push_back(inv.hash);
                         vEraseQueue.push_back(inv.hash);
@@ -4274,16 +4370,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             }
 
             BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
+                orphanTxPool.Resolve(hash);
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(vMsg);
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
-            if (nEvicted > 0)
-                printf("mapOrphan overflow, removed %u tx\n", nEvicted);
+            // DoS prevention: the pool bounds the memory of orphans, in all
+            // and from each peer
+            AddOrphanTx(ptx, pfrom->addr);
         }
         if (tx.nDoS) pfrom->Misbehaving(tx.nDoS);
     }
@@ -4584,6 +4677,22 @@ bool ProcessMessages(CNode* pfrom)
 // ProcessMessages ]
 // SendMessages [
 
+// Queue inv for pto unless it already knows it, sending full batches
+static void PushInventoryBatch(CNode* pto, vector<CInv>& vInv, const CInv& inv)
+{
+    if (pto->filterInventoryKnown.contains(inv))
+        return;
+    pto->filterInventoryKnown.insert(inv);
+    if (vInv.empty())
+        vInv.reserve(1000);
+    vInv.push_back(inv);
+    if (vInv.size() >= 1000)
+    {
+        pto->PushMessage("inv", vInv);
+        vInv.clear();
+    }
+}
+
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
     TRY_LOCK(cs_main, lockMain);
@@ -4660,26 +4769,34 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: inventory
         //
         vector<CInv> vInv;
-        vector<CInv> vInvWait;
         {
             LOCK(pto->cs_inventory);
-            vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
+            // Invs held back on earlier passes were already checked for
+            // trickling, so they are only looked at again on the trickle
+            if (fSendTrickle)
+            {
+                BOOST_FOREACH(const CInv& inv, pto->vInventoryWait)
+                    PushInventoryBatch(pto, vInv, inv);
+                pto->vInventoryWait.clear();
+            }
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
+                if (pto->filterInventoryKnown.contains(inv))
                     continue;
 
                 // trickle out tx inv to protect privacy
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
+                    // 1/4 of tx invs blast to all immediately, the same
+                    // ones for every peer
+                    static unsigned int pnTrickleSalt[HASH_SALT_WORDS];
+                    static bool fTrickleSalt = false;
+                    if (!fTrickleSalt)
+                    {
+                        RAND_bytes((unsigned char*)pnTrickleSalt, sizeof(pnTrickleSalt));
+                        fTrickleSalt = true;
+                    }
+                    bool fTrickleWait = (((inv.GetSaltedHash(pnTrickleSalt) * 0x9e3779b97f4a7c15ULL) >> 62) != 0);
 
                     // always trickle our own transactions
                     if (!fTrickleWait)
@@ -4692,23 +4809,15 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 
                     if (fTrickleWait)
                     {
-                        vInvWait.push_back(inv);
+                        pto->vInventoryWait.push_back(inv);
                         continue;
                     }
                 }
 
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
-                {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
-                }
+                PushInventoryBatch(pto, vInv, inv);
             }
-            pto->vInventoryToSend = vInvWait;
+            // Keeps its capacity for the next pass
+            pto->vInventoryToSend.clear();
         }
         if (!vInv.empty())
             pto->PushMessage("inv", vInv);
@@ -4797,12 +4906,12 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit)
 class COrphan
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
     set<uint256> setDependsOn;
     double dPriority;
     double dFeePerKb;
 
-    COrphan(CTransaction* ptxIn)
+    COrphan(const CTransaction* ptxIn)
     {
         ptx = ptxIn;
         dPriority = dFeePerKb = 0;
@@ -4823,7 +4932,7 @@ uint64 nLastBlockSize = 0;
 int64 nLastCoinStakeSearchInterval = 0;
  
 // We want to sort transactions by priority and fee, so:
-typedef boost::tuple<double, double, CTransaction*> TxPriority;
+typedef boost::tuple<double, double, const CTransaction*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -4937,9 +5046,9 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
         // This vector will be sorted into a priority queue:
         vector<TxPriority> vecPriority;
         vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        for (CHashMap<uint256, CTransactionRef>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
         {
-            CTransaction& tx = (*mi).second;
+            const CTransaction& tx = *(*mi).second;
             if (tx.IsCoinBase() || tx.IsCoinStake() || !tx.IsFinal())
                 continue;
 
@@ -4976,7 +5085,7 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
                     }
                     mapDependers[txin.prevout.hash].push_back(porphan);
                     porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
+                    nTotalIn += mempool.mapTx[txin.prevout.hash]->vout[txin.prevout.n].nValue;
                     continue;
                 }
                 int64 nValueIn = txPrev.vout[txin.prevout.n].nValue;
@@ -4988,7 +5097,7 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
             if (fMissingInputs) continue;
 
             // Priority is sum(valuein * age) / txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = tx.GetSize();
             dPriority /= nTxSize;
 
             // This is a more accurate fee-per-kilobyte than is used by the client code, because the
@@ -5002,7 +5111,7 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
                 porphan->dFeePerKb = dFeePerKb;
             }
             else
-                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
+                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &tx));
         }
 
         // Collect transactions into block
@@ -5020,13 +5129,13 @@ CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
             // Take highest priority transaction off the priority queue:
             double dPriority = vecPriority.front().get<0>();
             double dFeePerKb = vecPriority.front().get<1>();
-            CTransaction& tx = *(vecPriority.front().get<2>());
+            const CTransaction& tx = *(vecPriority.front().get<2>());
 
             std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
             vecPriority.pop_back();
 
             // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = tx.GetSize();
             if (nBlockSize + nTxSize >= nBlockMaxSize)
                 continue;
 
@@ -5207,7 +5316,7 @@ void FormatHashBuffers(CBlock* pblock, char* pmidstate, char* pdata, char* phash
 bool CheckWork(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
 {
     uint256 hash = pblock->GetHash();
-    uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+    uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 
     if (hash > hashTarget && pblock->IsProofOfWork())
         return error("BitcoinMiner : proof-of-work not meeting target");
@@ -5350,7 +5459,7 @@ void BitcoinMiner(CWallet *pwallet, bool fProofOfStake)
         // Search
         //
         int64 nStart = GetTime();
-        uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+        uint256 hashTarget = uint256().SetCompact(pblock->nBits);
 	uint256 hash;
 
         LOOP
@@ -15,6 +15,8 @@
 
 #include <list>
 
+#include <boost/shared_ptr.hpp>
+
 class CWallet;
 class CBlock;
 class CBlockIndex;
@@ -142,15 +144,15 @@ extern CScript MINER_SCRIPT_5;
 
 
 extern CCriticalSection cs_main;
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
+extern CHashMap<uint256, CBlockIndex*> mapBlockIndex;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern uint256 hashGenesisBlock;
 extern CBlockIndex* pindexGenesisBlock;
 extern unsigned int nStakeMinAge;
 extern int nCoinbaseMaturity;
 extern int nBestHeight;
-extern CBigNum bnBestChainTrust;
-extern CBigNum bnBestInvalidTrust;
+extern uint512 nBestChainTrust;
+extern uint512 nBestInvalidTrust;
 extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
 extern unsigned int nTransactionsUpdated;
@@ -164,7 +166,6 @@ extern int64 nTimeBestReceived;
 extern CCriticalSection cs_setpwalletRegistered;
 extern std::set<CWallet*> setpwalletRegistered;
 extern unsigned char pchMessageStart[4];
-extern std::map<uint256, CBlock*> mapOrphanBlocks;
 extern const char *reversedIndexHash;
 
 // Settings
@@ -177,13 +178,44 @@ static const uint64 nMinDiskSpace = 52428800;
 
 
 // Maximum age of a coin, to encourage open wallet (9 days)
-static const CBigNum MAX_COIN_SECONDS = 90 * 24 * 60 * 60;
+static const int64 MAX_COIN_SECONDS = 90 * 24 * 60 * 60;
 
 class CReserveKey;
 class CTxDB;
 class CTxIndex;
 class CTxIn;
 
+/** Time spent validating blocks, in microseconds, and what was connected.
+ * Accumulated under cs_main; reported by -replay */
+struct CValidationStats
+{
+    int64 nDeserializeTime;         // blocks read by LoadExternalBlockFile
+    int64 nCheckBlockTime;
+    int64 nFetchInputsTime;
+    int64 nConnectInputsTime;       // signatures are checked after, in a batch
+    int64 nVerifySignaturesTime;
+    int64 nCommitTime;              // the txdb transaction of each connected block
+    uint64 nBlocks;
+    uint64 nTransactions;
+    uint64 nSigOps;
+
+    CValidationStats() : nDeserializeTime(0), nCheckBlockTime(0), nFetchInputsTime(0), nConnectInputsTime(0),
+                         nVerifySignaturesTime(0), nCommitTime(0), nBlocks(0), nTransactions(0), nSigOps(0) {}
+};
+
+extern CValidationStats validationStats;
+
+/** Sees each block LoadExternalBlockFile reads, before and after it is
+ * deserialized */
+class CExternalBlockHook
+{
+public:
+    virtual ~CExternalBlockHook() {}
+    // False stops the load
+    virtual bool BeforeRead() { return true; }
+    virtual void BeforeProcess(const CBlock& block) {}
+};
+
 void RegisterWallet(CWallet* pwalletIn);
 void UnregisterWallet(CWallet* pwalletIn);
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL, bool fUpdate = false, bool fConnect = true);
@@ -196,7 +228,7 @@ void PrintBlockTree();
 CBlockIndex* FindBlockByHeight(int nHeight);
 bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
-bool LoadExternalBlockFile(FILE* fileIn);
+bool LoadExternalBlockFile(FILE* fileIn, CExternalBlockHook* phook=NULL);
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet);
 CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake=false);
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
@@ -288,11 +320,11 @@ public:
 class CInPoint
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
     unsigned int n;
 
     CInPoint() { SetNull(); }
-    CInPoint(CTransaction* ptxIn, unsigned int nIn) { ptx = ptxIn; n = nIn; }
+    CInPoint(const CTransaction* ptxIn, unsigned int nIn) { ptx = ptxIn; n = nIn; }
     void SetNull() { ptx = NULL; n = (unsigned int) -1; }
     bool IsNull() const { return (ptx == NULL && n == (unsigned int) -1); }
 };
@@ -327,6 +359,11 @@ public:
         return !(a == b);
     }
 
+    uint64 GetSaltedHash(const unsigned int* pnSalt) const
+    {
+        return hash.GetSaltedHash(pnSalt) + (uint64)(n + pnSalt[8]) * (pnSalt[9] | 1);
+    }
+
     std::string ToString() const
     {
         return strprintf("COutPoint(%s, %u)", hash.ToString().substr(0,10).c_str(), n);
@@ -535,6 +572,28 @@ enum GetMinFee_mode
 
 typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
 
+/** A transaction that no longer changes, shared by the memory pool, relay and
+ * block assembly instead of each keeping a copy. Made by MakeTransactionRef,
+ * which works out its hash and serialized size once.
+ */
+typedef boost::shared_ptr<const CTransaction> CTransactionRef;
+
+/** The hash and serialized size of a CTransaction, filled in by
+ * MakeTransactionRef. A copy of the transaction can be changed again, so a
+ * copy of these starts out empty.
+ */
+class CTxSharedCache
+{
+public:
+    bool fSet;
+    uint256 hash;
+    unsigned int nSize;
+
+    CTxSharedCache() : fSet(false), nSize(0) { }
+    CTxSharedCache(const CTxSharedCache&) : fSet(false), nSize(0) { }
+    CTxSharedCache& operator=(const CTxSharedCache&) { fSet = false; return *this; }
+};
+
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
@@ -553,6 +612,20 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+private:
+    // memory only
+    CTxSharedCache shared;
+    friend CTransactionRef MakeTransactionRef(const CTransaction& tx);
+    friend CTransactionRef MakeTransactionRef(CDataStream& s);
+
+    void SetShared()
+    {
+        shared.hash = SerializeHash(*this);
+        shared.nSize = ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+        shared.fSet = true;
+    }
+
+public:
     CTransaction()
     {
         SetNull();
@@ -585,9 +658,19 @@ public:
 
     uint256 GetHash() const
     {
+        if (shared.fSet)
+            return shared.hash;
         return SerializeHash(*this);
     }
 
+    // Serialized size, the same on the network and on disk
+    unsigned int GetSize() const
+    {
+        if (shared.fSet)
+            return shared.nSize;
+        return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+    }
+
     bool IsFinal(int nBlockHeight=0, int64 nBlockTime=0) const
     {
         // Time based nLockTime implemented in 0.1.6
@@ -802,7 +885,7 @@ public:
      @return	Returns true if all inputs are in txdb or mapTestPool
      */
     bool FetchInputs(CTxDB& txdb, const std::map<uint256, CTxIndex>& mapTestPool,
-                     bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid);
+                     bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid) const;
 
     /** Sanity check previous transactions, then, if all checks succeed,
         mark them as spent by this transaction.
@@ -818,7 +901,7 @@ public:
      */
     bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, bool fStrictPayToScriptHash=true) const;
     bool ClientConnectInputs();
     bool CheckTransaction() const;
     bool AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs=true, bool* pfMissingInputs=NULL);
@@ -832,6 +915,13 @@ protected:
 
 
 
+/** Copy tx into a CTransactionRef, working out its hash and size on the way */
+CTransactionRef MakeTransactionRef(const CTransaction& tx);
+/** Read a transaction from s straight into a CTransactionRef */
+CTransactionRef MakeTransactionRef(CDataStream& s);
+
+
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx : public CTransaction
 {
@@ -983,6 +1073,13 @@ public:
     // memory only
     mutable std::vector<uint256> vMerkleTree;
 
+    // memory only: the last GetHash and the header bytes it was computed from,
+    // so a header field changed in place (the miner's nNonce and nTime, the
+    // merkle root after IncrementExtraNonce) is hashed again
+    mutable bool fHashCached;
+    mutable uint256 hashCached;
+    mutable unsigned char pchHeaderCached[80];
+
     // Denial-of-service detection:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
@@ -1026,6 +1123,7 @@ public:
         vtx.clear();
         vchBlockSig.clear();
         vMerkleTree.clear();
+        fHashCached = false;
         nDoS = 0;
     }
 
@@ -1036,7 +1134,14 @@ public:
 
     uint256 GetHash() const
     {
-        return Hash9(BEGIN(nVersion), END(nNonce));
+        // X13 costs far more than comparing the 80 bytes it hashes
+        if (!fHashCached || memcmp(pchHeaderCached, BEGIN(nVersion), sizeof(pchHeaderCached)) != 0)
+        {
+            hashCached = Hash9(BEGIN(nVersion), END(nNonce));
+            memcpy(pchHeaderCached, BEGIN(nVersion), sizeof(pchHeaderCached));
+            fHashCached = true;
+        }
+        return hashCached;
     }
 
     int64 GetBlockTime() const
@@ -1248,7 +1353,7 @@ public:
     CBlockIndex* pnext;
     unsigned int nFile;
     unsigned int nBlockPos;
-    CBigNum bnChainTrust; // ppcoin: trust score of block chain
+    uint512 nChainTrust; // ppcoin: trust score of block chain
     int nHeight;
 
     int64 nMint;
@@ -1285,7 +1390,7 @@ public:
         nFile = 0;
         nBlockPos = 0;
         nHeight = 0;
-        bnChainTrust = 0;
+        nChainTrust = 0;
         nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
@@ -1310,7 +1415,7 @@ public:
         nFile = nFileIn;
         nBlockPos = nBlockPosIn;
         nHeight = 0;
-        bnChainTrust = 0;
+        nChainTrust = 0;
         nMint = 0;
         nMoneySupply = 0;
         nFlags = 0;
@@ -1359,7 +1464,7 @@ public:
         return (int64)nTime;
     }
 
-    CBigNum GetBlockTrust() const;
+    uint256 GetBlockTrust() const;
 
     bool IsInMainChain() const
     {
@@ -1592,7 +1697,7 @@ public:
 
     explicit CBlockLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end())
             Set((*mi).second);
     }
@@ -1643,7 +1748,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1662,7 +1767,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1678,7 +1783,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1709,12 +1814,31 @@ class CTxMemPool
 {
 public:
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
-    std::map<COutPoint, CInPoint> mapNextTx;
+    CHashMap<uint256, CTransactionRef> mapTx;
+    CHashMap<COutPoint, CInPoint> mapNextTx;
+    CHashMap<uint256, int64> mapTime;      // when each of mapTx came in
+
+private:
+    bool accept(CTxDB& txdb, const CTransaction& tx, CTransactionRef ptx,
+                bool fCheckInputs, bool* pfMissingInputs);
 
+public:
     bool accept(CTxDB& txdb, CTransaction &tx,
-                bool fCheckInputs, bool* pfMissingInputs = NULL);
-    bool addUnchecked(const uint256& hash, CTransaction &tx);
+                bool fCheckInputs, bool* pfMissingInputs = NULL)
+    {
+        return accept(txdb, tx, CTransactionRef(), fCheckInputs, pfMissingInputs);
+    }
+    // Keeps ptx itself rather than a copy
+    bool accept(CTxDB& txdb, const CTransactionRef& ptx,
+                bool fCheckInputs, bool* pfMissingInputs = NULL)
+    {
+        return accept(txdb, *ptx, ptx, fCheckInputs, pfMissingInputs);
+    }
+    bool addUnchecked(const uint256& hash, const CTransactionRef& ptx);
+    bool addUnchecked(const uint256& hash, const CTransaction& tx)
+    {
+        return addUnchecked(hash, MakeTransactionRef(tx));
+    }
     bool remove(const CTransaction &tx, bool fRecursive = false);
     bool removeConflicts(const CTransaction &tx);
     void clear();
@@ -1731,16 +1855,19 @@ public:
         return (mapTx.count(hash) != 0);
     }
 
-    CTransaction& lookup(uint256 hash)
+    // The shared transaction, or NULL if it is not in the pool
+    CTransactionRef get(uint256 hash) const
     {
-        return mapTx[hash];
+        CHashMap<uint256, CTransactionRef>::const_iterator i = mapTx.find(hash);
+        if (i==mapTx.end()) return CTransactionRef();
+        return i->second;
     }
 
     bool lookup(uint256 hash, CTransaction& result) const
     {
-        std::map<uint256, CTransaction>::const_iterator i = mapTx.find(hash);
+        CHashMap<uint256, CTransactionRef>::const_iterator i = mapTx.find(hash);
         if (i==mapTx.end()) return false;
-        result = i->second;
+        result = *i->second;
         return true;
     }
 };
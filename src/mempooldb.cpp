@@ -0,0 +1,345 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempooldb.h"
+#include "net.h"
+#include "txdb.h"
+
+#include <openssl/rand.h>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+static bool fMempoolLoaded = false;
+
+CMempoolDB::CMempoolDB()
+{
+    pathMempool = GetDataDir() / "mempool.dat";
+}
+
+bool CMempoolDB::Write(const vector<CMempoolDumpEntry>& vEntries)
+{
+    // Generate random temporary filename
+    unsigned short randv = 0;
+    RAND_bytes((unsigned char *)&randv, sizeof(randv));
+    boost::filesystem::path pathTmp = pathMempool.string() + strprintf(".%04x", randv);
+
+    // serialize transactions, checksum data up to that point, then append csum
+    CDataStream ssMempool(SER_DISK, CLIENT_VERSION);
+    ssMempool << FLATDATA(pchMessageStart) << MEMPOOL_DUMP_VERSION;
+    WriteCompactSize(ssMempool, vEntries.size());
+    BOOST_FOREACH(const CMempoolDumpEntry& entry, vEntries)
+        ssMempool << *entry.first << entry.second;
+    uint256 hash = Hash(ssMempool.begin(), ssMempool.end());
+    ssMempool << hash;
+
+    // open temp output file, and associate with CAutoFile
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("CMempoolDB::Write() : open failed");
+
+    try {
+        fileout << ssMempool;
+    }
+    catch (std::exception &e) {
+        return error("CMempoolDB::Write() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    // replace existing mempool.dat, if any, with new mempool.dat.XXXX
+    if (!RenameOver(pathTmp, pathMempool))
+        return error("CMempoolDB::Write() : Rename-into-place failed");
+
+    return true;
+}
+
+bool CMempoolDB::Read(vector<CMempoolDumpEntry>& vEntries)
+{
+    vEntries.clear();
+
+    // open input file, and associate with CAutoFile
+    FILE *file = fopen(pathMempool.string().c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("CMempoolDB::Read() : open failed");
+
+    // use file size to size memory buffer
+    int fileSize = GetFilesize(filein);
+    int dataSize = fileSize - sizeof(uint256);
+    if (dataSize < 0)
+        return error("CMempoolDB::Read() : file too short");
+    vector<unsigned char> vchData;
+    vchData.resize(dataSize);
+    uint256 hashIn;
+
+    // read data and checksum from file
+    try {
+        if (dataSize > 0)
+            filein.read((char *)&vchData[0], dataSize);
+        filein >> hashIn;
+    }
+    catch (std::exception &e) {
+        return error("CMempoolDB::Read() 2 : I/O error or stream data corrupted");
+    }
+    filein.fclose();
+
+    CDataStream ssMempool(vchData, SER_DISK, CLIENT_VERSION);
+
+    // verify stored checksum matches input data
+    uint256 hashTmp = Hash(ssMempool.begin(), ssMempool.end());
+    if (hashIn != hashTmp)
+        return error("CMempoolDB::Read() : checksum mismatch; data corrupted");
+
+    unsigned char pchMsgTmp[4];
+    try {
+        int nVersion;
+        ssMempool >> FLATDATA(pchMsgTmp) >> nVersion;
+        if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)))
+            return error("CMempoolDB::Read() : invalid network magic number");
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("CMempoolDB::Read() : unknown version %d", nVersion);
+
+        uint64 nCount = ReadCompactSize(ssMempool);
+        for (uint64 i = 0; i < nCount; i++)
+        {
+            CTransactionRef ptx = MakeTransactionRef(ssMempool);
+            int64 nTime;
+            ssMempool >> nTime;
+            vEntries.push_back(make_pair(ptx, nTime));
+        }
+    }
+    catch (std::exception &e) {
+        vEntries.clear();
+        return error("CMempoolDB::Read() : I/O error or stream data corrupted");
+    }
+
+    return true;
+}
+
+// Append the transaction hash and the ones of the pool it spends, parents first
+static void DumpWithParents(const uint256& hash, set<uint256>& setSeen, vector<CMempoolDumpEntry>& vEntries)
+{
+    if (!setSeen.insert(hash).second)
+        return;
+    CTransactionRef ptx = mempool.get(hash);
+    if (!ptx)
+        return;
+    BOOST_FOREACH(const CTxIn& txin, ptx->vin)
+        DumpWithParents(txin.prevout.hash, setSeen, vEntries);
+    CHashMap<uint256, int64>::const_iterator mi = mempool.mapTime.find(hash);
+    vEntries.push_back(make_pair(ptx, mi == mempool.mapTime.end() ? GetTime() : mi->second));
+}
+
+void GetMempoolDumpEntries(vector<CMempoolDumpEntry>& vEntries)
+{
+    vEntries.clear();
+    LOCK(mempool.cs);
+    set<uint256> setSeen;
+    vEntries.reserve(mempool.mapTx.size());
+    for (CHashMap<uint256, CTransactionRef>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        DumpWithParents(mi->first, setSeen, vEntries);
+}
+
+void SetMempoolEntryTime(const uint256& hash, int64 nTime)
+{
+    LOCK(mempool.cs);
+    if (mempool.mapTime.count(hash))
+        mempool.mapTime[hash] = nTime;
+}
+
+bool DumpMempool()
+{
+    if (!fMempoolLoaded)
+        return false;
+
+    int64 nStart = GetTimeMillis();
+    vector<CMempoolDumpEntry> vEntries;
+    GetMempoolDumpEntries(vEntries);
+
+    CMempoolDB mdb;
+    if (!mdb.Write(vEntries))
+        return false;
+
+    printf("Flushed %"PRIszu" transactions to mempool.dat  %"PRI64d"ms\n",
+           vEntries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+// An input of a reloaded transaction with the output it spends
+struct CMempoolLoadInput
+{
+    const CTransaction* ptx;
+    unsigned int nIn;
+    CScript scriptPubKey;
+};
+
+// Check every nThreads-th input from nThread on in one batch. Only the
+// valid signatures matter: they land in the signature cache
+static void ThreadCheckMempoolInputs(const vector<CMempoolLoadInput>* pvInputs, int nThread, int nThreads)
+{
+    CSignatureBatch batch;
+    for (unsigned int i = nThread; i < pvInputs->size() && !fShutdown; i += nThreads)
+    {
+        const CMempoolLoadInput& input = (*pvInputs)[i];
+        batch.VerifyInput(input.ptx->vin[input.nIn].scriptSig, input.scriptPubKey, *input.ptx, input.nIn, true, 0);
+    }
+    batch.Verify();
+}
+
+// Find the outputs spent by vEntries[nBegin, nEnd), reading each earlier
+// transaction once, and check their signatures on every core
+static void PrecheckMempoolChunk(const vector<CMempoolDumpEntry>& vEntries, unsigned int nBegin, unsigned int nEnd,
+                                 const map<uint256, const CTransaction*>& mapFile)
+{
+    // Outputs of the file's own transactions are at hand, the others are
+    // looked for in the pool and then on disk, in hash order
+    set<uint256> setFetch;
+    for (unsigned int i = nBegin; i < nEnd; i++)
+        BOOST_FOREACH(const CTxIn& txin, vEntries[i].first->vin)
+            if (!mapFile.count(txin.prevout.hash))
+                setFetch.insert(txin.prevout.hash);
+
+    map<uint256, CTransactionRef> mapFetched;
+    {
+        CTxDB txdb("r");
+        BOOST_FOREACH(const uint256& hash, setFetch)
+        {
+            CTransactionRef ptxPrev;
+            {
+                LOCK(mempool.cs);
+                ptxPrev = mempool.get(hash);
+            }
+            if (!ptxPrev)
+            {
+                CTransaction txPrev;
+                if (!txdb.ReadDiskTx(hash, txPrev))
+                    continue;
+                ptxPrev = MakeTransactionRef(txPrev);
+            }
+            mapFetched[hash] = ptxPrev;
+        }
+    }
+
+    vector<CMempoolLoadInput> vInputs;
+    for (unsigned int i = nBegin; i < nEnd; i++)
+    {
+        const CTransaction& tx = *vEntries[i].first;
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+        {
+            const COutPoint& prevout = tx.vin[nIn].prevout;
+            const CTransaction* ptxPrev = NULL;
+            map<uint256, const CTransaction*>::const_iterator mi = mapFile.find(prevout.hash);
+            if (mi != mapFile.end())
+                ptxPrev = mi->second;
+            else if (mapFetched.count(prevout.hash))
+                ptxPrev = mapFetched[prevout.hash].get();
+            // accept tells what is wrong with the others
+            if (!ptxPrev || prevout.n >= ptxPrev->vout.size())
+                continue;
+
+            CMempoolLoadInput input;
+            input.ptx = &tx;
+            input.nIn = nIn;
+            input.scriptPubKey = ptxPrev->vout[prevout.n].scriptPubKey;
+            vInputs.push_back(input);
+        }
+    }
+
+    int nThreads = boost::thread::hardware_concurrency();
+    nThreads = max(1, min(nThreads, 8));
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&ThreadCheckMempoolInputs, &vInputs, i, nThreads));
+    ThreadCheckMempoolInputs(&vInputs, 0, nThreads);
+    threads.join_all();
+}
+
+static bool LoadMempool()
+{
+    int64 nStart = GetTimeMillis();
+    vector<CMempoolDumpEntry> vEntries;
+    {
+        CMempoolDB mdb;
+        if (!mdb.Read(vEntries))
+            return false;
+    }
+
+    unsigned int nAccepted = 0;
+    map<uint256, const CTransaction*> mapFile;
+    for (unsigned int nBegin = 0; nBegin < vEntries.size(); nBegin += MEMPOOL_LOAD_CHUNK)
+    {
+        if (fShutdown)
+            return false;
+
+        unsigned int nEnd = min((unsigned int)vEntries.size(), nBegin + MEMPOOL_LOAD_CHUNK);
+        for (unsigned int i = nBegin; i < nEnd; i++)
+            mapFile[vEntries[i].first->GetHash()] = vEntries[i].first.get();
+        PrecheckMempoolChunk(vEntries, nBegin, nEnd, mapFile);
+
+        LOCK(cs_main);
+        CTxDB txdb("r");
+        for (unsigned int i = nBegin; i < nEnd; i++)
+        {
+            // Shutdown waits for this thread
+            if (fShutdown)
+                return false;
+
+            const CTransactionRef& ptx = vEntries[i].first;
+            if (!mempool.accept(txdb, ptx, true))
+                continue;
+            nAccepted++;
+            SetMempoolEntryTime(ptx->GetHash(), vEntries[i].second);
+        }
+    }
+
+    printf("Loaded %u of %"PRIszu" transactions from mempool.dat  %"PRI64d"ms\n",
+           nAccepted, vEntries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+static void ThreadMempoolPersist2()
+{
+    if (boost::filesystem::exists(GetDataDir() / "mempool.dat"))
+        LoadMempool();
+    if (fShutdown)
+        return;
+    fMempoolLoaded = true;
+
+    int64 nNextDump = GetTime() + MEMPOOL_DUMP_INTERVAL;
+    while (!fShutdown)
+    {
+        if (GetTime() >= nNextDump)
+        {
+            DumpMempool();
+            nNextDump = GetTime() + MEMPOOL_DUMP_INTERVAL;
+        }
+        vnThreadsRunning[THREAD_MEMPOOL]--;
+        Sleep(1000);
+        vnThreadsRunning[THREAD_MEMPOOL]++;
+    }
+}
+
+void ThreadMempoolPersist(void* parg)
+{
+    // Make this thread recognisable as the memory pool dumping thread
+    RenameThread("bitcoin-mempool");
+
+    try
+    {
+        vnThreadsRunning[THREAD_MEMPOOL]++;
+        ThreadMempoolPersist2();
+        vnThreadsRunning[THREAD_MEMPOOL]--;
+    }
+    catch (std::exception& e) {
+        vnThreadsRunning[THREAD_MEMPOOL]--;
+        PrintException(&e, "ThreadMempoolPersist()");
+    } catch (...) {
+        vnThreadsRunning[THREAD_MEMPOOL]--;
+        PrintException(NULL, "ThreadMempoolPersist()");
+    }
+    printf("ThreadMempoolPersist exited\n");
+}
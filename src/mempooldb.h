@@ -0,0 +1,57 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_MEMPOOLDB_H
+#define BITCOIN_MEMPOOLDB_H
+
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "main.h"
+
+static const int MEMPOOL_DUMP_VERSION = 1;
+// Transactions reloaded from mempool.dat per hold of cs_main
+static const unsigned int MEMPOOL_LOAD_CHUNK = 500;
+// How often the memory pool is written out while running
+static const int64 MEMPOOL_DUMP_INTERVAL = 15 * 60;
+
+// A memory pool transaction and the time it came in
+typedef std::pair<CTransactionRef, int64> CMempoolDumpEntry;
+
+/** Access to mempool.dat, the memory pool kept across restarts.
+ *
+ * Holds the network magic, a format version, then each transaction with
+ * its time, parents before children, and a checksum of all that, like
+ * peers.dat. It is written to a temporary file and renamed into place.
+ */
+class CMempoolDB
+{
+private:
+    boost::filesystem::path pathMempool;
+
+public:
+    CMempoolDB();
+    CMempoolDB(const boost::filesystem::path& pathIn) : pathMempool(pathIn) {}
+    bool Write(const std::vector<CMempoolDumpEntry>& vEntries);
+    bool Read(std::vector<CMempoolDumpEntry>& vEntries);
+};
+
+// The pool's transactions with the time each came in, parents first
+void GetMempoolDumpEntries(std::vector<CMempoolDumpEntry>& vEntries);
+
+// Give a reloaded transaction back the time it first came in
+void SetMempoolEntryTime(const uint256& hash, int64 nTime);
+
+// Write the memory pool to mempool.dat. Does nothing until the last one
+// has been loaded, so an early shutdown does not lose it
+bool DumpMempool();
+
+// Reload mempool.dat without holding up startup, then write it out every
+// MEMPOOL_DUMP_INTERVAL. The file's previous outputs are read a chunk at a
+// time and its signatures checked on every core before the transactions
+// go through CTxMemPool::accept, which then finds them in the signature cache
+void ThreadMempoolPersist(void* parg);
+
+#endif
@@ -70,10 +70,10 @@ CAddrMan addrman;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+CHashMap<CInv, boost::shared_ptr<const CDataStream> > mapRelay;
 deque<pair<int64, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
-map<CInv, int64> mapAlreadyAskedFor;
+CHashMap<CInv, int64> mapAlreadyAskedFor;
 
 static deque<string> vOneShots;
 CCriticalSection cs_vOneShots;
@@ -1986,7 +1986,11 @@ bool StopNode()
     if (vnThreadsRunning[THREAD_ADDEDCONNECTIONS] > 0) printf("ThreadOpenAddedConnections still running\n");
     if (vnThreadsRunning[THREAD_DUMPADDRESS] > 0) printf("ThreadDumpAddresses still running\n");
     if (vnThreadsRunning[THREAD_STEALTHER] > 0) printf("ThreadStakeMinter still running\n");
-    while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0)
+    if (vnThreadsRunning[THREAD_ADDRINDEX] > 0) printf("ThreadAddrIndexBuild still running\n");
+    if (vnThreadsRunning[THREAD_MEMPOOL] > 0) printf("ThreadMempoolPersist still running\n");
+    // The memory pool thread reads the chain and writes mempool.dat, so it
+    // must be done before Shutdown flushes the databases
+    while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0 || vnThreadsRunning[THREAD_MEMPOOL] > 0)
         Sleep(20);
     Sleep(50);
     DumpAddresses();
@@ -2017,17 +2021,8 @@ public:
     }
 }
 instance_of_cnetcleanup;
-void RelayTransaction(const CTransaction& tx, const uint256& hash)
-{
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, hash, ss);
-}
-
-void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataStream& ss)
+void RelayStored(const CInv& inv, const boost::shared_ptr<const CDataStream>& pss)
 {
-    CInv inv(MSG_TX, hash);
     {
         LOCK(cs_mapRelay);
         // Expire old relay messages
@@ -2037,10 +2032,28 @@ void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataSt
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        if (mapRelay.insert(std::make_pair(inv, pss)).second)
+            vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
 
     RelayInventory(inv);
 }
+
+boost::shared_ptr<const CDataStream> FindRelayed(const CInv& inv)
+{
+    LOCK(cs_mapRelay);
+    CHashMap<CInv, boost::shared_ptr<const CDataStream> >::const_iterator mi = mapRelay.find(inv);
+    if (mi == mapRelay.end())
+        return boost::shared_ptr<const CDataStream>();
+    return mi->second;
+}
+
+void RelayTransaction(const CTransaction& tx, const uint256& hash)
+{
+    RelayMessage(CInv(MSG_TX, hash), tx);
+}
+
+void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataStream& ss)
+{
+    RelayMessage(CInv(MSG_TX, hash), ss);
+}
@@ -8,13 +8,15 @@
 #include <deque>
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <openssl/rand.h>
 
 #ifndef WIN32
 #include <arpa/inet.h>
 #endif
 
-#include "mruset.h"
+#include "bloom.h"
+#include "hashmap.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
@@ -107,6 +109,8 @@ enum threadId
     THREAD_DUMPADDRESS,
     THREAD_RPCHANDLER,
     THREAD_STEALTHER,
+    THREAD_ADDRINDEX,
+    THREAD_MEMPOOL,
 
     THREAD_MAX
 };
@@ -120,10 +124,10 @@ extern CAddrMan addrman;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern CHashMap<CInv, boost::shared_ptr<const CDataStream> > mapRelay;
 extern std::deque<std::pair<int64, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
-extern std::map<CInv, int64> mapAlreadyAskedFor;
+extern CHashMap<CInv, int64> mapAlreadyAskedFor;
 
 
 
@@ -208,12 +212,13 @@ public:
     uint256 hashCheckpointKnown; // ppcoin: known sent sync-checkpoint
 
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
+    std::vector<CInv> vInventoryWait;   // tx invs held for the next trickle
     CCriticalSection cs_inventory;
     std::multimap<int64, CInv> mapAskFor;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, MIN_PROTO_VERSION), vRecv(SER_NETWORK, MIN_PROTO_VERSION)
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, MIN_PROTO_VERSION), vRecv(SER_NETWORK, MIN_PROTO_VERSION), filterInventoryKnown(SendBufferSize() / 100, 0.000001)
     {
         nServices = 0;
         hSocket = hSocketIn;
@@ -243,7 +248,6 @@ public:
         fGetAddr = false;
         nMisbehavior = 0;
         hashCheckpointKnown = 0;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
 
         // Be shy and don't send version until we hear
         if (!fInbound)
@@ -306,7 +310,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv);
         }
     }
 
@@ -314,7 +318,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.contains(inv))
                 vInventoryToSend.push_back(inv);
         }
     }
@@ -666,33 +670,26 @@ inline void RelayInventory(const CInv& inv)
     }
 }
 
+// Keep the serialized message for inv to answer getdata with for 15
+// minutes, and offer it to every peer. All peers share the one copy.
+void RelayStored(const CInv& inv, const boost::shared_ptr<const CDataStream>& pss);
+// The message kept for inv by RelayStored, or null
+boost::shared_ptr<const CDataStream> FindRelayed(const CInv& inv);
+
 template<typename T>
 void RelayMessage(const CInv& inv, const T& a)
 {
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << a;
-    RelayMessage(inv, ss);
+    boost::shared_ptr<CDataStream> pss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    pss->reserve(::GetSerializeSize(a, SER_NETWORK, PROTOCOL_VERSION));
+    *pss << a;
+    RelayStored(inv, pss);
 }
 
 template<>
 inline void RelayMessage<>(const CInv& inv, const CDataStream& ss)
 {
-    {
-        LOCK(cs_mapRelay);
-        // Expire old relay messages
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
-        {
-            mapRelay.erase(vRelayExpiration.front().second);
-            vRelayExpiration.pop_front();
-        }
-
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
-    }
-
-    RelayInventory(inv);
+    // Save original serialized message so newer versions are preserved
+    RelayStored(inv, boost::shared_ptr<const CDataStream>(new CDataStream(ss.begin(), ss.end(), SER_NETWORK, PROTOCOL_VERSION)));
 }
 class CTransaction;
 void RelayTransaction(const CTransaction& tx, const uint256& hash);
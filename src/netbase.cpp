@@ -976,6 +976,15 @@ uint64 CNetAddr::GetHash() const
     return nRet;
 }
 
+// Keyed like uint256::GetSaltedHash, over the four words of the address
+uint64 CNetAddr::GetSaltedHash(const unsigned int* pnSalt) const
+{
+    unsigned int pn[4];
+    memcpy(pn, ip, sizeof(pn));
+    return (uint64)(unsigned int)(pn[0] + pnSalt[0]) * (unsigned int)(pn[1] + pnSalt[1]) +
+           (uint64)(unsigned int)(pn[2] + pnSalt[2]) * (unsigned int)(pn[3] + pnSalt[3]);
+}
+
 void CNetAddr::print() const
 {
     printf("CNetAddr(%s)\n", ToString().c_str());
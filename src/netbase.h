@@ -68,6 +68,7 @@ class CNetAddr
         std::string ToStringIP() const;
         unsigned int GetByte(int n) const;
         uint64 GetHash() const;
+        uint64 GetSaltedHash(const unsigned int* pnSalt) const; // for CHashMap
         bool GetInAddr(struct in_addr* pipv4Addr) const;
         std::vector<unsigned char> GetGroup() const;
         int GetReachabilityFrom(const CNetAddr *paddrPartner = NULL) const;
@@ -0,0 +1,42 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphans.h"
+
+using namespace std;
+
+COrphanTxPool orphanTxPool(DEFAULT_MAX_ORPHAN_TX_MEMORY, DEFAULT_MAX_ORPHAN_TX_MEMORY_PEER,
+                           MAX_ORPHAN_TRANSACTIONS, ORPHAN_TX_EXPIRE_TIME, false);
+COrphanBlockPool orphanBlockPool;
+
+// The heap blocks of the vectors, scripts included, rounded as malloc does
+static unsigned int HeapUsage(unsigned int nBytes)
+{
+    return nBytes == 0 ? 0 : (nBytes + 2 * sizeof(void*) + 15) & ~15U;
+}
+
+static unsigned int TxHeapUsage(const CTransaction& tx)
+{
+    unsigned int nUsage = HeapUsage(tx.vin.capacity() * sizeof(CTxIn)) + HeapUsage(tx.vout.capacity() * sizeof(CTxOut));
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        nUsage += HeapUsage(txin.scriptSig.capacity());
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        nUsage += HeapUsage(txout.scriptPubKey.capacity());
+    return nUsage;
+}
+
+unsigned int GetOrphanMemoryUsage(const CTransactionRef& ptx)
+{
+    // With the shared_ptr's count
+    return sizeof(COrphanTxPool::CEntry) + HeapUsage(sizeof(CTransaction)) + HeapUsage(2 * sizeof(void*)) + TxHeapUsage(*ptx);
+}
+
+unsigned int GetOrphanMemoryUsage(const CBlock& block)
+{
+    unsigned int nUsage = sizeof(COrphanBlockPool::CEntry) + HeapUsage(block.vtx.capacity() * sizeof(CTransaction)) +
+                          HeapUsage(block.vchBlockSig.capacity()) + HeapUsage(block.vMerkleTree.capacity() * sizeof(uint256));
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        nUsage += TxHeapUsage(tx);
+    return nUsage;
+}
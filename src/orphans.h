@@ -0,0 +1,326 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_ORPHANS_H
+#define BITCOIN_ORPHANS_H
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "hashmap.h"
+#include "main.h"
+#include "netbase.h"
+
+// Orphan transactions bigger than this are not kept
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+// Memory the orphan transactions may take, in all and from one peer
+static const unsigned int DEFAULT_MAX_ORPHAN_TX_MEMORY = 10 * 1000 * 1000;
+static const unsigned int DEFAULT_MAX_ORPHAN_TX_MEMORY_PEER = 2 * 1000 * 1000;
+static const int64 ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+// Memory the orphan blocks may take, in all and from one peer
+static const unsigned int DEFAULT_MAX_ORPHAN_BLOCK_MEMORY = 64 * 1000 * 1000;
+static const unsigned int DEFAULT_MAX_ORPHAN_BLOCK_MEMORY_PEER = 32 * 1000 * 1000;
+static const int64 ORPHAN_BLOCK_EXPIRE_TIME = 60 * 60;
+// How often expired orphans are looked for
+static const int64 ORPHAN_EXPIRE_INTERVAL = 60;
+
+// Estimated memory an orphan takes
+unsigned int GetOrphanMemoryUsage(const CTransactionRef& ptx);
+unsigned int GetOrphanMemoryUsage(const CBlock& block);
+
+/** Counters of an orphan pool, for getorphaninfo */
+struct COrphanStats
+{
+    unsigned int nCount;
+    uint64 nMemory;
+    uint64 nPeakMemory;
+    unsigned int nPeers;
+    uint64 nAdded;
+    uint64 nResolved;       // erased once their parents arrived
+    uint64 nExpired;
+    uint64 nEvictedPeer;    // to keep their peer within its quota
+    uint64 nEvictedFull;    // to keep the pool within its limit
+    uint64 nRejected;       // too big, or a peer flooding with them
+
+    COrphanStats() : nCount(0), nMemory(0), nPeakMemory(0), nPeers(0), nAdded(0), nResolved(0),
+                     nExpired(0), nEvictedPeer(0), nEvictedFull(0), nRejected(0) {}
+};
+
+/** Things received before what they depend on: transactions spending
+ * unknown outputs and blocks on an unknown parent.
+ *
+ * Memory is accounted per entry with GetOrphanMemoryUsage. Each peer
+ * (by IP, so reconnecting does not reset it) may hold up to a quota,
+ * past which its own orphans make room; past the pool limit the peer
+ * holding the most gives way. Orphans are dropped when they expire.
+ * An index from each missing parent to its orphans gives the ones to
+ * retry in O(1) when the parent arrives.
+ *
+ * fEvictNewest chooses which of a peer's orphans goes first: the oldest
+ * transactions are the likeliest to have lost their parent, but the
+ * oldest orphan blocks are the closest to connecting.
+ *
+ * Entries are never moved, so pointers from Get stay valid until the
+ * entry is erased. Used under cs_main.
+ */
+template <typename T> class COrphanPool
+{
+public:
+    struct CEntry
+    {
+        T value;
+        std::vector<uint256> vParents;
+        CNetAddr peer;
+        unsigned int nMemory;
+        uint64 nSequence;
+        int64 nTimeExpire;
+    };
+
+private:
+    struct CPeer
+    {
+        uint64 nMemory;
+        std::set<uint64> setSequence;
+
+        CPeer() : nMemory(0) {}
+    };
+
+    CHashMap<uint256, CEntry> mapEntries;
+    CHashMap<uint256, std::vector<uint256> > mapChildren;
+    std::map<uint64, uint256> mapBySequence;
+    std::map<CNetAddr, CPeer> mapPeers;
+    uint64 nSequenceNext;
+    int64 nNextExpire;
+
+    uint64 nMaxMemory;
+    uint64 nMaxMemoryPeer;
+    unsigned int nMaxCount;
+    int64 nExpireTime;
+    bool fEvictNewest;
+
+    COrphanStats stats;
+
+    // The oldest or newest orphan of a peer, as fEvictNewest says
+    uint256 EvictionCandidate(const CPeer& peer) const
+    {
+        uint64 nSequence = fEvictNewest ? *peer.setSequence.rbegin() : *peer.setSequence.begin();
+        return mapBySequence.find(nSequence)->second;
+    }
+
+    uint256 HeaviestPeerCandidate() const
+    {
+        typename std::map<CNetAddr, CPeer>::const_iterator itMax = mapPeers.begin();
+        for (typename std::map<CNetAddr, CPeer>::const_iterator it = mapPeers.begin(); it != mapPeers.end(); ++it)
+            if (it->second.nMemory > itMax->second.nMemory)
+                itMax = it;
+        return EvictionCandidate(itMax->second);
+    }
+
+protected:
+    // Kept in step by derived pools
+    virtual void Inserted(const T& value) {}
+    virtual void Removed(const T& value) {}
+
+public:
+    COrphanPool(uint64 nMaxMemoryIn, uint64 nMaxMemoryPeerIn, unsigned int nMaxCountIn, int64 nExpireTimeIn, bool fEvictNewestIn) :
+        nSequenceNext(0), nNextExpire(0), nMaxMemory(nMaxMemoryIn), nMaxMemoryPeer(nMaxMemoryPeerIn),
+        nMaxCount(nMaxCountIn), nExpireTime(nExpireTimeIn), fEvictNewest(fEvictNewestIn) {}
+
+    virtual ~COrphanPool() {}
+
+    void SetLimits(uint64 nMaxMemoryIn, uint64 nMaxMemoryPeerIn)
+    {
+        nMaxMemory = nMaxMemoryIn;
+        nMaxMemoryPeer = std::min(nMaxMemoryPeerIn, nMaxMemoryIn);
+    }
+
+    // Keep value, which needs the distinct vParents, as an orphan from peer.
+    // False if it is already kept or cannot be
+    bool Add(const uint256& hash, const T& value, const std::vector<uint256>& vParents, const CNetAddr& peer, int64 nNow)
+    {
+        if (mapEntries.count(hash))
+            return false;
+        Expire(nNow);
+
+        unsigned int nMemory = GetOrphanMemoryUsage(value);
+        if (nMemory > nMaxMemoryPeer)
+        {
+            stats.nRejected++;
+            return false;
+        }
+
+        // Room in the peer's quota, from its own orphans. A peer is
+        // erased with its last orphan, so look it up each time
+        while (true)
+        {
+            typename std::map<CNetAddr, CPeer>::iterator pi = mapPeers.find(peer);
+            if (pi == mapPeers.end() || pi->second.nMemory + nMemory <= nMaxMemoryPeer)
+                break;
+            Erase(EvictionCandidate(pi->second));
+            stats.nEvictedPeer++;
+        }
+        CPeer& peerNew = mapPeers[peer];
+
+        CEntry& entry = mapEntries[hash];
+        entry.value = value;
+        entry.vParents = vParents;
+        entry.peer = peer;
+        entry.nMemory = nMemory;
+        entry.nSequence = nSequenceNext++;
+        entry.nTimeExpire = nNow + nExpireTime;
+        mapBySequence[entry.nSequence] = hash;
+        peerNew.nMemory += nMemory;
+        peerNew.setSequence.insert(entry.nSequence);
+        BOOST_FOREACH(const uint256& hashParent, vParents)
+            mapChildren[hashParent].push_back(hash);
+        stats.nMemory += nMemory;
+        stats.nAdded++;
+        Inserted(entry.value);
+
+        // Room in the pool, from whoever holds the most
+        while (stats.nMemory > nMaxMemory || mapEntries.size() > nMaxCount)
+        {
+            Erase(HeaviestPeerCandidate());
+            stats.nEvictedFull++;
+        }
+        stats.nPeakMemory = std::max(stats.nPeakMemory, stats.nMemory);
+        return mapEntries.count(hash) > 0;
+    }
+
+    bool Erase(const uint256& hash)
+    {
+        typename CHashMap<uint256, CEntry>::iterator it = mapEntries.find(hash);
+        if (it == mapEntries.end())
+            return false;
+        CEntry& entry = it->second;
+
+        BOOST_FOREACH(const uint256& hashParent, entry.vParents)
+        {
+            typename CHashMap<uint256, std::vector<uint256> >::iterator mi = mapChildren.find(hashParent);
+            if (mi == mapChildren.end())
+                continue;
+            std::vector<uint256>& vChildren = mi->second;
+            vChildren.erase(std::remove(vChildren.begin(), vChildren.end(), hash), vChildren.end());
+            if (vChildren.empty())
+                mapChildren.erase(mi);
+        }
+
+        typename std::map<CNetAddr, CPeer>::iterator pi = mapPeers.find(entry.peer);
+        pi->second.nMemory -= entry.nMemory;
+        pi->second.setSequence.erase(entry.nSequence);
+        if (pi->second.setSequence.empty())
+            mapPeers.erase(pi);
+
+        mapBySequence.erase(entry.nSequence);
+        stats.nMemory -= entry.nMemory;
+        Removed(entry.value);
+        mapEntries.erase(it);
+        return true;
+    }
+
+    // Erase an orphan whose parents have arrived
+    void Resolve(const uint256& hash)
+    {
+        if (Erase(hash))
+            stats.nResolved++;
+    }
+
+    // Drop the orphans past their time, at most every ORPHAN_EXPIRE_INTERVAL
+    unsigned int Expire(int64 nNow)
+    {
+        if (nNow < nNextExpire)
+            return 0;
+        nNextExpire = nNow + ORPHAN_EXPIRE_INTERVAL;
+
+        // Expiry times increase with the sequence
+        unsigned int nExpired = 0;
+        while (!mapBySequence.empty())
+        {
+            const uint256 hash = mapBySequence.begin()->second;
+            if (mapEntries.find(hash)->second.nTimeExpire > nNow)
+                break;
+            Erase(hash);
+            nExpired++;
+        }
+        stats.nExpired += nExpired;
+        return nExpired;
+    }
+
+    bool Have(const uint256& hash) const
+    {
+        return mapEntries.count(hash) > 0;
+    }
+
+    T* Get(const uint256& hash)
+    {
+        typename CHashMap<uint256, CEntry>::iterator it = mapEntries.find(hash);
+        return it == mapEntries.end() ? NULL : &it->second.value;
+    }
+
+    // Orphans waiting for hashParent
+    void GetChildren(const uint256& hashParent, std::vector<uint256>& vChildren) const
+    {
+        typename CHashMap<uint256, std::vector<uint256> >::const_iterator mi = mapChildren.find(hashParent);
+        if (mi == mapChildren.end())
+            vChildren.clear();
+        else
+            vChildren = mi->second;
+    }
+
+    bool HaveChildren(const uint256& hashParent) const
+    {
+        return mapChildren.count(hashParent) > 0;
+    }
+
+    unsigned int size() const
+    {
+        return mapEntries.size();
+    }
+
+    COrphanStats GetStats() const
+    {
+        COrphanStats statsRet = stats;
+        statsRet.nCount = mapEntries.size();
+        statsRet.nPeers = mapPeers.size();
+        return statsRet;
+    }
+};
+
+typedef COrphanPool<CTransactionRef> COrphanTxPool;
+
+/** Orphan blocks, and the proofs of stake they use */
+class COrphanBlockPool : public COrphanPool<CBlock>
+{
+private:
+    std::multiset<std::pair<COutPoint, unsigned int> > setStakeSeen;
+
+protected:
+    void Inserted(const CBlock& block)
+    {
+        if (block.IsProofOfStake())
+            setStakeSeen.insert(block.GetProofOfStake());
+    }
+
+    void Removed(const CBlock& block)
+    {
+        if (block.IsProofOfStake())
+            setStakeSeen.erase(setStakeSeen.find(block.GetProofOfStake()));
+    }
+
+public:
+    COrphanBlockPool() : COrphanPool<CBlock>(DEFAULT_MAX_ORPHAN_BLOCK_MEMORY, DEFAULT_MAX_ORPHAN_BLOCK_MEMORY_PEER,
+                                             std::numeric_limits<unsigned int>::max(), ORPHAN_BLOCK_EXPIRE_TIME, true) {}
+
+    bool HaveStake(const std::pair<COutPoint, unsigned int>& stake) const
+    {
+        return setStakeSeen.count(stake) > 0;
+    }
+};
+
+extern COrphanTxPool orphanTxPool;
+extern COrphanBlockPool orphanBlockPool;
+
+#endif
@@ -123,6 +123,12 @@ class CInv
         )
 
         friend bool operator<(const CInv& a, const CInv& b);
+        friend bool operator==(const CInv& a, const CInv& b);
+
+        uint64 GetSaltedHash(const unsigned int* pnSalt) const
+        {
+            return hash.GetSaltedHash(pnSalt) + (uint64)(type + pnSalt[8]) * (pnSalt[9] | 1);
+        }
 
         bool IsKnownType() const;
         const char* GetCommand() const;
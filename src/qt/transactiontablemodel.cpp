@@ -19,6 +19,8 @@
 #include <QDateTime>
 #include <QtAlgorithms>
 
+#include <algorithm>
+
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter,
@@ -28,23 +30,6 @@ static int column_alignments[] = {
         Qt::AlignRight|Qt::AlignVCenter
     };
 
-// Comparison operator for sort/binary search of model tx list
-struct TxLessThan
-{
-    bool operator()(const TransactionRecord &a, const TransactionRecord &b) const
-    {
-        return a.hash < b.hash;
-    }
-    bool operator()(const TransactionRecord &a, const uint256 &b) const
-    {
-        return a.hash < b;
-    }
-    bool operator()(const uint256 &a, const TransactionRecord &b) const
-    {
-        return a < b.hash;
-    }
-};
-
 // Private implementation
 class TransactionTablePriv
 {
@@ -57,114 +42,178 @@ public:
     CWallet *wallet;
     TransactionTableModel *parent;
 
-    /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+    /* Local cache of wallet. The records of a transaction are adjacent;
+     * transactions are in the order they were loaded, so that loading
+     * appends and the views see one insertion per batch.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* First row of each transaction in cachedWallet */
+    CHashMap<uint256, int> mapFirstRow;
+
+    /* Wallet transactions not decomposed yet, newest last */
+    std::vector<uint256> vToLoad;
+
+    /* Query entire wallet anew from core. Only the newest transactions are
+       decomposed right away, the rest follows in loadMore().
      */
-    void refreshWallet()
+    bool refreshWallet()
     {
         OutputDebugStringF("refreshWallet\n");
+        parent->beginResetModel();
         cachedWallet.clear();
+        mapFirstRow.clear();
+        vToLoad.clear();
+        {
+            LOCK(wallet->cs_wallet);
+            std::vector<std::pair<int64, uint256> > vSorted;
+            vSorted.reserve(wallet->mapWallet.size());
+            for(CHashMap<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+                vSorted.push_back(std::make_pair(it->second.GetTxTime(), it->first));
+            std::sort(vSorted.begin(), vSorted.end());
+            vToLoad.reserve(vSorted.size());
+            for(unsigned int i = 0; i < vSorted.size(); i++)
+                vToLoad.push_back(vSorted[i].second);
+        }
+        parent->endResetModel();
+        return loadMore();
+    }
+
+    /* Decompose queued transactions for a slice of time, then let the
+       event loop run. Returns whether there is more to load.
+     */
+    bool loadMore()
+    {
+        QList<TransactionRecord> toInsert;
         {
             LOCK(wallet->cs_wallet);
-            for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+            int64 nStart = GetTimeMillis();
+            while(!vToLoad.empty() && GetTimeMillis() - nStart < 50)
             {
-                if(TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                uint256 hash = vToLoad.back();
+                vToLoad.pop_back();
+                // Might have been added by an update meanwhile
+                if(mapFirstRow.count(hash))
+                    continue;
+                CHashMap<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                if(mi == wallet->mapWallet.end() || !TransactionRecord::showTransaction(mi->second))
+                    continue;
+                QList<TransactionRecord> parts = TransactionRecord::decomposeTransaction(wallet, mi->second);
+                if(parts.isEmpty())
+                    continue;
+                mapFirstRow[hash] = cachedWallet.size() + toInsert.size();
+                toInsert.append(parts);
             }
         }
+        append(toInsert);
+        return !vToLoad.empty();
+    }
+
+    void append(const QList<TransactionRecord> &toInsert)
+    {
+        if(toInsert.isEmpty())
+            return;
+        parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size()+toInsert.size()-1);
+        cachedWallet.append(toInsert);
+        parent->endInsertRows();
+    }
+
+    /* Rows [lower, upper) of the transaction hash, or lower == upper == -1 */
+    void findRows(const uint256 &hash, int &lower, int &upper)
+    {
+        lower = upper = -1;
+        CHashMap<uint256, int>::iterator mi = mapFirstRow.find(hash);
+        if(mi == mapFirstRow.end())
+            return;
+        lower = upper = mi->second;
+        while(upper < cachedWallet.size() && cachedWallet[upper].hash == hash)
+            upper++;
+    }
+
+    void removeRows(int lower, int upper)
+    {
+        parent->beginRemoveRows(QModelIndex(), lower, upper-1);
+        mapFirstRow.erase(cachedWallet[lower].hash);
+        cachedWallet.erase(cachedWallet.begin() + lower, cachedWallet.begin() + upper);
+        // Rows after the removed ones moved up
+        for(CHashMap<uint256, int>::iterator mi = mapFirstRow.begin(); mi != mapFirstRow.end(); ++mi)
+            if(mi->second > lower)
+                mi->second -= upper - lower;
+        parent->endRemoveRows();
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
        with that of the core.
 
-       Call with transaction that was added, removed or changed.
+       Call with transactions that were added, removed or changed. Whether
+       each is new, changed or gone is derived from the wallet, so changes
+       can be coalesced.
      */
-    void updateWallet(const uint256 &hash, int status)
+    void updateWallet(const std::set<uint256> &hashes)
     {
-        OutputDebugStringF("updateWallet %s %i\n", hash.ToString().c_str(), status);
+        QList<TransactionRecord> toInsert;
         {
             LOCK(wallet->cs_wallet);
+            BOOST_FOREACH(const uint256 &hash, hashes)
+            {
+                // Find transaction in wallet
+                CHashMap<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                bool inWallet = mi != wallet->mapWallet.end();
 
-            // Find transaction in wallet
-            std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
-            bool inWallet = mi != wallet->mapWallet.end();
+                // Find bounds of this transaction in model
+                int lowerIndex, upperIndex;
+                findRows(hash, lowerIndex, upperIndex);
+                bool inModel = (lowerIndex != upperIndex);
 
-            // Find bounds of this transaction in model
-            QList<TransactionRecord>::iterator lower = qLowerBound(
-                cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-            QList<TransactionRecord>::iterator upper = qUpperBound(
-                cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
-            int lowerIndex = (lower - cachedWallet.begin());
-            int upperIndex = (upper - cachedWallet.begin());
-            bool inModel = (lower != upper);
+                // Determine whether to show transaction or not
+                bool showTransaction = (inWallet && TransactionRecord::showTransaction(mi->second));
 
-            // Determine whether to show transaction or not
-            bool showTransaction = (inWallet && TransactionRecord::showTransaction(mi->second));
+                OutputDebugStringF("updateWallet %s inWallet=%i inModel=%i Index=%i-%i showTransaction=%i\n",
+                         hash.ToString().c_str(), inWallet, inModel, lowerIndex, upperIndex, showTransaction);
 
-            if(status == CT_UPDATED)
-            {
                 if(showTransaction && !inModel)
-                    status = CT_NEW; /* Not in model, but want to show, treat as new */
-                if(!showTransaction && inModel)
-                    status = CT_DELETED; /* In model, but want to hide, treat as deleted */
-            }
-
-            OutputDebugStringF("   inWallet=%i inModel=%i Index=%i-%i showTransaction=%i derivedStatus=%i\n",
-                     inWallet, inModel, lowerIndex, upperIndex, showTransaction, status);
-
-            switch(status)
-            {
-            case CT_NEW:
-                if(inModel)
-                {
-                    OutputDebugStringF("Warning: updateWallet: Got CT_NEW, but transaction is already in model\n");
-                    break;
-                }
-                if(!inWallet)
                 {
-                    OutputDebugStringF("Warning: updateWallet: Got CT_NEW, but transaction is not in wallet\n");
-                    break;
-                }
-                if(showTransaction)
-                {
-                    // Added -- insert at the right position
-                    QList<TransactionRecord> toInsert =
-                            TransactionRecord::decomposeTransaction(wallet, mi->second);
-                    if(!toInsert.isEmpty()) /* only if something to insert */
+                    // Added -- append, all new transactions in one insertion
+                    QList<TransactionRecord> parts = TransactionRecord::decomposeTransaction(wallet, mi->second);
+                    if(!parts.isEmpty())
                     {
-                        parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex+toInsert.size()-1);
-                        int insert_idx = lowerIndex;
-                        foreach(const TransactionRecord &rec, toInsert)
-                        {
-                            cachedWallet.insert(insert_idx, rec);
-                            insert_idx += 1;
-                        }
-                        parent->endInsertRows();
+                        mapFirstRow[hash] = cachedWallet.size() + toInsert.size();
+                        toInsert.append(parts);
                     }
                 }
-                break;
-            case CT_DELETED:
-                if(!inModel)
+                else if(!showTransaction && inModel)
+                {
+                    // Removed -- remove entire transaction from table
+                    removeRows(lowerIndex, upperIndex);
+                }
+                else if(inModel)
                 {
-                    OutputDebugStringF("Warning: updateWallet: Got CT_DELETED, but transaction is not in model\n");
-                    break;
+                    // Changed -- status is recomputed when the row is next shown
+                    for(int i = lowerIndex; i < upperIndex; i++)
+                        cachedWallet[i].status.cur_num_blocks = -1;
+                    emit parent->dataChanged(parent->index(lowerIndex, 0), parent->index(upperIndex-1, TransactionTableModel::Amount));
                 }
-                // Removed -- remove entire transaction from table
-                parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-                cachedWallet.erase(lower, upper);
-                parent->endRemoveRows();
-                break;
-            case CT_UPDATED:
-                // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
-                // visible transactions.
-                break;
             }
         }
+        append(toInsert);
+    }
+
+    /* Rows whose status can still change as blocks come in: not yet fully
+       confirmed or matured. Rows whose status was never computed are
+       left out, they have not been shown.
+     */
+    void unsettledRows(std::vector<int> &vRows)
+    {
+        for(int i = 0; i < cachedWallet.size(); i++)
+        {
+            const TransactionRecord &rec = cachedWallet[i];
+            if(rec.status.cur_num_blocks == -1)
+                continue;
+            bool fGenerated = (rec.type == TransactionRecord::Generated || rec.type == TransactionRecord::StakeMint);
+            if(fGenerated ? rec.status.maturity != TransactionStatus::Mature
+                          : rec.status.status != TransactionStatus::HaveConfirmations)
+                vRows.push_back(i);
+        }
     }
 
     int size()
@@ -185,7 +234,7 @@ public:
             {
                 {
                     LOCK(wallet->cs_wallet);
-                    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
+                    CHashMap<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
 
                     if(mi != wallet->mapWallet.end())
                     {
@@ -205,7 +254,7 @@ public:
     {
         {
             LOCK(wallet->cs_wallet);
-            std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
+            CHashMap<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
             if(mi != wallet->mapWallet.end())
             {
                 return TransactionDesc::toHTML(wallet, mi->second);
@@ -220,16 +269,11 @@ TransactionTableModel::TransactionTableModel(CWallet* wallet, WalletModel *paren
         QAbstractTableModel(parent),
         wallet(wallet),
         walletModel(parent),
-        priv(new TransactionTablePriv(wallet, this)),
-        cachedNumBlocks(0)
+        priv(new TransactionTablePriv(wallet, this))
 {
     columns << QString() << tr("Date") << tr("Type") << tr("Address") << tr("Amount");
 
-    priv->refreshWallet();
-
-    QTimer *timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(updateConfirmations()));
-    timer->start(MODEL_UPDATE_DELAY);
+    refreshWallet();
 
     connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
 }
@@ -240,28 +284,44 @@ TransactionTableModel::~TransactionTableModel()
 }
 
 void TransactionTableModel::refreshWallet() {
-    priv->refreshWallet();
+    if(priv->refreshWallet())
+        QTimer::singleShot(0, this, SLOT(loadMoreTransactions()));
 }
 
-void TransactionTableModel::updateTransaction(const QString &hash, int status)
+void TransactionTableModel::loadMoreTransactions()
 {
-    uint256 updated;
-    updated.SetHex(hash.toStdString());
+    if(priv->loadMore())
+        QTimer::singleShot(0, this, SLOT(loadMoreTransactions()));
+}
 
-    priv->updateWallet(updated, status);
+void TransactionTableModel::updateTransactions(const std::set<uint256> &hashes)
+{
+    priv->updateWallet(hashes);
 }
 
-void TransactionTableModel::updateConfirmations()
+void TransactionTableModel::updateConfirmations(bool fReorganized)
 {
-    if(nBestHeight != cachedNumBlocks)
+    if(priv->size() == 0)
+        return;
+    if(fReorganized)
+    {
+        // Any row might have changed depth. Qt is smart enough to only
+        // actually request the data for the visible rows.
+        for(int i = 0; i < priv->size(); i++)
+            priv->cachedWallet[i].status.cur_num_blocks = -1;
+        emit dataChanged(index(0, Status), index(priv->size()-1, Amount));
+        return;
+    }
+
+    // Blocks came in since last poll. Only rows that are not yet settled
+    // look any different; signalling just those keeps sorting and
+    // filtering proxies from revisiting the whole wallet.
+    std::vector<int> vRows;
+    priv->unsettledRows(vRows);
+    BOOST_FOREACH(int i, vRows)
     {
-        cachedNumBlocks = nBestHeight;
-        // Blocks came in since last poll.
-        // Invalidate status (number of confirmations) and (possibly) description
-        //  for all rows. Qt is smart enough to only actually request the data for the
-        //  visible rows.
-        emit dataChanged(index(0, Status), index(priv->size()-1, Status));
-        emit dataChanged(index(0, ToAddress), index(priv->size()-1, ToAddress));
+        emit dataChanged(index(i, Status), index(i, Status));
+        emit dataChanged(index(i, ToAddress), index(i, ToAddress));
     }
 }
 
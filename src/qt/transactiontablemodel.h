@@ -4,6 +4,10 @@
 #include <QAbstractTableModel>
 #include <QStringList>
 
+#include <set>
+
+#include "uint256.h"
+
 class CWallet;
 class TransactionTablePriv;
 class TransactionRecord;
@@ -51,6 +55,10 @@ public:
     };
 
     void refreshWallet();
+    /** Transactions were added, removed or changed in the wallet */
+    void updateTransactions(const std::set<uint256> &hashes);
+    /** New blocks; fReorganized when blocks were also disconnected */
+    void updateConfirmations(bool fReorganized);
     int rowCount(const QModelIndex &parent) const;
     int columnCount(const QModelIndex &parent) const;
     QVariant data(const QModelIndex &index, int role) const;
@@ -61,7 +69,6 @@ private:
     WalletModel *walletModel;
     QStringList columns;
     TransactionTablePriv *priv;
-    int cachedNumBlocks;
 
     QString lookupAddress(const std::string &address, bool tooltip) const;
     QVariant addressColor(const TransactionRecord *wtx) const;
@@ -75,9 +82,8 @@ private:
     QVariant txAddressDecoration(const TransactionRecord *wtx) const;
 
 public slots:
-    void updateTransaction(const QString &hash, int status);
-    void updateConfirmations();
     void updateDisplayUnit();
+    void loadMoreTransactions();
 
     friend class TransactionTablePriv;
 };
@@ -12,18 +12,54 @@
 #include <QSet>
 #include <QTimer>
 
+#include <set>
+
+/* Core notifications not yet handled by the GUI, and what each wallet
+ * transaction adds to the balances. New blocks and changed transactions
+ * cost as much as what they touch instead of a pass over the wallet.
+ */
+class WalletModelPriv
+{
+public:
+    WalletModelPriv(CWallet *wallet):
+            wallet(wallet), fProcessQueued(false), shares(wallet), pindexCachedBest(0)
+    {
+    }
+    CWallet *wallet;
+
+    // Filled from core threads, drained on the GUI thread
+    CCriticalSection cs_pending;
+    std::set<uint256> setPending;
+    bool fProcessQueued;
+
+    CWalletBalanceShares shares;
+    /* Chain tip the shares are valid for */
+    CBlockIndex *pindexCachedBest;
+};
+
 WalletModel::WalletModel(CWallet *wallet, OptionsModel *optionsModel, QObject *parent) :
     QObject(parent), wallet(wallet), optionsModel(optionsModel), addressTableModel(0),
     transactionTableModel(0),
+    priv(new WalletModelPriv(wallet)),
     cachedBalance(0), cachedStake(0), cachedUnconfirmedBalance(0), cachedImmatureBalance(0),
     cachedNumTransactions(0),
-    cachedEncryptionStatus(Unencrypted),
-    cachedNumBlocks(0)
+    cachedEncryptionStatus(Unencrypted)
 {
     addressTableModel = new AddressTableModel(wallet, this);
     transactionTableModel = new TransactionTableModel(wallet, this);
 
-    // This timer will be fired repeatedly to update the balance
+    {
+        LOCK2(cs_main, wallet->cs_wallet);
+        priv->shares.UpdateAll();
+        priv->pindexCachedBest = pindexBest;
+    }
+    const CWalletBalances &balances = priv->shares.GetBalances();
+    cachedBalance = balances.nBalance;
+    cachedStake = balances.nStake;
+    cachedUnconfirmedBalance = balances.nUnconfirmed;
+    cachedImmatureBalance = balances.nImmature;
+
+    // This timer will be fired repeatedly to notice new blocks
     pollTimer = new QTimer(this);
     connect(pollTimer, SIGNAL(timeout()), this, SLOT(pollBalanceChanged()));
     pollTimer->start(MODEL_UPDATE_DELAY);
@@ -34,27 +70,28 @@ WalletModel::WalletModel(CWallet *wallet, OptionsModel *optionsModel, QObject *p
 WalletModel::~WalletModel()
 {
     unsubscribeFromCoreSignals();
+    delete priv;
 }
 
 
 qint64 WalletModel::getBalance() const
 {
-    return wallet->GetBalance();
+    return cachedBalance;
 }
 
 qint64 WalletModel::getUnconfirmedBalance() const
 {
-    return wallet->GetUnconfirmedBalance();
+    return cachedUnconfirmedBalance;
 }
 
 qint64 WalletModel::getStake() const
 {
-    return wallet->GetStake();
+    return cachedStake;
 }
 
 qint64 WalletModel::getImmatureBalance() const
 {
-    return wallet->GetImmatureBalance();
+    return cachedImmatureBalance;
 }
 
 int WalletModel::getNumTransactions() const
@@ -77,22 +114,42 @@ void WalletModel::updateStatus()
 
 void WalletModel::pollBalanceChanged()
 {
-    if(nBestHeight != cachedNumBlocks)
+    if(pindexBest == priv->pindexCachedBest)
+        return;
+
+    // Don't stall the GUI behind block processing, try again on the next tick
+    TRY_LOCK(cs_main, lockMain);
+    if(!lockMain)
+        return;
+
+    // Blocks were only added if the old tip is an ancestor of the new one
+    CBlockIndex *pindex = pindexBest;
+    CBlockIndex *pindexCached = priv->pindexCachedBest;
+    while(pindex && pindexCached && pindex->nHeight > pindexCached->nHeight)
+        pindex = pindex->pprev;
+    bool fReorganized = (pindex != pindexCached);
+
     {
-        // Balance and number of transactions might have changed
-        cachedNumBlocks = nBestHeight;
-        checkBalanceChanged();
-        if(transactionTableModel)
-            transactionTableModel->updateConfirmations();
+        LOCK(wallet->cs_wallet);
+        if(fReorganized)
+            priv->shares.UpdateAll();
+        else
+            priv->shares.UpdateUnsettled();
     }
+    priv->pindexCachedBest = pindexBest;
+
+    checkBalanceChanged();
+    if(transactionTableModel)
+        transactionTableModel->updateConfirmations(fReorganized);
 }
 
 void WalletModel::checkBalanceChanged()
 {
-    qint64 newBalance = getBalance();
-    qint64 newStake = getStake();
-    qint64 newUnconfirmedBalance = getUnconfirmedBalance();
-    qint64 newImmatureBalance = getImmatureBalance();
+    const CWalletBalances &balances = priv->shares.GetBalances();
+    qint64 newBalance = balances.nBalance;
+    qint64 newStake = balances.nStake;
+    qint64 newUnconfirmedBalance = balances.nUnconfirmed;
+    qint64 newImmatureBalance = balances.nImmature;
 
     if(cachedBalance != newBalance || cachedStake != newStake || cachedUnconfirmedBalance != newUnconfirmedBalance || cachedImmatureBalance != newImmatureBalance)
     {
@@ -104,10 +161,49 @@ void WalletModel::checkBalanceChanged()
     }
 }
 
-void WalletModel::updateTransaction(const QString &hash, int status)
+bool WalletModel::queueTransactionChanged(const uint256 &hash)
+{
+    LOCK(priv->cs_pending);
+    priv->setPending.insert(hash);
+    if(priv->fProcessQueued)
+        return false;
+    priv->fProcessQueued = true;
+    return true;
+}
+
+void WalletModel::processTransactionChanges()
 {
+    std::set<uint256> setChanged;
+    {
+        LOCK(priv->cs_pending);
+        setChanged.swap(priv->setPending);
+        priv->fProcessQueued = false;
+    }
+    if(setChanged.empty())
+        return;
+
+    {
+        // Shares depend on confirmations. Don't stall the GUI behind block
+        // processing: put the changes back and try again shortly.
+        TRY_LOCK(cs_main, lockMain);
+        if(!lockMain)
+        {
+            LOCK(priv->cs_pending);
+            priv->setPending.insert(setChanged.begin(), setChanged.end());
+            if(!priv->fProcessQueued)
+            {
+                priv->fProcessQueued = true;
+                QTimer::singleShot(MODEL_UPDATE_DELAY, this, SLOT(processTransactionChanges()));
+            }
+            return;
+        }
+        LOCK(wallet->cs_wallet);
+        BOOST_FOREACH(const uint256 &hash, setChanged)
+            priv->shares.Update(hash);
+    }
+
     if(transactionTableModel)
-        transactionTableModel->updateTransaction(hash, status);
+        transactionTableModel->updateTransactions(setChanged);
 
     // Balance and number of transactions might have changed
     checkBalanceChanged();
@@ -497,9 +593,10 @@ static void NotifyAddressBookChanged(WalletModel *walletmodel, CWallet *wallet,
 static void NotifyTransactionChanged(WalletModel *walletmodel, CWallet *wallet, const uint256 &hash, ChangeType status)
 {
     OutputDebugStringF("NotifyTransactionChanged %s status=%i\n", hash.GetHex().c_str(), status);
-    QMetaObject::invokeMethod(walletmodel, "updateTransaction", Qt::QueuedConnection,
-                              Q_ARG(QString, QString::fromStdString(hash.GetHex())),
-                              Q_ARG(int, status));
+    // Changes arriving before the GUI gets to them share one queued call,
+    // so a rescan or a block full of wallet transactions is handled at once
+    if(walletmodel->queueTransactionChanged(hash))
+        QMetaObject::invokeMethod(walletmodel, "processTransactionChanges", Qt::QueuedConnection);
 }
 
 void WalletModel::subscribeToCoreSignals()
@@ -17,6 +17,7 @@ class COutput;
 class COutPoint;
 class uint256;
 class CCoinControl;
+class WalletModelPriv;
 
 QT_BEGIN_NAMESPACE
 class QTimer;
@@ -73,6 +74,11 @@ public:
     int getNumTransactions() const;
     EncryptionStatus getEncryptionStatus() const;
 
+    // Queue a changed wallet transaction for processTransactionChanges.
+    // Thread safe; returns true if nothing was queued yet, so the caller
+    // needs to schedule processTransactionChanges.
+    bool queueTransactionChanged(const uint256 &hash);
+
     // Check address for validity
     bool validateAddress(const QString &address);
 
@@ -141,6 +147,9 @@ private:
     AddressTableModel *addressTableModel;
     TransactionTableModel *transactionTableModel;
 
+    // Pending core notifications and per-transaction balance shares
+    WalletModelPriv *priv;
+
     // Cache some values to be able to detect changes
     qint64 cachedBalance;
     qint64 cachedStake;
@@ -148,7 +157,6 @@ private:
     qint64 cachedImmatureBalance;
     qint64 cachedNumTransactions;
     EncryptionStatus cachedEncryptionStatus;
-    int cachedNumBlocks;
 
     QTimer *pollTimer;
 
@@ -160,11 +168,11 @@ private:
 public slots:
     /* Wallet status might have changed */
     void updateStatus();
-    /* New transaction, or transaction changed status */
-    void updateTransaction(const QString &hash, int status);
+    /* Transactions were added, removed or changed since the last call */
+    void processTransactionChanges();
     /* New, updated or removed address book entry */
     void updateAddressBook(const QString &address, const QString &label, bool isMine, int status);
-    /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
+    /* New blocks might have changed confirmations and balances - emit 'balanceChanged' if so */
     void pollBalanceChanged();
 
 signals:
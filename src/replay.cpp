@@ -0,0 +1,127 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "replay.h"
+#include "jsonwriter.h"
+
+using namespace std;
+
+// The timed phases of validationStats, in the order they happen
+static const struct
+{
+    const char* pszName;
+    int64 CValidationStats::*pTime;
+} replayPhases[] = {
+    {"deserialize",       &CValidationStats::nDeserializeTime},
+    {"checkblock",        &CValidationStats::nCheckBlockTime},
+    {"fetchinputs",       &CValidationStats::nFetchInputsTime},
+    {"connectinputs",     &CValidationStats::nConnectInputsTime},
+    {"verifysignatures",  &CValidationStats::nVerifySignaturesTime},
+    {"commit",            &CValidationStats::nCommitTime},
+};
+
+static double PerSecond(uint64 n, int64 nMicros)
+{
+    return nMicros > 0 ? n * 1000000.0 / nMicros : 0.0;
+}
+
+CBlockReplay::CBlockReplay(int nStartHeightIn, int nStopHeightIn) :
+    nStartHeight(nStartHeightIn), nStopHeight(nStopHeightIn), nMockTime(0),
+    fStarted(false), nHeightBegin(0), nHeightEnd(0), nTimeBegin(0), nElapsed(0)
+{
+}
+
+bool CBlockReplay::BeforeRead()
+{
+    if (!fStarted && nBestHeight >= nStartHeight)
+    {
+        fStarted = true;
+        nHeightBegin = nBestHeight;
+        statsBegin = validationStats;
+        nTimeBegin = GetTimeMicros();
+    }
+    return nStopHeight < 0 || nBestHeight < nStopHeight;
+}
+
+void CBlockReplay::BeforeProcess(const CBlock& block)
+{
+    // Block times may go backwards a little, the clock does not
+    nMockTime = max(nMockTime, block.GetBlockTime());
+    SetMockTime(nMockTime);
+}
+
+bool CBlockReplay::Run(const string& strFile)
+{
+    FILE* file = fopen(strFile.c_str(), "rb");
+    if (!file)
+        return error("CBlockReplay::Run() : cannot open %s", strFile.c_str());
+
+    printf("Replaying %s from height %d\n", strFile.c_str(), nBestHeight);
+    LoadExternalBlockFile(file, this);
+    SetMockTime(0);
+    if (!fStarted)
+        return error("CBlockReplay::Run() : %s ends below height %d", strFile.c_str(), nStartHeight);
+
+    LOCK(cs_main);
+    nElapsed = GetTimeMicros() - nTimeBegin;
+    nHeightEnd = nBestHeight;
+    stats = validationStats;
+    for (unsigned int i = 0; i < ARRAYLEN(replayPhases); i++)
+        stats.*replayPhases[i].pTime -= statsBegin.*replayPhases[i].pTime;
+    stats.nBlocks -= statsBegin.nBlocks;
+    stats.nTransactions -= statsBegin.nTransactions;
+    stats.nSigOps -= statsBegin.nSigOps;
+    return stats.nBlocks > 0;
+}
+
+string CBlockReplay::GetReport() const
+{
+    string str = strprintf("Replayed blocks %d to %d: %"PRI64u" blocks, %"PRI64u" transactions, %"PRI64u" sigops in %.3fs\n",
+                           nHeightBegin + 1, nHeightEnd, stats.nBlocks, stats.nTransactions, stats.nSigOps, nElapsed / 1000000.0);
+    str += strprintf("%.1f blocks/s, %.1f tx/s, %.1f sigops/s\n", PerSecond(stats.nBlocks, nElapsed),
+                     PerSecond(stats.nTransactions, nElapsed), PerSecond(stats.nSigOps, nElapsed));
+
+    // Whatever is not in a phase: proof-of-stake checks, block files, the index
+    int64 nOther = nElapsed;
+    str += strprintf("%-18s %12s %8s %12s\n", "phase", "total(ms)", "share", "block(us)");
+    for (unsigned int i = 0; i < ARRAYLEN(replayPhases); i++)
+    {
+        int64 nTime = stats.*replayPhases[i].pTime;
+        nOther -= nTime;
+        str += strprintf("%-18s %12.3f %7.1f%% %12.1f\n", replayPhases[i].pszName, nTime / 1000.0,
+                         nElapsed > 0 ? 100.0 * nTime / nElapsed : 0.0, (double)nTime / stats.nBlocks);
+    }
+    str += strprintf("%-18s %12.3f %7.1f%% %12.1f\n", "other", nOther / 1000.0,
+                     nElapsed > 0 ? 100.0 * nOther / nElapsed : 0.0, (double)nOther / stats.nBlocks);
+    return str;
+}
+
+string CBlockReplay::GetReportJSON() const
+{
+    string strJSON;
+    CJSONWriter out(strJSON);
+    out.BeginObject();
+    out.Pair("version", FormatFullVersion());
+    out.Pair("start_height", nHeightBegin + 1);
+    out.Pair("end_height", nHeightEnd);
+    out.Key("blocks"); out.UInt(stats.nBlocks);
+    out.Key("transactions"); out.UInt(stats.nTransactions);
+    out.Key("sigops"); out.UInt(stats.nSigOps);
+    out.Pair("elapsed_us", nElapsed);
+    out.Pair("blocks_per_s", PerSecond(stats.nBlocks, nElapsed));
+    out.Pair("tx_per_s", PerSecond(stats.nTransactions, nElapsed));
+    out.Pair("sigops_per_s", PerSecond(stats.nSigOps, nElapsed));
+    out.Key("phases_us");
+    out.BeginObject();
+    int64 nOther = nElapsed;
+    for (unsigned int i = 0; i < ARRAYLEN(replayPhases); i++)
+    {
+        out.Pair(replayPhases[i].pszName, stats.*replayPhases[i].pTime);
+        nOther -= stats.*replayPhases[i].pTime;
+    }
+    out.Pair("other", nOther);
+    out.EndObject();
+    out.EndObject();
+    return strJSON;
+}
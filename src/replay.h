@@ -0,0 +1,50 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_REPLAY_H
+#define BITCOIN_REPLAY_H
+
+#include <string>
+
+#include "main.h"
+
+/** Replays a bootstrap.dat or blk000?.dat file through LoadExternalBlockFile
+ * to measure validation throughput end to end, for -replay.
+ *
+ * Meant for an empty data directory, with the network and the wallet left
+ * alone. The clock is mocked to each block's time as it is processed, so
+ * the checks against it come out the same on every run. Blocks up to
+ * nStartHeight are connected unmeasured as a warm-up, the ones after it
+ * up to nStopHeight (or the end of the file if negative) are measured.
+ */
+class CBlockReplay : public CExternalBlockHook
+{
+private:
+    int nStartHeight;
+    int nStopHeight;
+    int64 nMockTime;
+
+    // The measured range, from validationStats
+    bool fStarted;
+    int nHeightBegin;
+    int nHeightEnd;
+    int64 nTimeBegin;
+    int64 nElapsed;
+    CValidationStats statsBegin;
+    CValidationStats stats;
+
+public:
+    CBlockReplay(int nStartHeightIn, int nStopHeightIn);
+
+    bool BeforeRead();
+    void BeforeProcess(const CBlock& block);
+
+    // False if strFile cannot be opened or no block was measured
+    bool Run(const std::string& strFile);
+
+    // Throughput and time per phase of the measured blocks
+    std::string GetReport() const;
+    std::string GetReportJSON() const;
+};
+
+#endif
@@ -4,12 +4,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "main.h"
+#include "chainstats.h"
 #include "bitcoinrpc.h"
+#include "jsonwriter.h"
 
 using namespace json_spirit;
 using namespace std;
 
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, json_spirit::Object& entry);
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, CJSONWriter& out);
 
 double GetDifficulty(const CBlockIndex* blockindex)
 {
@@ -17,103 +19,85 @@ double GetDifficulty(const CBlockIndex* blockindex)
     // minimum difficulty = 1.0.
     if (blockindex == NULL)
     {
-        if (pindexBest == NULL)
+        blockindex = chainStats.GetLastBlockIndex(false);
+        if (blockindex == NULL)
             return 1.0;
-        else
-            blockindex = GetLastBlockIndex(pindexBest, false);
-    }
-
-    int nShift = (blockindex->nBits >> 24) & 0xff;
-
-    double dDiff =
-        (double)0x0000ffff / (double)(blockindex->nBits & 0x00ffffff);
-
-    while (nShift < 29)
-    {
-        dDiff *= 256.0;
-        nShift++;
-    }
-    while (nShift > 29)
-    {
-        dDiff /= 256.0;
-        nShift--;
     }
 
-    return dDiff;
+    return GetDifficultyFromBits(blockindex->nBits);
 }
 
-double GetPoSKernelPS()
+double GetPoSKernelPS(int nBlocks)
 {
-    int nPoSInterval = 72;
-    double dStakeKernelsTriedAvg = 0;
-    int nStakesHandled = 0, nStakesTime = 0;
-
-    CBlockIndex* pindex = pindexBest;;
-    CBlockIndex* pindexPrevStake = NULL;
-
-    while (pindex && nStakesHandled < nPoSInterval)
-    {
-        if (pindex->IsProofOfStake())
-        {
-            dStakeKernelsTriedAvg += GetDifficulty(pindex) * 4294967296.0;
-            nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0;
-            pindexPrevStake = pindex;
-            nStakesHandled++;
-        }
-
-        pindex = pindex->pprev;
-    }
-
-    return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+    return chainStats.GetPoSKernelPS(nBlocks);
 }
 
-Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail)
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail, CJSONWriter& out)
 {
-    Object result;
-    result.push_back(Pair("hash", block.GetHash().GetHex()));
+    out.BeginObject();
+    out.Key("hash");
+    out.Hash(block.GetHash());
     CMerkleTx txGen(block.vtx[0]);
     txGen.SetMerkleBranch(&block);
-    result.push_back(Pair("confirmations", (int)txGen.GetDepthInMainChain()));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    result.push_back(Pair("mint", ValueFromAmount(blockindex->nMint)));
-    result.push_back(Pair("time", (boost::int64_t)block.GetBlockTime()));
-    result.push_back(Pair("nonce", (boost::uint64_t)block.nNonce));
-    result.push_back(Pair("bits", HexBits(block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    out.Pair("confirmations", (int)txGen.GetDepthInMainChain());
+    out.Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    out.Pair("height", blockindex->nHeight);
+    out.Pair("version", block.nVersion);
+    out.Key("merkleroot");
+    out.Hash(block.hashMerkleRoot);
+    out.Key("mint");
+    out.Amount(blockindex->nMint);
+    out.Pair("time", (int64)block.GetBlockTime());
+    out.Key("nonce");
+    out.UInt(block.nNonce);
+    out.Pair("bits", HexBits(block.nBits));
+    out.Pair("difficulty", GetDifficulty(blockindex));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+    {
+        out.Key("previousblockhash");
+        out.Hash(blockindex->pprev->GetBlockHash());
+    }
     if (blockindex->pnext)
-        result.push_back(Pair("nextblockhash", blockindex->pnext->GetBlockHash().GetHex()));
-
-    result.push_back(Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": "")));
-    result.push_back(Pair("proofhash", blockindex->IsProofOfStake()? blockindex->hashProofOfStake.GetHex() : blockindex->GetBlockHash().GetHex()));
-    result.push_back(Pair("entropybit", (int)blockindex->GetStakeEntropyBit()));
-    result.push_back(Pair("modifier", strprintf("%016"PRI64x, blockindex->nStakeModifier)));
-    result.push_back(Pair("modifierchecksum", strprintf("%08x", blockindex->nStakeModifierChecksum)));
-    Array txinfo;
+    {
+        out.Key("nextblockhash");
+        out.Hash(blockindex->pnext->GetBlockHash());
+    }
+
+    out.Pair("flags", strprintf("%s%s", blockindex->IsProofOfStake()? "proof-of-stake" : "proof-of-work", blockindex->GeneratedStakeModifier()? " stake-modifier": ""));
+    out.Key("proofhash");
+    out.Hash(blockindex->IsProofOfStake()? blockindex->hashProofOfStake : blockindex->GetBlockHash());
+    out.Pair("entropybit", (int)blockindex->GetStakeEntropyBit());
+    out.Pair("modifier", strprintf("%016"PRI64x, blockindex->nStakeModifier));
+    out.Pair("modifierchecksum", strprintf("%08x", blockindex->nStakeModifierChecksum));
+    out.Key("tx");
+    out.BeginArray();
     BOOST_FOREACH (const CTransaction& tx, block.vtx)
     {
         if (fPrintTransactionDetail)
         {
-            Object entry;
-
-            entry.push_back(Pair("txid", tx.GetHash().GetHex()));
-            TxToJSON(tx, 0, entry);
-
-            txinfo.push_back(entry);
+            out.BeginObject();
+            out.Key("txid");
+            out.Hash(tx.GetHash());
+            TxToJSON(tx, 0, out);
+            out.EndObject();
         }
         else
-            txinfo.push_back(tx.GetHash().GetHex());
+            out.Hash(tx.GetHash());
     }
+    out.EndArray();
+    out.Key("signature");
+    out.Hex(block.vchBlockSig.begin(), block.vchBlockSig.end());
+    out.EndObject();
+}
 
-    result.push_back(Pair("tx", txinfo));
-    result.push_back(Pair("signature", HexStr(block.vchBlockSig.begin(), block.vchBlockSig.end())));
-
-    return result;
+// The tree form is parsed back from the writer so the two cannot drift apart
+Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPrintTransactionDetail)
+{
+    string strJSON;
+    CJSONWriter out(strJSON);
+    blockToJSON(block, blockindex, fPrintTransactionDetail, out);
+    return JSONWriterValue(strJSON).get_obj();
 }
 
 Value getbestblockhash(const Array& params, bool fHelp)
@@ -146,11 +130,42 @@ Value getdifficulty(const Array& params, bool fHelp)
 
     Object obj;
     obj.push_back(Pair("proof-of-work",        GetDifficulty()));
-    obj.push_back(Pair("proof-of-stake",       GetDifficulty(GetLastBlockIndex(pindexBest, true))));
+    obj.push_back(Pair("proof-of-stake",       GetDifficulty(chainStats.GetLastBlockIndex(true))));
     obj.push_back(Pair("search-interval",      (int)nLastCoinStakeSearchInterval));
     return obj;
 }
 
+Value getchainstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getchainstats [blocks]\n"
+            "Returns difficulty, spacing, stake kernel rate and money supply averages\n"
+            "over the last [blocks] blocks of each kind (default 72).");
+
+    int nBlocks = params.size() > 0 ? params[0].get_int() : CHAINSTATS_DEFAULT_POS_WINDOW;
+    if (nBlocks < 1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of blocks");
+
+    Object powObj;
+    powObj.push_back(Pair("difficulty",        chainStats.GetAverageDifficulty(false, nBlocks)));
+    powObj.push_back(Pair("spacing",           chainStats.GetAverageSpacing(false, nBlocks)));
+    powObj.push_back(Pair("networkhashps",     (boost::int64_t)chainStats.GetNetworkHashPS(nBlocks)));
+
+    Object posObj;
+    posObj.push_back(Pair("difficulty",        chainStats.GetAverageDifficulty(true, nBlocks)));
+    posObj.push_back(Pair("spacing",           chainStats.GetAverageSpacing(true, nBlocks)));
+    posObj.push_back(Pair("kernelsps",         chainStats.GetPoSKernelPS(nBlocks)));
+
+    Object obj;
+    obj.push_back(Pair("blocks",               nBlocks));
+    obj.push_back(Pair("height",               chainStats.Height()));
+    obj.push_back(Pair("proof-of-work",        powObj));
+    obj.push_back(Pair("proof-of-stake",       posObj));
+    obj.push_back(Pair("moneysupplychange",    ValueFromAmount(chainStats.GetMoneySupplyChange(nBlocks))));
+    return obj;
+}
+
 
 Value settxfee(const Array& params, bool fHelp)
 {
@@ -197,6 +212,26 @@ Value getblockhash(const Array& params, bool fHelp)
     return pblockindex->phashBlock->GetHex();
 }
 
+static CBlockIndex* BlockIndexFromHash(const Value& param)
+{
+    std::string strHash = param.get_str();
+    uint256 hash(strHash);
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    return mapBlockIndex[hash];
+}
+
+static CBlockIndex* BlockIndexFromHeight(const Value& param)
+{
+    int nHeight = param.get_int();
+    if (nHeight < 0 || nHeight > nBestHeight)
+        throw runtime_error("Block number out of range.");
+
+    return chainStats.GetBlockByHeight(nHeight);
+}
+
 Value getblock(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -205,17 +240,24 @@ Value getblock(const Array& params, bool fHelp)
             "txinfo optional to print more detailed tx info\n"
             "Returns details of a block with given block-hash.");
 
-    std::string strHash = params[0].get_str();
-    uint256 hash(strHash);
+    CBlock block;
+    CBlockIndex* pblockindex = BlockIndexFromHash(params[0]);
+    block.ReadFromDisk(pblockindex, true);
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+}
+
+bool getblock_stream(const Array& params, CJSONWriter& out)
+{
+    if (params.size() < 1 || params.size() > 2)
+        return false;
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = BlockIndexFromHash(params[0]);
     block.ReadFromDisk(pblockindex, true);
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false, out);
+    return true;
 }
 
 Value getblockbynumber(const Array& params, bool fHelp)
@@ -226,21 +268,24 @@ Value getblockbynumber(const Array& params, bool fHelp)
             "txinfo optional to print more detailed tx info\n"
             "Returns details of a block with given block-number.");
 
-    int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
-        throw runtime_error("Block number out of range.");
-
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
+    CBlockIndex* pblockindex = BlockIndexFromHeight(params[0]);
+    block.ReadFromDisk(pblockindex, true);
 
-    uint256 hash = *pblockindex->phashBlock;
+    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+}
 
-    pblockindex = mapBlockIndex[hash];
+bool getblockbynumber_stream(const Array& params, CJSONWriter& out)
+{
+    if (params.size() < 1 || params.size() > 2)
+        return false;
+
+    CBlock block;
+    CBlockIndex* pblockindex = BlockIndexFromHeight(params[0]);
     block.ReadFromDisk(pblockindex, true);
 
-    return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
+    blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false, out);
+    return true;
 }
 
 // ppcoin: get information of sync-checkpoint
@@ -63,8 +63,18 @@ Value importprivkey(const Array& params, bool fHelp)
 
         if (!pwalletMain->AddKey(key))
             throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+    }
+
+    // Not under the locks: the rescan takes cs_main and cs_wallet in short batches
+    bool fAborted, fFailed;
+    pwalletMain->ScanForWalletTransactions(pindexGenesisBlock, true, &fAborted, &fFailed);
+    if (fFailed)
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Key added, but the rescan could not read a block, see debug.log");
+    if (fAborted)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Key added, but the rescan was aborted");
 
-        pwalletMain->ScanForWalletTransactions(pindexGenesisBlock, true);
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         pwalletMain->ReacceptWalletTransactions();
     }
 
@@ -8,6 +8,7 @@
 #include "wallet.h"
 #include "db.h"
 #include "walletdb.h"
+#include "orphans.h"
 
 using namespace json_spirit;
 using namespace std;
@@ -72,6 +73,38 @@ Value getpeerinfo(const Array& params, bool fHelp)
     return ret;
 }
 
+static Object OrphanStatsToJSON(const COrphanStats& stats)
+{
+    Object obj;
+    obj.push_back(Pair("count", (int)stats.nCount));
+    obj.push_back(Pair("bytes", (boost::int64_t)stats.nMemory));
+    obj.push_back(Pair("peakbytes", (boost::int64_t)stats.nPeakMemory));
+    obj.push_back(Pair("peers", (int)stats.nPeers));
+    obj.push_back(Pair("added", (boost::int64_t)stats.nAdded));
+    obj.push_back(Pair("resolved", (boost::int64_t)stats.nResolved));
+    obj.push_back(Pair("expired", (boost::int64_t)stats.nExpired));
+    obj.push_back(Pair("evictedpeer", (boost::int64_t)stats.nEvictedPeer));
+    obj.push_back(Pair("evictedfull", (boost::int64_t)stats.nEvictedFull));
+    obj.push_back(Pair("rejected", (boost::int64_t)stats.nRejected));
+    return obj;
+}
+
+Value getorphaninfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getorphaninfo\n"
+            "Returns the size and counters of the orphan transaction and block pools.");
+
+    Object ret;
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("transactions", OrphanStatsToJSON(orphanTxPool.GetStats())));
+        ret.push_back(Pair("blocks", OrphanStatsToJSON(orphanBlockPool.GetStats())));
+    }
+    return ret;
+}
+
 extern CCriticalSection cs_mapAlerts;
 extern map<uint256, CAlert> mapAlerts;
  
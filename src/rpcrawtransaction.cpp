@@ -8,11 +8,13 @@
 
 #include <boost/assign/list_of.hpp>
 
+#include "addrindex.h"
 #include "base58.h"
 #include "bitcoinrpc.h"
 //#include "db.h"
 #include "txdb.h"
 #include "init.h"
+#include "jsonwriter.h"
 #include "main.h"
 #include "net.h"
 #include "wallet.h"
@@ -28,91 +30,118 @@ const int MaxTxnTimeDrift = 5 * 60;
 
 // ScriptPubKeyToJSON [
 
-void ScriptPubKeyToJSON(const CScript& scriptPubKey, Object& out)
+void ScriptPubKeyToJSON(const CScript& scriptPubKey, CJSONWriter& out)
 {
     txnouttype type;
     vector<CTxDestination> addresses;
     int nRequired;
 
-    out.push_back(Pair("asm", scriptPubKey.ToString()));
-    out.push_back(Pair("hex", HexStr(scriptPubKey.begin(), scriptPubKey.end())));
+    out.Pair("asm", scriptPubKey.ToString());
+    out.Key("hex");
+    out.Hex(scriptPubKey.begin(), scriptPubKey.end());
 
     if (!ExtractDestinations(scriptPubKey, type, addresses, nRequired))
     {
-        out.push_back(Pair("type", GetTxnOutputType(TX_NONSTANDARD)));
+        out.Pair("type", GetTxnOutputType(TX_NONSTANDARD));
         return;
     }
 
-    out.push_back(Pair("reqSigs", nRequired));
-    out.push_back(Pair("type", GetTxnOutputType(type)));
+    out.Pair("reqSigs", nRequired);
+    out.Pair("type", GetTxnOutputType(type));
 
-    Array a;
+    out.Key("addresses");
+    out.BeginArray();
     BOOST_FOREACH(const CTxDestination& addr, addresses)
-        a.push_back(CBitcoinAddress(addr).ToString());
-    out.push_back(Pair("addresses", a));
+        out.String(CBitcoinAddress(addr).ToString());
+    out.EndArray();
 }
 
 // ScriptPubKeyToJSON ]
 // TxToJSON [
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, CJSONWriter& out)
 {
-    entry.push_back(Pair("txid", tx.GetHash().GetHex()));
-    entry.push_back(Pair("version", tx.nVersion));
-    entry.push_back(Pair("time", (boost::int64_t)tx.nTime));
-    entry.push_back(Pair("locktime", (boost::int64_t)tx.nLockTime));
-    Array vin;
+    out.Key("txid");
+    out.Hash(tx.GetHash());
+    out.Pair("version", tx.nVersion);
+    out.Pair("time", (int64)tx.nTime);
+    out.Pair("locktime", (int64)tx.nLockTime);
+    out.Key("vin");
+    out.BeginArray();
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
     {
-        Object in;
+        out.BeginObject();
         if (tx.IsCoinBase())
-            in.push_back(Pair("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
+        {
+            out.Key("coinbase");
+            out.Hex(txin.scriptSig.begin(), txin.scriptSig.end());
+        }
         else
         {
-            in.push_back(Pair("txid", txin.prevout.hash.GetHex()));
-            in.push_back(Pair("vout", (boost::int64_t)txin.prevout.n));
-            Object o;
-            o.push_back(Pair("asm", txin.scriptSig.ToString()));
-            o.push_back(Pair("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
-            in.push_back(Pair("scriptSig", o));
+            out.Key("txid");
+            out.Hash(txin.prevout.hash);
+            out.Pair("vout", (int64)txin.prevout.n);
+            out.Key("scriptSig");
+            out.BeginObject();
+            out.Pair("asm", txin.scriptSig.ToString());
+            out.Key("hex");
+            out.Hex(txin.scriptSig.begin(), txin.scriptSig.end());
+            out.EndObject();
         }
-        in.push_back(Pair("sequence", (boost::int64_t)txin.nSequence));
-        vin.push_back(in);
+        out.Pair("sequence", (int64)txin.nSequence);
+        out.EndObject();
     }
-    entry.push_back(Pair("vin", vin));
-    Array vout;
+    out.EndArray();
+    out.Key("vout");
+    out.BeginArray();
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
         const CTxOut& txout = tx.vout[i];
-        Object out;
-        out.push_back(Pair("value", ValueFromAmount(txout.nValue)));
-        out.push_back(Pair("n", (boost::int64_t)i));
-        Object o;
-        ScriptPubKeyToJSON(txout.scriptPubKey, o);
-        out.push_back(Pair("scriptPubKey", o));
-        vout.push_back(out);
+        out.BeginObject();
+        out.Key("value");
+        out.Amount(txout.nValue);
+        out.Pair("n", (int64)i);
+        out.Key("scriptPubKey");
+        out.BeginObject();
+        ScriptPubKeyToJSON(txout.scriptPubKey, out);
+        out.EndObject();
+        out.EndObject();
     }
-    entry.push_back(Pair("vout", vout));
+    out.EndArray();
 
     if (hashBlock != 0)
     {
-        entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        out.Key("blockhash");
+        out.Hash(hashBlock);
+        CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second)
         {
             CBlockIndex* pindex = (*mi).second;
             if (pindex->IsInMainChain())
             {
-                entry.push_back(Pair("confirmations", 1 + nBestHeight - pindex->nHeight));
-                entry.push_back(Pair("time", (boost::int64_t)pindex->nTime));
-                entry.push_back(Pair("blocktime", (boost::int64_t)pindex->nTime));
+                out.Pair("confirmations", 1 + nBestHeight - pindex->nHeight);
+                out.Pair("time", (int64)pindex->nTime);
+                out.Pair("blocktime", (int64)pindex->nTime);
             }
             else
-                entry.push_back(Pair("confirmations", 0));
+                out.Pair("confirmations", 0);
         }
     }
 }
 
+// The tree form is parsed back from the writer so the two cannot drift apart
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry)
+{
+    string strJSON;
+    CJSONWriter out(strJSON);
+    out.BeginObject();
+    TxToJSON(tx, hashBlock, out);
+    out.EndObject();
+    Value val = JSONWriterValue(strJSON);
+    const Object& obj = val.get_obj();
+    entry.insert(entry.end(), obj.begin(), obj.end());
+}
+
 // TxToJSON ]
 
 Value getrawtransaction(const Array& params, bool fHelp)
@@ -150,6 +179,31 @@ Value getrawtransaction(const Array& params, bool fHelp)
     return result;
 }
 
+bool getrawtransaction_stream(const Array& params, CJSONWriter& out)
+{
+    // Only the verbose form is worth streaming
+    if (params.size() != 2 || params[1].get_int() == 0)
+        return false;
+
+    uint256 hash;
+    hash.SetHex(params[0].get_str());
+
+    CTransaction tx;
+    uint256 hashBlock = 0;
+    if (!GetTransaction(hash, tx, hashBlock))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
+
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+
+    out.BeginObject();
+    out.Key("hex");
+    out.Hex(ssTx.begin(), ssTx.end());
+    TxToJSON(tx, hashBlock, out);
+    out.EndObject();
+    return true;
+}
+
 Value listunspent(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 3)
@@ -465,6 +519,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
 
     // Sign what we can:
+    CSignatureHashCache sighashcache(mergedTx);
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++)
     {
         CTxIn& txin = mergedTx.vin[i];
@@ -582,7 +637,7 @@ Value decryptsend(const Array& params, bool fHelp)
     // look for existing matching timestamps in wallet (ghetto uid)
     // should handle replay with scriptsig in future (version 2)
     LOCK(pwalletMain->cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin();
+    for (CHashMap<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin();
          it != pwalletMain->mapWallet.end(); ++it) {
              const CWalletTx* pcoin = &(*it).second;
              if (pcoin->nTime == nTime) {
@@ -642,3 +697,121 @@ Value sendrawtransaction(const Array& params, bool fHelp)
 
     return hashTx.GetHex();
 }
+
+static CAddrIndexId AddrIndexIdFromParam(const Value& param)
+{
+    if (!fAddrIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is disabled (start with -addrindex)");
+
+    CBitcoinAddress address(param.get_str());
+    CAddrIndexId id;
+    if (!address.IsValid() || !id.Set(address.Get()))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid TheGCCcoin address");
+    return id;
+}
+
+static unsigned int AddrIndexUIntParam(const Array& params, unsigned int n, unsigned int nDefault)
+{
+    if (params.size() <= n)
+        return nDefault;
+    int nValue = params[n].get_int();
+    if (nValue < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative skip or count");
+    return nValue;
+}
+
+Value getaddressbalance(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance <address>\n"
+            "Returns the confirmed balance and number of unspent outputs of <address>.\n"
+            "Requires -addrindex; indexheight tells how far the index has been built.");
+
+    CAddrIndexId id = AddrIndexIdFromParam(params[0]);
+
+    CTxDB txdb("r");
+    vector<pair<COutPoint, CAddrUnspent> > vUnspent;
+    if (!txdb.ReadAddrUnspents(id, 0, 0, vUnspent))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Address index read failed");
+
+    int64 nBalance = 0;
+    for (unsigned int i = 0; i < vUnspent.size(); i++)
+        nBalance += vUnspent[i].second.nValue;
+
+    Object result;
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("utxos", (int)vUnspent.size()));
+    result.push_back(Pair("indexheight", nAddrIndexHeight));
+    return result;
+}
+
+Value getaddressutxos(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddressutxos <address> [skip=0] [count=0]\n"
+            "Returns the unspent outputs of <address> as an array of Objects\n"
+            "{txid, vout, amount, height, confirmations, scriptPubKey}.\n"
+            "count=0 returns all outputs after the first <skip>. Requires -addrindex.");
+
+    CAddrIndexId id = AddrIndexIdFromParam(params[0]);
+    unsigned int nSkip = AddrIndexUIntParam(params, 1, 0);
+    unsigned int nCount = AddrIndexUIntParam(params, 2, 0);
+
+    CTxDB txdb("r");
+    vector<pair<COutPoint, CAddrUnspent> > vUnspent;
+    if (!txdb.ReadAddrUnspents(id, nSkip, nCount, vUnspent))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Address index read failed");
+
+    Array results;
+    for (unsigned int i = 0; i < vUnspent.size(); i++)
+    {
+        const COutPoint& outpoint = vUnspent[i].first;
+        const CAddrUnspent& unspent = vUnspent[i].second;
+        Object entry;
+        entry.push_back(Pair("txid", outpoint.hash.GetHex()));
+        entry.push_back(Pair("vout", (int)outpoint.n));
+        entry.push_back(Pair("amount", ValueFromAmount(unspent.nValue)));
+        entry.push_back(Pair("height", unspent.nHeight));
+        entry.push_back(Pair("confirmations", nBestHeight - unspent.nHeight + 1));
+        entry.push_back(Pair("scriptPubKey", HexStr(unspent.scriptPubKey.begin(), unspent.scriptPubKey.end())));
+        results.push_back(entry);
+    }
+    return results;
+}
+
+Value getaddresshistory(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 5)
+        throw runtime_error(
+            "getaddresshistory <address> [skip=0] [count=100] [fromheight=0] [toheight=-1]\n"
+            "Returns the credits and spends of <address> in chain order as an array of Objects\n"
+            "{txid, height, category, index, amount}; index is the vout of a receive or\n"
+            "the vin of a spend. toheight=-1 means up to the best block. Requires -addrindex.");
+
+    CAddrIndexId id = AddrIndexIdFromParam(params[0]);
+    unsigned int nSkip = AddrIndexUIntParam(params, 1, 0);
+    unsigned int nCount = AddrIndexUIntParam(params, 2, 100);
+    int nFromHeight = params.size() > 3 ? params[3].get_int() : 0;
+    int nToHeight = params.size() > 4 ? params[4].get_int() : -1;
+
+    CTxDB txdb("r");
+    vector<pair<CAddrIndexKey, CAddrIndexValue> > vHistory;
+    if (!txdb.ReadAddrHistory(id, nFromHeight, nToHeight, nSkip, nCount, vHistory))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Address index read failed");
+
+    Array results;
+    for (unsigned int i = 0; i < vHistory.size(); i++)
+    {
+        const CAddrIndexKey& key = vHistory[i].first;
+        Object entry;
+        entry.push_back(Pair("txid", key.txhash.GetHex()));
+        entry.push_back(Pair("height", key.nHeight));
+        entry.push_back(Pair("category", key.fSpend ? "send" : "receive"));
+        entry.push_back(Pair("index", (int)key.nIndex));
+        entry.push_back(Pair("amount", ValueFromAmount(key.fSpend ? -vHistory[i].second.nValue : vHistory[i].second.nValue)));
+        results.push_back(entry);
+    }
+    return results;
+}
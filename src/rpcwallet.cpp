@@ -8,6 +8,7 @@
 #include "bitcoinrpc.h"
 #include "init.h"
 #include "base58.h"
+#include "jsonwriter.h"
 #include "stealthaddress.h"
 
 using namespace json_spirit;
@@ -33,27 +34,44 @@ void EnsureWalletIsUnlocked()
         throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Wallet unlocked for block minting only.");
 }
 
-void WalletTxToJSON(const CWalletTx& wtx, Object& entry)
+static void WalletTxToJSON(const CWalletTx& wtx, CJSONWriter& out)
 {
     int confirms = wtx.GetDepthInMainChain();
-    entry.push_back(Pair("confirmations", confirms));
+    out.Pair("confirmations", confirms);
     if (wtx.IsCoinBase() || wtx.IsCoinStake())
-        entry.push_back(Pair("generated", true));
+        out.Pair("generated", true);
     if (confirms > 0)
     {
-        entry.push_back(Pair("blockhash", wtx.hashBlock.GetHex()));
-        entry.push_back(Pair("blockindex", wtx.nIndex));
-        std::map<uint256, CBlockIndex*>::const_iterator it = mapBlockIndex.find(wtx.hashBlock);
+        out.Key("blockhash");
+        out.Hash(wtx.hashBlock);
+        out.Pair("blockindex", wtx.nIndex);
+        CHashMap<uint256, CBlockIndex*>::const_iterator it = mapBlockIndex.find(wtx.hashBlock);
         if (it != mapBlockIndex.end())
-            entry.push_back(Pair("blocktime", (boost::int64_t)(it->second->nTime)));
+            out.Pair("blocktime", (int64)(it->second->nTime));
         else
             throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Error: Block hash %s was not found in the block index.", wtx.hashBlock.ToString().c_str()));
     }
-    entry.push_back(Pair("txid", wtx.GetHash().GetHex()));
-    entry.push_back(Pair("time", (boost::int64_t)wtx.GetTxTime()));
-    entry.push_back(Pair("timereceived", (boost::int64_t)wtx.nTimeReceived));
+    out.Key("txid");
+    out.Hash(wtx.GetHash());
+    out.Pair("time", (int64)wtx.GetTxTime());
+    out.Pair("timereceived", (int64)wtx.nTimeReceived);
     BOOST_FOREACH(const PAIRTYPE(string,string)& item, wtx.mapValue)
-        entry.push_back(Pair(item.first, item.second));
+    {
+        out.Key(item.first);
+        out.String(item.second);
+    }
+}
+
+void WalletTxToJSON(const CWalletTx& wtx, Object& entry)
+{
+    string strJSON;
+    CJSONWriter out(strJSON);
+    out.BeginObject();
+    WalletTxToJSON(wtx, out);
+    out.EndObject();
+    Value val = JSONWriterValue(strJSON);
+    const Object& obj = val.get_obj();
+    entry.insert(entry.end(), obj.begin(), obj.end());
 }
 
 string AccountFromValue(const Value& value)
@@ -93,6 +111,8 @@ Value getinfo(const Array& params, bool fHelp)
     obj.push_back(Pair("paytxfee",      ValueFromAmount(nTransactionFee)));
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", (boost::int64_t)nWalletUnlockTime / 1000));
+    if (pwalletMain->nRescanProgress >= 0)
+        obj.push_back(Pair("rescanprogress", pwalletMain->nRescanProgress));
     obj.push_back(Pair("errors",        GetWarnings("statusbar")));
     return obj;
 }
@@ -169,7 +189,7 @@ CBitcoinAddress GetAccountAddress(string strAccount, bool bForceNew=false)
     {
         CScript scriptPubKey;
         scriptPubKey.SetDestination(account.vchPubKey.GetID());
-        for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin();
+        for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin();
              it != pwalletMain->mapWallet.end() && account.vchPubKey.IsValid();
              ++it)
         {
@@ -462,7 +482,7 @@ Value getreceivedbyaddress(const Array& params, bool fHelp)
 
     // Tally
     int64 nAmount = 0;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
     {
         const CWalletTx& wtx = (*it).second;
         if (wtx.IsCoinBase() || wtx.IsCoinStake() || !wtx.IsFinal())
@@ -508,7 +528,7 @@ Value getreceivedbyaccount(const Array& params, bool fHelp)
 
     // Tally
     int64 nAmount = 0;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
     {
         const CWalletTx& wtx = (*it).second;
         if (wtx.IsCoinBase() || wtx.IsCoinStake() || !wtx.IsFinal())
@@ -532,7 +552,7 @@ int64 GetAccountBalance(CWalletDB& walletdb, const string& strAccount, int nMinD
     int64 nBalance = 0;
 
     // Tally wallet transactions
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
     {
         const CWalletTx& wtx = (*it).second;
         if (!wtx.IsFinal() || wtx.GetDepthInMainChain() < 0)
@@ -584,7 +604,7 @@ Value getbalance(const Array& params, bool fHelp)
         // (GetBalance() sums up all unspent TxOuts)
         // getbalance and getbalance '*' should always return the same number.
         int64 nBalance = 0;
-        for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+        for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
         {
             const CWalletTx& wtx = (*it).second;
             if (!wtx.IsFinal())
@@ -911,7 +931,7 @@ Value ListReceived(const Array& params, bool fByAccounts)
 
     // Tally
     map<CBitcoinAddress, tallyitem> mapTally;
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
     {
         const CWalletTx& wtx = (*it).second;
 
@@ -1017,13 +1037,22 @@ Value listreceivedbyaccount(const Array& params, bool fHelp)
 
     return ListReceived(params, true);
 }
-static void MaybePushAddress(Object & entry, const CTxDestination &dest)
+static void MaybePushAddress(CJSONWriter& out, const CTxDestination &dest)
 {
     CBitcoinAddress addr;
     if (addr.Set(dest))
-        entry.push_back(Pair("address", addr.ToString()));
+        out.Pair("address", addr.ToString());
 }
-void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDepth, bool fLong, Array& ret)
+
+// Closes an entry object and, with pvEntryEnd set, records where it ends
+static void EndEntry(CJSONWriter& out, vector<size_t>* pvEntryEnd)
+{
+    out.EndObject();
+    if (pvEntryEnd)
+        pvEntryEnd->push_back(out.Size());
+}
+
+static void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDepth, bool fLong, CJSONWriter& out, vector<size_t>* pvEntryEnd)
 {
     int64 nGeneratedImmature, nGeneratedMature, nFee;
     string strSentAccount;
@@ -1037,21 +1066,23 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
     // Generated blocks assigned to account ""
     if ((nGeneratedMature+nGeneratedImmature) != 0 && (fAllAccounts || strAccount == ""))
     {
-        Object entry;
-        entry.push_back(Pair("account", string("")));
+        out.BeginObject();
+        out.Pair("account", "");
         if (nGeneratedImmature)
         {
-            entry.push_back(Pair("category", wtx.GetDepthInMainChain() ? "immature" : "orphan"));
-            entry.push_back(Pair("amount", ValueFromAmount(nGeneratedImmature)));
+            out.Pair("category", wtx.GetDepthInMainChain() ? "immature" : "orphan");
+            out.Key("amount");
+            out.Amount(nGeneratedImmature);
         }
         else
         {
-            entry.push_back(Pair("category", "generate"));
-            entry.push_back(Pair("amount", ValueFromAmount(nGeneratedMature)));
+            out.Pair("category", "generate");
+            out.Key("amount");
+            out.Amount(nGeneratedMature);
         }
         if (fLong)
-            WalletTxToJSON(wtx, entry);
-        ret.push_back(entry);
+            WalletTxToJSON(wtx, out);
+        EndEntry(out, pvEntryEnd);
     }
 
     // Sent
@@ -1059,16 +1090,17 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
     {
         BOOST_FOREACH(const PAIRTYPE(CTxDestination, int64)& s, listSent)
         {
-            Object entry;
-            entry.push_back(Pair("account", strSentAccount));
-            //entry.push_back(Pair("address", CBitcoinAddress(s.first).ToString()));
-            MaybePushAddress(entry, s.first);
-            entry.push_back(Pair("category", "send"));
-            entry.push_back(Pair("amount", ValueFromAmount(-s.second)));
-            entry.push_back(Pair("fee", ValueFromAmount(-nFee)));
+            out.BeginObject();
+            out.Pair("account", strSentAccount);
+            MaybePushAddress(out, s.first);
+            out.Pair("category", "send");
+            out.Key("amount");
+            out.Amount(-s.second);
+            out.Key("fee");
+            out.Amount(-nFee);
             if (fLong)
-                WalletTxToJSON(wtx, entry);
-            ret.push_back(entry);
+                WalletTxToJSON(wtx, out);
+            EndEntry(out, pvEntryEnd);
         }
     }
 
@@ -1082,60 +1114,69 @@ void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDe
                 account = pwalletMain->mapAddressBook[r.first];
             if (fAllAccounts || (account == strAccount))
             {
-                Object entry;
-                entry.push_back(Pair("account", account));
-                entry.push_back(Pair("address", CBitcoinAddress(r.first).ToString()));
+                out.BeginObject();
+                out.Pair("account", account);
+                out.Pair("address", CBitcoinAddress(r.first).ToString());
                 if (wtx.IsCoinBase())
                 {
                     if (wtx.GetDepthInMainChain() < 1)
-                        entry.push_back(Pair("category", "orphan"));
+                        out.Pair("category", "orphan");
                     else if (wtx.GetBlocksToMaturity() > 0)
-                        entry.push_back(Pair("category", "immature"));
+                        out.Pair("category", "immature");
                     else
-                        entry.push_back(Pair("category", "generate"));
+                        out.Pair("category", "generate");
                 }
                 else
-                    entry.push_back(Pair("category", "receive"));
-                entry.push_back(Pair("amount", ValueFromAmount(r.second)));
+                    out.Pair("category", "receive");
+                out.Key("amount");
+                out.Amount(r.second);
                 if (fLong)
-                    WalletTxToJSON(wtx, entry);
-                ret.push_back(entry);
+                    WalletTxToJSON(wtx, out);
+                EndEntry(out, pvEntryEnd);
             }
         }
     }
 }
 
-void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Array& ret)
+void ListTransactions(const CWalletTx& wtx, const string& strAccount, int nMinDepth, bool fLong, Array& ret)
+{
+    string strJSON;
+    CJSONWriter out(strJSON);
+    out.BeginArray();
+    ListTransactions(wtx, strAccount, nMinDepth, fLong, out, NULL);
+    out.EndArray();
+    Value val = JSONWriterValue(strJSON);
+    const Array& entries = val.get_array();
+    ret.insert(ret.end(), entries.begin(), entries.end());
+}
+
+static void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, CJSONWriter& out, vector<size_t>* pvEntryEnd)
 {
     bool fAllAccounts = (strAccount == string("*"));
 
     if (fAllAccounts || acentry.strAccount == strAccount)
     {
-        Object entry;
-        entry.push_back(Pair("account", acentry.strAccount));
-        entry.push_back(Pair("category", "move"));
-        entry.push_back(Pair("time", (boost::int64_t)acentry.nTime));
-        entry.push_back(Pair("amount", ValueFromAmount(acentry.nCreditDebit)));
-        entry.push_back(Pair("otheraccount", acentry.strOtherAccount));
-        entry.push_back(Pair("comment", acentry.strComment));
-        ret.push_back(entry);
+        out.BeginObject();
+        out.Pair("account", acentry.strAccount);
+        out.Pair("category", "move");
+        out.Pair("time", (int64)acentry.nTime);
+        out.Key("amount");
+        out.Amount(acentry.nCreditDebit);
+        out.Pair("otheraccount", acentry.strOtherAccount);
+        out.Pair("comment", acentry.strComment);
+        EndEntry(out, pvEntryEnd);
     }
 }
 
-Value listtransactions(const Array& params, bool fHelp)
+static void ListTransactionsParams(const Array& params, string& strAccount, int& nCount, int& nFrom)
 {
-    if (fHelp || params.size() > 3)
-        throw runtime_error(
-            "listtransactions [account] [count=10] [from=0]\n"
-            "Returns up to [count] most recent transactions skipping the first [from] transactions for account [account].");
-
-    string strAccount = "*";
+    strAccount = "*";
     if (params.size() > 0)
         strAccount = params[0].get_str();
-    int nCount = 10;
+    nCount = 10;
     if (params.size() > 1)
         nCount = params[1].get_int();
-    int nFrom = 0;
+    nFrom = 0;
     if (params.size() > 2)
         nFrom = params[2].get_int();
 
@@ -1143,41 +1184,67 @@ Value listtransactions(const Array& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+}
 
-    Array ret;
-
+// Writes the array of entries [nFrom, nFrom+nCount) counting from the newest,
+// oldest first. Entries are written newest first into a scratch buffer until
+// enough are found, then the selected ones are copied out in reverse.
+static void ListTransactionsNewestFirst(const string& strAccount, int nCount, int nFrom, CJSONWriter& out)
+{
     std::list<CAccountingEntry> acentries;
     CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
 
-    // iterate backwards until we have nCount items to return:
+    string strEntries;
+    CJSONWriter entries(strEntries);
+    vector<size_t> vEntryEnd;
+
+    // iterate backwards until we have nCount+nFrom items:
     for (CWallet::TxItems::reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
     {
         CWalletTx *const pwtx = (*it).second.first;
         if (pwtx != 0)
-            ListTransactions(*pwtx, strAccount, 0, true, ret);
+            ListTransactions(*pwtx, strAccount, 0, true, entries, &vEntryEnd);
         CAccountingEntry *const pacentry = (*it).second.second;
         if (pacentry != 0)
-            AcentryToJSON(*pacentry, strAccount, ret);
+            AcentryToJSON(*pacentry, strAccount, entries, &vEntryEnd);
 
-        if ((int)ret.size() >= (nCount+nFrom)) break;
+        if ((int)vEntryEnd.size() >= nCount+nFrom) break;
     }
-    // ret is newest to oldest
 
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-    Array::iterator first = ret.begin();
-    std::advance(first, nFrom);
-    Array::iterator last = ret.begin();
-    std::advance(last, nFrom+nCount);
+    int nEnd = std::min((int)vEntryEnd.size(), nCount+nFrom);
+    out.BeginArray();
+    for (int i = nEnd - 1; i >= nFrom; i--) // Return oldest to newest
+    {
+        size_t nBegin = (i > 0 ? vEntryEnd[i-1] : 0);
+        out.Raw(strEntries.data() + nBegin, vEntryEnd[i] - nBegin);
+    }
+    out.EndArray();
+}
 
-    if (last != ret.end()) ret.erase(last, ret.end());
-    if (first != ret.begin()) ret.erase(ret.begin(), first);
+Value listtransactions(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 3)
+        throw runtime_error(
+            "listtransactions [account] [count=10] [from=0]\n"
+            "Returns up to [count] most recent transactions skipping the first [from] transactions for account [account].");
 
-    std::reverse(ret.begin(), ret.end()); // Return oldest to newest
+    string strJSON;
+    CJSONWriter out(strJSON);
+    listtransactions_stream(params, out);
+    return JSONWriterValue(strJSON);
+}
 
-    return ret;
+bool listtransactions_stream(const Array& params, CJSONWriter& out)
+{
+    if (params.size() > 3)
+        return false;
+
+    string strAccount;
+    int nCount, nFrom;
+    ListTransactionsParams(params, strAccount, nCount, nFrom);
+
+    ListTransactionsNewestFirst(strAccount, nCount, nFrom, out);
+    return true;
 }
 
 Value listaccounts(const Array& params, bool fHelp)
@@ -1197,7 +1264,7 @@ Value listaccounts(const Array& params, bool fHelp)
             mapAccountBalances[entry.second] = 0;
     }
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
     {
         const CWalletTx& wtx = (*it).second;
 
@@ -1272,7 +1339,7 @@ Value listsinceblock(const Array& params, bool fHelp)
 
     Array transactions;
 
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++)
     {
         CWalletTx tx = (*it).second;
 
@@ -1351,7 +1418,7 @@ Value gettransaction(const Array& params, bool fHelp)
             else
             {
                 entry.push_back(Pair("blockhash", hashBlock.GetHex()));
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+                CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
                 if (mi != mapBlockIndex.end() && (*mi).second)
                 {
                     CBlockIndex* pindex = (*mi).second;
@@ -2203,6 +2270,7 @@ Value scanforalltxns(const Array& params, bool fHelp)
 
     if (nFromHeight > 0)
     {
+        LOCK(cs_main);
         pindex = mapBlockIndex[hashBestChain];
         while (pindex->nHeight > nFromHeight
             && pindex->pprev)
@@ -2213,11 +2281,19 @@ Value scanforalltxns(const Array& params, bool fHelp)
         throw runtime_error("Genesis Block is not set.");
 
     {
-        LOCK2(cs_main, pwalletMain->cs_wallet);
-
+        LOCK(pwalletMain->cs_wallet);
         pwalletMain->MarkDirty();
+    }
+
+    bool fAborted, fFailed;
+    pwalletMain->ScanForWalletTransactions(pindex, true, &fAborted, &fFailed);
+    if (fFailed)
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Scan could not read a block, see debug.log");
+    if (fAborted)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Scan aborted.");
 
-        pwalletMain->ScanForWalletTransactions(pindex, true);
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
         pwalletMain->ReacceptWalletTransactions();
     }
 
@@ -2226,6 +2302,19 @@ Value scanforalltxns(const Array& params, bool fHelp)
     return result;
 }
 
+Value abortrescan(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "Stops a running wallet rescan, as started by importprivkey or scanforalltxns.");
+
+    if (pwalletMain->nRescanProgress < 0)
+        return false;
+    pwalletMain->fAbortRescan = true;
+    return true;
+}
+
 Value scanforstealthtxns(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -2268,6 +2357,7 @@ Value scanforstealthtxns(const Array& params, bool fHelp)
         nBlocks++;
         CBlock block;
         block.ReadFromDisk(pindex, true);
+        pwalletMain->ScanBlockForStealth(block.vtx);
 
         BOOST_FOREACH(CTransaction& tx, block.vtx)
         {
@@ -5,6 +5,7 @@
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/tuple/tuple_comparison.hpp>
+#include <boost/thread/tss.hpp>
 
 using namespace std;
 using namespace boost;
@@ -18,25 +19,15 @@ using namespace boost;
 #include "util.h"
 #include "stealthaddress.h"
 
-bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+bool CheckSig(const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey, const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 
 static const valtype vchFalse(0);
 static const valtype vchZero(0);
 static const valtype vchTrue(1, 1);
-static const CBigNum bnZero(0);
-static const CBigNum bnOne(1);
-static const CBigNum bnFalse(0);
-static const CBigNum bnTrue(1);
-static const size_t nMaxNumSize = 4;
-
-
-CBigNum CastToBigNum(const valtype& vch)
-{
-    if (vch.size() > nMaxNumSize)
-        throw runtime_error("CastToBigNum() : overflow");
-    // Get rid of extra leading zeros
-    return CBigNum(CBigNum(vch).getvch());
-}
+static const CScriptNum bnZero(0);
+static const CScriptNum bnOne(1);
+static const CScriptNum bnFalse(0);
+static const CScriptNum bnTrue(1);
 
 bool CastToBool(const valtype& vch)
 {
@@ -256,7 +247,6 @@ const char* GetOpName(opcodetype opcode)
 
 bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
-    CAutoBN_CTX pctx;
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
     CScript::const_iterator pbegincodehash = script.begin();
@@ -329,7 +319,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 case OP_16:
                 {
                     // ( -- value)
-                    CBigNum bn((int)opcode - (int)(OP_1 - 1));
+                    CScriptNum bn((int)opcode - (int)(OP_1 - 1));
                     stack.push_back(bn.getvch());
                 }
                 break;
@@ -505,7 +495,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 case OP_DEPTH:
                 {
                     // -- stacksize
-                    CBigNum bn(stack.size());
+                    CScriptNum bn(stack.size());
                     stack.push_back(bn.getvch());
                 }
                 break;
@@ -555,7 +545,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (xn ... x2 x1 x0 n - ... x2 x1 x0 xn)
                     if (stack.size() < 2)
                         return false;
-                    int n = CastToBigNum(stacktop(-1)).getint();
+                    int n = CScriptNum(stacktop(-1)).getint();
                     popstack(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return false;
@@ -621,8 +611,8 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if (stack.size() < 3)
                         return false;
                     valtype& vch = stacktop(-3);
-                    int nBegin = CastToBigNum(stacktop(-2)).getint();
-                    int nEnd = nBegin + CastToBigNum(stacktop(-1)).getint();
+                    int nBegin = CScriptNum(stacktop(-2)).getint();
+                    int nEnd = nBegin + CScriptNum(stacktop(-1)).getint();
                     if (nBegin < 0 || nEnd < nBegin)
                         return false;
                     if (nBegin > (int)vch.size())
@@ -643,7 +633,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if (stack.size() < 2)
                         return false;
                     valtype& vch = stacktop(-2);
-                    int nSize = CastToBigNum(stacktop(-1)).getint();
+                    int nSize = CScriptNum(stacktop(-1)).getint();
                     if (nSize < 0)
                         return false;
                     if (nSize > (int)vch.size())
@@ -661,7 +651,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (in -- in size)
                     if (stack.size() < 1)
                         return false;
-                    CBigNum bn(stacktop(-1).size());
+                    CScriptNum bn(stacktop(-1).size());
                     stack.push_back(bn.getvch());
                 }
                 break;
@@ -749,8 +739,6 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                 //
                 case OP_1ADD:
                 case OP_1SUB:
-                case OP_2MUL:
-                case OP_2DIV:
                 case OP_NEGATE:
                 case OP_ABS:
                 case OP_NOT:
@@ -759,13 +747,11 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (in -- out)
                     if (stack.size() < 1)
                         return false;
-                    CBigNum bn = CastToBigNum(stacktop(-1));
+                    CScriptNum bn(stacktop(-1));
                     switch (opcode)
                     {
                     case OP_1ADD:       bn += bnOne; break;
                     case OP_1SUB:       bn -= bnOne; break;
-                    case OP_2MUL:       bn <<= 1; break;
-                    case OP_2DIV:       bn >>= 1; break;
                     case OP_NEGATE:     bn = -bn; break;
                     case OP_ABS:        if (bn < bnZero) bn = -bn; break;
                     case OP_NOT:        bn = (bn == bnZero); break;
@@ -779,11 +765,6 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
 
                 case OP_ADD:
                 case OP_SUB:
-                case OP_MUL:
-                case OP_DIV:
-                case OP_MOD:
-                case OP_LSHIFT:
-                case OP_RSHIFT:
                 case OP_BOOLAND:
                 case OP_BOOLOR:
                 case OP_NUMEQUAL:
@@ -799,9 +780,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x1 x2 -- out)
                     if (stack.size() < 2)
                         return false;
-                    CBigNum bn1 = CastToBigNum(stacktop(-2));
-                    CBigNum bn2 = CastToBigNum(stacktop(-1));
-                    CBigNum bn;
+                    CScriptNum bn1(stacktop(-2));
+                    CScriptNum bn2(stacktop(-1));
+                    CScriptNum bn(0);
                     switch (opcode)
                     {
                     case OP_ADD:
@@ -812,33 +793,6 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                         bn = bn1 - bn2;
                         break;
 
-                    case OP_MUL:
-                        if (!BN_mul(&bn, &bn1, &bn2, pctx))
-                            return false;
-                        break;
-
-                    case OP_DIV:
-                        if (!BN_div(&bn, NULL, &bn1, &bn2, pctx))
-                            return false;
-                        break;
-
-                    case OP_MOD:
-                        if (!BN_mod(&bn, &bn1, &bn2, pctx))
-                            return false;
-                        break;
-
-                    case OP_LSHIFT:
-                        if (bn2 < bnZero || bn2 > CBigNum(2048))
-                            return false;
-                        bn = bn1 << bn2.getulong();
-                        break;
-
-                    case OP_RSHIFT:
-                        if (bn2 < bnZero || bn2 > CBigNum(2048))
-                            return false;
-                        bn = bn1 >> bn2.getulong();
-                        break;
-
                     case OP_BOOLAND:             bn = (bn1 != bnZero && bn2 != bnZero); break;
                     case OP_BOOLOR:              bn = (bn1 != bnZero || bn2 != bnZero); break;
                     case OP_NUMEQUAL:            bn = (bn1 == bn2); break;
@@ -871,9 +825,9 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     // (x min max -- out)
                     if (stack.size() < 3)
                         return false;
-                    CBigNum bn1 = CastToBigNum(stacktop(-3));
-                    CBigNum bn2 = CastToBigNum(stacktop(-2));
-                    CBigNum bn3 = CastToBigNum(stacktop(-1));
+                    CScriptNum bn1(stacktop(-3));
+                    CScriptNum bn2(stacktop(-2));
+                    CScriptNum bn3(stacktop(-1));
                     bool fValue = (bn2 <= bn1 && bn1 < bn3);
                     popstack(stack);
                     popstack(stack);
@@ -969,7 +923,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if ((int)stack.size() < i)
                         return false;
 
-                    int nKeysCount = CastToBigNum(stacktop(-i)).getint();
+                    int nKeysCount = CScriptNum(stacktop(-i)).getint();
                     if (nKeysCount < 0 || nKeysCount > 20)
                         return false;
                     nOpCount += nKeysCount;
@@ -980,7 +934,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
                     if ((int)stack.size() < i)
                         return false;
 
-                    int nSigsCount = CastToBigNum(stacktop(-i)).getint();
+                    int nSigsCount = CScriptNum(stacktop(-i)).getint();
                     if (nSigsCount < 0 || nSigsCount > nKeysCount)
                         return false;
                     int isig = ++i;
@@ -1063,79 +1017,151 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, co
 
 
 
-uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+// The CSignatureHashCache of this thread, if any
+static void SignatureHashCacheNoCleanup(CSignatureHashCache*) { }
+static boost::thread_specific_ptr<CSignatureHashCache> pSignatureHashCache(SignatureHashCacheNoCleanup);
+
+uint256 SignatureHash(const CScript& scriptCodeIn, const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
     if (nIn >= txTo.vin.size())
     {
         printf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
         return 1;
     }
-    CTransaction txTmp(txTo);
 
     // In case concatenating two scripts ends up with two codeseparators,
     // or an extra one at the end, this prevents all those possible incompatibilities.
-    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+    // A script without the byte anywhere has none to remove and is used as it is
+    CScript scriptCodeCopy;
+    const CScript* pscriptCode = &scriptCodeIn;
+    if (find(scriptCodeIn.begin(), scriptCodeIn.end(), (unsigned char)OP_CODESEPARATOR) != scriptCodeIn.end())
+    {
+        scriptCodeCopy = scriptCodeIn;
+        scriptCodeCopy.FindAndDelete(CScript(OP_CODESEPARATOR));
+        pscriptCode = &scriptCodeCopy;
+    }
+    const CScript& scriptCode = *pscriptCode;
 
-    // Blank out other inputs' signatures
-    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-        txTmp.vin[i].scriptSig = CScript();
-    txTmp.vin[nIn].scriptSig = scriptCode;
+    bool fNone = (nHashType & 0x1f) == SIGHASH_NONE;
+    bool fSingle = (nHashType & 0x1f) == SIGHASH_SINGLE;
+    bool fAnyoneCanPay = (nHashType & SIGHASH_ANYONECANPAY) != 0;
+    if (fSingle && nIn >= txTo.vout.size())
+    {
+        printf("ERROR: SignatureHash() : nOut=%d out of range\n", nIn);
+        return 1;
+    }
 
-    // Blank out some of the outputs
-    if ((nHashType & 0x1f) == SIGHASH_NONE)
+    CSignatureHashCache* pcache = pSignatureHashCache.get();
+    if (!fNone && !fSingle && !fAnyoneCanPay && pcache && pcache->Covers(txTo))
+        return pcache->SignatureHashAll(scriptCode, nIn, nHashType);
+
+    // Serialize and hash the transaction as it would be with other inputs'
+    // signatures blanked, scriptCode in place of this one's, and the hash
+    // type's changes, without making that copy of it
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.nVersion << txTo.nTime;
+
+    // Blank out other inputs completely, not recommended for open transactions
+    WriteCompactSize(ss, fAnyoneCanPay ? 1 : txTo.vin.size());
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
     {
-        // Wildcard payee
-        txTmp.vout.clear();
+        if (fAnyoneCanPay && i != nIn)
+            continue;
+        // Blank out other inputs' signatures, and with NONE and SINGLE
+        // let the others update at will
+        const CTxIn& txin = txTo.vin[i];
+        ss << txin.prevout;
+        if (i == nIn)
+            ss << scriptCode << txin.nSequence;
+        else
+            ss << CScript() << ((fNone || fSingle) ? (unsigned int)0 : txin.nSequence);
+    }
 
-        // Let the others update at will
-        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-            if (i != nIn)
-                txTmp.vin[i].nSequence = 0;
+    if (fNone)
+    {
+        // Wildcard payee
+        WriteCompactSize(ss, 0);
     }
-    else if ((nHashType & 0x1f) == SIGHASH_SINGLE)
+    else if (fSingle)
     {
         // Only lock-in the txout payee at same index as txin
-        unsigned int nOut = nIn;
-        if (nOut >= txTmp.vout.size())
-        {
-            printf("ERROR: SignatureHash() : nOut=%d out of range\n", nOut);
-            return 1;
-        }
-        txTmp.vout.resize(nOut+1);
-        for (unsigned int i = 0; i < nOut; i++)
-            txTmp.vout[i].SetNull();
+        WriteCompactSize(ss, nIn + 1);
+        CTxOut txoutNull;
+        for (unsigned int i = 0; i < nIn; i++)
+            ss << txoutNull;
+        ss << txTo.vout[nIn];
+    }
+    else
+        ss << txTo.vout;
 
-        // Let the others update at will
-        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-            if (i != nIn)
-                txTmp.vin[i].nSequence = 0;
+    ss << txTo.nLockTime << nHashType;
+    return ss.GetHash();
+}
+
+CSignatureHashCache::CSignatureHashCache(const CTransaction& txTo)
+{
+    ptx = &txTo;
+    nInputs = txTo.vin.size();
+    pprev = pSignatureHashCache.get();
+    pSignatureHashCache.reset(this);
+}
+
+CSignatureHashCache::~CSignatureHashCache()
+{
+    pSignatureHashCache.reset(pprev);
+}
+
+bool CSignatureHashCache::Covers(const CTransaction& txTo) const
+{
+    return &txTo == ptx && txTo.vin.size() == nInputs;
+}
+
+// Made on first use, as signatures are not always checked
+void CSignatureHashCache::Build()
+{
+    CDataStream ss(SER_GETHASH, 0);
+    ss << ptx->nVersion << ptx->nTime;
+    WriteCompactSize(ss, ptx->vin.size());
+    BOOST_FOREACH(const CTxIn& txin, ptx->vin)
+    {
+        ss << txin.prevout;
+        vInputPos.push_back(ss.size());
+        ss << CScript() << txin.nSequence;
     }
+    ss << ptx->vout << ptx->nLockTime;
+    vchBlank.assign(ss.begin(), ss.end());
+    vMidstate.reserve(vInputPos.size());
+}
 
-    // Blank out other inputs completely, not recommended for open transactions
-    if (nHashType & SIGHASH_ANYONECANPAY)
+uint256 CSignatureHashCache::SignatureHashAll(const CScript& scriptCode, unsigned int nIn, int nHashType)
+{
+    if (vchBlank.empty())
+        Build();
+
+    // Inputs are usually signed and checked in order, so each midstate
+    // extends the one before
+    while (vMidstate.size() <= nIn)
     {
-        txTmp.vin[0] = txTmp.vin[nIn];
-        txTmp.vin.resize(1);
+        SHA256_CTX ctx;
+        unsigned int nFrom = 0;
+        if (vMidstate.empty())
+            SHA256_Init(&ctx);
+        else
+        {
+            ctx = vMidstate.back();
+            nFrom = vInputPos[vMidstate.size() - 1];
+        }
+        SHA256_Update(&ctx, &vchBlank[nFrom], vInputPos[vMidstate.size()] - nFrom);
+        vMidstate.push_back(ctx);
     }
 
-    // Serialize and hash
-    CDataStream ss(SER_GETHASH, 0);
-    ss.reserve(10000);
-    ss << txTmp << nHashType;
-
-    //x l.x.1 llog SignatureHash - todo: recheck [
-/*
-    std::vector<char> v = std::vector<char>(ss.begin(), ss.end());
-
-//    llogLog(L"SignatureHash", L"ss", static_cast<const void*>(v.data()), v.size(), 0);
-    std::wostringstream ss1;
-//    ss1 << "size" << v.size() << "\nhash " << Hash(ss.begin(), ss.end()).GetHex().c_str() << "\n";
-    ss1 << "hash " << Hash(ss.begin(), ss.end()).GetHex().c_str() << "\n";
-    llogLog(L"SignatureHash", ss1.str());
-*/
-    //x l.x.1 llog SignatureHash - todo: recheck ]
-
-    return Hash(ss.begin(), ss.end());
+    // The blank scriptSig is the single byte of its empty size
+    CHashWriter ss(SER_GETHASH, 0, vMidstate[nIn]);
+    ss << scriptCode;
+    unsigned int nAfter = vInputPos[nIn] + 1;
+    ss.write((const char*)&vchBlank[nAfter], vchBlank.size() - nAfter);
+    ss << nHashType;
+    return ss.GetHash();
 }
 
 
@@ -1195,36 +1221,136 @@ public:
     }
 };
 
-bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
+static CSignatureCache signatureCache;
+
+// The CSignatureBatch collecting this thread's signature checks, if any
+static void SignatureBatchNoCleanup(CSignatureBatch*) { }
+static boost::thread_specific_ptr<CSignatureBatch> pSignatureBatch(SignatureBatchNoCleanup);
+
+bool CheckSig(const vector<unsigned char>& vchSigIn, const vector<unsigned char>& vchPubKey, const CScript& scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
-    static CSignatureCache signatureCache;
 
     // Hash type is one byte tacked on to the end of the signature
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
     if (nHashType == 0)
-        nHashType = vchSig.back();
-    else if (nHashType != vchSig.back())
+        nHashType = vchSigIn.back();
+    else if (nHashType != vchSigIn.back())
         return false;
-    vchSig.pop_back();
+    vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.end() - 1);
 
     uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
 
     if (signatureCache.Get(sighash, vchSig, vchPubKey))
         return true;
 
-    CKey key;
-    if (!key.SetPubKey(vchPubKey))
+    CSignatureBatch* pbatch = pSignatureBatch.get();
+    if (pbatch && pbatch->IsCollecting())
+        return pbatch->Defer(sighash, vchSig, vchPubKey);
+
+    CECPoint pubkey;
+    if (vchPubKey.empty() || !ECParsePubKey(&vchPubKey[0], vchPubKey.size(), pubkey))
         return false;
 
-    if (!key.Verify(sighash, vchSig))
+    if (vchSig.empty() || !ECVerify(pubkey, sighash, &vchSig[0], vchSig.size()))
         return false;
 
     signatureCache.Set(sighash, vchSig, vchPubKey);
     return true;
 }
 
+CSignatureBatch::CSignatureBatch()
+{
+    fCollecting = false;
+    assert(pSignatureBatch.get() == NULL);
+    pSignatureBatch.reset(this);
+}
+
+CSignatureBatch::~CSignatureBatch()
+{
+    pSignatureBatch.reset(NULL);
+}
+
+void CSignatureBatch::Truncate(size_t nSize)
+{
+    verifier.resize(nSize);
+    vHash.resize(nSize);
+    vSig.resize(nSize);
+    vPubKey.resize(nSize);
+    vInput.resize(nSize);
+}
+
+bool CSignatureBatch::Defer(const uint256& hash, const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey)
+{
+    // What does not parse fails now, exactly as it would in CheckSig
+    if (vchSig.empty() || vchPubKey.empty())
+        return false;
+    if (!verifier.Add(&vchPubKey[0], vchPubKey.size(), &vchSig[0], vchSig.size(), hash))
+        return false;
+    vHash.push_back(hash);
+    vSig.push_back(vchSig);
+    vPubKey.push_back(vchPubKey);
+    vInput.push_back(vInputs.size());
+    return true;
+}
+
+bool CSignatureBatch::VerifyInput(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                                  bool fValidatePayToScriptHash, int nHashType)
+{
+    size_t nFirst = vHash.size();
+    fCollecting = true;
+    bool fValid = VerifyScript(scriptSig, scriptPubKey, txTo, nIn, fValidatePayToScriptHash, nHashType);
+    fCollecting = false;
+
+    if (!fValid)
+    {
+        Truncate(nFirst);
+        return VerifyScript(scriptSig, scriptPubKey, txTo, nIn, fValidatePayToScriptHash, nHashType);
+    }
+
+    if (vHash.size() > nFirst)
+    {
+        CInputCheck check;
+        check.scriptPubKey = scriptPubKey;
+        check.ptxTo = &txTo;
+        check.nIn = nIn;
+        check.fValidatePayToScriptHash = fValidatePayToScriptHash;
+        check.nHashType = nHashType;
+        vInputs.push_back(check);
+    }
+    return true;
+}
+
+bool CSignatureBatch::Verify()
+{
+    vector<bool> vfValid;
+    verifier.Verify(vfValid);
+
+    set<unsigned int> setRecheck;
+    for (unsigned int i = 0; i < vfValid.size(); i++)
+    {
+        if (vfValid[i])
+            signatureCache.Set(vHash[i], vSig[i], vPubKey[i]);
+        else
+            setRecheck.insert(vInput[i]);
+    }
+
+    // An input may still be valid with a bad signature (the script can
+    // require one to fail), so judge it by running it for real
+    BOOST_FOREACH(unsigned int nInput, setRecheck)
+    {
+        const CInputCheck& check = vInputs[nInput];
+        const CTransaction& txTo = *check.ptxTo;
+        if (!VerifyScript(txTo.vin[check.nIn].scriptSig, check.scriptPubKey, txTo, check.nIn, check.fValidatePayToScriptHash, check.nHashType))
+            return error("CSignatureBatch::Verify() : %s input %u has an invalid signature", txTo.GetHash().ToString().substr(0,10).c_str(), check.nIn);
+    }
+
+    Truncate(0);
+    vInputs.clear();
+    return true;
+}
+
 
 
 
@@ -1646,10 +1772,215 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, vecto
     return true;
 }
 
+//
+// Standard scripts are recognized by their exact form and checked without
+// the interpreter, doing what EvalScript would do for them step by step.
+// Anything that might take a path of EvalScript not followed here, such as
+// FindAndDelete finding a signature in the scriptCode, is left to it.
+//
+
+// Fewer elements than this keep any template far below the stack limit
+static const unsigned int MAX_STANDARD_PUSHES = 100;
+
+// The data pushed by a script of nothing but data pushes
+static bool GetPushes(const CScript& script, vector<valtype>& vPushes)
+{
+    if (script.size() > 10000)
+        return false;
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    while (pc < script.end())
+    {
+        if (vPushes.size() >= MAX_STANDARD_PUSHES)
+            return false;
+        vPushes.push_back(valtype());
+        if (!script.GetOp(pc, opcode, vPushes.back()) || opcode > OP_PUSHDATA4 || vPushes.back().size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+    }
+    return true;
+}
+
+// Whether script.FindAndDelete(CScript(vch)) would find anything, without
+// making either script
+static bool FindsPush(const CScript& script, const valtype& vch)
+{
+    unsigned char pchHeader[5];
+    unsigned int nHeader;
+    if (vch.size() < OP_PUSHDATA1)
+    {
+        pchHeader[0] = vch.size();
+        nHeader = 1;
+    }
+    else if (vch.size() <= 0xff)
+    {
+        pchHeader[0] = OP_PUSHDATA1;
+        pchHeader[1] = vch.size();
+        nHeader = 2;
+    }
+    else if (vch.size() <= 0xffff)
+    {
+        unsigned short nSize = vch.size();
+        pchHeader[0] = OP_PUSHDATA2;
+        memcpy(&pchHeader[1], &nSize, sizeof(nSize));
+        nHeader = 3;
+    }
+    else
+    {
+        unsigned int nSize = vch.size();
+        pchHeader[0] = OP_PUSHDATA4;
+        memcpy(&pchHeader[1], &nSize, sizeof(nSize));
+        nHeader = 5;
+    }
+
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    do
+    {
+        if (script.end() - pc >= (long)(nHeader + vch.size()) && memcmp(&pc[0], pchHeader, nHeader) == 0 &&
+            (vch.empty() || memcmp(&pc[nHeader], &vch[0], vch.size()) == 0))
+            return true;
+    }
+    while (script.GetOp(pc, opcode));
+    return false;
+}
+
+// Run a pay-to-pubkey, pay-to-pubkey-hash or multisig script on vStack and
+// set fValid to whether it leaves true on top. False if script is none of
+// them, or vStack is not what it spends exactly
+static bool EvalStandardScript(const vector<valtype>& vStack, const CScript& script, const CTransaction& txTo, unsigned int nIn,
+                               int nHashType, bool& fValid)
+{
+    unsigned int nSize = script.size();
+
+    // OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG
+    if (nSize == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG)
+    {
+        if (vStack.size() != 2)
+            return false;
+        const valtype& vchSig = vStack[0];
+        const valtype& vchPubKey = vStack[1];
+        uint160 hash160 = Hash160(vchPubKey);
+        if (memcmp(&hash160, &script[3], 20) != 0)
+        {
+            fValid = false;
+            return true;
+        }
+        if (FindsPush(script, vchSig))
+            return false;
+        fValid = CheckSig(vchSig, vchPubKey, script, txTo, nIn, nHashType);
+        return true;
+    }
+
+    // <pubkey> OP_CHECKSIG
+    if ((nSize == 35 || nSize == 67) && script[0] == nSize - 2 && script[nSize - 1] == OP_CHECKSIG)
+    {
+        if (vStack.size() != 1)
+            return false;
+        const valtype& vchSig = vStack[0];
+        if (FindsPush(script, vchSig))
+            return false;
+        valtype vchPubKey(script.begin() + 1, script.end() - 1);
+        fValid = CheckSig(vchSig, vchPubKey, script, txTo, nIn, nHashType);
+        return true;
+    }
+
+    // OP_m <pubkey>... OP_n OP_CHECKMULTISIG, with the signatures after a
+    // dummy element that is popped too
+    if (nSize > 3 && script[0] >= OP_1 && script[0] <= OP_16 && script[nSize - 1] == OP_CHECKMULTISIG &&
+        script[nSize - 2] >= OP_1 && script[nSize - 2] <= OP_16)
+    {
+        int nSigsCount = script[0] - (OP_1 - 1);
+        int nKeysCount = script[nSize - 2] - (OP_1 - 1);
+        if (nSigsCount > nKeysCount || (int)vStack.size() != nSigsCount + 1)
+            return false;
+
+        vector<valtype> vKeys;
+        CScript::const_iterator pc = script.begin() + 1;
+        CScript::const_iterator pkeysend = script.end() - 2;
+        opcodetype opcode;
+        while (pc < pkeysend)
+        {
+            vKeys.push_back(valtype());
+            if (!script.GetOp(pc, opcode, vKeys.back()) || opcode > OP_PUSHDATA4 || vKeys.back().size() > MAX_SCRIPT_ELEMENT_SIZE)
+                return false;
+        }
+        if (pc != pkeysend || (int)vKeys.size() != nKeysCount)
+            return false;
+        for (int i = 1; i <= nSigsCount; i++)
+            if (FindsPush(script, vStack[i]))
+                return false;
+
+        // The last signature against the last key first, as EvalScript
+        int isig = nSigsCount;
+        int ikey = nKeysCount - 1;
+        bool fSuccess = true;
+        while (fSuccess && nSigsCount > 0)
+        {
+            if (CheckSig(vStack[isig], vKeys[ikey], script, txTo, nIn, nHashType))
+            {
+                isig--;
+                nSigsCount--;
+            }
+            ikey--;
+            nKeysCount--;
+
+            // If there are more signatures left than keys left,
+            // then too many signatures have failed
+            if (nSigsCount > nKeysCount)
+                fSuccess = false;
+        }
+        fValid = fSuccess;
+        return true;
+    }
+
+    return false;
+}
+
+// VerifyScript for a push-only scriptSig spending one of the templates of
+// EvalStandardScript, or pay-to-script-hash. False if it must run in full
+static bool VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                                 bool fValidatePayToScriptHash, int nHashType, bool& fValid)
+{
+    vector<valtype> vPushes;
+    if (!GetPushes(scriptSig, vPushes))
+        return false;
+
+    // OP_HASH160 <hash> OP_EQUAL, then the script itself when validated
+    if (scriptPubKey.IsPayToScriptHash())
+    {
+        if (vPushes.empty())
+            return false;
+        uint160 hash160 = Hash160(vPushes.back());
+        if (memcmp(&hash160, &scriptPubKey[2], 20) != 0)
+        {
+            fValid = false;
+            return true;
+        }
+        if (!fValidatePayToScriptHash)
+        {
+            fValid = true;
+            return true;
+        }
+
+        CScript scriptRedeem(vPushes.back().begin(), vPushes.back().end());
+        vPushes.pop_back();
+        if (!EvalStandardScript(vPushes, scriptRedeem, txTo, nIn, nHashType, fValid))
+            fValid = EvalScript(vPushes, scriptRedeem, txTo, nIn, nHashType) && !vPushes.empty() && CastToBool(vPushes.back());
+        return true;
+    }
+
+    return EvalStandardScript(vPushes, scriptPubKey, txTo, nIn, nHashType, fValid);
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
                   bool fValidatePayToScriptHash, int nHashType)
                   //int nHashType)
 {
+    bool fValid;
+    if (VerifyStandardScript(scriptSig, scriptPubKey, txTo, nIn, fValidatePayToScriptHash, nHashType, fValid))
+        return fValid;
+
     vector<vector<unsigned char> > stack, stackCopy;
     if (!EvalScript(stack, scriptSig, txTo, nIn, nHashType))
         return false;
@@ -1743,6 +2074,10 @@ bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsig
     if (txin.prevout.hash != txFrom.GetHash())
         return false;
 
+    CSignatureBatch* pbatch = pSignatureBatch.get();
+    if (pbatch)
+        return pbatch->VerifyInput(txin.scriptSig, txout.scriptPubKey, txTo, nIn, fValidatePayToScriptHash, nHashType);
+
     return VerifyScript(txin.scriptSig, txout.scriptPubKey, txTo, nIn, fValidatePayToScriptHash, nHashType);
 }
 
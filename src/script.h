@@ -5,6 +5,8 @@
 #ifndef H_BITCOIN_SCRIPT
 #define H_BITCOIN_SCRIPT
 
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -13,9 +15,12 @@
 #include <boost/foreach.hpp>
 #include <boost/variant.hpp>
 
+#include <openssl/sha.h>
+
 #include "keystore.h"
 #include "bignum.h"
 #include "stealthaddress.h"
+#include "secp256k1.h"
 
 typedef std::vector<unsigned char> valtype;
 
@@ -24,6 +29,143 @@ class CTransaction;
 static const unsigned int MAX_SCRIPT_ELEMENT_SIZE = 520;
 static const unsigned int MAX_OP_RETURN_RELAY = 48;
 
+class scriptnum_error : public std::runtime_error
+{
+public:
+    explicit scriptnum_error(const std::string& str) : std::runtime_error(str) {}
+};
+
+/** Numeric opcodes (OP_1ADD, etc) are restricted to operating on 4-byte
+ * integers. Their results may overflow that, and are still pushed as they
+ * are, but a number read from the stack must be at most 4 bytes.
+ *
+ * The encoding is little-endian sign and magnitude, as CBigNum::getvch
+ * gives it, so an int64 holds every value a script can reach and the
+ * results are byte for byte those of the CBigNum arithmetic it replaces.
+ */
+class CScriptNum
+{
+public:
+    static const size_t nMaxNumSize = 4;
+
+    explicit CScriptNum(const int64& n)
+    {
+        m_value = n;
+    }
+
+    explicit CScriptNum(const std::vector<unsigned char>& vch)
+    {
+        if (vch.size() > nMaxNumSize)
+            throw scriptnum_error("CScriptNum() : overflow");
+        m_value = set_vch(vch);
+    }
+
+    inline bool operator==(const int64& rhs) const    { return m_value == rhs; }
+    inline bool operator!=(const int64& rhs) const    { return m_value != rhs; }
+    inline bool operator<=(const int64& rhs) const    { return m_value <= rhs; }
+    inline bool operator< (const int64& rhs) const    { return m_value <  rhs; }
+    inline bool operator>=(const int64& rhs) const    { return m_value >= rhs; }
+    inline bool operator> (const int64& rhs) const    { return m_value >  rhs; }
+
+    inline bool operator==(const CScriptNum& rhs) const { return operator==(rhs.m_value); }
+    inline bool operator!=(const CScriptNum& rhs) const { return operator!=(rhs.m_value); }
+    inline bool operator<=(const CScriptNum& rhs) const { return operator<=(rhs.m_value); }
+    inline bool operator< (const CScriptNum& rhs) const { return operator< (rhs.m_value); }
+    inline bool operator>=(const CScriptNum& rhs) const { return operator>=(rhs.m_value); }
+    inline bool operator> (const CScriptNum& rhs) const { return operator> (rhs.m_value); }
+
+    inline CScriptNum operator+(const int64& rhs) const       { return CScriptNum(m_value + rhs); }
+    inline CScriptNum operator-(const int64& rhs) const       { return CScriptNum(m_value - rhs); }
+    inline CScriptNum operator+(const CScriptNum& rhs) const  { return operator+(rhs.m_value); }
+    inline CScriptNum operator-(const CScriptNum& rhs) const  { return operator-(rhs.m_value); }
+
+    inline CScriptNum& operator+=(const CScriptNum& rhs)      { return operator+=(rhs.m_value); }
+    inline CScriptNum& operator-=(const CScriptNum& rhs)      { return operator-=(rhs.m_value); }
+
+    inline CScriptNum operator-() const
+    {
+        return CScriptNum(-m_value);
+    }
+
+    inline CScriptNum& operator=(const int64& rhs)
+    {
+        m_value = rhs;
+        return *this;
+    }
+
+    inline CScriptNum& operator+=(const int64& rhs)
+    {
+        m_value += rhs;
+        return *this;
+    }
+
+    inline CScriptNum& operator-=(const int64& rhs)
+    {
+        m_value -= rhs;
+        return *this;
+    }
+
+    // Clamped to the range of int, as CBigNum::getint
+    int getint() const
+    {
+        if (m_value > std::numeric_limits<int>::max())
+            return std::numeric_limits<int>::max();
+        else if (m_value < std::numeric_limits<int>::min())
+            return std::numeric_limits<int>::min();
+        return m_value;
+    }
+
+    std::vector<unsigned char> getvch() const
+    {
+        return serialize(m_value);
+    }
+
+    static std::vector<unsigned char> serialize(const int64& value)
+    {
+        if (value == 0)
+            return std::vector<unsigned char>();
+
+        std::vector<unsigned char> result;
+        const bool neg = value < 0;
+        uint64 absvalue = neg ? -(uint64)value : value;
+
+        while (absvalue)
+        {
+            result.push_back(absvalue & 0xff);
+            absvalue >>= 8;
+        }
+
+        // The most significant byte carries the sign: if it is taken by the
+        // magnitude, a byte more holds it
+        if (result.back() & 0x80)
+            result.push_back(neg ? 0x80 : 0);
+        else if (neg)
+            result.back() |= 0x80;
+
+        return result;
+    }
+
+private:
+    static int64 set_vch(const std::vector<unsigned char>& vch)
+    {
+        if (vch.empty())
+            return 0;
+
+        int64 result = 0;
+        for (size_t i = 0; i != vch.size(); ++i)
+            result |= static_cast<int64>(vch[i]) << 8*i;
+
+        // If the input's most significant byte has the sign bit, the result
+        // is negative, with that bit cleared from its magnitude
+        if (vch.back() & 0x80)
+            return -((int64)(result & ~(0x80ULL << (8 * (vch.size() - 1)))));
+
+        return result;
+    }
+
+    int64 m_value;
+};
+
 
 /** Signature hash types/flags */
 enum
@@ -611,6 +753,89 @@ bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTrans
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
                   bool fValidatePayToScriptHash, int nHashType);
 bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, bool fValidatePayToScriptHash, int nHashType);
+
+/** Signature checks of a block, verified together.
+ *
+ * While one exists on a thread, VerifySignature runs scripts as if every
+ * signature check passed and queues the checks instead. A script that
+ * fails under that assumption is rerun at once with real checks, since it
+ * may depend on a signature failing. Verify() then checks the queue in one
+ * batch and reruns exactly the inputs that had a bad signature, so the
+ * overall result is the same as checking every signature in place.
+ * The transactions passed to VerifySignature must outlive the batch.
+ */
+class CSignatureBatch
+{
+private:
+    struct CInputCheck
+    {
+        CScript scriptPubKey;
+        const CTransaction* ptxTo;
+        unsigned int nIn;
+        bool fValidatePayToScriptHash;
+        int nHashType;
+    };
+
+    CECBatchVerifier verifier;
+    std::vector<uint256> vHash;                       // per queued signature
+    std::vector<std::vector<unsigned char> > vSig;
+    std::vector<std::vector<unsigned char> > vPubKey;
+    std::vector<unsigned int> vInput;                 // index into vInputs
+    std::vector<CInputCheck> vInputs;
+    bool fCollecting;
+
+    CSignatureBatch(const CSignatureBatch&);
+    CSignatureBatch& operator=(const CSignatureBatch&);
+
+    void Truncate(size_t nSize);
+
+public:
+    CSignatureBatch();
+    ~CSignatureBatch();
+
+    bool VerifyInput(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
+                     bool fValidatePayToScriptHash, int nHashType);
+    // Called from CheckSig for a signature not in the cache
+    bool Defer(const uint256& hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey);
+    bool IsCollecting() const { return fCollecting; }
+
+    bool Verify();
+};
+
+/** Shares the work of SignatureHash between the inputs of one transaction.
+ *
+ * While one exists on a thread, the SIGHASH_ALL digests of its transaction
+ * start from the SHA-256 midstate of the transaction, serialized once with
+ * every scriptSig blank, up to the input signed; only the scriptCode and
+ * the rest of that serialization are hashed per input, where SignatureHash
+ * would copy and reserialize the whole transaction. The other hash types
+ * are rare and take the usual path. The digests are the same either way.
+ * Only the scriptSigs of the transaction may change while this exists.
+ */
+class CSignatureHashCache
+{
+private:
+    const CTransaction* ptx;
+    unsigned int nInputs;
+    CSignatureHashCache* pprev;
+    std::vector<unsigned char> vchBlank;
+    std::vector<unsigned int> vInputPos;    // of each blank scriptSig in vchBlank
+    std::vector<SHA256_CTX> vMidstate;      // of vchBlank up to vInputPos[i], as far as needed yet
+
+    CSignatureHashCache(const CSignatureHashCache&);
+    CSignatureHashCache& operator=(const CSignatureHashCache&);
+
+    void Build();
+
+public:
+    CSignatureHashCache(const CTransaction& txTo);
+    ~CSignatureHashCache();
+
+    bool Covers(const CTransaction& txTo) const;
+    // scriptCode with OP_CODESEPARATORs already removed
+    uint256 SignatureHashAll(const CScript& scriptCode, unsigned int nIn, int nHashType);
+};
+
 // Given two sets of signatures for scriptPubKey, possibly with OP_0 placeholders,
 // combine them intelligently and return the result.
 CScript CombineSignatures(CScript scriptPubKey, const CTransaction& txTo, unsigned int nIn, const CScript& scriptSig1, const CScript& scriptSig2);
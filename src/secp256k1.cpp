@@ -0,0 +1,1399 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "secp256k1.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+//
+// Numbers are four 64 bit limbs, least significant first
+//
+
+#if defined(__SIZEOF_INT128__)
+static inline void Mul64(uint64 a, uint64 b, uint64& lo, uint64& hi)
+{
+    unsigned __int128 t = (unsigned __int128)a * b;
+    lo = (uint64)t;
+    hi = (uint64)(t >> 64);
+}
+#else
+static inline void Mul64(uint64 a, uint64 b, uint64& lo, uint64& hi)
+{
+    uint64 a0 = a & 0xffffffffULL, a1 = a >> 32;
+    uint64 b0 = b & 0xffffffffULL, b1 = b >> 32;
+    uint64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64 mid = (p00 >> 32) + (p01 & 0xffffffffULL) + (p10 & 0xffffffffULL);
+    lo = (mid << 32) | (p00 & 0xffffffffULL);
+    hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+}
+#endif
+
+// Three limb column accumulator (c0, c1, c2) += a * b
+static inline void MulAcc(uint64 a, uint64 b, uint64& c0, uint64& c1, uint64& c2)
+{
+    uint64 lo, hi;
+    Mul64(a, b, lo, hi);
+    c0 += lo;
+    hi += (c0 < lo);
+    c1 += hi;
+    c2 += (c1 < hi);
+}
+
+// (c0, c1, c2) += 2 * a * b
+static inline void MulAcc2(uint64 a, uint64 b, uint64& c0, uint64& c1, uint64& c2)
+{
+    uint64 lo, hi;
+    Mul64(a, b, lo, hi);
+    c2 += hi >> 63;
+    hi = (hi << 1) | (lo >> 63);
+    lo <<= 1;
+    c0 += lo;
+    hi += (c0 < lo);
+    c1 += hi;
+    c2 += (c1 < hi);
+}
+
+static inline void ShiftColumn(uint64& c0, uint64& c1, uint64& c2)
+{
+    c0 = c1;
+    c1 = c2;
+    c2 = 0;
+}
+
+static void Mul256(const uint64 a[4], const uint64 b[4], uint64 t[8])
+{
+    uint64 c0 = 0, c1 = 0, c2 = 0;
+    MulAcc(a[0], b[0], c0, c1, c2);
+    t[0] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[0], b[1], c0, c1, c2);
+    MulAcc(a[1], b[0], c0, c1, c2);
+    t[1] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[0], b[2], c0, c1, c2);
+    MulAcc(a[1], b[1], c0, c1, c2);
+    MulAcc(a[2], b[0], c0, c1, c2);
+    t[2] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[0], b[3], c0, c1, c2);
+    MulAcc(a[1], b[2], c0, c1, c2);
+    MulAcc(a[2], b[1], c0, c1, c2);
+    MulAcc(a[3], b[0], c0, c1, c2);
+    t[3] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[1], b[3], c0, c1, c2);
+    MulAcc(a[2], b[2], c0, c1, c2);
+    MulAcc(a[3], b[1], c0, c1, c2);
+    t[4] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[2], b[3], c0, c1, c2);
+    MulAcc(a[3], b[2], c0, c1, c2);
+    t[5] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[3], b[3], c0, c1, c2);
+    t[6] = c0;
+    t[7] = c1;
+}
+
+static void Sqr256(const uint64 a[4], uint64 t[8])
+{
+    uint64 c0 = 0, c1 = 0, c2 = 0;
+    MulAcc(a[0], a[0], c0, c1, c2);
+    t[0] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc2(a[0], a[1], c0, c1, c2);
+    t[1] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc2(a[0], a[2], c0, c1, c2);
+    MulAcc(a[1], a[1], c0, c1, c2);
+    t[2] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc2(a[0], a[3], c0, c1, c2);
+    MulAcc2(a[1], a[2], c0, c1, c2);
+    t[3] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc2(a[1], a[3], c0, c1, c2);
+    MulAcc(a[2], a[2], c0, c1, c2);
+    t[4] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc2(a[2], a[3], c0, c1, c2);
+    t[5] = c0; ShiftColumn(c0, c1, c2);
+    MulAcc(a[3], a[3], c0, c1, c2);
+    t[6] = c0;
+    t[7] = c1;
+}
+
+static void Read256(const unsigned char* pch, uint64 r[4])
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint64 v = 0;
+        for (int j = 0; j < 8; j++)
+            v = (v << 8) | pch[(3 - i) * 8 + j];
+        r[i] = v;
+    }
+}
+
+static void Write256(const uint64 a[4], unsigned char* pch)
+{
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 8; j++)
+            pch[(3 - i) * 8 + j] = (unsigned char)(a[i] >> (56 - 8 * j));
+}
+
+static int Compare256(const uint64 a[4], const uint64 b[4])
+{
+    for (int i = 3; i >= 0; i--)
+    {
+        if (a[i] > b[i])
+            return 1;
+        if (a[i] < b[i])
+            return -1;
+    }
+    return 0;
+}
+
+// r = a + b, returns the carry out
+static uint64 Add256(uint64 r[4], const uint64 a[4], const uint64 b[4])
+{
+    uint64 c = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint64 s = a[i] + c;
+        c = (s < c);
+        s += b[i];
+        c += (s < b[i]);
+        r[i] = s;
+    }
+    return c;
+}
+
+// r = a - b, returns the borrow out
+static uint64 Sub256(uint64 r[4], const uint64 a[4], const uint64 b[4])
+{
+    uint64 borrow = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint64 d = a[i] - b[i];
+        uint64 borrow2 = (a[i] < b[i]);
+        r[i] = d - borrow;
+        borrow = borrow2 | (d < borrow);
+    }
+    return borrow;
+}
+
+static bool IsZero256(const uint64 a[4])
+{
+    return (a[0] | a[1] | a[2] | a[3]) == 0;
+}
+
+
+//
+// Field elements mod p = 2^256 - 0x1000003D1, always fully reduced
+//
+
+struct CFieldElem
+{
+    uint64 n[4];
+};
+
+static const uint64 FIELD_C = 0x1000003D1ULL;
+static const uint64 FIELD_P[4] = { 0xFFFFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL };
+
+static inline void FeSetInt(CFieldElem& r, uint64 v)
+{
+    r.n[0] = v;
+    r.n[1] = r.n[2] = r.n[3] = 0;
+}
+
+static inline bool FeIsZero(const CFieldElem& a)
+{
+    return IsZero256(a.n);
+}
+
+static inline bool FeEqual(const CFieldElem& a, const CFieldElem& b)
+{
+    return a.n[0] == b.n[0] && a.n[1] == b.n[1] && a.n[2] == b.n[2] && a.n[3] == b.n[3];
+}
+
+static inline bool FeIsOdd(const CFieldElem& a)
+{
+    return a.n[0] & 1;
+}
+
+static bool FeSetB32(CFieldElem& r, const unsigned char* pch)
+{
+    Read256(pch, r.n);
+    return Compare256(r.n, FIELD_P) < 0;
+}
+
+static void FeGetB32(const CFieldElem& a, unsigned char* pch)
+{
+    Write256(a.n, pch);
+}
+
+// Adds v < 2^64 into r, returns the carry out
+static inline uint64 AddSmall(uint64 r[4], uint64 v)
+{
+    for (int i = 0; i < 4 && v; i++)
+    {
+        r[i] += v;
+        v = (r[i] < v);
+    }
+    return v;
+}
+
+static inline void FeNormalize(CFieldElem& r)
+{
+    if (Compare256(r.n, FIELD_P) >= 0)
+        AddSmall(r.n, FIELD_C); // - p, mod 2^256
+}
+
+static void FeAdd(CFieldElem& r, const CFieldElem& a, const CFieldElem& b)
+{
+    if (Add256(r.n, a.n, b.n))
+        AddSmall(r.n, FIELD_C);
+    FeNormalize(r);
+}
+
+static void FeSub(CFieldElem& r, const CFieldElem& a, const CFieldElem& b)
+{
+    if (Sub256(r.n, a.n, b.n))
+    {
+        // + p, mod 2^256
+        uint64 c[4] = { FIELD_C, 0, 0, 0 };
+        Sub256(r.n, r.n, c);
+    }
+}
+
+static void FeNeg(CFieldElem& r, const CFieldElem& a)
+{
+    CFieldElem zero;
+    FeSetInt(zero, 0);
+    FeSub(r, zero, a);
+}
+
+static void FeReduce(CFieldElem& r, const uint64 t[8])
+{
+    // t = L + H * 2^256 and 2^256 = FIELD_C (mod p)
+    uint64 u[5];
+    uint64 c = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        uint64 lo, hi;
+        Mul64(t[4 + i], FIELD_C, lo, hi);
+        lo += c;
+        hi += (lo < c);
+        u[i] = t[i] + lo;
+        hi += (u[i] < lo);
+        c = hi;
+    }
+    u[4] = c;
+
+    uint64 lo, hi;
+    Mul64(u[4], FIELD_C, lo, hi);
+    r.n[0] = u[0] + lo;
+    c = (r.n[0] < lo);
+    r.n[1] = u[1] + hi;
+    uint64 c1 = (r.n[1] < hi);
+    r.n[1] += c;
+    c1 += (r.n[1] < c);
+    r.n[2] = u[2] + c1;
+    c = (r.n[2] < c1);
+    r.n[3] = u[3] + c;
+    c = (r.n[3] < c);
+    if (c)
+        AddSmall(r.n, FIELD_C);
+    FeNormalize(r);
+}
+
+static void FeMul(CFieldElem& r, const CFieldElem& a, const CFieldElem& b)
+{
+    uint64 t[8];
+    Mul256(a.n, b.n, t);
+    FeReduce(r, t);
+}
+
+static void FeSqr(CFieldElem& r, const CFieldElem& a)
+{
+    uint64 t[8];
+    Sqr256(a.n, t);
+    FeReduce(r, t);
+}
+
+static void FeSqrN(CFieldElem& r, const CFieldElem& a, int n)
+{
+    r = a;
+    for (int i = 0; i < n; i++)
+        FeSqr(r, r);
+}
+
+// a^(2^223 - 1) and a^(2^22 - 1) and a^(2^2 - 1), shared by inversion and
+// square root
+static void FePowChain(const CFieldElem& a, CFieldElem& x2, CFieldElem& x22, CFieldElem& x223)
+{
+    CFieldElem x3, x6, x9, x11, x44, x88, x176, x220, t;
+    FeSqr(t, a);
+    FeMul(x2, t, a);
+    FeSqr(t, x2);
+    FeMul(x3, t, a);
+    FeSqrN(t, x3, 3);
+    FeMul(x6, t, x3);
+    FeSqrN(t, x6, 3);
+    FeMul(x9, t, x3);
+    FeSqrN(t, x9, 2);
+    FeMul(x11, t, x2);
+    FeSqrN(t, x11, 11);
+    FeMul(x22, t, x11);
+    FeSqrN(t, x22, 22);
+    FeMul(x44, t, x22);
+    FeSqrN(t, x44, 44);
+    FeMul(x88, t, x44);
+    FeSqrN(t, x88, 88);
+    FeMul(x176, t, x88);
+    FeSqrN(t, x176, 44);
+    FeMul(x220, t, x44);
+    FeSqrN(t, x220, 3);
+    FeMul(x223, t, x3);
+}
+
+// a^(p-2)
+static void FeInv(CFieldElem& r, const CFieldElem& a)
+{
+    CFieldElem x2, x22, x223, t;
+    FePowChain(a, x2, x22, x223);
+    FeSqrN(t, x223, 23);
+    FeMul(t, t, x22);
+    FeSqrN(t, t, 5);
+    FeMul(t, t, a);
+    FeSqrN(t, t, 3);
+    FeMul(t, t, x2);
+    FeSqrN(t, t, 2);
+    FeMul(r, t, a);
+}
+
+// a^((p+1)/4), false if a is not a square
+static bool FeSqrt(CFieldElem& r, const CFieldElem& a)
+{
+    CFieldElem x2, x22, x223, t, check;
+    FePowChain(a, x2, x22, x223);
+    FeSqrN(t, x223, 23);
+    FeMul(t, t, x22);
+    FeSqrN(t, t, 6);
+    FeMul(t, t, x2);
+    FeSqrN(r, t, 2);
+    FeSqr(check, r);
+    return FeEqual(check, a);
+}
+
+
+//
+// Scalars mod the group order n = 2^256 - SCALAR_C
+//
+
+struct CScalar
+{
+    uint64 n[4];
+};
+
+static const uint64 SCALAR_N[4] = { 0xBFD25E8CD0364141ULL, 0xBAAEDCE6AF48A03BULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL };
+static const uint64 SCALAR_C[3] = { 0x402DA1732FC9BEBFULL, 0x4551231950B75FC4ULL, 1 };
+static const uint64 SCALAR_HALF_N[4] = { 0xDFE92F46681B20A0ULL, 0x5D576E7357A4501DULL, 0xFFFFFFFFFFFFFFFFULL, 0x7FFFFFFFFFFFFFFFULL };
+// p - n: x coordinates in [n, p) have a second preimage r = x - n
+static const uint64 FIELD_P_MINUS_N[4] = { 0x402DA1722FC9BAEEULL, 0x4551231950B75FC4ULL, 1, 0 };
+
+static inline void ScalarSetInt(CScalar& r, uint64 v)
+{
+    r.n[0] = v;
+    r.n[1] = r.n[2] = r.n[3] = 0;
+}
+
+static inline bool ScalarIsZero(const CScalar& a)
+{
+    return IsZero256(a.n);
+}
+
+// Reduces the 256 bit big-endian number at pch, fOverflow tells if it was >= n
+static void ScalarSetB32(CScalar& r, const unsigned char* pch, bool* pfOverflow = NULL)
+{
+    Read256(pch, r.n);
+    bool fOverflow = Compare256(r.n, SCALAR_N) >= 0;
+    if (fOverflow)
+        Sub256(r.n, r.n, SCALAR_N);
+    if (pfOverflow)
+        *pfOverflow = fOverflow;
+}
+
+static void ScalarAdd(CScalar& r, const CScalar& a, const CScalar& b)
+{
+    uint64 c = Add256(r.n, a.n, b.n);
+    if (c || Compare256(r.n, SCALAR_N) >= 0)
+        Sub256(r.n, r.n, SCALAR_N);
+}
+
+static void ScalarNeg(CScalar& r, const CScalar& a)
+{
+    if (ScalarIsZero(a))
+        r = a;
+    else
+        Sub256(r.n, SCALAR_N, a.n);
+}
+
+// Adds a * SCALAR_C (a of nLen limbs) to the 8 limb number u
+static void ScalarAddMulC(uint64 u[8], const uint64* a, int nLen)
+{
+    for (int i = 0; i < nLen; i++)
+    {
+        uint64 c = 0;
+        for (int j = 0; j < 3; j++)
+        {
+            uint64 lo, hi;
+            Mul64(a[i], SCALAR_C[j], lo, hi);
+            lo += c;
+            hi += (lo < c);
+            u[i + j] += lo;
+            hi += (u[i + j] < lo);
+            c = hi;
+        }
+        for (int k = i + 3; c && k < 8; k++)
+        {
+            u[k] += c;
+            c = (u[k] < c);
+        }
+    }
+}
+
+static void ScalarReduce(CScalar& r, const uint64 t[8])
+{
+    // Fold the part above 2^256 back in as H * SCALAR_C: 512 bits become
+    // at most 386, then 260, then 256 plus a carry
+    uint64 m[8] = { t[0], t[1], t[2], t[3], 0, 0, 0, 0 };
+    ScalarAddMulC(m, t + 4, 4);
+    uint64 p[8] = { m[0], m[1], m[2], m[3], 0, 0, 0, 0 };
+    ScalarAddMulC(p, m + 4, 3);
+    uint64 q[8] = { p[0], p[1], p[2], p[3], 0, 0, 0, 0 };
+    ScalarAddMulC(q, p + 4, 1);
+    memcpy(r.n, q, sizeof(r.n));
+    if (q[4] || Compare256(r.n, SCALAR_N) >= 0)
+        Sub256(r.n, r.n, SCALAR_N);
+}
+
+static void ScalarMul(CScalar& r, const CScalar& a, const CScalar& b)
+{
+    uint64 t[8];
+    Mul256(a.n, b.n, t);
+    ScalarReduce(r, t);
+}
+
+static inline void Shr256(uint64 a[4], uint64 nTop)
+{
+    a[0] = (a[0] >> 1) | (a[1] << 63);
+    a[1] = (a[1] >> 1) | (a[2] << 63);
+    a[2] = (a[2] >> 1) | (a[3] << 63);
+    a[3] = (a[3] >> 1) | (nTop << 63);
+}
+
+// x / 2 mod n
+static inline void ScalarHalve(uint64 x[4])
+{
+    uint64 nTop = 0;
+    if (x[0] & 1)
+        nTop = Add256(x, x, SCALAR_N);
+    Shr256(x, nTop);
+}
+
+static inline void ScalarSubMod(uint64 r[4], const uint64 a[4], const uint64 b[4])
+{
+    if (Sub256(r, a, b))
+        Add256(r, r, SCALAR_N);
+}
+
+// Binary extended Euclid. Variable time, which is fine because only
+// public values (signature parts) are ever inverted.
+static void ScalarInv(CScalar& r, const CScalar& a)
+{
+    if (ScalarIsZero(a))
+    {
+        r = a;
+        return;
+    }
+    static const uint64 ONE[4] = { 1, 0, 0, 0 };
+    uint64 u[4], v[4], x1[4] = { 1, 0, 0, 0 }, x2[4] = { 0, 0, 0, 0 };
+    memcpy(u, a.n, sizeof(u));
+    memcpy(v, SCALAR_N, sizeof(v));
+    while (Compare256(u, ONE) != 0 && Compare256(v, ONE) != 0)
+    {
+        while (!(u[0] & 1))
+        {
+            Shr256(u, 0);
+            ScalarHalve(x1);
+        }
+        while (!(v[0] & 1))
+        {
+            Shr256(v, 0);
+            ScalarHalve(x2);
+        }
+        if (Compare256(u, v) >= 0)
+        {
+            Sub256(u, u, v);
+            ScalarSubMod(x1, x1, x2);
+        }
+        else
+        {
+            Sub256(v, v, u);
+            ScalarSubMod(x2, x2, x1);
+        }
+    }
+    memcpy(r.n, Compare256(u, ONE) == 0 ? x1 : x2, sizeof(r.n));
+}
+
+// (a * b) >> 384, rounded to nearest
+static void ScalarMulShift384(CScalar& r, const CScalar& a, const uint64 b[4])
+{
+    uint64 t[8];
+    Mul256(a.n, b, t);
+    r.n[0] = t[6];
+    r.n[1] = t[7];
+    r.n[2] = r.n[3] = 0;
+    AddSmall(r.n, t[5] >> 63);
+}
+
+// Endomorphism: lambda * (x, y) = (beta * x, y)
+static const uint64 SCALAR_LAMBDA[4] = { 0xDF02967C1B23BD72ULL, 0x122E22EA20816678ULL, 0xA5261C028812645AULL, 0x5363AD4CC05C30E0ULL };
+static const uint64 FIELD_BETA[4] = { 0xC1396C28719501EEULL, 0x9CF0497512F58995ULL, 0x6E64479EAC3434E9ULL, 0x7AE96A2B657C0710ULL };
+static const uint64 SCALAR_MINUS_B1[4] = { 0x6F547FA90ABFE4C3ULL, 0xE4437ED6010E8828ULL, 0, 0 };
+static const uint64 SCALAR_MINUS_B2[4] = { 0xD765CDA83DB1562CULL, 0x8A280AC50774346DULL, 0xFFFFFFFFFFFFFFFEULL, 0xFFFFFFFFFFFFFFFFULL };
+static const uint64 SCALAR_G1[4] = { 0xE893209A45DBB031ULL, 0x3DAA8A1471E8CA7FULL, 0xE86C90E49284EB15ULL, 0x3086D221A7D46BCDULL };
+static const uint64 SCALAR_G2[4] = { 0x1571B4AE8AC47F71ULL, 0x221208AC9DF506C6ULL, 0x6F547FA90ABFE4C4ULL, 0xE4437ED6010E8828ULL };
+
+// k = r1 + r2 * lambda (mod n) with r1 and r2 of about 128 bits in
+// absolute value; returned as magnitudes plus signs
+static void ScalarSplitLambda(const CScalar& k, CScalar& r1, bool& fNeg1, CScalar& r2, bool& fNeg2)
+{
+    CScalar c1, c2, b, t;
+    ScalarMulShift384(c1, k, SCALAR_G1);
+    ScalarMulShift384(c2, k, SCALAR_G2);
+    memcpy(b.n, SCALAR_MINUS_B1, sizeof(b.n));
+    ScalarMul(c1, c1, b);
+    memcpy(b.n, SCALAR_MINUS_B2, sizeof(b.n));
+    ScalarMul(c2, c2, b);
+    ScalarAdd(r2, c1, c2);
+    memcpy(b.n, SCALAR_LAMBDA, sizeof(b.n));
+    ScalarMul(t, r2, b);
+    ScalarNeg(t, t);
+    ScalarAdd(r1, t, k);
+
+    fNeg1 = Compare256(r1.n, SCALAR_HALF_N) > 0;
+    if (fNeg1)
+        ScalarNeg(r1, r1);
+    fNeg2 = Compare256(r2.n, SCALAR_HALF_N) > 0;
+    if (fNeg2)
+        ScalarNeg(r2, r2);
+}
+
+
+//
+// Group elements
+//
+
+struct CGroupElem
+{
+    CFieldElem x, y;
+    bool fInfinity;
+};
+
+struct CGroupElemJ
+{
+    CFieldElem x, y, z;
+    bool fInfinity;
+};
+
+static void GeSetXY(CGroupElem& r, const CFieldElem& x, const CFieldElem& y)
+{
+    r.x = x;
+    r.y = y;
+    r.fInfinity = false;
+}
+
+static bool GeIsOnCurve(const CGroupElem& a)
+{
+    CFieldElem y2, x3, seven;
+    FeSqr(y2, a.y);
+    FeSqr(x3, a.x);
+    FeMul(x3, x3, a.x);
+    FeSetInt(seven, 7);
+    FeAdd(x3, x3, seven);
+    return FeEqual(y2, x3);
+}
+
+// Point with the given x and y parity, false if x is not on the curve
+static bool GeSetXO(CGroupElem& r, const CFieldElem& x, bool fOdd)
+{
+    CFieldElem x3, seven, y;
+    FeSqr(x3, x);
+    FeMul(x3, x3, x);
+    FeSetInt(seven, 7);
+    FeAdd(x3, x3, seven);
+    if (!FeSqrt(y, x3))
+        return false;
+    if (FeIsOdd(y) != fOdd)
+        FeNeg(y, y);
+    GeSetXY(r, x, y);
+    return true;
+}
+
+static void GejSetInfinity(CGroupElemJ& r)
+{
+    FeSetInt(r.x, 0);
+    FeSetInt(r.y, 0);
+    FeSetInt(r.z, 0);
+    r.fInfinity = true;
+}
+
+static void GejSetGe(CGroupElemJ& r, const CGroupElem& a)
+{
+    r.x = a.x;
+    r.y = a.y;
+    FeSetInt(r.z, 1);
+    r.fInfinity = a.fInfinity;
+}
+
+static void GeSetGej(CGroupElem& r, const CGroupElemJ& a)
+{
+    if (a.fInfinity)
+    {
+        FeSetInt(r.x, 0);
+        FeSetInt(r.y, 0);
+        r.fInfinity = true;
+        return;
+    }
+    CFieldElem zi, zi2, zi3;
+    FeInv(zi, a.z);
+    FeSqr(zi2, zi);
+    FeMul(zi3, zi2, zi);
+    FeMul(r.x, a.x, zi2);
+    FeMul(r.y, a.y, zi3);
+    r.fInfinity = false;
+}
+
+static void GejDouble(CGroupElemJ& r, const CGroupElemJ& a)
+{
+    if (a.fInfinity)
+    {
+        GejSetInfinity(r);
+        return;
+    }
+    // dbl-2009-l; y is never 0 since the curve has no point of order 2
+    CFieldElem A, B, C, D, E, F, t;
+    FeSqr(A, a.x);
+    FeSqr(B, a.y);
+    FeSqr(C, B);
+    FeAdd(t, a.x, B);
+    FeSqr(t, t);
+    FeSub(t, t, A);
+    FeSub(t, t, C);
+    FeAdd(D, t, t);
+    FeAdd(E, A, A);
+    FeAdd(E, E, A);
+    FeSqr(F, E);
+
+    CFieldElem z3;
+    FeMul(z3, a.y, a.z);
+    FeAdd(z3, z3, z3);
+
+    FeSub(r.x, F, D);
+    FeSub(r.x, r.x, D);
+    FeSub(t, D, r.x);
+    FeMul(t, E, t);
+    FeAdd(C, C, C);
+    FeAdd(C, C, C);
+    FeAdd(C, C, C);
+    FeSub(r.y, t, C);
+    r.z = z3;
+    r.fInfinity = false;
+}
+
+// r = a + b with b affine
+static void GejAddGe(CGroupElemJ& r, const CGroupElemJ& a, const CGroupElem& b)
+{
+    if (b.fInfinity)
+    {
+        r = a;
+        return;
+    }
+    if (a.fInfinity)
+    {
+        GejSetGe(r, b);
+        return;
+    }
+    CFieldElem z1z1, u2, s2, h, rr, hh, hhh, v, t;
+    FeSqr(z1z1, a.z);
+    FeMul(u2, b.x, z1z1);
+    FeMul(s2, b.y, a.z);
+    FeMul(s2, s2, z1z1);
+    FeSub(h, u2, a.x);
+    FeSub(rr, s2, a.y);
+    if (FeIsZero(h))
+    {
+        if (FeIsZero(rr))
+            GejDouble(r, a);
+        else
+            GejSetInfinity(r);
+        return;
+    }
+    FeSqr(hh, h);
+    FeMul(hhh, h, hh);
+    FeMul(v, a.x, hh);
+
+    CFieldElem x3, y3, z3;
+    FeSqr(x3, rr);
+    FeSub(x3, x3, hhh);
+    FeSub(x3, x3, v);
+    FeSub(x3, x3, v);
+    FeSub(t, v, x3);
+    FeMul(y3, rr, t);
+    FeMul(t, a.y, hhh);
+    FeSub(y3, y3, t);
+    FeMul(z3, a.z, h);
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+    r.fInfinity = false;
+}
+
+static void GejAdd(CGroupElemJ& r, const CGroupElemJ& a, const CGroupElemJ& b)
+{
+    if (b.fInfinity)
+    {
+        r = a;
+        return;
+    }
+    if (a.fInfinity)
+    {
+        r = b;
+        return;
+    }
+    CFieldElem z1z1, z2z2, u1, u2, s1, s2, h, rr, hh, hhh, v, t;
+    FeSqr(z1z1, a.z);
+    FeSqr(z2z2, b.z);
+    FeMul(u1, a.x, z2z2);
+    FeMul(u2, b.x, z1z1);
+    FeMul(s1, a.y, b.z);
+    FeMul(s1, s1, z2z2);
+    FeMul(s2, b.y, a.z);
+    FeMul(s2, s2, z1z1);
+    FeSub(h, u2, u1);
+    FeSub(rr, s2, s1);
+    if (FeIsZero(h))
+    {
+        if (FeIsZero(rr))
+            GejDouble(r, a);
+        else
+            GejSetInfinity(r);
+        return;
+    }
+    FeSqr(hh, h);
+    FeMul(hhh, h, hh);
+    FeMul(v, u1, hh);
+
+    CFieldElem x3, y3, z3;
+    FeSqr(x3, rr);
+    FeSub(x3, x3, hhh);
+    FeSub(x3, x3, v);
+    FeSub(x3, x3, v);
+    FeSub(t, v, x3);
+    FeMul(y3, rr, t);
+    FeMul(t, s1, hhh);
+    FeSub(y3, y3, t);
+    FeMul(z3, a.z, b.z);
+    FeMul(z3, z3, h);
+    r.x = x3;
+    r.y = y3;
+    r.z = z3;
+    r.fInfinity = false;
+}
+
+static void GejNeg(CGroupElemJ& r, const CGroupElemJ& a)
+{
+    r = a;
+    FeNeg(r.y, r.y);
+}
+
+
+//
+// Multiplication
+//
+
+static const unsigned char pchGx[32] = {
+    0x79,0xBE,0x66,0x7E,0xF9,0xDC,0xBB,0xAC,0x55,0xA0,0x62,0x95,0xCE,0x87,0x0B,0x07,
+    0x02,0x9B,0xFC,0xDB,0x2D,0xCE,0x28,0xD9,0x59,0xF2,0x81,0x5B,0x16,0xF8,0x17,0x98
+};
+static const unsigned char pchGy[32] = {
+    0x48,0x3A,0xDA,0x77,0x26,0xA3,0xC4,0x65,0x5D,0xA4,0xFB,0xFC,0x0E,0x11,0x08,0xA8,
+    0xFD,0x17,0xB4,0x48,0xA6,0x85,0x54,0x19,0x9C,0x47,0xD0,0x8F,0xFB,0x10,0xD4,0xB8
+};
+
+// aGenTable[i][j] = (j + 1) * 16^i * G, so any u*G is at most 64 additions
+// and no doublings
+static CGroupElem aGenTable[64][15];
+
+static void GeGetGenerator(CGroupElem& g)
+{
+    CFieldElem x, y;
+    FeSetB32(x, pchGx);
+    FeSetB32(y, pchGy);
+    GeSetXY(g, x, y);
+}
+
+static void BuildGenTable()
+{
+    CGroupElem g;
+    GeGetGenerator(g);
+
+    static CGroupElemJ aJ[64][15];
+    CGroupElemJ base;
+    GejSetGe(base, g);
+    for (int i = 0; i < 64; i++)
+    {
+        aJ[i][0] = base;
+        for (int j = 1; j < 15; j++)
+            GejAdd(aJ[i][j], aJ[i][j - 1], base);
+        for (int k = 0; k < 4; k++)
+            GejDouble(base, base);
+    }
+
+    // Normalize all of them with a single inversion
+    static CFieldElem aPrefix[64 * 15];
+    CFieldElem acc;
+    FeSetInt(acc, 1);
+    for (int k = 0; k < 64 * 15; k++)
+    {
+        aPrefix[k] = acc;
+        FeMul(acc, acc, aJ[k / 15][k % 15].z);
+    }
+    CFieldElem inv;
+    FeInv(inv, acc);
+    for (int k = 64 * 15 - 1; k >= 0; k--)
+    {
+        const CGroupElemJ& p = aJ[k / 15][k % 15];
+        CFieldElem zi, zi2, zi3;
+        FeMul(zi, inv, aPrefix[k]);
+        FeMul(inv, inv, p.z);
+        FeSqr(zi2, zi);
+        FeMul(zi3, zi2, zi);
+        CFieldElem x, y;
+        FeMul(x, p.x, zi2);
+        FeMul(y, p.y, zi3);
+        GeSetXY(aGenTable[k / 15][k % 15], x, y);
+    }
+}
+
+static class CSecp256k1Init
+{
+public:
+    CSecp256k1Init()
+    {
+        BuildGenTable();
+    }
+} instance_of_csecp256k1init;
+
+static const int WNAF_WINDOW = 5;
+static const int WNAF_TABLE_SIZE = 1 << (WNAF_WINDOW - 2);
+
+static int GetBits(const CScalar& a, int nBit, int nCount)
+{
+    int nLimb = nBit / 64, nShift = nBit % 64;
+    uint64 v = a.n[nLimb] >> nShift;
+    if (nShift + nCount > 64 && nLimb < 3)
+        v |= a.n[nLimb + 1] << (64 - nShift);
+    return (int)(v & ((1ULL << nCount) - 1));
+}
+
+// Width-w non-adjacent form: odd digits in (-2^(w-1), 2^(w-1)) with at
+// least w-1 zeros between them. Returns the number of digits.
+static int ScalarWNAF(int* pnDigits, const CScalar& a, int w)
+{
+    memset(pnDigits, 0, sizeof(int) * 257);
+    int nCarry = 0, nLast = -1;
+    int nBit = 0;
+    while (nBit < 256)
+    {
+        if (GetBits(a, nBit, 1) == nCarry)
+        {
+            nBit++;
+            continue;
+        }
+        int nNow = w;
+        if (nNow > 256 - nBit)
+            nNow = 256 - nBit;
+        int nWord = GetBits(a, nBit, nNow) + nCarry;
+        nCarry = (nWord >> (w - 1)) & 1;
+        nWord -= nCarry << w;
+        pnDigits[nBit] = nWord;
+        nLast = nBit;
+        nBit += nNow;
+    }
+    if (nCarry)
+    {
+        pnDigits[256] = 1;
+        nLast = 256;
+    }
+    return nLast + 1;
+}
+
+static void GejAddDigit(CGroupElemJ& r, const CGroupElemJ* pTable, int nDigit)
+{
+    if (nDigit > 0)
+        GejAdd(r, r, pTable[(nDigit - 1) / 2]);
+    else
+    {
+        CGroupElemJ neg;
+        GejNeg(neg, pTable[(-nDigit - 1) / 2]);
+        GejAdd(r, r, neg);
+    }
+}
+
+// r = na * a + ng * G
+static void ECMult(CGroupElemJ& r, const CGroupElem& a, const CScalar& na, const CScalar& ng)
+{
+    GejSetInfinity(r);
+
+    if (!a.fInfinity && !ScalarIsZero(na))
+    {
+        CScalar k1, k2;
+        bool fNeg1, fNeg2;
+        ScalarSplitLambda(na, k1, fNeg1, k2, fNeg2);
+
+        // Odd multiples a, 3a, ... 15a and their images under the endomorphism
+        CGroupElemJ aPre[WNAF_TABLE_SIZE], aPreLam[WNAF_TABLE_SIZE], d;
+        GejSetGe(aPre[0], a);
+        GejDouble(d, aPre[0]);
+        for (int i = 1; i < WNAF_TABLE_SIZE; i++)
+            GejAdd(aPre[i], aPre[i - 1], d);
+        CFieldElem beta;
+        memcpy(beta.n, FIELD_BETA, sizeof(beta.n));
+        for (int i = 0; i < WNAF_TABLE_SIZE; i++)
+        {
+            aPreLam[i] = aPre[i];
+            FeMul(aPreLam[i].x, aPre[i].x, beta);
+            if (fNeg1)
+                GejNeg(aPre[i], aPre[i]);
+            if (fNeg2)
+                GejNeg(aPreLam[i], aPreLam[i]);
+        }
+
+        int anWNAF1[257], anWNAF2[257];
+        int nLen1 = ScalarWNAF(anWNAF1, k1, WNAF_WINDOW);
+        int nLen2 = ScalarWNAF(anWNAF2, k2, WNAF_WINDOW);
+        for (int i = max(nLen1, nLen2) - 1; i >= 0; i--)
+        {
+            GejDouble(r, r);
+            if (anWNAF1[i])
+                GejAddDigit(r, aPre, anWNAF1[i]);
+            if (anWNAF2[i])
+                GejAddDigit(r, aPreLam, anWNAF2[i]);
+        }
+    }
+
+    for (int i = 0; i < 64; i++)
+    {
+        int nNibble = (ng.n[i / 16] >> ((i % 16) * 4)) & 15;
+        if (nNibble)
+            GejAddGe(r, r, aGenTable[i][nNibble - 1]);
+    }
+}
+
+
+//
+// ECDSA
+//
+
+static bool PointToGe(const CECPoint& point, CGroupElem& r)
+{
+    if (point.fInfinity)
+    {
+        FeSetInt(r.x, 0);
+        FeSetInt(r.y, 0);
+        r.fInfinity = true;
+        return true;
+    }
+    CFieldElem x, y;
+    if (!FeSetB32(x, point.x) || !FeSetB32(y, point.y))
+        return false;
+    GeSetXY(r, x, y);
+    return true;
+}
+
+static void GeToPoint(const CGroupElem& a, CECPoint& point)
+{
+    point.fInfinity = a.fInfinity;
+    FeGetB32(a.x, point.x);
+    FeGetB32(a.y, point.y);
+}
+
+bool ECParsePubKey(const unsigned char* pch, size_t nSize, CECPoint& point)
+{
+    // Same rules as EC_POINT_oct2point: form byte, exact size, coordinates
+    // below p and the point on the curve
+    if (nSize == 0)
+        return false;
+    int nForm = pch[0] & ~1;
+    bool fYBit = pch[0] & 1;
+    if (nForm != 0 && nForm != 2 && nForm != 4 && nForm != 6)
+        return false;
+    if ((nForm == 0 || nForm == 4) && fYBit)
+        return false;
+
+    if (nForm == 0)
+    {
+        if (nSize != 1)
+            return false;
+        point = CECPoint();
+        return true;
+    }
+
+    CFieldElem x, y;
+    CGroupElem ge;
+    if (nForm == 2)
+    {
+        if (nSize != 33 || !FeSetB32(x, pch + 1))
+            return false;
+        if (!GeSetXO(ge, x, fYBit))
+            return false;
+    }
+    else
+    {
+        if (nSize != 65 || !FeSetB32(x, pch + 1) || !FeSetB32(y, pch + 33))
+            return false;
+        if (nForm == 6 && FeIsOdd(y) != fYBit)
+            return false;
+        GeSetXY(ge, x, y);
+        if (!GeIsOnCurve(ge))
+            return false;
+    }
+    GeToPoint(ge, point);
+    return true;
+}
+
+void ECSerializePubKey(const CECPoint& point, bool fCompressed, vector<unsigned char>& vch)
+{
+    if (point.fInfinity)
+    {
+        vch.assign(1, 0);
+        return;
+    }
+    if (fCompressed)
+    {
+        vch.resize(33);
+        vch[0] = (point.y[31] & 1) ? 0x03 : 0x02;
+        memcpy(&vch[1], point.x, 32);
+    }
+    else
+    {
+        vch.resize(65);
+        vch[0] = 0x04;
+        memcpy(&vch[1], point.x, 32);
+        memcpy(&vch[33], point.y, 32);
+    }
+}
+
+// Reads one DER INTEGER's length the lax way; see ParseSignatureLax
+static bool ParseLaxLength(const unsigned char* pch, size_t nSize, size_t& nPos, size_t& nLen)
+{
+    if (nPos == nSize)
+        return false;
+    size_t nLenByte = pch[nPos++];
+    if (nLenByte & 0x80)
+    {
+        nLenByte -= 0x80;
+        if (nLenByte > nSize - nPos)
+            return false;
+        while (nLenByte > 0 && pch[nPos] == 0)
+        {
+            nPos++;
+            nLenByte--;
+        }
+        if (nLenByte >= sizeof(size_t))
+            return false;
+        nLen = 0;
+        while (nLenByte > 0)
+        {
+            nLen = (nLen << 8) + pch[nPos];
+            nPos++;
+            nLenByte--;
+        }
+    }
+    else
+        nLen = nLenByte;
+    return nLen <= nSize - nPos;
+}
+
+// Copies an INTEGER's magnitude into a 32 byte big-endian buffer, false if
+// it is negative or does not fit
+static bool ParseLaxInteger(const unsigned char* pch, size_t nLen, unsigned char* pch32)
+{
+    if (nLen > 0 && (pch[0] & 0x80))
+        return false;
+    while (nLen > 0 && pch[0] == 0)
+    {
+        pch++;
+        nLen--;
+    }
+    if (nLen > 32)
+        return false;
+    memset(pch32, 0, 32);
+    memcpy(pch32 + 32 - nLen, pch, nLen);
+    return true;
+}
+
+// Signature parsing as lenient as OpenSSL's d2i_ECDSA_SIG was before it
+// started insisting on DER: long form and padded lengths, leading zero
+// bytes and trailing garbage are all tolerated. r and s must come out in
+// [1, n-1], the same range check ECDSA_do_verify made.
+static bool ParseSignatureLax(const unsigned char* pch, size_t nSize, CScalar& r, CScalar& s)
+{
+    size_t nPos = 0;
+
+    // Sequence tag and length; the length itself is not checked
+    if (nPos == nSize || pch[nPos] != 0x30)
+        return false;
+    nPos++;
+    if (nPos == nSize)
+        return false;
+    size_t nLenByte = pch[nPos++];
+    if (nLenByte & 0x80)
+    {
+        nLenByte -= 0x80;
+        if (nLenByte > nSize - nPos)
+            return false;
+        nPos += nLenByte;
+    }
+
+    size_t nRPos, nRLen, nSPos, nSLen;
+    if (nPos == nSize || pch[nPos] != 0x02)
+        return false;
+    nPos++;
+    if (!ParseLaxLength(pch, nSize, nPos, nRLen))
+        return false;
+    nRPos = nPos;
+    nPos += nRLen;
+
+    if (nPos == nSize || pch[nPos] != 0x02)
+        return false;
+    nPos++;
+    if (!ParseLaxLength(pch, nSize, nPos, nSLen))
+        return false;
+    nSPos = nPos;
+
+    unsigned char pchR[32], pchS[32];
+    if (!ParseLaxInteger(pch + nRPos, nRLen, pchR) || !ParseLaxInteger(pch + nSPos, nSLen, pchS))
+        return false;
+
+    bool fOverflowR, fOverflowS;
+    ScalarSetB32(r, pchR, &fOverflowR);
+    ScalarSetB32(s, pchS, &fOverflowS);
+    return !fOverflowR && !fOverflowS && !ScalarIsZero(r) && !ScalarIsZero(s);
+}
+
+static void ScalarFromHash(CScalar& e, const uint256& hash)
+{
+    ScalarSetB32(e, (const unsigned char*)&hash);
+}
+
+static bool VerifyCore(const CGroupElem& pubkey, const CScalar& r, const CScalar& sinv, const CScalar& e)
+{
+    CScalar u1, u2;
+    ScalarMul(u1, e, sinv);
+    ScalarMul(u2, r, sinv);
+    CGroupElemJ R;
+    ECMult(R, pubkey, u2, u1);
+    if (R.fInfinity)
+        return false;
+
+    // R.x mod n == r, checked as X == r * Z^2 so R is never normalized
+    CFieldElem xr, zz, t;
+    memcpy(xr.n, r.n, sizeof(xr.n));
+    FeSqr(zz, R.z);
+    FeMul(t, xr, zz);
+    if (FeEqual(t, R.x))
+        return true;
+    if (Compare256(r.n, FIELD_P_MINUS_N) >= 0)
+        return false;
+    Add256(xr.n, xr.n, SCALAR_N);
+    FeMul(t, xr, zz);
+    return FeEqual(t, R.x);
+}
+
+bool ECVerify(const CECPoint& pubkey, const uint256& hash, const unsigned char* pchSig, size_t nSigSize)
+{
+    CScalar r, s, e, sinv;
+    CGroupElem q;
+    if (!PointToGe(pubkey, q) || !ParseSignatureLax(pchSig, nSigSize, r, s))
+        return false;
+    ScalarFromHash(e, hash);
+    ScalarInv(sinv, s);
+    return VerifyCore(q, r, sinv, e);
+}
+
+bool ECRecoverCompact(const uint256& hash, const unsigned char* pch64, int nRecId, CECPoint& pubkey)
+{
+    if (nRecId < 0 || nRecId > 3)
+        return false;
+
+    // x = r + (nRecId / 2) * n, taken from the unreduced r like OpenSSL did
+    uint64 x[4];
+    Read256(pch64, x);
+    if (nRecId & 2)
+    {
+        if (Add256(x, x, SCALAR_N))
+            return false;
+    }
+    if (Compare256(x, FIELD_P) >= 0)
+        return false;
+    CFieldElem fx;
+    memcpy(fx.n, x, sizeof(fx.n));
+    CGroupElem R;
+    if (!GeSetXO(R, fx, nRecId & 1))
+        return false;
+
+    CScalar r, s, e, rinv, u1, u2;
+    ScalarSetB32(r, pch64);
+    ScalarSetB32(s, pch64 + 32);
+    if (ScalarIsZero(r))
+        return false;
+    ScalarFromHash(e, hash);
+    ScalarInv(rinv, r);
+    ScalarMul(u1, e, rinv);
+    ScalarNeg(u1, u1);
+    ScalarMul(u2, s, rinv);
+
+    // Q = r^-1 (s R - e G)
+    CGroupElemJ qj;
+    ECMult(qj, R, u2, u1);
+    if (qj.fInfinity)
+        return false;
+    CGroupElem q;
+    GeSetGej(q, qj);
+    GeToPoint(q, pubkey);
+    return true;
+}
+
+bool CECBatchVerifier::Add(const unsigned char* pchPubKey, size_t nPubKeySize, const unsigned char* pchSig, size_t nSigSize, const uint256& hash)
+{
+    CEntry entry;
+    CScalar r, s, e;
+    if (!ECParsePubKey(pchPubKey, nPubKeySize, entry.pubkey) || !ParseSignatureLax(pchSig, nSigSize, r, s))
+        return false;
+    ScalarFromHash(e, hash);
+    Write256(r.n, entry.r);
+    Write256(s.n, entry.s);
+    Write256(e.n, entry.e);
+    vEntries.push_back(entry);
+    return true;
+}
+
+bool CECBatchVerifier::Verify(vector<bool>& vfValid) const
+{
+    size_t nCount = vEntries.size();
+    vfValid.assign(nCount, false);
+    if (nCount == 0)
+        return true;
+
+    // Invert every s with one inversion (Montgomery's trick)
+    vector<CScalar> vS(nCount), vPrefix(nCount);
+    CScalar acc;
+    ScalarSetInt(acc, 1);
+    for (size_t i = 0; i < nCount; i++)
+    {
+        ScalarSetB32(vS[i], vEntries[i].s);
+        vPrefix[i] = acc;
+        ScalarMul(acc, acc, vS[i]);
+    }
+    CScalar inv;
+    ScalarInv(inv, acc);
+
+    bool fAllValid = true;
+    for (size_t i = nCount; i-- > 0; )
+    {
+        CScalar sinv, r, e;
+        ScalarMul(sinv, inv, vPrefix[i]);
+        ScalarMul(inv, inv, vS[i]);
+
+        const CEntry& entry = vEntries[i];
+        CGroupElem q;
+        PointToGe(entry.pubkey, q);
+        ScalarSetB32(r, entry.r);
+        ScalarSetB32(e, entry.e);
+        vfValid[i] = VerifyCore(q, r, sinv, e);
+        fAllValid &= vfValid[i];
+    }
+    return fAllValid;
+}
+
+bool ECSelfTest()
+{
+    static const unsigned char pchPubKey[65] = {
+        0x04,0xaa,0x1c,0x74,0x07,0xd5,0xc3,0xf5,0x09,0xf1,0xdd,0xa5,0x86,0xc3,0x7a,0x54,
+        0xce,0xe1,0x1b,0xbe,0x44,0x45,0x5d,0xd8,0xe8,0xae,0xa8,0xdf,0x71,0x11,0x41,0xbc,
+        0x9e,0xb2,0x7e,0x95,0x95,0xc4,0x0f,0xe7,0x7e,0xb8,0x6e,0xc9,0xf4,0xd1,0xf9,0xba,
+        0xcd,0xee,0xf1,0x3f,0xe5,0x30,0x4e,0x8b,0xb4,0x8f,0xe9,0x19,0x3c,0xeb,0x88,0xb9,
+        0x93
+    };
+    static const unsigned char pchHash[32] = {
+        0xf1,0x6f,0xf7,0x12,0x7f,0x80,0x6d,0x05,0xcd,0x10,0xc8,0x43,0xc4,0x57,0xfd,0x07,
+        0xb4,0x43,0x58,0x4e,0xd3,0x55,0xaf,0xec,0xe2,0x91,0x78,0x5d,0x0d,0xd7,0xbb,0x0e
+    };
+    static const unsigned char pchSig[71] = {
+        0x30,0x45,0x02,0x20,0x17,0xf5,0x32,0x89,0xea,0xc9,0x61,0xe5,0xad,0xc8,0x58,0xd3,
+        0xca,0x50,0xda,0xb0,0x56,0xdd,0xca,0x7a,0x1a,0x90,0x6c,0x08,0x15,0xa0,0x36,0x93,
+        0x12,0xd1,0xaa,0x49,0x02,0x21,0x00,0x86,0x6e,0xad,0xbf,0x84,0xe2,0x95,0xe0,0xba,
+        0x8c,0xb0,0xc2,0xa3,0xc2,0xa2,0xa4,0x5f,0x95,0x9f,0xb7,0x05,0x12,0x1c,0x9c,0x0f,
+        0x44,0x91,0xb3,0x99,0x27,0x19,0x86
+    };
+
+    // lambda * G = (beta * Gx, Gy)
+    CGroupElem g;
+    GeGetGenerator(g);
+    CScalar lambda, zero;
+    memcpy(lambda.n, SCALAR_LAMBDA, sizeof(lambda.n));
+    ScalarSetInt(zero, 0);
+    CGroupElemJ lgj;
+    ECMult(lgj, g, lambda, zero);
+    CGroupElem lg;
+    GeSetGej(lg, lgj);
+    CFieldElem beta, bx;
+    memcpy(beta.n, FIELD_BETA, sizeof(beta.n));
+    FeMul(bx, g.x, beta);
+    if (lg.fInfinity || !FeEqual(lg.x, bx) || !FeEqual(lg.y, g.y))
+        return false;
+
+    // The table and the endomorphism path agree: (n-1) * G = -G
+    CScalar nm1;
+    ScalarSetInt(nm1, 1);
+    ScalarNeg(nm1, nm1);
+    CGroupElemJ aj, bj;
+    ECMult(aj, g, nm1, zero);
+    ECMult(bj, g, zero, nm1);
+    CGroupElem a, b;
+    GeSetGej(a, aj);
+    GeSetGej(b, bj);
+    CFieldElem negy;
+    FeNeg(negy, g.y);
+    if (a.fInfinity || b.fInfinity || !FeEqual(a.x, g.x) || !FeEqual(a.y, negy) || !FeEqual(b.x, a.x) || !FeEqual(b.y, a.y))
+        return false;
+
+    // Known signature, a corrupted copy, and key recovery
+    uint256 hash;
+    memcpy(&hash, pchHash, 32);
+    CECPoint pubkey;
+    if (!ECParsePubKey(pchPubKey, sizeof(pchPubKey), pubkey))
+        return false;
+    if (!ECVerify(pubkey, hash, pchSig, sizeof(pchSig)))
+        return false;
+    unsigned char pchBad[sizeof(pchSig)];
+    memcpy(pchBad, pchSig, sizeof(pchSig));
+    pchBad[10] ^= 1;
+    if (ECVerify(pubkey, hash, pchBad, sizeof(pchBad)))
+        return false;
+
+    unsigned char pchCompact[64];
+    memcpy(pchCompact, pchSig + 4, 32);
+    memcpy(pchCompact + 32, pchSig + 39, 32);
+    CECPoint recovered;
+    if (!ECRecoverCompact(hash, pchCompact, 0, recovered))
+        return false;
+    return memcmp(recovered.x, pubkey.x, 32) == 0 && memcmp(recovered.y, pubkey.y, 32) == 0;
+}
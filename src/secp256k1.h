@@ -0,0 +1,85 @@
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SECP256K1_H
+#define BITCOIN_SECP256K1_H
+
+#include <string.h>
+#include <vector>
+
+#include "uint256.h"
+
+/** secp256k1 signature verification without OpenSSL.
+ *
+ * Verification and public key recovery only ever see public data, so this
+ * code is variable time and tuned for speed: the generator is multiplied
+ * from a precomputed table and the public key half of u1*G + u2*Q uses the
+ * curve endomorphism to halve the doublings. Signing stays with OpenSSL.
+ *
+ * What is accepted matches what CKey::SetPubKey and ECDSA_verify accepted:
+ * compressed, uncompressed, hybrid and point-at-infinity public key
+ * encodings, and DER signatures as leniently as OpenSSL parsed them.
+ */
+
+/** A public key parsed for verification (affine, big-endian coordinates) */
+class CECPoint
+{
+public:
+    unsigned char x[32];
+    unsigned char y[32];
+    bool fInfinity;
+
+    CECPoint()
+    {
+        memset(x, 0, sizeof(x));
+        memset(y, 0, sizeof(y));
+        fInfinity = true;
+    }
+};
+
+// Parse a public key the way o2i_ECPublicKey does
+bool ECParsePubKey(const unsigned char* pch, size_t nSize, CECPoint& point);
+void ECSerializePubKey(const CECPoint& point, bool fCompressed, std::vector<unsigned char>& vch);
+
+// Check a DER signature (without hash type byte) of hash, which is read as
+// the 32 bytes of its memory image like ECDSA_verify was given
+bool ECVerify(const CECPoint& pubkey, const uint256& hash, const unsigned char* pchSig, size_t nSigSize);
+
+// Recover the key behind a compact signature's r and s (64 bytes) for
+// nRecId 0..3, as ECDSA_SIG_recover_key_GFp did
+bool ECRecoverCompact(const uint256& hash, const unsigned char* pch64, int nRecId, CECPoint& pubkey);
+
+/** Verifies many signatures at once, as in block validation. The scalar
+ * inversions of all entries share one modular inversion.
+ */
+class CECBatchVerifier
+{
+private:
+    struct CEntry
+    {
+        CECPoint pubkey;
+        unsigned char r[32];
+        unsigned char s[32];
+        unsigned char e[32];
+    };
+    std::vector<CEntry> vEntries;
+
+public:
+    // Queue one check. Returns false, queueing nothing, if the key or the
+    // signature does not parse; ECVerify would reject those too.
+    bool Add(const unsigned char* pchPubKey, size_t nPubKeySize, const unsigned char* pchSig, size_t nSigSize, const uint256& hash);
+
+    size_t size() const { return vEntries.size(); }
+    void clear() { vEntries.clear(); }
+    // Drop the entries queued after the first nSize
+    void resize(size_t nSize) { if (nSize < vEntries.size()) vEntries.resize(nSize); }
+
+    // Check every queued entry; vfValid[i] tells whether entry i verified.
+    // Returns true if all of them did.
+    bool Verify(std::vector<bool>& vfValid) const;
+};
+
+// Known answer and consistency checks of the arithmetic, for startup
+bool ECSelfTest();
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2009-2012 The Bitcoin developers
+ * Distributed under the MIT/X11 software license, see the accompanying
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.
+ *
+ * AES-NI versions of the AES based hashes: ECHO, SHAvite-3 and Groestl
+ * (the 512-bit ones). They are built into echo.c, shavite.c and groestl.c
+ * next to the table code, with the target attribute so that no -maes is
+ * needed, and chosen at run time when CPUID reports AES-NI and SSSE3.
+ * The table code stays the fallback and gives the same results.
+ */
+
+#ifndef SPH_AESNI_H__
+#define SPH_AESNI_H__
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "sph_types.h"
+
+#if !defined SPH_AESNI
+#if (SPH_I386_GCC || SPH_AMD64_GCC) && !SPH_NO_ASM \
+	&& ((defined __clang__ && __clang_major__ >= 4) \
+	|| (!defined __clang__ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SPH_AESNI   1
+#else
+#define SPH_AESNI   0
+#endif
+#endif
+
+#if SPH_AESNI
+#define SPH_TARGET_AESNI   __attribute__((target("aes,ssse3")))
+#endif
+
+/**
+ * Non-zero if the CPU has AES-NI and SSSE3, and this build can use them.
+ */
+int sph_aesni_supported(void);
+
+/**
+ * Non-zero if the AES-NI code is in use: supported, and not turned off
+ * with <code>sph_aesni_enable(0)</code>.
+ */
+int sph_aesni_enabled(void);
+
+/**
+ * Turn the AES-NI code on (the default where supported) or off. Meant
+ * for tests and benchmarks; not to be called while hashing.
+ *
+ * @param enable   zero to use the table code only
+ */
+void sph_aesni_enable(int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "stealthaddress.h"
 #include "base58.h"
+#include "main.h"
 
 
 #include <openssl/rand.h>
@@ -681,3 +682,232 @@ bool IsStealthAddress(const std::string& encodedAddress)
     
     return true;
 };
+
+CStealthScanner::CStealthScanner()
+{
+    ecgrp = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    bnCtx = BN_CTX_new();
+    if (!ecgrp || !bnCtx)
+        printf("CStealthScanner(): EC_GROUP_new_by_curve_name or BN_CTX_new failed.\n");
+    // Multiples of G for the cG of every candidate
+    else if (!EC_GROUP_precompute_mult(ecgrp, bnCtx))
+        printf("CStealthScanner(): EC_GROUP_precompute_mult failed.\n");
+};
+
+CStealthScanner::~CStealthScanner()
+{
+    Clear();
+    if (bnCtx)
+        BN_CTX_free(bnCtx);
+    if (ecgrp)
+        EC_GROUP_free(ecgrp);
+};
+
+void CStealthScanner::Clear()
+{
+    for (unsigned int i = 0; i < vScanSecret.size(); i++)
+        BN_clear_free(vScanSecret[i]);
+    for (unsigned int i = 0; i < vSpendPubkey.size(); i++)
+        EC_POINT_free(vSpendPubkey[i]);
+    vScanSecret.clear();
+    vSpendPubkey.clear();
+    vAddresses.clear();
+    vKeys.clear();
+};
+
+bool CStealthScanner::SetAddresses(const std::set<CStealthAddress>& setAddresses)
+{
+    std::vector<std::pair<data_chunk, ec_point> > vKeysNew;
+    std::set<CStealthAddress>::const_iterator it;
+    for (it = setAddresses.begin(); it != setAddresses.end(); ++it)
+        if (it->scan_secret.size() == ec_secret_size)
+            vKeysNew.push_back(std::make_pair(it->scan_secret, it->spend_pubkey));
+
+    if (vKeysNew == vKeys)
+        return !vAddresses.empty();
+
+    Clear();
+    vKeys = vKeysNew;
+    if (!ecgrp || !bnCtx)
+        return false;
+
+    for (it = setAddresses.begin(); it != setAddresses.end(); ++it)
+    {
+        if (it->scan_secret.size() != ec_secret_size)
+            continue;
+
+        BIGNUM* bnScan = BN_bin2bn(&it->scan_secret[0], ec_secret_size, NULL);
+        EC_POINT* R = EC_POINT_new(ecgrp);
+        if (!bnScan || !R || it->spend_pubkey.empty()
+            || !EC_POINT_oct2point(ecgrp, R, &it->spend_pubkey[0], it->spend_pubkey.size(), bnCtx))
+        {
+            printf("CStealthScanner::SetAddresses(): invalid keys for %s.\n", it->Encoded().c_str());
+            if (bnScan) BN_clear_free(bnScan);
+            if (R)      EC_POINT_free(R);
+            continue;
+        };
+
+        vAddresses.push_back(*it);
+        vScanSecret.push_back(bnScan);
+        vSpendPubkey.push_back(R);
+    };
+
+    return !vAddresses.empty();
+};
+
+// Affine coordinates for all non-null points at once, so that writing them
+// out does not need an inversion each
+static void MakeAffine(const EC_GROUP* ecgrp, std::vector<EC_POINT*>& vPoints, BN_CTX* bnCtx)
+{
+    std::vector<EC_POINT*> vBatch;
+    for (unsigned int i = 0; i < vPoints.size(); i++)
+        if (vPoints[i])
+            vBatch.push_back(vPoints[i]);
+    if (!vBatch.empty() && !EC_POINTs_make_affine(ecgrp, vBatch.size(), &vBatch[0], bnCtx))
+        printf("CStealthScanner::Scan(): EC_POINTs_make_affine failed.\n");
+};
+
+struct CStealthEphem
+{
+    unsigned int nTx;
+    unsigned int nOut;
+    ec_point pk;
+    // The key IDs paid to by the transaction's other outputs
+    std::vector<std::pair<unsigned int, CKeyID> > vTargets;
+};
+
+void CStealthScanner::Scan(const std::vector<const CTransaction*>& vtx, std::vector<CStealthMatch>& vMatches,
+                           std::vector<unsigned int>* pvScanned)
+{
+    vMatches.clear();
+    if (pvScanned)
+        pvScanned->clear();
+
+    // -- OP_RETURN <33 byte ephemeral key>, with at least one pay to key hash output beside it
+    std::vector<CStealthEphem> vEphem;
+    for (unsigned int i = 0; i < vtx.size(); i++)
+    {
+        const CTransaction& tx = *vtx[i];
+        bool fEphem = false;
+        for (unsigned int j = 0; j < tx.vout.size(); j++)
+        {
+            const CScript& script = tx.vout[j].scriptPubKey;
+            CScript::const_iterator pc = script.begin();
+            opcodetype opCode;
+            std::vector<uint8_t> vchEphemPK;
+            if (!script.GetOp(pc, opCode) || opCode != OP_RETURN
+                || !script.GetOp(pc, opCode, vchEphemPK) || vchEphemPK.size() != ec_compressed_size)
+                continue;
+            fEphem = true;
+
+            CStealthEphem ephem;
+            ephem.nTx = i;
+            ephem.nOut = j;
+            ephem.pk = vchEphemPK;
+            for (unsigned int k = 0; k < tx.vout.size(); k++)
+            {
+                CTxDestination address;
+                if (k != j && ExtractDestination(tx.vout[k].scriptPubKey, address) && address.type() == typeid(CKeyID))
+                    ephem.vTargets.push_back(std::make_pair(k, boost::get<CKeyID>(address)));
+            };
+            if (!ephem.vTargets.empty())
+                vEphem.push_back(ephem);
+        };
+        if (fEphem && pvScanned)
+            pvScanned->push_back(i);
+    };
+
+    if (vEphem.empty() || vAddresses.empty())
+        return;
+
+    size_t nAddresses = vAddresses.size();
+    size_t nCandidates = vEphem.size() * nAddresses;
+
+    // -- dP for every ephemeral key P and scan secret d
+    std::vector<EC_POINT*> vShared(nCandidates, (EC_POINT*)NULL);
+    EC_POINT* P = EC_POINT_new(ecgrp);
+    for (unsigned int e = 0; P && e < vEphem.size(); e++)
+    {
+        if (!EC_POINT_oct2point(ecgrp, P, &vEphem[e].pk[0], vEphem[e].pk.size(), bnCtx))
+            continue; // not a point, cannot have been paid to
+        for (unsigned int a = 0; a < nAddresses; a++)
+        {
+            EC_POINT* Q = EC_POINT_new(ecgrp);
+            if (!Q)
+                continue;
+            if (!EC_POINT_mul(ecgrp, Q, NULL, P, vScanSecret[a], bnCtx) || EC_POINT_is_at_infinity(ecgrp, Q))
+            {
+                EC_POINT_free(Q);
+                continue;
+            };
+            vShared[e * nAddresses + a] = Q;
+        };
+    };
+    if (P)
+        EC_POINT_free(P);
+    MakeAffine(ecgrp, vShared, bnCtx);
+
+    // -- c = H(dP), R' = R + cG
+    std::vector<ec_secret> vSecret(nCandidates);
+    std::vector<EC_POINT*> vDerived(nCandidates, (EC_POINT*)NULL);
+    BIGNUM* bnc = BN_new();
+    for (unsigned int k = 0; bnc && k < nCandidates; k++)
+    {
+        if (!vShared[k])
+            continue;
+        uint8_t vchShared[ec_compressed_size];
+        if (EC_POINT_point2oct(ecgrp, vShared[k], POINT_CONVERSION_COMPRESSED, vchShared, sizeof(vchShared), bnCtx) != ec_compressed_size)
+            continue;
+        SHA256(vchShared, sizeof(vchShared), &vSecret[k].e[0]);
+
+        EC_POINT* Rout = EC_POINT_new(ecgrp);
+        if (!Rout)
+            continue;
+        if (!BN_bin2bn(&vSecret[k].e[0], ec_secret_size, bnc)
+            || !EC_POINT_mul(ecgrp, Rout, bnc, NULL, NULL, bnCtx)
+            || !EC_POINT_add(ecgrp, Rout, Rout, vSpendPubkey[k % nAddresses], bnCtx)
+            || EC_POINT_is_at_infinity(ecgrp, Rout))
+        {
+            EC_POINT_free(Rout);
+            continue;
+        };
+        vDerived[k] = Rout;
+    };
+    if (bnc)
+        BN_clear_free(bnc);
+    MakeAffine(ecgrp, vDerived, bnCtx);
+
+    // -- compare with the outputs
+    for (unsigned int k = 0; k < nCandidates; k++)
+    {
+        if (!vDerived[k])
+            continue;
+        ec_point pkExtracted(ec_compressed_size);
+        if (EC_POINT_point2oct(ecgrp, vDerived[k], POINT_CONVERSION_COMPRESSED, &pkExtracted[0], pkExtracted.size(), bnCtx) != ec_compressed_size)
+            continue;
+        CKeyID keyID = CPubKey(pkExtracted).GetID();
+
+        const CStealthEphem& ephem = vEphem[k / nAddresses];
+        for (unsigned int t = 0; t < ephem.vTargets.size(); t++)
+        {
+            if (ephem.vTargets[t].second != keyID)
+                continue;
+            CStealthMatch match;
+            match.nTx = ephem.nTx;
+            match.nEphemOut = ephem.nOut;
+            match.nOut = ephem.vTargets[t].first;
+            match.address = vAddresses[k % nAddresses];
+            match.pkEphem = ephem.pk;
+            match.sShared = vSecret[k];
+            match.pkExtracted = pkExtracted;
+            vMatches.push_back(match);
+        };
+    };
+
+    for (unsigned int k = 0; k < nCandidates; k++)
+    {
+        if (vShared[k])  EC_POINT_free(vShared[k]);
+        if (vDerived[k]) EC_POINT_free(vDerived[k]);
+    };
+    OPENSSL_cleanse(&vSecret[0], vSecret.size() * sizeof(ec_secret));
+};
@@ -12,6 +12,10 @@
 #include <stdio.h> 
 #include <vector>
 #include <inttypes.h>
+#include <set>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
 
 typedef unsigned char byte;
 
@@ -110,6 +114,61 @@ int StealthSharedToSecretSpend(ec_secret& sharedS, ec_secret& spendSecret, ec_se
 
 bool IsStealthAddress(const std::string& encodedAddress);
 
+class CTransaction;
+
+/** A payment to one of the scanned stealth addresses */
+struct CStealthMatch
+{
+    unsigned int nTx;       // index in the scanned transactions
+    unsigned int nEphemOut; // output carrying the ephemeral key
+    unsigned int nOut;      // output paying to pkExtracted
+    CStealthAddress address;
+    ec_point pkEphem;
+    ec_secret sShared;      // H(dP)
+    ec_point pkExtracted;   // R + H(dP)G, compressed
+};
+
+/** Finds payments to stealth addresses in batches of transactions.
+ *
+ * The curve, a bignum context, the generator table and the parsed scan
+ * secret and spend key of every address are kept between calls, where
+ * StealthSecret sets all of them up for each key it derives. The shared
+ * secret of an ephemeral key is computed once per address rather than once
+ * per output, and the points of a whole batch are made affine together,
+ * which costs one field inversion instead of one each.
+ */
+class CStealthScanner
+{
+private:
+    EC_GROUP* ecgrp;
+    BN_CTX* bnCtx;
+    // Scan secret and spend key of each address given, to notice changes
+    std::vector<std::pair<data_chunk, ec_point> > vKeys;
+    std::vector<CStealthAddress> vAddresses;
+    std::vector<BIGNUM*> vScanSecret;
+    std::vector<EC_POINT*> vSpendPubkey;
+
+    void Clear();
+
+    // Not copyable
+    CStealthScanner(const CStealthScanner&);
+    CStealthScanner& operator=(const CStealthScanner&);
+
+public:
+    CStealthScanner();
+    ~CStealthScanner();
+
+    // Scan for the addresses of setAddresses that have a scan secret; the
+    // tables are only rebuilt if those changed. Returns whether there is
+    // anything to scan for.
+    bool SetAddresses(const std::set<CStealthAddress>& setAddresses);
+
+    // All payments in vtx to the addresses. pvScanned, if given, receives
+    // the indexes of the transactions that carry ephemeral keys.
+    void Scan(const std::vector<const CTransaction*>& vtx, std::vector<CStealthMatch>& vMatches,
+              std::vector<unsigned int>* pvScanned = NULL);
+};
+
 
 #endif  // BITCOIN_STEALTHADDRESS_H
 
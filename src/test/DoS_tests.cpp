@@ -9,6 +9,7 @@
 #include <boost/foreach.hpp>
 
 #include "main.h"
+#include "orphans.h"
 #include "wallet.h"
 #include "net.h"
 #include "util.h"
@@ -16,10 +17,7 @@
 #include <stdint.h>
 
 // Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CDataStream& vMsg);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-extern std::map<uint256, CDataStream*> mapOrphanTransactions;
-extern std::map<uint256, std::map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
+extern bool AddOrphanTx(const CTransaction& tx, const CNetAddr& addrFrom);
 
 CService ip(uint32_t i)
 {
@@ -132,16 +130,16 @@ BOOST_AUTO_TEST_CASE(DoS_checknbits)
     
 }
 
-CTransaction RandomOrphan()
+CTransaction RandomOrphan(const std::vector<uint256>& vOrphans)
 {
-    std::map<uint256, CDataStream*>::iterator it;
-    it = mapOrphanTransactions.lower_bound(GetRandHash());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    const CDataStream* pvMsg = it->second;
-    CTransaction tx;
-    CDataStream(*pvMsg) >> tx;
-    return tx;
+    return **orphanTxPool.Get(vOrphans[GetRandInt(vOrphans.size())]);
+}
+
+void ClearOrphans(std::vector<uint256>& vOrphans)
+{
+    BOOST_FOREACH(const uint256& hash, vOrphans)
+        orphanTxPool.Erase(hash);
+    vOrphans.clear();
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -150,6 +148,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     key.MakeNewKey(true);
     CBasicKeyStore keystore;
     keystore.AddKey(key);
+    std::vector<uint256> vOrphans;
 
     // 50 orphan transactions:
     for (int i = 0; i < 50; i++)
@@ -163,15 +162,14 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        AddOrphanTx(ds);
+        BOOST_CHECK(AddOrphanTx(tx, ip(i)));
+        vOrphans.push_back(tx.GetHash());
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++)
     {
-        CTransaction txPrev = RandomOrphan();
+        CTransaction txPrev = RandomOrphan(vOrphans);
 
         CTransaction tx;
         tx.vin.resize(1);
@@ -182,15 +180,20 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
         SignSignature(keystore, txPrev, tx, 0);
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        AddOrphanTx(ds);
+        BOOST_CHECK(AddOrphanTx(tx, ip(i)));
+        vOrphans.push_back(tx.GetHash());
+
+        // which are indexed by the parent they wait for
+        std::vector<uint256> vChildren;
+        orphanTxPool.GetChildren(txPrev.GetHash(), vChildren);
+        BOOST_CHECK(std::find(vChildren.begin(), vChildren.end(), tx.GetHash()) != vChildren.end());
     }
+    BOOST_CHECK_EQUAL(orphanTxPool.size(), 100U);
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++)
     {
-        CTransaction txPrev = RandomOrphan();
+        CTransaction txPrev = RandomOrphan(vOrphans);
 
         CTransaction tx;
         tx.vout.resize(1);
@@ -208,19 +211,13 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        BOOST_CHECK(!AddOrphanTx(ds));
+        BOOST_CHECK(!AddOrphanTx(tx, ip(i)));
     }
+    BOOST_CHECK_EQUAL(orphanTxPool.size(), 100U);
 
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
-    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    ClearOrphans(vOrphans);
+    BOOST_CHECK_EQUAL(orphanTxPool.size(), 0U);
+    BOOST_CHECK_EQUAL(orphanTxPool.GetStats().nMemory, 0U);
 }
 
 BOOST_AUTO_TEST_CASE(DoS_checkSig)
@@ -234,6 +231,7 @@ BOOST_AUTO_TEST_CASE(DoS_checkSig)
 
     // 100 orphan transactions:
     static const int NPREV=100;
+    std::vector<uint256> vOrphans;
     CTransaction orphans[NPREV];
     for (int i = 0; i < NPREV; i++)
     {
@@ -246,9 +244,8 @@ BOOST_AUTO_TEST_CASE(DoS_checkSig)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        AddOrphanTx(ds);
+        AddOrphanTx(tx, ip(i));
+        vOrphans.push_back(tx.GetHash());
     }
 
     // Create a transaction that depends on orphans:
@@ -308,7 +305,7 @@ BOOST_AUTO_TEST_CASE(DoS_checkSig)
         BOOST_CHECK(VerifySignature(orphans[j], tx, j, true, SIGHASH_ALL));
     mapArgs.erase("-maxsigcachesize");
 
-    LimitOrphanTxSize(0);
+    ClearOrphans(vOrphans);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
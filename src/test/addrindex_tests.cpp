@@ -0,0 +1,195 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "addrindex.h"
+#include "txdb.h"
+
+using namespace std;
+
+static string SerializeKey(const CAddrIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << make_pair(string("addr"), key);
+    return ss.str();
+}
+
+static CAddrIndexId RandomAddrId(CScript& scriptPubKey)
+{
+    uint160 hash;
+    uint256 hashRand = GetRandHash();
+    memcpy(hash.begin(), hashRand.begin(), hash.size());
+    scriptPubKey.SetDestination(CKeyID(hash));
+    CAddrIndexId id;
+    id.SetScript(scriptPubKey);
+    return id;
+}
+
+static CTransaction SpendTx(const CTransaction* ptxPrev, unsigned int nPrevOut)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    if (ptxPrev)
+        tx.vin[0].prevout = COutPoint(ptxPrev->GetHash(), nPrevOut);
+    else
+        tx.vin[0].scriptSig = CScript() << GetRandInt(1000000); // a coinbase
+    return tx;
+}
+
+static int64 Balance(CTxDB& txdb, const CAddrIndexId& id)
+{
+    vector<pair<COutPoint, CAddrUnspent> > vUnspent;
+    BOOST_CHECK(txdb.ReadAddrUnspents(id, 0, 0, vUnspent));
+    int64 nBalance = 0;
+    for (unsigned int i = 0; i < vUnspent.size(); i++)
+        nBalance += vUnspent[i].second.nValue;
+    return nBalance;
+}
+
+static unsigned int HistorySize(CTxDB& txdb, const CAddrIndexId& id)
+{
+    vector<pair<CAddrIndexKey, CAddrIndexValue> > vHistory;
+    BOOST_CHECK(txdb.ReadAddrHistory(id, 0, -1, 0, 0, vHistory));
+    return vHistory.size();
+}
+
+BOOST_AUTO_TEST_SUITE(addrindex_tests)
+
+BOOST_AUTO_TEST_CASE(addrindex_key_order)
+{
+    CAddrIndexId id;
+    id.nAddrType = CAddrIndexId::ADDR_KEY;
+    id.hash = 12345;
+
+    // LevelDB orders keys bytewise; heights must sort numerically
+    int nHeights[] = { 0, 1, 255, 256, 65535, 65536, 1000000, 0x7fffffff };
+    for (unsigned int i = 1; i < sizeof(nHeights) / sizeof(nHeights[0]); i++)
+    {
+        CAddrIndexKey keyLow(id, nHeights[i - 1], ~uint256(0), 99, true);
+        CAddrIndexKey keyHigh(id, nHeights[i], 0, 0, false);
+        BOOST_CHECK(SerializeKey(keyLow) < SerializeKey(keyHigh));
+    }
+
+    // Every record of an address shares the prefix a range scan seeks to
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair(string("addr"), id);
+    string strKey = SerializeKey(CAddrIndexKey(id, 1234, 1, 2, false));
+    BOOST_CHECK(strKey.compare(0, ssPrefix.size(), ssPrefix.str()) == 0);
+
+    CAddrIndexId idOther = id;
+    idOther.nAddrType = CAddrIndexId::ADDR_SCRIPT;
+    BOOST_CHECK(SerializeKey(CAddrIndexKey(idOther, 0, 0, 0, false)).compare(0, ssPrefix.size(), ssPrefix.str()) != 0);
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_key_roundtrip)
+{
+    CAddrIndexId id;
+    id.nAddrType = CAddrIndexId::ADDR_SCRIPT;
+    id.hash = 777;
+    CAddrIndexKey key(id, 0x01020304, 42, 7, true);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    CAddrIndexKey key2;
+    ss >> key2;
+
+    BOOST_CHECK(key2.id == id);
+    BOOST_CHECK_EQUAL(key2.nHeight, 0x01020304);
+    BOOST_CHECK(key2.txhash == 42);
+    BOOST_CHECK_EQUAL(key2.nIndex, 7U);
+    BOOST_CHECK(key2.fSpend);
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_build_connect_disconnect)
+{
+    CScript scriptA, scriptB;
+    CAddrIndexId idA = RandomAddrId(scriptA);
+    CAddrIndexId idB = RandomAddrId(scriptB);
+
+    // tx1 pays A twice, tx2 moves one of those to B with change to A, tx3 pays B's back to A
+    CTransaction tx1 = SpendTx(NULL, 0);
+    tx1.vout.push_back(CTxOut(50 * COIN, scriptA));
+    tx1.vout.push_back(CTxOut(25 * COIN, scriptA));
+    CTransaction tx2 = SpendTx(&tx1, 0);
+    tx2.vout.push_back(CTxOut(30 * COIN, scriptB));
+    tx2.vout.push_back(CTxOut(20 * COIN, scriptA));
+    CTransaction tx3 = SpendTx(&tx2, 0);
+    tx3.vout.push_back(CTxOut(30 * COIN, scriptA));
+    vector<CTxOut> vSpent1, vSpent2(1, tx1.vout[0]), vSpent3(1, tx2.vout[0]);
+
+    CTxDB txdb;
+    CTxDB txdbRead("r");
+
+    // Built in one chunk, as the background builder does
+    BOOST_CHECK(txdb.TxnBegin());
+    CAddrIndexChunk chunk(txdb, txdbRead);
+    BOOST_CHECK(chunk.ConnectTx(tx1, 1, vSpent1));
+    BOOST_CHECK(chunk.ConnectTx(tx2, 2, vSpent2));
+    BOOST_CHECK(txdb.TxnCommit());
+    BOOST_CHECK_EQUAL(Balance(txdb, idA), 45 * COIN);
+    BOOST_CHECK_EQUAL(Balance(txdb, idB), 30 * COIN);
+    BOOST_CHECK_EQUAL(HistorySize(txdb, idA), 4U);
+
+    // The spend remembers the height of the output created in the same chunk
+    CAddrIndexValue value;
+    BOOST_CHECK(txdb.ReadAddrIndex(CAddrIndexKey(idA, 2, tx2.GetHash(), 0, true), value));
+    BOOST_CHECK_EQUAL(value.nValue, 50 * COIN);
+    BOOST_CHECK_EQUAL(value.nPrevHeight, 1);
+
+    // Connected on top, as ConnectBlock does
+    BOOST_CHECK(txdb.TxnBegin());
+    BOOST_CHECK(AddrIndexConnectTx(txdb, tx3, 3, vSpent3));
+    BOOST_CHECK(txdb.TxnCommit());
+    BOOST_CHECK_EQUAL(Balance(txdb, idA), 75 * COIN);
+    BOOST_CHECK_EQUAL(Balance(txdb, idB), 0);
+    BOOST_CHECK(txdb.ReadAddrIndex(CAddrIndexKey(idB, 3, tx3.GetHash(), 0, true), value));
+    BOOST_CHECK_EQUAL(value.nPrevHeight, 2);
+
+    // Disconnecting puts the spent output back at its own height
+    BOOST_CHECK(txdb.TxnBegin());
+    BOOST_CHECK(AddrIndexDisconnectTx(txdb, tx3, 3, vSpent3));
+    BOOST_CHECK(txdb.TxnCommit());
+    BOOST_CHECK_EQUAL(Balance(txdb, idA), 45 * COIN);
+    BOOST_CHECK_EQUAL(Balance(txdb, idB), 30 * COIN);
+    CAddrUnspent unspent;
+    BOOST_CHECK(txdb.ReadAddrUnspent(idB, COutPoint(tx2.GetHash(), 0), unspent));
+    BOOST_CHECK_EQUAL(unspent.nHeight, 2);
+
+    BOOST_CHECK(txdb.TxnBegin());
+    BOOST_CHECK(AddrIndexDisconnectTx(txdb, tx2, 2, vSpent2));
+    BOOST_CHECK(AddrIndexDisconnectTx(txdb, tx1, 1, vSpent1));
+    BOOST_CHECK(txdb.TxnCommit());
+    BOOST_CHECK_EQUAL(Balance(txdb, idA), 0);
+    BOOST_CHECK_EQUAL(Balance(txdb, idB), 0);
+    BOOST_CHECK_EQUAL(HistorySize(txdb, idA), 0U);
+    BOOST_CHECK_EQUAL(HistorySize(txdb, idB), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_stale_tip)
+{
+    fAddrIndex = true;
+    CTxDB txdb;
+    int nHeight;
+    uint256 hashBlock;
+
+    // An index built up to a block the chain no longer has is dropped
+    BOOST_CHECK(txdb.WriteAddrIndexBest(nBestHeight + 10, GetRandHash()));
+    BOOST_CHECK(InitAddrIndex(txdb));
+    BOOST_CHECK_EQUAL(nAddrIndexHeight, -1);
+    BOOST_CHECK(!txdb.ReadAddrIndexBest(nHeight, hashBlock));
+
+    // So is one whose height does not match its block
+    BOOST_CHECK(txdb.WriteAddrIndexBest(nBestHeight + 1, hashBestChain));
+    BOOST_CHECK(InitAddrIndex(txdb));
+    BOOST_CHECK_EQUAL(nAddrIndexHeight, -1);
+
+    // One at the best block is kept
+    BOOST_CHECK(txdb.WriteAddrIndexBest(nBestHeight, hashBestChain));
+    BOOST_CHECK(InitAddrIndex(txdb));
+    BOOST_CHECK_EQUAL(nAddrIndexHeight, nBestHeight);
+
+    BOOST_CHECK(txdb.WipeAddrIndex());
+    fAddrIndex = false;
+    nAddrIndexHeight = -1;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
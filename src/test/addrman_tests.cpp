@@ -0,0 +1,110 @@
+#include <boost/test/unit_test.hpp>
+
+#include "addrman.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(addrman_tests)
+
+static CAddress RandomAddress(int64 nTime)
+{
+    // 20.0.0.0 - 99.255.255.255 holds no special ranges
+    struct in_addr ip;
+    ip.s_addr = htonl(((20 + GetRandInt(80)) << 24) | GetRandInt(1 << 24));
+    CAddress addr(CService(CNetAddr(ip), 8333));
+    addr.nTime = nTime;
+    return addr;
+}
+
+static vector<CAddress> RandomAddresses(int nCount, int64 nTime)
+{
+    vector<CAddress> vAddr;
+    for (int i = 0; i < nCount; i++)
+        vAddr.push_back(RandomAddress(nTime));
+    return vAddr;
+}
+
+BOOST_AUTO_TEST_CASE(addrman_simple)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+    CNetAddr source = RandomAddress(nNow);
+
+    BOOST_CHECK_EQUAL(addrman.size(), 0);
+    BOOST_CHECK(addrman.Select().IsValid() == false);
+
+    CAddress addr1 = RandomAddress(nNow - 3600);
+    BOOST_CHECK(addrman.Add(addr1, source));
+    BOOST_CHECK(!addrman.Add(addr1, source));
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+    BOOST_CHECK(addrman.Select(0) == addr1);
+
+    // Unroutable addresses are not taken
+    CAddress addrLocal(CService("127.0.0.1", 8333));
+    addrLocal.nTime = nNow;
+    BOOST_CHECK(!addrman.Add(addrLocal, source));
+
+    // A good address moves to tried and stays found
+    addrman.Good(addr1, nNow);
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+    BOOST_CHECK(addrman.Select(0) == addr1);
+
+    BOOST_CHECK(addrman.Add(RandomAddresses(100, nNow - 3600), source));
+    BOOST_CHECK_EQUAL(addrman.size(), 101);
+    BOOST_CHECK_EQUAL(addrman.GetAddr().size(), 101U * ADDRMAN_GETADDR_MAX_PCT / 100);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_serialize)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+    vector<CAddress> vAddr;
+    for (int i = 0; i < 50; i++)
+    {
+        vector<CAddress> vAddrSource = RandomAddresses(100, nNow - 3600);
+        addrman.Add(vAddrSource, RandomAddress(nNow));
+        vAddr.insert(vAddr.end(), vAddrSource.begin(), vAddrSource.end());
+    }
+    for (int i = 0; i < 1000; i++)
+        addrman.Good(vAddr[GetRandInt(vAddr.size())], nNow);
+
+    CDataStream ss1(SER_DISK, CLIENT_VERSION);
+    ss1 << addrman;
+    BOOST_CHECK_EQUAL(ss1.size(), addrman.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    // Loading and saving again gives the same bytes
+    CAddrMan addrman2;
+    CDataStream ss2(ss1);
+    ss2 >> addrman2;
+    BOOST_CHECK(ss2.empty());
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+    CDataStream ss3(SER_DISK, CLIENT_VERSION);
+    ss3 << addrman2;
+    BOOST_CHECK(ss3.str() == ss1.str());
+
+    // A file written with another number of new buckets is rebucketed
+    CDataStream ss4(SER_DISK, CLIENT_VERSION);
+    unsigned char nVersion = 0;
+    vector<unsigned char> nKey(32, 1);
+    int nNew = 2, nTried = 0, nUBuckets = ADDRMAN_NEW_BUCKET_COUNT / 2;
+    ss4 << nVersion << nKey << nNew << nTried << nUBuckets;
+    for (int i = 0; i < nNew; i++)
+    {
+        CAddrInfo info(RandomAddress(nNow), RandomAddress(nNow));
+        ::Serialize(ss4, info, SER_DISK, 0);
+    }
+    for (int i = 0; i < nUBuckets; i++)
+    {
+        if (i < nNew)
+            ss4 << 1 << i;
+        else
+            ss4 << 0;
+    }
+    CAddrMan addrman3;
+    ss4 >> addrman3;
+    BOOST_CHECK(ss4.empty());
+    BOOST_CHECK_EQUAL(addrman3.size(), nNew);
+    BOOST_CHECK(addrman3.Select(100).IsValid());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,64 @@
+#include <boost/test/unit_test.hpp>
+
+#include "bloom.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(bloom_tests)
+
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    CRollingBloomFilter filter(100, 0.01);
+
+    // Nothing is in an empty filter, and recent inserts always are
+    BOOST_CHECK(!filter.contains(CInv(MSG_TX, GetRandHash())));
+    vector<CInv> vInv;
+    for (int i = 0; i < 399; i++)
+    {
+        vInv.push_back(CInv(MSG_TX, GetRandHash()));
+        filter.insert(vInv.back());
+        for (int j = max(0, i - 99); j <= i; j++)
+            BOOST_CHECK(filter.contains(vInv[j]));
+    }
+
+    // Old entries roll out, leaving only false positives near the rate
+    int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++)
+        if (filter.contains(CInv(MSG_TX, GetRandHash())))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives < 250);
+    int nOld = 0;
+    for (int i = 0; i < 150; i++)
+        if (filter.contains(vInv[i]))
+            nOld++;
+    BOOST_CHECK(nOld < 20);
+
+    // The type is part of the key
+    CInv inv(MSG_TX, GetRandHash());
+    filter.insert(inv);
+    BOOST_CHECK(filter.contains(inv));
+    BOOST_CHECK(!filter.contains(CInv(MSG_BLOCK, inv.hash)));
+
+    filter.reset();
+    BOOST_CHECK(!filter.contains(inv));
+    for (int i = 300; i < 399; i++)
+        BOOST_CHECK(!filter.contains(vInv[i]));
+}
+
+BOOST_AUTO_TEST_CASE(rolling_bloom_size)
+{
+    // The known inventory filter of a peer at the default -maxsendbuffer
+    CRollingBloomFilter filter(10000, 0.000001);
+    BOOST_CHECK(filter.GetMemoryUsage() < 150000);
+    for (int i = 0; i < 30000; i++)
+        filter.insert(CInv(MSG_TX, GetRandHash()));
+    int nFalsePositives = 0;
+    for (int i = 0; i < 100000; i++)
+        if (filter.contains(CInv(MSG_TX, GetRandHash())))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives <= 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
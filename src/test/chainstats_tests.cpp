@@ -0,0 +1,159 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "chainstats.h"
+
+using namespace std;
+
+// Reference implementation: walk pprev the way GetPoSKernelPS used to
+static double WalkPoSKernelPS(CBlockIndex* pindex, int nPoSInterval)
+{
+    double dStakeKernelsTriedAvg = 0;
+    int nStakesHandled = 0, nStakesTime = 0;
+    CBlockIndex* pindexPrevStake = NULL;
+
+    while (pindex && nStakesHandled < nPoSInterval)
+    {
+        if (pindex->IsProofOfStake())
+        {
+            dStakeKernelsTriedAvg += GetDifficultyFromBits(pindex->nBits) * 4294967296.0;
+            nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0;
+            pindexPrevStake = pindex;
+            nStakesHandled++;
+        }
+        pindex = pindex->pprev;
+    }
+
+    return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
+}
+
+static void BuildChain(vector<CBlockIndex*>& vChain, CBlockIndex* pindexFork, int nBlocks, unsigned int nSeed)
+{
+    CBlockIndex* pprev = pindexFork;
+    for (int i = 0; i < nBlocks; i++)
+    {
+        CBlockIndex* pindex = new CBlockIndex();
+        pindex->pprev = pprev;
+        pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+        pindex->nTime = (pprev ? pprev->nTime : 1488585034) + 30 + (nSeed * 7 + i * 13) % 90;
+        pindex->nBits = 0x1d00ffff - ((nSeed + i) % 5) * 0x100;
+        pindex->nMoneySupply = (pprev ? pprev->nMoneySupply : 0) + COIN;
+        if (pindex->nHeight > 0 && (i + nSeed) % 3 != 0)
+            pindex->SetProofOfStake();
+        vChain.push_back(pindex);
+        pprev = pindex;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(chainstats_tests)
+
+BOOST_AUTO_TEST_CASE(chainstats_matches_walk)
+{
+    vector<CBlockIndex*> vMain;
+    BuildChain(vMain, NULL, 300, 1);
+
+    CChainStats stats;
+    BOOST_FOREACH(CBlockIndex* pindex, vMain)
+        BOOST_CHECK(stats.Connect(pindex));
+
+    BOOST_CHECK_EQUAL(stats.Height(), 299);
+    BOOST_CHECK(stats.GetBlockByHeight(150) == vMain[150]);
+    BOOST_CHECK(stats.GetBlockByHeight(300) == NULL);
+
+    int nWindows[] = { 1, 2, 10, 72, 500 };
+    BOOST_FOREACH(int nWindow, nWindows)
+        BOOST_CHECK_CLOSE(stats.GetPoSKernelPS(nWindow), WalkPoSKernelPS(vMain.back(), nWindow), 1e-9);
+
+    BOOST_CHECK_EQUAL(stats.GetMoneySupplyChange(10), 10 * COIN);
+
+    // Connecting a block that does not extend the tip is refused
+    BOOST_CHECK(!stats.Connect(vMain[100]));
+
+    BOOST_FOREACH(CBlockIndex* pindex, vMain)
+        delete pindex;
+}
+
+BOOST_AUTO_TEST_CASE(chainstats_reorg)
+{
+    vector<CBlockIndex*> vMain, vFork;
+    BuildChain(vMain, NULL, 200, 2);
+    BuildChain(vFork, vMain[149], 80, 5);
+
+    CChainStats stats;
+    stats.Rebuild(vMain.back());
+    double dBefore = stats.GetPoSKernelPS();
+
+    // Roll back to the fork point and connect the other branch
+    for (int i = 199; i > 149; i--)
+        BOOST_CHECK(stats.Disconnect(vMain[i]));
+    BOOST_FOREACH(CBlockIndex* pindex, vFork)
+        BOOST_CHECK(stats.Connect(pindex));
+
+    BOOST_CHECK_EQUAL(stats.Height(), vFork.back()->nHeight);
+    BOOST_CHECK_CLOSE(stats.GetPoSKernelPS(), WalkPoSKernelPS(vFork.back(), 72), 1e-9);
+
+    CChainStats rebuilt;
+    rebuilt.Rebuild(vFork.back());
+    BOOST_CHECK_EQUAL(stats.GetPoSKernelPS(), rebuilt.GetPoSKernelPS());
+    BOOST_CHECK_EQUAL(stats.GetAverageSpacing(true, 40), rebuilt.GetAverageSpacing(true, 40));
+    BOOST_CHECK_EQUAL(stats.GetNetworkHashPS(120), rebuilt.GetNetworkHashPS(120));
+
+    // Disconnecting anything but the tip is refused
+    BOOST_CHECK(!stats.Disconnect(vMain[199]));
+
+    // And back again
+    for (int i = vFork.size() - 1; i >= 0; i--)
+        BOOST_CHECK(stats.Disconnect(vFork[i]));
+    for (int i = 150; i < 200; i++)
+        BOOST_CHECK(stats.Connect(vMain[i]));
+    BOOST_CHECK_EQUAL(stats.GetPoSKernelPS(), dBefore);
+
+    BOOST_FOREACH(CBlockIndex* pindex, vMain)
+        delete pindex;
+    BOOST_FOREACH(CBlockIndex* pindex, vFork)
+        delete pindex;
+}
+
+BOOST_AUTO_TEST_CASE(chainstats_precision)
+{
+    // Small windows after a long run of huge difficulties: a difference of
+    // double prefix sums near 1e24 loses these entirely
+    const unsigned int nBitsHigh = 0x1400ffff, nBitsLow = 0x1f00ffff;
+    vector<CBlockIndex*> vChain;
+    CBlockIndex* pprev = NULL;
+    for (int i = 0; i < 1010; i++)
+    {
+        CBlockIndex* pindex = new CBlockIndex();
+        pindex->pprev = pprev;
+        pindex->nHeight = i;
+        pindex->nTime = 1488585034 + 60 * i;
+        pindex->nBits = i < 1000 ? nBitsHigh : nBitsLow;
+        if (i > 0)
+            pindex->SetProofOfStake();
+        vChain.push_back(pindex);
+        pprev = pindex;
+    }
+
+    CChainStats stats;
+    stats.Rebuild(vChain.back());
+    BOOST_CHECK_CLOSE(stats.GetAverageDifficulty(true, 10), GetDifficultyFromBits(nBitsLow), 1e-9);
+    BOOST_CHECK_CLOSE(stats.GetPoSKernelPS(10), WalkPoSKernelPS(vChain.back(), 10), 1e-9);
+
+    double dSum = 0;
+    for (int i = 1; i < 1010; i++)
+        dSum += GetDifficultyFromBits(vChain[i]->nBits);
+    BOOST_CHECK_CLOSE(stats.GetAverageDifficulty(true, 2000), dSum / 1009, 1e-9);
+
+    // Exactly back where it was after popping the low blocks off and on
+    for (int i = 1009; i >= 1000; i--)
+        BOOST_CHECK(stats.Disconnect(vChain[i]));
+    BOOST_CHECK_EQUAL(stats.GetAverageDifficulty(true, 1), GetDifficultyFromBits(nBitsHigh));
+    for (int i = 1000; i < 1010; i++)
+        BOOST_CHECK(stats.Connect(vChain[i]));
+    BOOST_CHECK_CLOSE(stats.GetAverageDifficulty(true, 10), GetDifficultyFromBits(nBitsLow), 1e-9);
+
+    BOOST_FOREACH(CBlockIndex* pindex, vChain)
+        delete pindex;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,111 @@
+#include <boost/test/unit_test.hpp>
+
+#include <openssl/rand.h>
+
+#include "script.h"
+#include "keystore.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(crypter_tests)
+
+static CKeyingMaterial RandomMasterKey()
+{
+    CKeyingMaterial vMasterKey(WALLET_CRYPTO_KEY_SIZE);
+    RAND_bytes(&vMasterKey[0], WALLET_CRYPTO_KEY_SIZE);
+    return vMasterKey;
+}
+
+BOOST_AUTO_TEST_CASE(crypter_reuse)
+{
+    CKeyingMaterial vMasterKey = RandomMasterKey();
+    CCrypter crypter;
+    BOOST_CHECK(crypter.SetKey(vMasterKey, vector<unsigned char>(WALLET_CRYPTO_KEY_SIZE)));
+
+    // One crypter, the IV changed for each secret, agrees with a fresh one each time
+    for (int i = 0; i < 20; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        bool fCompressed;
+        CSecret vchSecret = key.GetSecret(fCompressed);
+        uint256 nIV = key.GetPubKey().GetHash();
+
+        vector<unsigned char> vchCrypted, vchCrypted2;
+        BOOST_CHECK(EncryptSecret(vMasterKey, vchSecret, nIV, vchCrypted));
+        BOOST_CHECK(crypter.SetIV(nIV));
+        BOOST_CHECK(crypter.Encrypt(CKeyingMaterial(vchSecret.begin(), vchSecret.end()), vchCrypted2));
+        BOOST_CHECK(vchCrypted == vchCrypted2);
+
+        CKeyingMaterial vchPlain;
+        BOOST_CHECK(crypter.Decrypt(vchCrypted, vchPlain));
+        BOOST_CHECK(CSecret(vchPlain.begin(), vchPlain.end()) == vchSecret);
+    }
+
+    // A failed decryption does not spoil the next
+    CKeyingMaterial vchPlain;
+    BOOST_CHECK(!crypter.Decrypt(vector<unsigned char>(5, 1), vchPlain));
+    vector<unsigned char> vchCrypted;
+    BOOST_CHECK(crypter.Encrypt(CKeyingMaterial(32, 7), vchCrypted));
+    BOOST_CHECK(crypter.Decrypt(vchCrypted, vchPlain));
+    BOOST_CHECK(vchPlain == CKeyingMaterial(32, 7));
+}
+
+class CTestCryptoKeyStore : public CCryptoKeyStore
+{
+public:
+    bool EncryptKeys(CKeyingMaterial& vMasterKeyIn) { return CCryptoKeyStore::EncryptKeys(vMasterKeyIn); }
+    bool Unlock(const CKeyingMaterial& vMasterKeyIn) { return CCryptoKeyStore::Unlock(vMasterKeyIn); }
+};
+
+BOOST_AUTO_TEST_CASE(crypter_keystore_unlock)
+{
+    CTestCryptoKeyStore keystore;
+    vector<CKey> vKeys(50);
+    for (unsigned int i = 0; i < vKeys.size(); i++)
+    {
+        vKeys[i].MakeNewKey(i % 2 == 0);
+        BOOST_CHECK(keystore.AddKey(vKeys[i]));
+    }
+
+    CKeyingMaterial vMasterKey = RandomMasterKey();
+    BOOST_CHECK(keystore.EncryptKeys(vMasterKey));
+    BOOST_CHECK(keystore.IsCrypted());
+    BOOST_CHECK(keystore.IsLocked());
+
+    CKey keyOut;
+    BOOST_CHECK(!keystore.GetKey(vKeys[0].GetPubKey().GetID(), keyOut));
+    BOOST_CHECK(!keystore.Unlock(RandomMasterKey()));
+    BOOST_CHECK(keystore.IsLocked());
+
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    BOOST_CHECK(!keystore.IsLocked());
+
+    // Decrypted on first use, from the cache after; the same either way
+    for (int nPass = 0; nPass < 2; nPass++)
+    {
+        BOOST_FOREACH(CKey& key, vKeys)
+        {
+            CKeyID keyID = key.GetPubKey().GetID();
+            BOOST_CHECK(keystore.GetKey(keyID, keyOut));
+            BOOST_CHECK(keyOut.GetPubKey() == key.GetPubKey());
+            BOOST_CHECK(keyOut.IsCompressed() == key.IsCompressed());
+            bool fCompressed, fCompressedOut;
+            BOOST_CHECK(keyOut.GetSecret(fCompressedOut) == key.GetSecret(fCompressed));
+
+            uint256 hash = GetRandHash();
+            vector<unsigned char> vchSig;
+            BOOST_CHECK(keyOut.Sign(hash, vchSig));
+            BOOST_CHECK(key.Verify(hash, vchSig));
+        }
+    }
+
+    BOOST_CHECK(keystore.LockKeyStore());
+    BOOST_CHECK(keystore.IsLocked());
+    BOOST_CHECK(!keystore.GetKey(vKeys[0].GetPubKey().GetID(), keyOut));
+    BOOST_CHECK(keystore.Unlock(vMasterKey));
+    BOOST_CHECK(keystore.GetKey(vKeys[0].GetPubKey().GetID(), keyOut));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,119 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "db.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(dbjournal_tests)
+
+static CDBJournal::CRecord MakeRecord(const string& strKey, const string& strValue, bool fErase = false)
+{
+    CDBJournal::CRecord record;
+    record.fErase = fErase;
+    record.vchKey.assign(strKey.begin(), strKey.end());
+    if (!fErase)
+        record.vchValue.assign(strValue.begin(), strValue.end());
+    return record;
+}
+
+static CDBJournal::LookupResult Lookup(CDBJournal& journal, const string& strKey, string& strValue)
+{
+    CDBJournal::data_type vchKey(strKey.begin(), strKey.end()), vchValue;
+    CDBJournal::LookupResult result = journal.Lookup(vchKey, vchValue);
+    strValue.assign(vchValue.begin(), vchValue.end());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(dbjournal_replay)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_bitcoin_%%%%%%%%.journal");
+    string strValue;
+    {
+        CDBJournal journal;
+        BOOST_CHECK(journal.Open(path));
+        BOOST_CHECK_EQUAL(journal.GetSize(), 0U);
+        BOOST_CHECK(Lookup(journal, "a", strValue) == CDBJournal::NOT_FOUND);
+
+        vector<CDBJournal::CRecord> vRecords;
+        vRecords.push_back(MakeRecord("a", "1"));
+        vRecords.push_back(MakeRecord("b", "2"));
+        BOOST_CHECK(journal.Append(vRecords));
+        BOOST_CHECK(journal.Append(vector<CDBJournal::CRecord>(1, MakeRecord("a", "3"))));
+        BOOST_CHECK(journal.Append(vector<CDBJournal::CRecord>(1, MakeRecord("b", "", true))));
+        BOOST_CHECK(journal.Commit());
+
+        // The latest record for a key wins
+        BOOST_CHECK(Lookup(journal, "a", strValue) == CDBJournal::FOUND);
+        BOOST_CHECK_EQUAL(strValue, "3");
+        BOOST_CHECK(Lookup(journal, "b", strValue) == CDBJournal::ERASED);
+        BOOST_CHECK(journal.GetSize() > 0);
+
+        // Nothing is dropped before it is merged
+        BOOST_CHECK(!journal.Truncate());
+    }
+
+    // A restart finds what was committed
+    uint64 nSize = boost::filesystem::file_size(path);
+    {
+        CDBJournal journal;
+        BOOST_CHECK(journal.Open(path));
+        BOOST_CHECK_EQUAL(journal.GetSize(), nSize);
+        BOOST_CHECK(Lookup(journal, "a", strValue) == CDBJournal::FOUND);
+        BOOST_CHECK_EQUAL(strValue, "3");
+        BOOST_CHECK(Lookup(journal, "b", strValue) == CDBJournal::ERASED);
+
+        vector<CDBJournal::CRecord> vRecords;
+        vRecords.push_back(MakeRecord("c", "4"));
+        vRecords.push_back(MakeRecord("a", "5"));
+        BOOST_CHECK(journal.Append(vRecords));
+        BOOST_CHECK(journal.Commit());
+    }
+
+    // A batch torn by a crash is dropped whole
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 3);
+    {
+        CDBJournal journal;
+        BOOST_CHECK(journal.Open(path));
+        BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+        BOOST_CHECK(Lookup(journal, "a", strValue) == CDBJournal::FOUND);
+        BOOST_CHECK_EQUAL(strValue, "3");
+        BOOST_CHECK(Lookup(journal, "c", strValue) == CDBJournal::NOT_FOUND);
+
+        // and appends follow the last complete batch
+        BOOST_CHECK(journal.Append(vector<CDBJournal::CRecord>(1, MakeRecord("c", "6"))));
+        BOOST_CHECK(journal.Commit());
+    }
+    {
+        CDBJournal journal;
+        BOOST_CHECK(journal.Open(path));
+        BOOST_CHECK(Lookup(journal, "c", strValue) == CDBJournal::FOUND);
+        BOOST_CHECK_EQUAL(strValue, "6");
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(dbjournal_append_flushed)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_bitcoin_%%%%%%%%.journal");
+    string strValue;
+    CDBJournal journal;
+    BOOST_CHECK(journal.Open(path));
+
+    // Each batch is in the file as soon as it is appended, before any Commit
+    BOOST_CHECK(journal.Append(vector<CDBJournal::CRecord>(1, MakeRecord("a", "1"))));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), journal.GetSize());
+    {
+        CDBJournal journalReader;
+        BOOST_CHECK(journalReader.Open(path));
+        BOOST_CHECK(Lookup(journalReader, "a", strValue) == CDBJournal::FOUND);
+        BOOST_CHECK_EQUAL(strValue, "1");
+    }
+
+    journal.Close();
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
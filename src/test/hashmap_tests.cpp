@@ -0,0 +1,113 @@
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+#include "hashmap.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(hashmap_tests)
+
+BOOST_AUTO_TEST_CASE(hashmap_matches_map)
+{
+    // Random operations on a small key space so that finds, overwrites
+    // and erases of present and absent keys all happen often
+    vector<uint256> vKeys;
+    for (int i = 0; i < 300; i++)
+        vKeys.push_back(GetRandHash());
+
+    CHashMap<uint256, int> hashmap;
+    map<uint256, int> stdmap;
+    for (int i = 0; i < 20000; i++)
+    {
+        const uint256& key = vKeys[GetRand(vKeys.size())];
+        switch (GetRand(5))
+        {
+        case 0:
+            BOOST_CHECK(hashmap.insert(make_pair(key, i)).second == stdmap.insert(make_pair(key, i)).second);
+            break;
+        case 1:
+            hashmap[key] = i;
+            stdmap[key] = i;
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(hashmap.erase(key), stdmap.erase(key));
+            break;
+        default:
+            BOOST_CHECK_EQUAL(hashmap.count(key), stdmap.count(key));
+            if (stdmap.count(key))
+                BOOST_CHECK_EQUAL(hashmap.find(key)->second, stdmap[key]);
+            else
+                BOOST_CHECK(hashmap.find(key) == hashmap.end());
+        }
+        BOOST_CHECK_EQUAL(hashmap.size(), stdmap.size());
+    }
+
+    // Iteration visits every entry once
+    map<uint256, int> mapSeen;
+    for (CHashMap<uint256, int>::const_iterator it = hashmap.begin(); it != hashmap.end(); ++it)
+        BOOST_CHECK(mapSeen.insert(*it).second);
+    BOOST_CHECK(mapSeen == stdmap);
+
+    CHashMap<uint256, int> copy(hashmap);
+    hashmap.clear();
+    BOOST_CHECK(hashmap.empty());
+    BOOST_CHECK(hashmap.begin() == hashmap.end());
+    BOOST_CHECK_EQUAL(copy.size(), stdmap.size());
+    hashmap.swap(copy);
+    BOOST_CHECK_EQUAL(hashmap.size(), stdmap.size());
+    BOOST_CHECK(copy.empty());
+}
+
+BOOST_AUTO_TEST_CASE(hashmap_stability)
+{
+    // Entries do not move when the table grows, which mapNextTx
+    // (pointing into mapTx) and CBlockIndex::phashBlock rely on
+    CHashMap<uint256, int> hashmap;
+    uint256 hashFirst = GetRandHash();
+    const uint256* pkey = &hashmap.insert(make_pair(hashFirst, 1)).first->first;
+    int* pvalue = &hashmap[hashFirst];
+    for (int i = 0; i < 5000; i++)
+        hashmap[GetRandHash()] = i;
+    BOOST_CHECK(pkey == &hashmap.find(hashFirst)->first);
+    BOOST_CHECK(pvalue == &hashmap[hashFirst]);
+
+    // Erasing while iterating
+    int nErased = 0;
+    for (CHashMap<uint256, int>::iterator it = hashmap.begin(); it != hashmap.end(); )
+    {
+        if (it->second % 3 == 0)
+        {
+            hashmap.erase(it++);
+            nErased++;
+        }
+        else
+            ++it;
+    }
+    BOOST_CHECK_EQUAL(hashmap.size(), 5001U - nErased);
+    for (CHashMap<uint256, int>::iterator it = hashmap.begin(); it != hashmap.end(); ++it)
+        BOOST_CHECK(it->second % 3 != 0);
+}
+
+BOOST_AUTO_TEST_CASE(hashmap_composite_keys)
+{
+    uint256 hash = GetRandHash();
+    CHashMap<COutPoint, int> mapOutPoints;
+    for (unsigned int n = 0; n < 100; n++)
+        mapOutPoints[COutPoint(hash, n)] = n;
+    BOOST_CHECK_EQUAL(mapOutPoints.size(), 100U);
+    for (unsigned int n = 0; n < 100; n++)
+        BOOST_CHECK_EQUAL(mapOutPoints[COutPoint(hash, n)], (int)n);
+    BOOST_CHECK(!mapOutPoints.count(COutPoint(hash, 100)));
+
+    CHashMap<CInv, int> mapInv;
+    mapInv[CInv(MSG_TX, hash)] = 1;
+    mapInv[CInv(MSG_BLOCK, hash)] = 2;
+    BOOST_CHECK_EQUAL(mapInv.size(), 2U);
+    BOOST_CHECK_EQUAL(mapInv[CInv(MSG_TX, hash)], 1);
+    BOOST_CHECK_EQUAL(mapInv[CInv(MSG_BLOCK, hash)], 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
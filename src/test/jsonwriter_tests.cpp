@@ -0,0 +1,121 @@
+#include <boost/test/unit_test.hpp>
+
+#include "json/json_spirit_writer_template.h"
+#include "json/json_spirit_value.h"
+
+#include "jsonwriter.h"
+#include "util.h"
+
+using namespace std;
+using namespace json_spirit;
+
+static string Written(const Value& value)
+{
+    return write_string(value, false);
+}
+
+BOOST_AUTO_TEST_SUITE(jsonwriter_tests)
+
+BOOST_AUTO_TEST_CASE(jsonwriter_strings)
+{
+    const char* vStrings[] = { "", "plain", "quote\" back\\slash", "\b\f\n\r\t", "\x01\x1f\x7f", "caf\xc3\xa9", "\xff\x80" };
+    for (unsigned int i = 0; i < sizeof(vStrings) / sizeof(vStrings[0]); i++)
+    {
+        string str;
+        CJSONWriter out(str);
+        out.String(vStrings[i]);
+        BOOST_CHECK_EQUAL(str, Written(Value(string(vStrings[i]))));
+    }
+
+    // Embedded NULs survive through the std::string overload
+    string strNul("a\0b", 3);
+    string str;
+    CJSONWriter out(str);
+    out.String(strNul);
+    BOOST_CHECK_EQUAL(str, Written(Value(strNul)));
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_numbers)
+{
+    int64 vInts[] = { 0, 1, -1, 2147483647LL, -2147483647LL - 1, 9223372036854775807LL, -9223372036854775807LL - 1 };
+    for (unsigned int i = 0; i < sizeof(vInts) / sizeof(vInts[0]); i++)
+    {
+        string str;
+        CJSONWriter out(str);
+        out.Int(vInts[i]);
+        BOOST_CHECK_EQUAL(str, Written(Value((boost::int64_t)vInts[i])));
+    }
+
+    string strU;
+    CJSONWriter outU(strU);
+    outU.UInt(18446744073709551615ULL);
+    BOOST_CHECK_EQUAL(strU, Written(Value((boost::uint64_t)18446744073709551615ULL)));
+
+    double vReals[] = { 0.0, 1.0, -1.5, 0.00000001, 123456789.12345678, 1e20, -1e-9, 3.0e15 };
+    for (unsigned int i = 0; i < sizeof(vReals) / sizeof(vReals[0]); i++)
+    {
+        string str;
+        CJSONWriter out(str);
+        out.Real(vReals[i]);
+        BOOST_CHECK_EQUAL(str, Written(Value(vReals[i])));
+    }
+
+    int64 vAmounts[] = { 0, 1, COIN, -COIN, 123456789, 2000000000LL * COIN, 9223372036854775807LL, 2099999997690000LL };
+    for (unsigned int i = 0; i < sizeof(vAmounts) / sizeof(vAmounts[0]); i++)
+    {
+        string str;
+        CJSONWriter out(str);
+        out.Amount(vAmounts[i]);
+        BOOST_CHECK_EQUAL(str, Written(Value((double)vAmounts[i] / (double)COIN)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(jsonwriter_structure)
+{
+    uint256 hash;
+    hash.SetHex("000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f");
+    vector<unsigned char> vch = ParseHex("00ff10ab");
+
+    Object obj;
+    obj.push_back(Pair("hash", hash.GetHex()));
+    obj.push_back(Pair("hex", HexStr(vch.begin(), vch.end())));
+    obj.push_back(Pair("empty", HexStr(vch.begin(), vch.begin())));
+    obj.push_back(Pair("n", 42));
+    obj.push_back(Pair("flag", false));
+    obj.push_back(Pair("none", Value::null));
+    obj.push_back(Pair("amount", (double)150000000 / (double)COIN));
+    Array arr;
+    arr.push_back(Object());
+    arr.push_back(Array());
+    Object inner;
+    inner.push_back(Pair("n", 1));
+    inner.push_back(Pair("n", 2));
+    arr.push_back(inner);
+    arr.push_back("x");
+    obj.push_back(Pair("arr", arr));
+    obj.push_back(Pair("raw", 7));
+
+    string str;
+    CJSONWriter out(str);
+    out.BeginObject();
+    out.Key("hash"); out.Hash(hash);
+    out.Key("hex"); out.Hex(vch.begin(), vch.end());
+    out.Key("empty"); out.Hex(vch.begin(), vch.begin());
+    out.Pair("n", 42);
+    out.Pair("flag", false);
+    out.Key("none"); out.Null();
+    out.Key("amount"); out.Amount(150000000);
+    out.Key("arr");
+    out.BeginArray();
+    out.BeginObject(); out.EndObject();
+    out.BeginArray(); out.EndArray();
+    out.BeginObject(); out.Pair("n", 1); out.Pair("n", 2); out.EndObject();
+    out.String("x");
+    out.EndArray();
+    out.Key("raw"); out.Raw(Written(Value(7)));
+    out.EndObject();
+
+    BOOST_CHECK_EQUAL(str, Written(Value(obj)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "key.h"
+#include "keystore.h"
 #include "base58.h"
 #include "uint256.h"
 #include "util.h"
@@ -144,4 +145,34 @@ BOOST_AUTO_TEST_CASE(key_test1)
     }
 }
 
+BOOST_AUTO_TEST_CASE(key_skipcheck)
+{
+    CKey key1, key2;
+    key1.MakeNewKey(false);
+    key2.MakeNewKey(false);
+
+    // key1's secret with key2's public key, which ends the DER encoding
+    CPrivKey privkey = key1.GetPrivKey();
+    CPubKey pubkey2 = key2.GetPubKey();
+    std::vector<unsigned char> vchPubKey2 = pubkey2.Raw();
+    BOOST_CHECK(privkey.size() > vchPubKey2.size());
+    std::copy(vchPubKey2.begin(), vchPubKey2.end(), privkey.end() - vchPubKey2.size());
+
+    CKey keyBad;
+    BOOST_CHECK(!keyBad.SetPrivKey(privkey));
+    BOOST_CHECK(keyBad.SetPrivKey(privkey, true));
+    BOOST_CHECK(keyBad.GetPubKey() == pubkey2);
+    BOOST_CHECK(!keyBad.IsValid());
+
+    // Loaded unchecked, the key store refuses it at first use
+    CBasicKeyStore keystore;
+    BOOST_CHECK(keystore.AddKey(key1));
+    BOOST_CHECK(keystore.AddKey(keyBad));
+    CKey keyOut;
+    BOOST_CHECK(keystore.GetKey(key1.GetPubKey().GetID(), keyOut));
+    BOOST_CHECK(keyOut.GetPubKey() == key1.GetPubKey());
+    BOOST_CHECK(keystore.HaveKey(pubkey2.GetID()));
+    BOOST_CHECK(!keystore.GetKey(pubkey2.GetID(), keyOut));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
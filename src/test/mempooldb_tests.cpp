@@ -0,0 +1,135 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+#include "mempooldb.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(mempooldb_tests)
+
+static CTransaction MakeTx(const uint256& hashPrev, int64 nValue)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = hashPrev;
+    tx.vin[0].prevout.n = 0;
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey << OP_TRUE;
+    return tx;
+}
+
+// A file laid out like mempool.dat, with no transactions
+static void WriteEmpty(const boost::filesystem::path& path, const unsigned char* pchMagic, int nVersion)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.write((const char*)pchMagic, 4);
+    ss << nVersion;
+    WriteCompactSize(ss, 0);
+    uint256 hash = Hash(ss.begin(), ss.end());
+    ss << hash;
+    FILE* file = fopen(path.string().c_str(), "wb");
+    fwrite(&ss[0], 1, ss.size(), file);
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(mempooldb_roundtrip)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_bitcoin_%%%%%%%%.mempool");
+
+    // A chain of pool transactions, children added before their parents
+    vector<CTransaction> vtx;
+    uint256 hashPrev = GetRandHash();
+    for (int i = 0; i < 5; i++)
+    {
+        vtx.push_back(MakeTx(hashPrev, (i + 1) * CENT));
+        hashPrev = vtx.back().GetHash();
+    }
+    for (int i = 4; i >= 0; i--)
+    {
+        mempool.addUnchecked(vtx[i].GetHash(), vtx[i]);
+        SetMempoolEntryTime(vtx[i].GetHash(), 1400000000 + i);
+    }
+
+    // Parents come first, with the times the transactions came in
+    vector<CMempoolDumpEntry> vEntries;
+    GetMempoolDumpEntries(vEntries);
+    BOOST_CHECK_EQUAL(vEntries.size(), vtx.size());
+    set<uint256> setBefore;
+    BOOST_FOREACH(const CMempoolDumpEntry& entry, vEntries)
+    {
+        BOOST_FOREACH(const CTxIn& txin, entry.first->vin)
+            BOOST_CHECK(!mempool.exists(txin.prevout.hash) || setBefore.count(txin.prevout.hash));
+        setBefore.insert(entry.first->GetHash());
+    }
+    for (unsigned int i = 0; i < vEntries.size() && i < vtx.size(); i++)
+    {
+        BOOST_CHECK(vEntries[i].first->GetHash() == vtx[i].GetHash());
+        BOOST_CHECK_EQUAL(vEntries[i].second, 1400000000 + (int64)i);
+    }
+    mempool.clear();
+
+    // and read back as written
+    CMempoolDB mdb(path);
+    BOOST_CHECK(mdb.Write(vEntries));
+    vector<CMempoolDumpEntry> vRead;
+    BOOST_CHECK(mdb.Read(vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), vEntries.size());
+    for (unsigned int i = 0; i < vRead.size() && i < vEntries.size(); i++)
+    {
+        BOOST_CHECK(vRead[i].first->GetHash() == vEntries[i].first->GetHash());
+        BOOST_CHECK_EQUAL(vRead[i].second, vEntries[i].second);
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(mempooldb_rejects)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_bitcoin_%%%%%%%%.mempool");
+    CMempoolDB mdb(path);
+    vector<CMempoolDumpEntry> vRead;
+
+    // Missing
+    BOOST_CHECK(!mdb.Read(vRead));
+
+    // A flipped byte fails the checksum
+    vector<CMempoolDumpEntry> vEntries;
+    vEntries.push_back(make_pair(MakeTransactionRef(MakeTx(GetRandHash(), COIN)), 1400000000));
+    BOOST_CHECK(mdb.Write(vEntries));
+    uint64 nSize = boost::filesystem::file_size(path);
+    {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        fseek(file, nSize / 2, SEEK_SET);
+        int c = fgetc(file);
+        fseek(file, nSize / 2, SEEK_SET);
+        fputc(c ^ 0x01, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!mdb.Read(vRead));
+    BOOST_CHECK(vRead.empty());
+
+    // and so does a cut off one, or one too short to hold a checksum
+    BOOST_CHECK(mdb.Write(vEntries));
+    boost::filesystem::resize_file(path, nSize - 1);
+    BOOST_CHECK(!mdb.Read(vRead));
+    boost::filesystem::resize_file(path, 10);
+    BOOST_CHECK(!mdb.Read(vRead));
+
+    // Another network's file or another version is not loaded
+    const unsigned char pchOther[4] = { 0x01, 0x02, 0x03, 0x04 };
+    WriteEmpty(path, pchOther, MEMPOOL_DUMP_VERSION);
+    BOOST_CHECK(!mdb.Read(vRead));
+    WriteEmpty(path, pchMessageStart, MEMPOOL_DUMP_VERSION + 1);
+    BOOST_CHECK(!mdb.Read(vRead));
+    WriteEmpty(path, pchMessageStart, MEMPOOL_DUMP_VERSION);
+    BOOST_CHECK(mdb.Read(vRead));
+    BOOST_CHECK(vRead.empty());
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
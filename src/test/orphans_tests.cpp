@@ -0,0 +1,116 @@
+#include <boost/test/unit_test.hpp>
+
+#include "orphans.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(orphans_tests)
+
+static CNetAddr Peer(int n)
+{
+    struct in_addr ip;
+    ip.s_addr = htonl((30 << 24) | n);
+    return CNetAddr(ip);
+}
+
+static CTransaction MakeOrphanTx(const uint256& hashParent)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashParent, 0);
+    tx.vin[0].scriptSig << GetRandHash();
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1*CENT;
+    return tx;
+}
+
+static CTransactionRef MakeOrphan(const uint256& hashParent)
+{
+    return MakeTransactionRef(MakeOrphanTx(hashParent));
+}
+
+static uint256 AddOrphan(COrphanTxPool& pool, const uint256& hashParent, const CNetAddr& peer, int64 nNow)
+{
+    CTransactionRef ptx = MakeOrphan(hashParent);
+    pool.Add(ptx->GetHash(), ptx, vector<uint256>(1, hashParent), peer, nNow);
+    return ptx->GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(orphans_limits)
+{
+    const int64 nNow = 1400000000;
+    const unsigned int nMemory = GetOrphanMemoryUsage(MakeOrphan(0));
+    COrphanTxPool pool(10 * nMemory, 4 * nMemory, 1000, ORPHAN_TX_EXPIRE_TIME, false);
+
+    // A peer past its quota makes room from its own, oldest first
+    vector<uint256> vFirst;
+    for (int i = 0; i < 6; i++)
+        vFirst.push_back(AddOrphan(pool, GetRandHash(), Peer(1), nNow));
+    COrphanStats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nCount, 4U);
+    BOOST_CHECK_EQUAL(stats.nEvictedPeer, 2U);
+    BOOST_CHECK(!pool.Have(vFirst[0]) && !pool.Have(vFirst[1]));
+    BOOST_CHECK(pool.Have(vFirst[2]) && pool.Have(vFirst[5]));
+
+    // A full pool makes room from the peer holding the most
+    for (int i = 0; i < 3; i++)
+        AddOrphan(pool, GetRandHash(), Peer(2), nNow);
+    for (int i = 0; i < 3; i++)
+        AddOrphan(pool, GetRandHash(), Peer(3), nNow);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nCount, 10U);
+    BOOST_CHECK_EQUAL(stats.nEvictedFull, 0U);
+    uint256 hash = AddOrphan(pool, GetRandHash(), Peer(4), nNow);
+    stats = pool.GetStats();
+    BOOST_CHECK(pool.Have(hash));
+    BOOST_CHECK_EQUAL(stats.nCount, 10U);
+    BOOST_CHECK_EQUAL(stats.nEvictedFull, 1U);
+    BOOST_CHECK(!pool.Have(vFirst[2]));
+    BOOST_CHECK(stats.nMemory <= 10U * nMemory);
+    BOOST_CHECK_EQUAL(stats.nPeakMemory, 10U * nMemory);
+    BOOST_CHECK_EQUAL(stats.nPeers, 4U);
+
+    // Nothing bigger than a peer's quota is taken
+    CTransaction txBig = MakeOrphanTx(GetRandHash());
+    txBig.vin[0].scriptSig = CScript() << vector<unsigned char>(5 * nMemory);
+    CTransactionRef ptxBig = MakeTransactionRef(txBig);
+    BOOST_CHECK(!pool.Add(ptxBig->GetHash(), ptxBig, vector<uint256>(1, ptxBig->vin[0].prevout.hash), Peer(5), nNow));
+    BOOST_CHECK_EQUAL(pool.GetStats().nRejected, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(orphans_children_expiry)
+{
+    const int64 nNow = 1400000000;
+    COrphanTxPool pool(DEFAULT_MAX_ORPHAN_TX_MEMORY, DEFAULT_MAX_ORPHAN_TX_MEMORY_PEER, 1000, ORPHAN_TX_EXPIRE_TIME, false);
+
+    // The orphans waiting for a parent are found from it
+    uint256 hashParent = GetRandHash();
+    set<uint256> setChildren;
+    for (int i = 0; i < 5; i++)
+        setChildren.insert(AddOrphan(pool, hashParent, Peer(i), nNow));
+    uint256 hashOther = AddOrphan(pool, GetRandHash(), Peer(1), nNow + ORPHAN_EXPIRE_INTERVAL);
+    vector<uint256> vChildren;
+    pool.GetChildren(hashParent, vChildren);
+    BOOST_CHECK(set<uint256>(vChildren.begin(), vChildren.end()) == setChildren);
+
+    BOOST_FOREACH(const uint256& hash, vChildren)
+        pool.Resolve(hash);
+    BOOST_CHECK(!pool.HaveChildren(hashParent));
+    BOOST_CHECK_EQUAL(pool.GetStats().nResolved, 5U);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+
+    // Orphans go when they expire, the older first
+    uint256 hashLater = AddOrphan(pool, GetRandHash(), Peer(2), nNow + 2 * ORPHAN_EXPIRE_INTERVAL);
+    BOOST_CHECK_EQUAL(pool.Expire(nNow + ORPHAN_EXPIRE_INTERVAL + ORPHAN_TX_EXPIRE_TIME), 1U);
+    BOOST_CHECK(!pool.Have(hashOther));
+    BOOST_CHECK(pool.Have(hashLater));
+    BOOST_CHECK_EQUAL(pool.GetStats().nExpired, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nPeers, 1U);
+
+    BOOST_CHECK(pool.Erase(hashLater));
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nMemory, 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nPeers, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,15 @@
 #include "base58.h"
 #include "util.h"
 #include "bitcoinrpc.h"
+#include "jsonwriter.h"
+#include "main.h"
 
 using namespace std;
 using namespace json_spirit;
 
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, Object& entry);
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, CJSONWriter& out);
+
 BOOST_AUTO_TEST_SUITE(rpc_tests)
 
 static Array
@@ -59,4 +64,181 @@ BOOST_AUTO_TEST_CASE(rpc_addmultisig)
     BOOST_CHECK_THROW(addmultisig(createArgs(2, short2.c_str()), false), runtime_error);
 }
 
+// Runs a request body the way the server does, "" for no reply
+static string ExecRequest(const string& strRequest)
+{
+    Value valRequest;
+    BOOST_CHECK(read_string(strRequest, valRequest));
+    Value id;
+    return JSONRPCExecRequest(valRequest, id);
+}
+
+static Object GetMethodStats(const string& strMethod)
+{
+    Value valInfo = tableRPC.execute("getrpcinfo", Array());
+    Value valMethod = find_value(find_value(valInfo.get_obj(), "methods").get_obj(), strMethod);
+    return valMethod.type() == obj_type ? valMethod.get_obj() : Object();
+}
+
+static int64 GetStat(const Object& obj, const string& strName)
+{
+    Value val = find_value(obj, strName);
+    return val.type() == int_type ? val.get_int64() : 0;
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch)
+{
+    Object objInfoBefore = tableRPC.execute("getrpcinfo", Array()).get_obj();
+    int64 nCallsBefore = GetStat(GetMethodStats("getblockcount"), "calls");
+
+    // A 1.0 call, a 2.0 call, a 2.0 notification and an unknown method
+    string strReply = ExecRequest(
+        "[{\"method\":\"getblockcount\",\"params\":[],\"id\":1},"
+        "{\"jsonrpc\":\"2.0\",\"method\":\"getblockcount\",\"id\":2},"
+        "{\"jsonrpc\":\"2.0\",\"method\":\"getblockcount\"},"
+        "{\"method\":\"nosuchmethod\",\"id\":3}]");
+    Value valReply;
+    BOOST_CHECK(read_string(strReply, valReply));
+    BOOST_REQUIRE(valReply.type() == array_type);
+    const Array& arr = valReply.get_array();
+    BOOST_REQUIRE_EQUAL(arr.size(), 3U);
+
+    // 1.0 replies carry both result and error, 2.0 replies only one of them
+    const Object& reply1 = arr[0].get_obj();
+    BOOST_CHECK_EQUAL(find_value(reply1, "id").get_int(), 1);
+    BOOST_CHECK_EQUAL(find_value(reply1, "result").get_int(), nBestHeight);
+    BOOST_CHECK(find_value(reply1, "error").type() == null_type);
+    BOOST_CHECK(find_value(reply1, "jsonrpc").type() == null_type);
+
+    const Object& reply2 = arr[1].get_obj();
+    BOOST_CHECK_EQUAL(find_value(reply2, "id").get_int(), 2);
+    BOOST_CHECK_EQUAL(find_value(reply2, "jsonrpc").get_str(), "2.0");
+    BOOST_CHECK_EQUAL(find_value(reply2, "result").get_int(), nBestHeight);
+    BOOST_CHECK_EQUAL(reply2.size(), 3U);
+
+    const Object& reply3 = arr[2].get_obj();
+    BOOST_CHECK_EQUAL(find_value(reply3, "id").get_int(), 3);
+    BOOST_CHECK_EQUAL(find_value(find_value(reply3, "error").get_obj(), "code").get_int(), (int)RPC_METHOD_NOT_FOUND);
+
+    // The notification ran even though it got no reply
+    BOOST_CHECK_EQUAL(GetStat(GetMethodStats("getblockcount"), "calls"), nCallsBefore + 3);
+    Object objInfo = tableRPC.execute("getrpcinfo", Array()).get_obj();
+    BOOST_CHECK_EQUAL(GetStat(objInfo, "requests"), GetStat(objInfoBefore, "requests") + 1);
+    BOOST_CHECK_EQUAL(GetStat(objInfo, "batches"), GetStat(objInfoBefore, "batches") + 1);
+    BOOST_CHECK_EQUAL(GetStat(objInfo, "batchcalls"), GetStat(objInfoBefore, "batchcalls") + 4);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_notifications)
+{
+    // Notifications only, alone or batched, get no reply at all
+    BOOST_CHECK_EQUAL(ExecRequest("{\"jsonrpc\":\"2.0\",\"method\":\"getblockcount\"}"), "");
+    BOOST_CHECK_EQUAL(ExecRequest("[{\"jsonrpc\":\"2.0\",\"method\":\"getblockcount\"},"
+                                  "{\"jsonrpc\":\"2.0\",\"method\":\"getblockcount\",\"params\":[]}]"), "");
+
+    // An explicit null id is a call, and a 1.0 request without an id too
+    Value valReply;
+    BOOST_CHECK(read_string(ExecRequest("{\"jsonrpc\":\"2.0\",\"method\":\"getblockcount\",\"id\":null}"), valReply));
+    BOOST_CHECK(find_value(valReply.get_obj(), "id").type() == null_type);
+    BOOST_CHECK_EQUAL(find_value(valReply.get_obj(), "result").get_int(), nBestHeight);
+    BOOST_CHECK(read_string(ExecRequest("{\"method\":\"getblockcount\"}"), valReply));
+    BOOST_CHECK_EQUAL(find_value(valReply.get_obj(), "result").get_int(), nBestHeight);
+
+    // An empty batch and a bad top level are errors
+    BOOST_CHECK_THROW(ExecRequest("[]"), Object);
+    BOOST_CHECK_THROW(ExecRequest("42"), Object);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_workqueue)
+{
+    int n[6];
+    AcceptedConnection* pconn[6];
+    for (int i = 0; i < 6; i++)
+        pconn[i] = reinterpret_cast<AcceptedConnection*>(&n[i]);
+
+    CRPCWorkQueue queue;
+    queue.SetMaxDepth(2);
+    BOOST_CHECK(!queue.Waiting());
+
+    // Parked idle connections have their own bound and do not turn new clients away
+    BOOST_CHECK(queue.Park(pconn[0], 100));
+    BOOST_CHECK(queue.Park(pconn[1], 101));
+    BOOST_CHECK(!queue.Park(pconn[2], 102));
+    BOOST_CHECK(queue.Push(pconn[3], 103));
+    BOOST_CHECK(queue.Push(pconn[4], 104));
+    BOOST_CHECK(!queue.Push(pconn[5], 105));
+    BOOST_CHECK(queue.Waiting());
+
+    Object obj;
+    queue.ToJSON(obj);
+    BOOST_CHECK_EQUAL(find_value(obj, "queuedepth").get_int(), 2);
+    BOOST_CHECK_EQUAL(find_value(obj, "parked").get_int(), 2);
+    BOOST_CHECK_EQUAL(find_value(obj, "rejected").get_int64(), 1);
+    BOOST_CHECK_EQUAL(find_value(obj, "parkedclosed").get_int64(), 1);
+
+    // New connections are served before parked ones
+    CRPCQueuedConnection item;
+    BOOST_CHECK(queue.Pop(item));
+    BOOST_CHECK(item.conn == pconn[3]);
+    BOOST_CHECK(queue.Pop(item));
+    BOOST_CHECK(item.conn == pconn[4]);
+    BOOST_CHECK(queue.Pop(item));
+    BOOST_CHECK(item.conn == pconn[0] && item.nIdleSince == 100);
+
+    Object objActive;
+    queue.ToJSON(objActive);
+    BOOST_CHECK_EQUAL(find_value(objActive, "active").get_int(), 3);
+    for (int i = 0; i < 3; i++)
+        queue.Done();
+
+    vector<AcceptedConnection*> vConn;
+    queue.Drain(vConn);
+    BOOST_CHECK_EQUAL(vConn.size(), 1U);
+    BOOST_CHECK(vConn[0] == pconn[1]);
+    BOOST_CHECK(!queue.Waiting());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_stream_matches_tree)
+{
+    // Tree results are parsed back from the streaming writer, and must
+    // serialize to exactly the streamed text
+    string strJSON;
+    CJSONWriter out(strJSON);
+    out.BeginObject();
+    out.Pair("comment", string("tab\t quote\" ctl\x01 high\xc3\xa9"));
+    out.Key("amount");
+    out.Amount(2099999997690000LL);
+    out.Key("fee");
+    out.Amount(-1);
+    out.Pair("difficulty", 123456789.123456789);
+    out.Pair("time", (int64)1400000000);
+    out.Key("nonce");
+    out.UInt(4294967295U);
+    out.EndObject();
+    BOOST_CHECK_EQUAL(write_string(JSONWriterValue(strJSON), false), strJSON);
+
+    CTransaction tx;
+    tx.nTime = 1400000000;
+    tx.vin.resize(2);
+    tx.vin[0].prevout.hash = Hash(strJSON.begin(), strJSON.end());
+    tx.vin[0].prevout.n = 3;
+    tx.vin[0].scriptSig << OP_1 << ParseHex("00ff7f");
+    tx.vin[1].prevout.n = 0;
+    tx.vout.resize(3);
+    tx.vout[0].nValue = 123456789;
+    tx.vout[0].scriptPubKey.SetDestination(CKeyID(uint160(42)));
+    tx.vout[1].nValue = 2099999997690000LL;
+    tx.vout[1].scriptPubKey << OP_RETURN << ParseHex("deadbeef");
+    tx.vout[2].nValue = 0;
+
+    string strStreamed;
+    CJSONWriter outTx(strStreamed);
+    outTx.BeginObject();
+    TxToJSON(tx, 0, outTx);
+    outTx.EndObject();
+
+    Object entry;
+    TxToJSON(tx, 0, entry);
+    BOOST_CHECK_EQUAL(write_string(Value(entry), false), strStreamed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,9 +19,10 @@ using namespace std;
 using namespace json_spirit;
 using namespace boost::algorithm;
 
-extern uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+extern uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 extern bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn,
                          bool fValidatePayToScriptHash, int nHashType);
+extern bool CastToBool(const valtype& vch);
 
 CScript
 ParseScript(string s)
@@ -442,4 +443,112 @@ BOOST_AUTO_TEST_CASE(script_combineSigs)
     BOOST_CHECK(combined == partial3c);
 }
 
+// VerifyScript on the interpreter alone, without its standard templates
+static bool VerifyScriptInterpreted(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo,
+                                    bool fValidatePayToScriptHash)
+{
+    vector<vector<unsigned char> > stack, stackCopy;
+    if (!EvalScript(stack, scriptSig, txTo, 0, 0))
+        return false;
+    stackCopy = stack;
+    if (!EvalScript(stack, scriptPubKey, txTo, 0, 0) || stack.empty() || !CastToBool(stack.back()))
+        return false;
+    if (fValidatePayToScriptHash && scriptPubKey.IsPayToScriptHash())
+    {
+        if (!scriptSig.IsPushOnly())
+            return false;
+        CScript scriptRedeem(stackCopy.back().begin(), stackCopy.back().end());
+        stackCopy.pop_back();
+        return EvalScript(stackCopy, scriptRedeem, txTo, 0, 0) && !stackCopy.empty() && CastToBool(stackCopy.back());
+    }
+    return true;
+}
+
+static CScript PushAll(const vector<valtype>& vPushes)
+{
+    CScript script;
+    BOOST_FOREACH(const valtype& vch, vPushes)
+        script << vch;
+    return script;
+}
+
+BOOST_AUTO_TEST_CASE(script_standard_templates)
+{
+    CBasicKeyStore keystore;
+    vector<CKey> keys(3);
+    for (unsigned int i = 0; i < keys.size(); i++)
+    {
+        keys[i].MakeNewKey(i != 1);
+        keystore.AddKey(keys[i]);
+    }
+
+    vector<CScript> vScriptPubKey;
+    vScriptPubKey.push_back(CScript() << keys[0].GetPubKey() << OP_CHECKSIG);
+    vScriptPubKey.push_back(CScript() << keys[1].GetPubKey() << OP_CHECKSIG);
+    CScript scriptPubKeyHash;
+    scriptPubKeyHash.SetDestination(keys[0].GetPubKey().GetID());
+    vScriptPubKey.push_back(scriptPubKeyHash);
+    CScript scriptMultisig;
+    scriptMultisig.SetMultisig(2, keys);
+    vScriptPubKey.push_back(scriptMultisig);
+    unsigned int nDirect = vScriptPubKey.size();
+    for (unsigned int i = 0; i < nDirect; i++)
+    {
+        keystore.AddCScript(vScriptPubKey[i]);
+        CScript scriptP2SH;
+        scriptP2SH.SetDestination(vScriptPubKey[i].GetID());
+        vScriptPubKey.push_back(scriptP2SH);
+    }
+
+    BOOST_FOREACH(const CScript& scriptPubKey, vScriptPubKey)
+    {
+        CTransaction txFrom;
+        txFrom.vout.push_back(CTxOut(1, scriptPubKey));
+        CTransaction txTo;
+        txTo.vin.push_back(CTxIn(COutPoint(txFrom.GetHash(), 0)));
+        txTo.vout.push_back(CTxOut(1, CScript() << OP_1));
+        BOOST_CHECK(SignSignature(keystore, txFrom, txTo, 0));
+
+        // The signed scriptSig, then ways of spoiling it
+        vector<valtype> vPushes;
+        CScript::const_iterator pc = txTo.vin[0].scriptSig.begin();
+        opcodetype opcode;
+        valtype vch;
+        while (txTo.vin[0].scriptSig.GetOp(pc, opcode, vch))
+            vPushes.push_back(vch);
+
+        vector<CScript> vScriptSig;
+        vScriptSig.push_back(txTo.vin[0].scriptSig);
+        vScriptSig.push_back(CScript());
+        vScriptSig.push_back(PushAll(vector<valtype>(vPushes.begin() + 1, vPushes.end())));
+        vScriptSig.push_back(PushAll(vector<valtype>(vPushes.begin(), vPushes.end() - 1)));
+        vScriptSig.push_back(CScript() + CScript(OP_0) + txTo.vin[0].scriptSig);
+        vScriptSig.push_back(txTo.vin[0].scriptSig + CScript(OP_NOP));
+        vScriptSig.push_back(CScript() << keys[0].GetPubKey() << keys[0].GetPubKey());
+        for (unsigned int i = 0; i < vPushes.size(); i++)
+        {
+            vector<valtype> vSpoilt = vPushes;
+            if (vSpoilt[i].empty())
+                continue;
+            vSpoilt[i][GetRandInt(vSpoilt[i].size())] ^= 1 << GetRandInt(8);
+            vScriptSig.push_back(PushAll(vSpoilt));
+            vSpoilt = vPushes;
+            vSpoilt[i].back() = SIGHASH_NONE;
+            vScriptSig.push_back(PushAll(vSpoilt));
+            if (i > 0)
+            {
+                swap(vSpoilt[i], vSpoilt[i - 1]);
+                vScriptSig.push_back(PushAll(vSpoilt));
+            }
+        }
+
+        BOOST_CHECK(VerifyScript(vScriptSig[0], scriptPubKey, txTo, 0, true, 0));
+        BOOST_FOREACH(const CScript& scriptSig, vScriptSig)
+        {
+            BOOST_CHECK_EQUAL(VerifyScript(scriptSig, scriptPubKey, txTo, 0, true, 0), VerifyScriptInterpreted(scriptSig, scriptPubKey, txTo, true));
+            BOOST_CHECK_EQUAL(VerifyScript(scriptSig, scriptPubKey, txTo, 0, false, 0), VerifyScriptInterpreted(scriptSig, scriptPubKey, txTo, false));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
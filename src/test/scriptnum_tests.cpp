@@ -0,0 +1,65 @@
+#include <boost/test/unit_test.hpp>
+#include <limits>
+
+#include "bignum.h"
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(scriptnum_tests)
+
+// As EvalScript read numbers before CScriptNum
+static CBigNum CastToBigNum(const valtype& vch)
+{
+    return CBigNum(CBigNum(vch).getvch());
+}
+
+// Every encoding of up to 4 bytes is some number, if not a minimal one
+static valtype RandomNum()
+{
+    valtype vch(GetRandInt(5));
+    for (unsigned int i = 0; i < vch.size(); i++)
+        vch[i] = GetRandInt(4) ? GetRandInt(256) : (GetRandInt(2) ? 0 : 0x80);
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(scriptnum_bignum)
+{
+    for (int i = 0; i < 50000; i++)
+    {
+        valtype vch1 = RandomNum();
+        valtype vch2 = RandomNum();
+        CBigNum bn1 = CastToBigNum(vch1);
+        CBigNum bn2 = CastToBigNum(vch2);
+        CScriptNum num1(vch1);
+        CScriptNum num2(vch2);
+
+        BOOST_CHECK(num1.getvch() == bn1.getvch());
+        BOOST_CHECK_EQUAL(num1.getint(), bn1.getint());
+        BOOST_CHECK((num1 + num2).getvch() == (bn1 + bn2).getvch());
+        BOOST_CHECK((num1 - num2).getvch() == (bn1 - bn2).getvch());
+        BOOST_CHECK((-num1).getvch() == (-bn1).getvch());
+        BOOST_CHECK((num1 + 1).getvch() == (bn1 + 1).getvch());
+        BOOST_CHECK((num1 - 1).getvch() == (bn1 - 1).getvch());
+        BOOST_CHECK_EQUAL(num1 < num2, bn1 < bn2);
+        BOOST_CHECK_EQUAL(num1 <= num2, bn1 <= bn2);
+        BOOST_CHECK_EQUAL(num1 == num2, bn1 == bn2);
+        BOOST_CHECK_EQUAL(num1 == 0, bn1 == 0);
+
+        // Results past 4 bytes are pushed, and read back no more
+        int64 n = GetRand(numeric_limits<int64>::max()) >> GetRandInt(63);
+        if (GetRandInt(2))
+            n = -n;
+        BOOST_CHECK(CScriptNum(n).getvch() == CBigNum(n).getvch());
+    }
+
+    BOOST_CHECK_THROW(CScriptNum(valtype(5)), scriptnum_error);
+    BOOST_CHECK(CScriptNum(valtype(1, 0x80)) == 0);
+    BOOST_CHECK(CScriptNum(0x7fffffff).getvch() == CBigNum(0x7fffffff).getvch());
+    BOOST_CHECK(CScriptNum(-0x7fffffff).getvch() == CBigNum(-0x7fffffff).getvch());
+    BOOST_CHECK_EQUAL(CScriptNum(0xffffffffLL).getint(), numeric_limits<int>::max());
+    BOOST_CHECK_EQUAL(CScriptNum(-0xffffffffLL).getint(), numeric_limits<int>::min());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,213 @@
+#include <boost/test/unit_test.hpp>
+
+#include "bignum.h"
+#include "key.h"
+#include "secp256k1.h"
+#include "util.h"
+
+using namespace std;
+
+// r and s of a strict DER signature, left padded to 32 bytes
+static void SplitSignature(const vector<unsigned char>& vchSig, vector<unsigned char>& vchR, vector<unsigned char>& vchS)
+{
+    unsigned int nRLen = vchSig[3];
+    unsigned int nSLen = vchSig[5 + nRLen];
+    vector<unsigned char> r(vchSig.begin() + 4, vchSig.begin() + 4 + nRLen);
+    vector<unsigned char> s(vchSig.begin() + 6 + nRLen, vchSig.begin() + 6 + nRLen + nSLen);
+    while (!r.empty() && r[0] == 0) r.erase(r.begin());
+    while (!s.empty() && s[0] == 0) s.erase(s.begin());
+    vchR.assign(32 - r.size(), 0);
+    vchR.insert(vchR.end(), r.begin(), r.end());
+    vchS.assign(32 - s.size(), 0);
+    vchS.insert(vchS.end(), s.begin(), s.end());
+}
+
+static bool EngineVerify(const CPubKey& pubkey, const uint256& hash, const vector<unsigned char>& vchSig)
+{
+    return pubkey.Verify(hash, vchSig);
+}
+
+BOOST_AUTO_TEST_SUITE(secp256k1_tests)
+
+BOOST_AUTO_TEST_CASE(secp256k1_selftest)
+{
+    BOOST_CHECK(ECSelfTest());
+    BOOST_CHECK(ECC_InitSanityCheck());
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_matches_openssl)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i & 1);
+        CPubKey pubkey = key.GetPubKey();
+        uint256 hash = GetRandHash();
+        vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+
+        // Parsing and serializing gives back OpenSSL's encoding
+        vector<unsigned char> vchPubKey = pubkey.Raw();
+        CECPoint point;
+        BOOST_CHECK(ECParsePubKey(&vchPubKey[0], vchPubKey.size(), point));
+        vector<unsigned char> vchSerialized;
+        ECSerializePubKey(point, pubkey.IsCompressed(), vchSerialized);
+        BOOST_CHECK(vchSerialized == vchPubKey);
+
+        BOOST_CHECK(EngineVerify(pubkey, hash, vchSig));
+        BOOST_CHECK(key.Verify(hash, vchSig));
+
+        uint256 hashOther = hash ^ uint256(1);
+        BOOST_CHECK(!EngineVerify(pubkey, hashOther, vchSig));
+        vector<unsigned char> vchBad = vchSig;
+        vchBad[vchBad.size() - 1] ^= 0x01;
+        BOOST_CHECK(!EngineVerify(pubkey, hash, vchBad));
+
+        // Compact signatures recover the signing key
+        vector<unsigned char> vchCompact;
+        BOOST_CHECK(key.SignCompact(hash, vchCompact));
+        CKey keyRecovered;
+        BOOST_CHECK(keyRecovered.SetCompactSignature(hash, vchCompact));
+        BOOST_CHECK(keyRecovered.GetPubKey() == pubkey);
+        BOOST_CHECK(key.VerifyCompact(hash, vchCompact));
+        BOOST_CHECK(!key.VerifyCompact(hashOther, vchCompact));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_lax_der)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    for (int i = 0; i < 16; i++)
+    {
+        uint256 hash = GetRandHash();
+        vector<unsigned char> vchSig;
+        key.Sign(hash, vchSig);
+        vector<unsigned char> vchR, vchS;
+        SplitSignature(vchSig, vchR, vchS);
+
+        // Long form lengths, extra zero padding, a wrong sequence length
+        // and trailing garbage were all accepted by OpenSSL's parser
+        vector<unsigned char> vchLax;
+        vchLax.push_back(0x30); vchLax.push_back(0x81); vchLax.push_back(0x00);
+        vchLax.push_back(0x02); vchLax.push_back(0x82); vchLax.push_back(0x00); vchLax.push_back(35);
+        vchLax.push_back(0); vchLax.push_back(0); vchLax.push_back(0);
+        vchLax.insert(vchLax.end(), vchR.begin(), vchR.end());
+        vchLax.push_back(0x02); vchLax.push_back(33); vchLax.push_back(0);
+        vchLax.insert(vchLax.end(), vchS.begin(), vchS.end());
+        vchLax.push_back(0xde); vchLax.push_back(0xad);
+        BOOST_CHECK(EngineVerify(pubkey, hash, vchLax));
+
+        // Without the zero byte a high first byte makes the integer negative
+        vector<unsigned char> vchRaw;
+        vchRaw.push_back(0x30); vchRaw.push_back(68);
+        vchRaw.push_back(0x02); vchRaw.push_back(32);
+        vchRaw.insert(vchRaw.end(), vchR.begin(), vchR.end());
+        vchRaw.push_back(0x02); vchRaw.push_back(32);
+        vchRaw.insert(vchRaw.end(), vchS.begin(), vchS.end());
+        BOOST_CHECK(EngineVerify(pubkey, hash, vchRaw) == !((vchR[0] & 0x80) || (vchS[0] & 0x80)));
+
+        // High S is valid too
+        CBigNum bnOrder;
+        bnOrder.SetHex("FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141");
+        vector<unsigned char> vchSRev(vchS.rbegin(), vchS.rend());
+        CBigNum bnS;
+        bnS.setvch(vchSRev);
+        vector<unsigned char> vchHighS = (bnOrder - bnS).getvch();
+        reverse(vchHighS.begin(), vchHighS.end());
+        vector<unsigned char> vchHigh;
+        vchHigh.push_back(0x30); vchHigh.push_back(0);
+        vchHigh.push_back(0x02); vchHigh.push_back(33); vchHigh.push_back(0);
+        vchHigh.insert(vchHigh.end(), vchR.begin(), vchR.end());
+        vchHigh.push_back(0x02); vchHigh.push_back(vchHighS.size());
+        vchHigh.insert(vchHigh.end(), vchHighS.begin(), vchHighS.end());
+        vchHigh[1] = vchHigh.size() - 2;
+        BOOST_CHECK(EngineVerify(pubkey, hash, vchHigh));
+    }
+
+    // Truncated and empty signatures
+    uint256 hash = GetRandHash();
+    vector<unsigned char> vchSig;
+    key.Sign(hash, vchSig);
+    for (unsigned int n = 1; n < vchSig.size(); n++)
+        BOOST_CHECK(!EngineVerify(pubkey, hash, vector<unsigned char>(vchSig.begin(), vchSig.begin() + n)));
+    BOOST_CHECK(!EngineVerify(pubkey, hash, vector<unsigned char>()));
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_pubkey_encodings)
+{
+    CKey key;
+    key.MakeNewKey(false);
+    vector<unsigned char> vchPubKey = key.GetPubKey().Raw();
+    BOOST_CHECK_EQUAL(vchPubKey.size(), 65U);
+    uint256 hash = GetRandHash();
+    vector<unsigned char> vchSig;
+    key.Sign(hash, vchSig);
+
+    // Hybrid form: 0x06/0x07 with the parity of y
+    vector<unsigned char> vchHybrid = vchPubKey;
+    vchHybrid[0] = 0x06 | (vchPubKey[64] & 1);
+    BOOST_CHECK(CPubKey(vchHybrid).Verify(hash, vchSig));
+    vchHybrid[0] ^= 1;
+    BOOST_CHECK(!CPubKey(vchHybrid).Verify(hash, vchSig));
+
+    // Off the curve, bad prefix, wrong sizes
+    vector<unsigned char> vchBad = vchPubKey;
+    vchBad[64] ^= 1;
+    BOOST_CHECK(!CPubKey(vchBad).Verify(hash, vchSig));
+    vchBad = vchPubKey;
+    vchBad[0] = 0x05;
+    BOOST_CHECK(!CPubKey(vchBad).Verify(hash, vchSig));
+    vchBad = vchPubKey;
+    vchBad.resize(64);
+    BOOST_CHECK(!CPubKey(vchBad).Verify(hash, vchSig));
+
+    // A lone zero byte is the point at infinity
+    unsigned char chZero = 0;
+    CECPoint point;
+    BOOST_CHECK(ECParsePubKey(&chZero, 1, point));
+    BOOST_CHECK(point.fInfinity);
+    unsigned char chOne = 1;
+    BOOST_CHECK(!ECParsePubKey(&chOne, 1, point));
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_batch)
+{
+    CECBatchVerifier batch;
+    vector<CPubKey> vPubKey;
+    vector<vector<unsigned char> > vSig;
+    vector<uint256> vHash;
+    for (int i = 0; i < 40; i++)
+    {
+        CKey key;
+        key.MakeNewKey(i % 3 == 0);
+        uint256 hash = GetRandHash();
+        vector<unsigned char> vchSig;
+        key.Sign(hash, vchSig);
+        vPubKey.push_back(key.GetPubKey());
+        vSig.push_back(vchSig);
+        vHash.push_back(i % 9 == 4 ? hash ^ uint256(1) : hash);
+    }
+    for (unsigned int i = 0; i < vPubKey.size(); i++)
+    {
+        vector<unsigned char> vchPubKey = vPubKey[i].Raw();
+        BOOST_CHECK(batch.Add(&vchPubKey[0], vchPubKey.size(), &vSig[i][0], vSig[i].size(), vHash[i]));
+    }
+    unsigned char chBad = 0x30;
+    vector<unsigned char> vchPubKey = vPubKey[0].Raw();
+    BOOST_CHECK(!batch.Add(&vchPubKey[0], vchPubKey.size(), &chBad, 1, vHash[0]));
+    BOOST_CHECK_EQUAL(batch.size(), vPubKey.size());
+
+    vector<bool> vfValid;
+    BOOST_CHECK(!batch.Verify(vfValid));
+    for (unsigned int i = 0; i < vfValid.size(); i++)
+        BOOST_CHECK(vfValid[i] == (i % 9 != 4));
+
+    batch.resize(4);
+    BOOST_CHECK(batch.Verify(vfValid));
+    BOOST_CHECK_EQUAL(vfValid.size(), 4U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+extern uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+
+BOOST_AUTO_TEST_SUITE(sighash_tests)
+
+// SignatureHash as it was, copying the transaction
+static uint256 SignatureHashOld(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+{
+    if (nIn >= txTo.vin.size())
+        return 1;
+    CTransaction txTmp(txTo);
+
+    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+
+    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+        txTmp.vin[i].scriptSig = CScript();
+    txTmp.vin[nIn].scriptSig = scriptCode;
+
+    if ((nHashType & 0x1f) == SIGHASH_NONE)
+    {
+        txTmp.vout.clear();
+        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            if (i != nIn)
+                txTmp.vin[i].nSequence = 0;
+    }
+    else if ((nHashType & 0x1f) == SIGHASH_SINGLE)
+    {
+        unsigned int nOut = nIn;
+        if (nOut >= txTmp.vout.size())
+            return 1;
+        txTmp.vout.resize(nOut+1);
+        for (unsigned int i = 0; i < nOut; i++)
+            txTmp.vout[i].SetNull();
+        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            if (i != nIn)
+                txTmp.vin[i].nSequence = 0;
+    }
+
+    if (nHashType & SIGHASH_ANYONECANPAY)
+    {
+        txTmp.vin[0] = txTmp.vin[nIn];
+        txTmp.vin.resize(1);
+    }
+
+    CDataStream ss(SER_GETHASH, 0);
+    ss << txTmp << nHashType;
+    return Hash(ss.begin(), ss.end());
+}
+
+static CScript RandomScript()
+{
+    static const opcodetype ops[] = {OP_FALSE, OP_1, OP_2, OP_3, OP_CHECKSIG, OP_IF, OP_VERIF, OP_RETURN, OP_CODESEPARATOR};
+    CScript script;
+    int nOps = GetRandInt(10);
+    for (int i = 0; i < nOps; i++)
+        script << ops[GetRandInt(sizeof(ops)/sizeof(ops[0]))];
+    return script;
+}
+
+static CTransaction RandomTransaction()
+{
+    CTransaction tx;
+    tx.nVersion = GetRandInt(3);
+    tx.nTime = GetRandInt(2000000000);
+    tx.nLockTime = GetRandInt(2) ? GetRandInt(500000000) : 0;
+    int nIns = GetRandInt(4) + 1;
+    int nOuts = GetRandInt(4) + 1;
+    for (int i = 0; i < nIns; i++)
+    {
+        CTxIn txin(COutPoint(GetRandHash(), GetRandInt(4)), RandomScript(), GetRandInt(2) ? GetRandInt(100) : (unsigned int)-1);
+        tx.vin.push_back(txin);
+    }
+    for (int i = 0; i < nOuts; i++)
+        tx.vout.push_back(CTxOut(GetRandInt(100000000), RandomScript()));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(sighash_equivalence)
+{
+    for (int i = 0; i < 500; i++)
+    {
+        CTransaction tx = RandomTransaction();
+        CScript scriptCode = RandomScript();
+        // Any value, not only the defined ones, as all are consensus
+        int nHashType = GetRandInt(4) ? (int)GetRand(0x100000000ULL) : (1 + GetRandInt(3)) | (GetRandInt(2) ? SIGHASH_ANYONECANPAY : 0);
+
+        // Every input, with and without the cache, one past the end too
+        vector<uint256> vHash;
+        for (unsigned int nIn = 0; nIn <= tx.vin.size(); nIn++)
+        {
+            vHash.push_back(SignatureHash(scriptCode, tx, nIn, nHashType));
+            BOOST_CHECK(vHash.back() == SignatureHashOld(scriptCode, tx, nIn, nHashType));
+        }
+        {
+            CSignatureHashCache sighashcache(tx);
+            for (unsigned int nIn = tx.vin.size(); nIn-- > 0; )
+                BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType) == vHash[nIn]);
+
+            // Signatures do not change it, other inputs may be signed meanwhile
+            tx.vin[0].scriptSig = RandomScript();
+            BOOST_CHECK(SignatureHash(scriptCode, tx, 0, nHashType) == vHash[0]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
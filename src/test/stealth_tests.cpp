@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "stealthaddress.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(stealth_tests)
+
+static CStealthAddress MakeStealthAddress()
+{
+    ec_secret scan_secret, spend_secret;
+    BOOST_CHECK(GenerateRandomSecret(scan_secret) == 0);
+    BOOST_CHECK(GenerateRandomSecret(spend_secret) == 0);
+
+    CStealthAddress sxAddr;
+    sxAddr.scan_secret.assign(&scan_secret.e[0], &scan_secret.e[0] + ec_secret_size);
+    sxAddr.spend_secret.assign(&spend_secret.e[0], &spend_secret.e[0] + ec_secret_size);
+    BOOST_CHECK(SecretToPublicKey(scan_secret, sxAddr.scan_pubkey) == 0);
+    BOOST_CHECK(SecretToPublicKey(spend_secret, sxAddr.spend_pubkey) == 0);
+    return sxAddr;
+}
+
+static CKeyID RandomKeyID()
+{
+    uint256 hash = GetRandHash();
+    return CKeyID(Hash160(vector<unsigned char>(hash.begin(), hash.end())));
+}
+
+// A payment as SendStealthMoneyToDestination makes it
+static CTransaction MakeStealthPayment(CStealthAddress sxAddr, ec_point& pkSendTo, ec_secret& sShared)
+{
+    ec_secret ephem_secret;
+    ec_point ephem_pubkey;
+    BOOST_CHECK(GenerateRandomSecret(ephem_secret) == 0);
+    BOOST_CHECK(StealthSecret(ephem_secret, sxAddr.scan_pubkey, sxAddr.spend_pubkey, sShared, pkSendTo) == 0);
+    BOOST_CHECK(SecretToPublicKey(ephem_secret, ephem_pubkey) == 0);
+
+    CTransaction tx;
+    tx.vout.resize(3);
+    tx.vout[0].scriptPubKey.SetDestination(RandomKeyID());
+    tx.vout[1].scriptPubKey.SetDestination(CPubKey(pkSendTo).GetID());
+    tx.vout[2].scriptPubKey = CScript() << OP_RETURN << ephem_pubkey;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(stealth_scanner)
+{
+    set<CStealthAddress> setAddresses;
+    CStealthAddress sxMine = MakeStealthAddress();
+    CStealthAddress sxOther = MakeStealthAddress();
+    setAddresses.insert(sxMine);
+    setAddresses.insert(MakeStealthAddress());
+
+    CStealthScanner scanner;
+    BOOST_CHECK(scanner.SetAddresses(setAddresses));
+
+    ec_point pkMine, pkOther;
+    ec_secret sSharedMine, sSharedOther;
+    CTransaction txPlain;
+    txPlain.vout.resize(1);
+    txPlain.vout[0].scriptPubKey.SetDestination(RandomKeyID());
+    CTransaction txOther = MakeStealthPayment(sxOther, pkOther, sSharedOther);
+    CTransaction txMine = MakeStealthPayment(sxMine, pkMine, sSharedMine);
+
+    vector<const CTransaction*> vtx;
+    vtx.push_back(&txPlain);
+    vtx.push_back(&txOther);
+    vtx.push_back(&txMine);
+    vector<CStealthMatch> vMatches;
+    vector<unsigned int> vScanned;
+    scanner.Scan(vtx, vMatches, &vScanned);
+
+    // Only the payment to our address matches, with what the sender derived
+    BOOST_CHECK_EQUAL(vScanned.size(), 2U);
+    BOOST_CHECK_EQUAL(vMatches.size(), 1U);
+    if (vMatches.size() == 1)
+    {
+        const CStealthMatch& match = vMatches[0];
+        BOOST_CHECK_EQUAL(match.nTx, 2U);
+        BOOST_CHECK_EQUAL(match.nOut, 1U);
+        BOOST_CHECK_EQUAL(match.nEphemOut, 2U);
+        BOOST_CHECK(match.pkExtracted == pkMine);
+        BOOST_CHECK(memcmp(&match.sShared.e[0], &sSharedMine.e[0], ec_secret_size) == 0);
+        BOOST_CHECK(match.address.scan_pubkey == sxMine.scan_pubkey);
+
+        // The spend key derived from the shared secret owns the output
+        ec_secret sSpend, sSpendR, sShared = match.sShared;
+        memcpy(&sSpend.e[0], &sxMine.spend_secret[0], ec_secret_size);
+        BOOST_CHECK(StealthSharedToSecretSpend(sShared, sSpend, sSpendR) == 0);
+        ec_point pkSpendR;
+        BOOST_CHECK(SecretToPublicKey(sSpendR, pkSpendR) == 0);
+        BOOST_CHECK(pkSpendR == pkMine);
+    }
+
+    // Same result one transaction at a time, and once the address is added
+    scanner.Scan(vector<const CTransaction*>(1, &txMine), vMatches);
+    BOOST_CHECK_EQUAL(vMatches.size(), 1U);
+    setAddresses.insert(sxOther);
+    BOOST_CHECK(scanner.SetAddresses(setAddresses));
+    scanner.Scan(vtx, vMatches);
+    BOOST_CHECK_EQUAL(vMatches.size(), 2U);
+
+    // Nothing to scan for without scan secrets
+    set<CStealthAddress> setPublic;
+    CStealthAddress sxPublic = sxMine;
+    sxPublic.scan_secret.clear();
+    setPublic.insert(sxPublic);
+    BOOST_CHECK(!scanner.SetAddresses(setPublic));
+    scanner.Scan(vtx, vMatches);
+    BOOST_CHECK(vMatches.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
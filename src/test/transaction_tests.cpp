@@ -261,4 +261,43 @@ BOOST_AUTO_TEST_CASE(test_GetThrow)
     BOOST_CHECK_THROW(t1.GetValueIn(missingInputs), runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(test_TransactionRef)
+{
+    CTransaction t1;
+    t1.vin.resize(1);
+    t1.vin[0].prevout.hash = GetRandHash();
+    t1.vin[0].prevout.n = 0;
+    t1.vin[0].scriptSig << OP_1;
+    t1.vout.resize(1);
+    t1.vout[0].nValue = 90*CENT;
+    t1.vout[0].scriptPubKey << OP_1;
+    uint256 hash = t1.GetHash();
+    unsigned int nSize = ::GetSerializeSize(t1, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(t1.GetSize() == nSize);
+
+    CTransactionRef ptx = MakeTransactionRef(t1);
+    BOOST_CHECK(ptx->GetHash() == hash);
+    BOOST_CHECK(ptx->GetSize() == nSize);
+
+    // A copy can be changed, and does not keep the shared hash and size
+    CTransaction t2(*ptx);
+    t2.vout[0].nValue--;
+    BOOST_CHECK(t2.GetHash() == SerializeHash(t2));
+    BOOST_CHECK(t2.GetHash() != hash);
+    t2 = *ptx;
+    t2.vin[0].scriptSig << OP_2;
+    BOOST_CHECK(t2.GetHash() != hash);
+    BOOST_CHECK(t2.GetSize() == nSize + 1);
+    BOOST_CHECK(ptx->GetHash() == hash);
+
+    // The memory pool hands out the one it holds
+    mempool.addUnchecked(hash, ptx);
+    BOOST_CHECK(mempool.get(hash) == ptx);
+    BOOST_CHECK(!mempool.get(t2.GetHash()));
+    CTransaction t3;
+    BOOST_CHECK(mempool.lookup(hash, t3) && t3 == t1);
+    mempool.remove(t1);
+    BOOST_CHECK(!mempool.get(hash));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
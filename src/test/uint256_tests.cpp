@@ -1,6 +1,9 @@
 #include <boost/test/unit_test.hpp>
 
+#include "bignum.h"
+#include "kernel.h"
 #include "uint256.h"
+#include "util.h"
 
 BOOST_AUTO_TEST_SUITE(uint256_tests)
 
@@ -15,4 +18,121 @@ BOOST_AUTO_TEST_CASE(uint256_equality)
     BOOST_CHECK(num1+num2 == num3+num2);
 }
 
+static CBigNum BigNum(const uint512& n)
+{
+    CBigNum bn;
+    bn.SetHex(n.GetHex());
+    return bn;
+}
+
+// A random number of a random length, zero included
+static uint256 RandomUint256()
+{
+    return GetRandHash() >> GetRandInt(257);
+}
+
+// Sizes around the ends of the types, mantissas with and without the sign bit
+static unsigned int RandomCompact()
+{
+    unsigned int nSize = GetRandInt(4) ? GetRandInt(40) : GetRandInt(256);
+    unsigned int nWord = GetRandInt(3) ? GetRandInt(0x1000000) : (GetRandInt(2) ? 0x800000 : 0) | GetRandInt(0x100);
+    return nSize << 24 | nWord;
+}
+
+BOOST_AUTO_TEST_CASE(uint256_compact)
+{
+    const CBigNum bnMax(~uint256(0));
+    for (int i = 0; i < 20000; i++)
+    {
+        unsigned int nCompact = RandomCompact();
+        bool fNegative, fOverflow;
+        uint256 n;
+        n.SetCompact(nCompact, &fNegative, &fOverflow);
+        CBigNum bn;
+        bn.SetCompact(nCompact);
+        CBigNum bnAbs = bn < 0 ? -bn : bn;
+
+        if (fNegative)
+        {
+            BOOST_CHECK(bn < 0);
+            BOOST_CHECK(fOverflow || bnAbs.getuint256() == n);
+        }
+        else
+            BOOST_CHECK(bn >= 0 || n == 0);
+        BOOST_CHECK_EQUAL(fOverflow, bnAbs > bnMax);
+        if (fNegative || fOverflow)
+            continue;
+        BOOST_CHECK(bn.getuint256() == n);
+
+        // Encoding agrees for any number, not only those decoded
+        BOOST_CHECK_EQUAL(n.GetCompact(), bn.GetCompact());
+        uint256 m = RandomUint256();
+        BOOST_CHECK_EQUAL(m.GetCompact(), CBigNum(m).GetCompact());
+    }
+    BOOST_CHECK_EQUAL(uint256(0).GetCompact(), 0U);
+    BOOST_CHECK_EQUAL(uint256(0x80).GetCompact(), 0x02008000U);
+    BOOST_CHECK_EQUAL((~uint256(0) >> 20).GetCompact(), 0x1e0fffffU);
+}
+
+BOOST_AUTO_TEST_CASE(uint256_muldiv)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        uint256 a = RandomUint256();
+        uint256 b = RandomUint256();
+        uint64 c = GetRand(GetRandInt(2) ? 100 : std::numeric_limits<uint64>::max());
+
+        BOOST_CHECK(BigNum(uint512(a) * uint512(b)) == CBigNum(a) * CBigNum(b));
+        BOOST_CHECK(BigNum(uint512(a * b)) == (CBigNum(a) * CBigNum(b)) % (CBigNum(1) << 256));
+        BOOST_CHECK(BigNum(uint512(a * c)) == (CBigNum(a) * CBigNum(c)) % (CBigNum(1) << 256));
+        BOOST_CHECK(BigNum(uint512(a * (unsigned int)c)) == (CBigNum(a) * CBigNum((unsigned int)c)) % (CBigNum(1) << 256));
+        if (b != 0)
+            BOOST_CHECK(CBigNum(a / b) == CBigNum(a) / CBigNum(b));
+        if (c != 0)
+            BOOST_CHECK(CBigNum(a / c) == CBigNum(a) / CBigNum(c));
+        CBigNum bnA(a);
+        BOOST_CHECK_EQUAL(a.bits(), (unsigned int)BN_num_bits(&bnA));
+        BOOST_CHECK_CLOSE(a.getdouble(), strtod(CBigNum(a).ToString().c_str(), NULL), 1e-9);
+
+        // Block trust, 2**256 / (t+1), without the 257th bit
+        if (a != 0)
+            BOOST_CHECK(CBigNum(~a / (a + 1) + 1) == (CBigNum(1) << 256) / (CBigNum(a) + 1));
+    }
+    BOOST_CHECK_THROW(uint256(1) / uint256(0), uint_error);
+    BOOST_CHECK_EQUAL(uint256(1000).getdouble(), 1000.0);
+}
+
+BOOST_AUTO_TEST_CASE(uint256_kernel_product)
+{
+    // The weight times the target times 10, as CheckStakeKernelHash has it,
+    // against CBigNum: targets in range, too wide for 256 bits (some shifted
+    // out to zero entirely), negative, and any nBits at all
+    for (int i = 0; i < 20000; i++)
+    {
+        unsigned int nBits;
+        if (i % 4 < 2)
+            nBits = 0x1d000000 | GetRandInt(0x800000);
+        else if (i % 4 == 2)
+            nBits = ((0x20 + GetRandInt(0xe0)) << 24) | GetRandInt(0x1000000);
+        else
+            nBits = (unsigned int)GetRand(0x100000000ULL);
+        uint256 bnWeight = 0;
+        if (i % 7 != 0)
+            bnWeight = uint256(GetRand(std::numeric_limits<uint64>::max())) * uint256(GetRand(std::numeric_limits<uint64>::max())) / COIN / (24 * 60 * 60);
+        bool fWeightNegative = (i % 5 == 0);
+        uint256 hash = GetRandHash() >> GetRandInt(100);
+
+        CBigNum bnTarget;
+        bnTarget.SetCompact(nBits);
+        CBigNum bnProduct = CBigNum(bnWeight) * bnTarget * 10;
+        if (fWeightNegative)
+            bnProduct = -bnProduct;
+        BOOST_CHECK_EQUAL(CheckStakeKernelProduct(hash, bnWeight, fWeightNegative, nBits, 10), !(CBigNum(hash) > bnProduct));
+    }
+
+    // A target shifted out to zero is still one too big for any hash
+    BOOST_CHECK(CheckStakeKernelProduct(~uint256(0), 1, false, 0x23000001, 10));
+    BOOST_CHECK(!CheckStakeKernelProduct(1, 0, false, 0x23000001, 10));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
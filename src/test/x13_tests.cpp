@@ -0,0 +1,154 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "sph_aesni.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(x13_tests)
+
+typedef void (*HashFunction)(const vector<unsigned char>& vch, unsigned int nChunk, unsigned char* pout);
+
+// Hash vch fed nChunk bytes at a time
+#define SPH_HASH512(name) \
+    static void Hash_##name(const vector<unsigned char>& vch, unsigned int nChunk, unsigned char* pout) \
+    { \
+        sph_##name##_context ctx; \
+        sph_##name##_init(&ctx); \
+        for (unsigned int i = 0; i < vch.size(); i += nChunk) \
+            sph_##name(&ctx, &vch[i], min((size_t)nChunk, vch.size() - i)); \
+        sph_##name##_close(&ctx, pout); \
+    }
+
+SPH_HASH512(echo512)
+SPH_HASH512(shavite512)
+SPH_HASH512(groestl512)
+
+static string HashHex(HashFunction hash, const vector<unsigned char>& vch, unsigned int nChunk = 1000)
+{
+    unsigned char out[64];
+    hash(vch, nChunk, out);
+    return HexStr(out, out + 64);
+}
+
+static const struct
+{
+    const char* pszName;
+    HashFunction hash;
+    const char* pszEmpty;       // sph reference vector of the empty message
+    const char* pszBytes200;    // bytes 0 to 199, over two blocks
+} vectors[] = {
+    {"echo512", Hash_echo512,
+     "158f58cc79d300a9aa292515049275d051a28ab931726d0ec44bdd9faef4a702c36db9e7922fff077402236465833c5cc76af4efc352b4b44c7fa15aa0ef234e",
+     "61c10247231339fe1649319067997f656a1a90a0482763a227378c96eaf07eb984018a897d0ed453729ca700d21753432c0cabef97ea9b32fcbd61268d0f7d11"},
+    {"shavite512", Hash_shavite512,
+     "a485c1b2578459d1efc5dddd840bb0b4a650ac82fe68f58c4442ccda747da006b2d1dc6b4a4eb7d84ff91e1f466fef429d259acd995dddcad16fa545c7a6e5ba",
+     "c312d285cd9c597d7df9525133155f05aa94f206b31e2def255879b8bb27f25ccfaba516238c5de679545e7d0d88a5d0c0c975aae8a2e62369fcdeda4d02da42"},
+    {"groestl512", Hash_groestl512,
+     "6d3ad29d279110eef3adbd66de2a0345a77baede1557f5d099fce0c03d6dc2ba8e6d4a6633dfbd66053c20faa87d1a11f39a7fbe4a6c2f009801370308fc4ad8",
+     "ff6dabc4aacd1f3955daba7ee2f36b2e24cca8aef87bdf286ea77b2d86dc40526ca5290c0558e95b4f620d78241a2665ab300216016b66ae87c6dc2e216348bb"},
+};
+
+BOOST_AUTO_TEST_CASE(x13_aes_known_answers)
+{
+    if (!sph_aesni_supported())
+        BOOST_TEST_MESSAGE("No AES-NI here, the table code only is tested");
+
+    vector<unsigned char> vchBytes200;
+    for (int i = 0; i < 200; i++)
+        vchBytes200.push_back(i);
+
+    for (int fAESNI = 0; fAESNI < 2; fAESNI++)
+    {
+        sph_aesni_enable(fAESNI);
+        for (unsigned int i = 0; i < ARRAYLEN(vectors); i++)
+        {
+            BOOST_CHECK_MESSAGE(HashHex(vectors[i].hash, vector<unsigned char>()) == vectors[i].pszEmpty, vectors[i].pszName);
+            BOOST_CHECK_MESSAGE(HashHex(vectors[i].hash, vchBytes200) == vectors[i].pszBytes200, vectors[i].pszName);
+        }
+    }
+    sph_aesni_enable(1);
+}
+
+BOOST_AUTO_TEST_CASE(x13_aes_equivalence)
+{
+    // Every length to past two blocks, fed whole and in odd pieces
+    for (unsigned int nLen = 0; nLen < 300; nLen++)
+    {
+        vector<unsigned char> vch(nLen);
+        for (unsigned int i = 0; i < nLen; i++)
+            vch[i] = GetRandInt(256);
+        for (unsigned int i = 0; i < ARRAYLEN(vectors); i++)
+        {
+            sph_aesni_enable(0);
+            string strTable = HashHex(vectors[i].hash, vch);
+            sph_aesni_enable(1);
+            BOOST_CHECK_MESSAGE(HashHex(vectors[i].hash, vch) == strTable, vectors[i].pszName << " " << nLen);
+            BOOST_CHECK_MESSAGE(HashHex(vectors[i].hash, vch, 7) == strTable, vectors[i].pszName << " " << nLen);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(x13_genesis)
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = 0;
+    block.hashMerkleRoot = uint256("0x8e352eea8e1f1ccd31bc5e6936b99b870277ee2d620a167f6cfd2d85b56c1455");
+    block.nTime = 1488585034;
+    block.nBits = (~uint256(0) >> 20).GetCompact();
+    block.nNonce = 141844;
+
+    sph_aesni_enable(0);
+    BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+    sph_aesni_enable(1);
+    BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+}
+
+BOOST_AUTO_TEST_CASE(x13_header_hash_cache)
+{
+    CBlock block;
+    block.nVersion = 1;
+    block.hashPrevBlock = 0;
+    block.hashMerkleRoot = uint256("0x8e352eea8e1f1ccd31bc5e6936b99b870277ee2d620a167f6cfd2d85b56c1455");
+    block.nTime = 1488585034;
+    block.nBits = (~uint256(0) >> 20).GetCompact();
+    block.nNonce = 141844;
+    BOOST_CHECK(END(block.nNonce) - BEGIN(block.nVersion) == sizeof(block.pchHeaderCached));
+    BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+    BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+
+    // Every header field changed in place is seen
+    block.nNonce++;
+    BOOST_CHECK(block.GetHash() == Hash9(BEGIN(block.nVersion), END(block.nNonce)));
+    BOOST_CHECK(block.GetHash() != hashGenesisBlockOfficial);
+    block.nNonce--;
+    BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+    block.nTime++;
+    BOOST_CHECK(block.GetHash() == Hash9(BEGIN(block.nVersion), END(block.nNonce)));
+    block.nTime--;
+    block.hashMerkleRoot = GetRandHash();
+    BOOST_CHECK(block.GetHash() == Hash9(BEGIN(block.nVersion), END(block.nNonce)));
+    block.hashMerkleRoot = uint256("0x8e352eea8e1f1ccd31bc5e6936b99b870277ee2d620a167f6cfd2d85b56c1455");
+
+    // Copies and deserialized blocks
+    CBlock blockCopy(block);
+    BOOST_CHECK(blockCopy.GetHash() == hashGenesisBlockOfficial);
+    blockCopy.nVersion = 2;
+    BOOST_CHECK(blockCopy.GetHash() != hashGenesisBlockOfficial);
+    BOOST_CHECK(block.GetHash() == hashGenesisBlockOfficial);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    ss >> blockCopy;
+    BOOST_CHECK(blockCopy.GetHash() == hashGenesisBlockOfficial);
+
+    // An all-zero header is not mistaken for a cached one
+    CBlock blockZero;
+    blockZero.nVersion = 0;
+    BOOST_CHECK(blockZero.GetHash() == Hash9(BEGIN(blockZero.nVersion), END(blockZero.nNonce)));
+    BOOST_CHECK(blockZero.GetHash() != 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
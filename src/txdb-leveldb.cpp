@@ -15,6 +15,8 @@
 #include <memenv/memenv.h>
 
 #include "kernel.h"
+#include "addrindex.h"
+#include "chainstats.h"
 #include "checkpoints.h"
 #include "txdb.h"
 #include "util.h"
@@ -149,11 +151,25 @@ bool CTxDB::TxnCommit()
     activeBatch = NULL;
     if (!status.ok()) {
         printf("LevelDB batch commit failure: %s\n", status.ToString().c_str());
+        uint256 hashAddrIndexBest;
+        if (fAddrIndex && !ReadAddrIndexBest(nAddrIndexHeight, hashAddrIndexBest))
+            nAddrIndexHeight = -1;
         return false;
     }
     return true;
 }
 
+bool CTxDB::TxnAbort()
+{
+    delete activeBatch;
+    activeBatch = NULL;
+    // The batch may have advanced the address index; go back to what is on disk
+    uint256 hashAddrIndexBest;
+    if (fAddrIndex && !ReadAddrIndexBest(nAddrIndexHeight, hashAddrIndexBest))
+        nAddrIndexHeight = -1;
+    return true;
+}
+
 class CBatchScanner : public leveldb::WriteBatch::Handler {
 public:
     std::string needle;
@@ -269,13 +285,20 @@ bool CTxDB::WriteHashBestChain(uint256 hashBestChain)
     return Write(string("hashBestChain"), hashBestChain);
 }
 
-bool CTxDB::ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust)
+// Kept in the CBigNum format it always had
+bool CTxDB::ReadBestInvalidTrust(uint512& nBestInvalidTrust)
 {
-    return Read(string("bnBestInvalidTrust"), bnBestInvalidTrust);
+    CBigNum bnBestInvalidTrust;
+    if (!Read(string("bnBestInvalidTrust"), bnBestInvalidTrust))
+        return false;
+    nBestInvalidTrust.SetHex(bnBestInvalidTrust.GetHex());
+    return true;
 }
 
-bool CTxDB::WriteBestInvalidTrust(CBigNum bnBestInvalidTrust)
+bool CTxDB::WriteBestInvalidTrust(const uint512& nBestInvalidTrust)
 {
+    CBigNum bnBestInvalidTrust;
+    bnBestInvalidTrust.SetHex(nBestInvalidTrust.GetHex());
     return Write(string("bnBestInvalidTrust"), bnBestInvalidTrust);
 }
 
@@ -299,6 +322,164 @@ bool CTxDB::WriteCheckpointPubKey(const string& strPubKey)
     return Write(string("strCheckpointPubKey"), strPubKey);
 }
 
+bool CTxDB::ReadAddrIndexBest(int& nHeight, uint256& hashBlock)
+{
+    pair<int, uint256> best;
+    if (!Read(string("addrindexbest"), best))
+        return false;
+    nHeight = best.first;
+    hashBlock = best.second;
+    return true;
+}
+
+bool CTxDB::WriteAddrIndexBest(int nHeight, const uint256& hashBlock)
+{
+    return Write(string("addrindexbest"), make_pair(nHeight, hashBlock));
+}
+
+bool CTxDB::ReadAddrIndex(const CAddrIndexKey& key, CAddrIndexValue& value)
+{
+    return Read(make_pair(string("addr"), key), value);
+}
+
+bool CTxDB::WriteAddrIndex(const CAddrIndexKey& key, const CAddrIndexValue& value)
+{
+    return Write(make_pair(string("addr"), key), value);
+}
+
+bool CTxDB::EraseAddrIndex(const CAddrIndexKey& key)
+{
+    return Erase(make_pair(string("addr"), key));
+}
+
+bool CTxDB::ReadAddrUnspent(const CAddrIndexId& id, const COutPoint& outpoint, CAddrUnspent& unspent)
+{
+    return Read(make_pair(string("addru"), make_pair(id, outpoint)), unspent);
+}
+
+bool CTxDB::WriteAddrUnspent(const CAddrIndexId& id, const COutPoint& outpoint, const CAddrUnspent& unspent)
+{
+    return Write(make_pair(string("addru"), make_pair(id, outpoint)), unspent);
+}
+
+bool CTxDB::EraseAddrUnspent(const CAddrIndexId& id, const COutPoint& outpoint)
+{
+    return Erase(make_pair(string("addru"), make_pair(id, outpoint)));
+}
+
+bool CTxDB::ReadAddrHistory(const CAddrIndexId& id, int nHeightFrom, int nHeightTo, unsigned int nSkip, unsigned int nCount,
+                            vector<pair<CAddrIndexKey, CAddrIndexValue> >& vHistory)
+{
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair(string("addr"), id);
+    string strPrefix = ssPrefix.str();
+
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("addr"), CAddrIndexKey(id, max(nHeightFrom, 0), 0, 0, false));
+
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    for (iterator->Seek(ssStartKey.str()); iterator->Valid(); iterator->Next())
+    {
+        if (!iterator->key().starts_with(strPrefix))
+            break;
+        CDataStream ssKey(iterator->key().data(), iterator->key().data() + iterator->key().size(), SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(iterator->value().data(), iterator->value().data() + iterator->value().size(), SER_DISK, CLIENT_VERSION);
+        string strType;
+        pair<CAddrIndexKey, CAddrIndexValue> item;
+        try {
+            ssKey >> strType >> item.first;
+            ssValue >> item.second;
+        }
+        catch (std::exception &e) {
+            delete iterator;
+            return error("CTxDB::ReadAddrHistory() : deserialize error");
+        }
+        if (nHeightTo >= 0 && item.first.nHeight > nHeightTo)
+            break;
+        if (nSkip > 0)
+        {
+            nSkip--;
+            continue;
+        }
+        vHistory.push_back(item);
+        if (nCount > 0 && vHistory.size() >= nCount)
+            break;
+    }
+    delete iterator;
+    return true;
+}
+
+bool CTxDB::ReadAddrUnspents(const CAddrIndexId& id, unsigned int nSkip, unsigned int nCount,
+                             vector<pair<COutPoint, CAddrUnspent> >& vUnspent)
+{
+    CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+    ssPrefix << make_pair(string("addru"), id);
+    string strPrefix = ssPrefix.str();
+
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    for (iterator->Seek(strPrefix); iterator->Valid(); iterator->Next())
+    {
+        if (!iterator->key().starts_with(strPrefix))
+            break;
+        if (nSkip > 0)
+        {
+            nSkip--;
+            continue;
+        }
+        CDataStream ssKey(iterator->key().data(), iterator->key().data() + iterator->key().size(), SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(iterator->value().data(), iterator->value().data() + iterator->value().size(), SER_DISK, CLIENT_VERSION);
+        string strType;
+        CAddrIndexId idKey;
+        pair<COutPoint, CAddrUnspent> item;
+        try {
+            ssKey >> strType >> idKey >> item.first;
+            ssValue >> item.second;
+        }
+        catch (std::exception &e) {
+            delete iterator;
+            return error("CTxDB::ReadAddrUnspents() : deserialize error");
+        }
+        vUnspent.push_back(item);
+        if (nCount > 0 && vUnspent.size() >= nCount)
+            break;
+    }
+    delete iterator;
+    return true;
+}
+
+bool CTxDB::WipeAddrIndex()
+{
+    if (fReadOnly)
+        assert(!"WipeAddrIndex called on database in read-only mode");
+
+    leveldb::WriteBatch batch;
+    unsigned int nErased = 0;
+    const char* pszTypes[] = { "addr", "addru" };
+    for (unsigned int i = 0; i < sizeof(pszTypes) / sizeof(pszTypes[0]); i++)
+    {
+        CDataStream ssPrefix(SER_DISK, CLIENT_VERSION);
+        ssPrefix << string(pszTypes[i]);
+        string strPrefix = ssPrefix.str();
+
+        leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+        for (iterator->Seek(strPrefix); iterator->Valid() && iterator->key().starts_with(strPrefix); iterator->Next())
+        {
+            batch.Delete(iterator->key());
+            nErased++;
+        }
+        delete iterator;
+    }
+    CDataStream ssBestKey(SER_DISK, CLIENT_VERSION);
+    ssBestKey << string("addrindexbest");
+    batch.Delete(ssBestKey.str());
+
+    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), &batch);
+    if (!status.ok())
+        return error("CTxDB::WipeAddrIndex() : %s", status.ToString().c_str());
+    printf("WipeAddrIndex() : erased %u records\n", nErased);
+    return true;
+}
+
 // InsertBlockIndex :> pindexNew [
 
 static CBlockIndex *InsertBlockIndex(uint256 hash)
@@ -307,7 +488,7 @@ static CBlockIndex *InsertBlockIndex(uint256 hash)
         return NULL;
 
     // Return existing
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    CHashMap<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
     if (mi != mapBlockIndex.end())
         return (*mi).second;
 
@@ -435,7 +616,7 @@ bool CTxDB::LoadBlockIndex()
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
-        pindex->bnChainTrust = (pindex->pprev ? pindex->pprev->bnChainTrust : 0) + pindex->GetBlockTrust();
+        pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + uint512(pindex->GetBlockTrust());
         // NovaCoin: calculate stake modifier checksum
         pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
         if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
@@ -443,7 +624,7 @@ bool CTxDB::LoadBlockIndex()
     }
 
     // Calculate nChainTrust & verify nStakeModifierChecksum checkpoints ]
-    // Load hashBestChain pindexBest nBestHeight bnBestChainTrust [
+    // Load hashBestChain pindexBest nBestHeight nBestChainTrust [
 
     // Load hashBestChain pointer to end of best chain
     if (!ReadHashBestChain(hashBestChain))
@@ -456,24 +637,27 @@ bool CTxDB::LoadBlockIndex()
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     pindexBest = mapBlockIndex[hashBestChain];
     nBestHeight = pindexBest->nHeight;
-    bnBestChainTrust = pindexBest->bnChainTrust;
+    nBestChainTrust = pindexBest->nChainTrust;
+    chainStats.Rebuild(pindexBest);
+    if (!InitAddrIndex(*this))
+        return error("CTxDB::LoadBlockIndex() : InitAddrIndex failed");
 
-    printf("LoadBlockIndex(): hashBestChain=%s  height=%d  trust=%s  date=%s\n",
-      hashBestChain.ToString().substr(0,20).c_str(), nBestHeight, CBigNum(bnBestChainTrust).ToString().c_str(),
+    printf("LoadBlockIndex(): hashBestChain=%s  height=%d  log2_trust=%.8g  date=%s\n",
+      hashBestChain.ToString().substr(0,20).c_str(), nBestHeight, log(nBestChainTrust.getdouble())/log(2.0),
       DateTimeStrFormat("%x %H:%M:%S", pindexBest->GetBlockTime()).c_str());
 
     llogLog(L"LoadBlockIndex/pindexBest", L"pindexBest ", *pindexBest);
 
-    // Load hashBestChain pindexBest nBestHeight bnBestChainTrust ]
+    // Load hashBestChain pindexBest nBestHeight nBestChainTrust ]
 
     // NovaCoin: load hashSyncCheckpoint
     if (!ReadSyncCheckpoint(Checkpoints::hashSyncCheckpoint))
         return error("CTxDB::LoadBlockIndex() : hashSyncCheckpoint not loaded");
     printf("LoadBlockIndex(): synchronized checkpoint %s\n", Checkpoints::hashSyncCheckpoint.ToString().c_str());
 
-    // Load bnBestInvalidTrust, OK if it doesn't exist
-    CBigNum bnBestInvalidTrust;
-    ReadBestInvalidTrust(bnBestInvalidTrust);
+    // Load nBestInvalidTrust, OK if it doesn't exist
+    uint512 nBestInvalidTrust;
+    ReadBestInvalidTrust(nBestInvalidTrust);
 
     // Verify blocks in the best chain
     int nCheckLevel = GetArg("-checklevel", 1);
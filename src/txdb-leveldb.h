@@ -15,6 +15,11 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+class CAddrIndexId;
+class CAddrIndexKey;
+class CAddrIndexValue;
+class CAddrUnspent;
+
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
 // be very cheap. Unfortunately that means, a CTxDB instance is actually just a
@@ -165,12 +170,7 @@ protected:
 public:
     bool TxnBegin();
     bool TxnCommit();
-    bool TxnAbort()
-    {
-        delete activeBatch;
-        activeBatch = NULL;
-        return true;
-    }
+    bool TxnAbort();
 
     bool ReadVersion(int& nVersion)
     {
@@ -195,13 +195,31 @@ public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
     bool ReadHashBestChain(uint256& hashBestChain);
     bool WriteHashBestChain(uint256 hashBestChain);
-    bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
-    bool WriteBestInvalidTrust(CBigNum bnBestInvalidTrust);
+    bool ReadBestInvalidTrust(uint512& nBestInvalidTrust);
+    bool WriteBestInvalidTrust(const uint512& nBestInvalidTrust);
     bool ReadSyncCheckpoint(uint256& hashCheckpoint);
     bool WriteSyncCheckpoint(uint256 hashCheckpoint);
     bool ReadCheckpointPubKey(std::string& strPubKey);
     bool WriteCheckpointPubKey(const std::string& strPubKey);
     bool LoadBlockIndex();
+
+    // Address index (-addrindex)
+    bool ReadAddrIndexBest(int& nHeight, uint256& hashBlock);
+    bool WriteAddrIndexBest(int nHeight, const uint256& hashBlock);
+    bool ReadAddrIndex(const CAddrIndexKey& key, CAddrIndexValue& value);
+    bool WriteAddrIndex(const CAddrIndexKey& key, const CAddrIndexValue& value);
+    bool EraseAddrIndex(const CAddrIndexKey& key);
+    bool ReadAddrUnspent(const CAddrIndexId& id, const COutPoint& outpoint, CAddrUnspent& unspent);
+    bool WriteAddrUnspent(const CAddrIndexId& id, const COutPoint& outpoint, const CAddrUnspent& unspent);
+    bool EraseAddrUnspent(const CAddrIndexId& id, const COutPoint& outpoint);
+    // Range reads see committed data only, not the active batch.
+    // nHeightTo < 0 means no upper bound, nCount == 0 means no limit.
+    bool ReadAddrHistory(const CAddrIndexId& id, int nHeightFrom, int nHeightTo, unsigned int nSkip, unsigned int nCount,
+                         std::vector<std::pair<CAddrIndexKey, CAddrIndexValue> >& vHistory);
+    bool ReadAddrUnspents(const CAddrIndexId& id, unsigned int nSkip, unsigned int nCount,
+                          std::vector<std::pair<COutPoint, CAddrUnspent> >& vUnspent);
+    // Delete every address index record, bypassing the active batch
+    bool WipeAddrIndex();
 private:
     bool LoadBlockIndexGuts();
 };
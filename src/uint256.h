@@ -8,6 +8,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -17,6 +18,12 @@ typedef unsigned long long  uint64;
 
 inline int Testuint256AdHoc(std::vector<std::string> vArg);
 
+/** Errors thrown by the uint classes */
+class uint_error : public std::runtime_error
+{
+public:
+    explicit uint_error(const std::string& str) : std::runtime_error(str) {}
+};
 
 
 /** Base class without constructors for uint256 and uint160.
@@ -168,6 +175,65 @@ public:
         return *this;
     }
 
+    base_uint& operator*=(unsigned int b32)
+    {
+        uint64 carry = 0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            uint64 n = carry + (uint64)b32 * pn[i];
+            pn[i] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        return *this;
+    }
+
+    // Modulo 2^BITS, as the other operators
+    base_uint& operator*=(const base_uint& b)
+    {
+        base_uint a;
+        for (int i = 0; i < WIDTH; i++)
+            a.pn[i] = 0;
+        for (int j = 0; j < WIDTH; j++)
+        {
+            uint64 carry = 0;
+            for (int i = 0; i + j < WIDTH; i++)
+            {
+                uint64 n = carry + a.pn[i + j] + (uint64)pn[j] * b.pn[i];
+                a.pn[i + j] = n & 0xffffffff;
+                carry = n >> 32;
+            }
+        }
+        *this = a;
+        return *this;
+    }
+
+    base_uint& operator/=(const base_uint& b)
+    {
+        base_uint div = b;
+        base_uint num = *this;
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+        int nNumBits = num.bits();
+        int nDivBits = div.bits();
+        if (nDivBits == 0)
+            throw uint_error("base_uint : division by zero");
+        if (nDivBits > nNumBits)
+            return *this;
+        int nShift = nNumBits - nDivBits;
+        div <<= nShift;
+        while (nShift >= 0)
+        {
+            if (num >= div)
+            {
+                num -= div;
+                pn[nShift / 32] |= (1U << (nShift & 31));
+            }
+            div >>= 1;
+            nShift--;
+        }
+        return *this;
+    }
+
 
     base_uint& operator++()
     {
@@ -354,6 +420,100 @@ public:
         return pn[2*n] | (uint64)pn[2*n+1] << 32;
     }
 
+    // Position of the highest bit set, 0 for zero
+    unsigned int bits() const
+    {
+        for (int i = WIDTH-1; i >= 0; i--)
+        {
+            if (pn[i])
+            {
+                unsigned int nBits = 32*i;
+                for (unsigned int n = pn[i]; n; n >>= 1)
+                    nBits++;
+                return nBits;
+            }
+        }
+        return 0;
+    }
+
+    double getdouble() const
+    {
+        double ret = 0.0;
+        double fact = 1.0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            ret += fact * pn[i];
+            fact *= 4294967296.0;
+        }
+        return ret;
+    }
+
+    // The "compact" format is a representation of a whole number N using
+    // an unsigned 32bit number similar to a floating point format: the most
+    // significant 8 bits are the size in bytes of N, the lower 23 bits are
+    // the mantissa and bit 0x00800000 is the sign. This is the MPI format
+    // CBigNum::SetCompact decodes, so the same values come out of it; a
+    // negative number or one too wide for this type is flagged instead.
+    base_uint& SetCompact(unsigned int nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL)
+    {
+        unsigned int nSize = nCompact >> 24;
+        unsigned int nWord = nCompact & 0x007fffff;
+        if (nSize <= 3)
+        {
+            nWord >>= 8 * (3 - nSize);
+            *this = nWord;
+        }
+        else
+        {
+            *this = nWord;
+            *this <<= 8 * (nSize - 3);
+        }
+        if (pfNegative)
+            *pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+        if (pfOverflow)
+        {
+            unsigned int nWordBits = 0;
+            for (unsigned int n = nWord; n; n >>= 1)
+                nWordBits++;
+            *pfOverflow = nWord != 0 && nSize > 3 && nWordBits + 8 * (nSize - 3) > BITS;
+        }
+        return *this;
+    }
+
+    unsigned int GetCompact() const
+    {
+        unsigned int nSize = (bits() + 7) / 8;
+        unsigned int nCompact = 0;
+        if (nSize <= 3)
+            nCompact = pn[0] << 8 * (3 - nSize);
+        else
+        {
+            base_uint b = *this;
+            b >>= 8 * (nSize - 3);
+            nCompact = b.pn[0];
+        }
+        // The sign bit is not part of the mantissa, a byte more keeps it clear
+        if (nCompact & 0x00800000)
+        {
+            nCompact >>= 8;
+            nSize++;
+        }
+        return nCompact | nSize << 24;
+    }
+
+    // Keyed hash for hash tables (see hashmap.h): NH from UMAC over the
+    // words, one multiply per pair, so equal hashes for different keys
+    // need knowledge of the salt
+    uint64 GetSaltedHash(const unsigned int* pnSalt) const
+    {
+        uint64 nHash = 0;
+        for (int i = 0; i + 1 < WIDTH; i += 2)
+            nHash += (uint64)(unsigned int)(pn[i] + pnSalt[i]) * (unsigned int)(pn[i+1] + pnSalt[i+1]);
+        if (WIDTH & 1)
+            nHash += (uint64)(unsigned int)(pn[WIDTH-1] + pnSalt[WIDTH-1]) * (pnSalt[WIDTH] | 1);
+        return nHash;
+    }
+
 //    unsigned int GetSerializeSize(int nType=0, int nVersion=PROTOCOL_VERSION) const
     unsigned int GetSerializeSize(int nType, int nVersion) const
     {
@@ -581,6 +741,10 @@ inline const uint256 operator&(const base_uint256& a, const base_uint256& b) { r
 inline const uint256 operator|(const base_uint256& a, const base_uint256& b) { return uint256(a) |= b; }
 inline const uint256 operator+(const base_uint256& a, const base_uint256& b) { return uint256(a) += b; }
 inline const uint256 operator-(const base_uint256& a, const base_uint256& b) { return uint256(a) -= b; }
+inline const uint256 operator*(const base_uint256& a, const base_uint256& b) { return uint256(a) *= b; }
+inline const uint256 operator/(const base_uint256& a, const base_uint256& b) { return uint256(a) /= b; }
+inline const uint256 operator*(const base_uint256& a, uint64 b)            { return uint256(a) *= uint256(b); }
+inline const uint256 operator/(const base_uint256& a, uint64 b)            { return uint256(a) /= uint256(b); }
 
 inline bool operator<(const base_uint256& a, const uint256& b)          { return (base_uint256)a <  (base_uint256)b; }
 inline bool operator<=(const base_uint256& a, const uint256& b)         { return (base_uint256)a <= (base_uint256)b; }
@@ -669,6 +833,14 @@ public:
         return *this;
     }
 
+    explicit uint512(const base_uint256& b)
+    {
+        for (int i = 0; i < base_uint256::WIDTH; i++)
+            pn[i] = b.pn[i];
+        for (int i = base_uint256::WIDTH; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
     explicit uint512(const std::string& str)
     {
         SetHex(str);
@@ -704,6 +876,10 @@ inline const uint512 operator&(const base_uint512& a, const base_uint512& b) { r
 inline const uint512 operator|(const base_uint512& a, const base_uint512& b) { return uint512(a) |= b; }
 inline const uint512 operator+(const base_uint512& a, const base_uint512& b) { return uint512(a) += b; }
 inline const uint512 operator-(const base_uint512& a, const base_uint512& b) { return uint512(a) -= b; }
+inline const uint512 operator*(const base_uint512& a, const base_uint512& b) { return uint512(a) *= b; }
+inline const uint512 operator/(const base_uint512& a, const base_uint512& b) { return uint512(a) /= b; }
+inline const uint512 operator*(const base_uint512& a, uint64 b)            { return uint512(a) *= uint512(b); }
+inline const uint512 operator/(const base_uint512& a, uint64 b)            { return uint512(a) /= uint512(b); }
 
 inline bool operator<(const base_uint512& a, const uint512& b) { return (base_uint512)a < (base_uint512)b; }
 inline bool operator<=(const base_uint512& a, const uint512& b) { return (base_uint512)a <= (base_uint512)b; }
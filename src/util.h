@@ -346,6 +346,12 @@ inline int64 GetTimeMillis()
             boost::posix_time::ptime(boost::gregorian::date(1970,1,1))).total_milliseconds();
 }
 
+inline int64 GetTimeMicros()
+{
+    return (boost::posix_time::ptime(boost::posix_time::microsec_clock::universal_time()) -
+            boost::posix_time::ptime(boost::gregorian::date(1970,1,1))).total_microseconds();
+}
+
 inline std::string DateTimeStrFormat(const char* pszFormat, int64 nTime)
 {
     time_t n = nTime;
@@ -469,6 +475,9 @@ public:
         Init();
     }
 
+    // Continues from a SHA-256 midstate
+    CHashWriter(int nTypeIn, int nVersionIn, const SHA256_CTX& ctxIn) : ctx(ctxIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
     CHashWriter& write(const char *pch, size_t size) {
         SHA256_Update(&ctx, pch, size);
         return (*this);
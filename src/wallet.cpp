@@ -12,6 +12,7 @@
 #include "base58.h"
 #include "kernel.h"
 #include "coincontrol.h"
+#include "walletscan.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -416,7 +417,7 @@ CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries,
 
     // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
     // would make this much faster for applications that do this a lot.
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         CWalletTx* wtx = &((*it).second);
         txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
@@ -440,7 +441,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
         LOCK(cs_wallet);
         BOOST_FOREACH(const CTxIn& txin, tx.vin)
         {
-            map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+            CHashMap<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
             if (mi != mapWallet.end())
             {
                 CWalletTx& wtx = (*mi).second;
@@ -458,7 +459,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
         if (fBlock)
                 {
                     uint256 hash = tx.GetHash();
-                    map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+                    CHashMap<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
                     CWalletTx& wtx = (*mi).second;
 
                     BOOST_FOREACH(const CTxOut& txout, tx.vout)
@@ -489,7 +490,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
     {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
-        pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
+        pair<CHashMap<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         bool fInsertedNew = ret.second;
@@ -656,7 +657,7 @@ bool CWallet::IsMine(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        CHashMap<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             const CWalletTx& prev = (*mi).second;
@@ -672,7 +673,7 @@ int64 CWallet::GetDebit(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        CHashMap<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             const CWalletTx& prev = (*mi).second;
@@ -860,7 +861,7 @@ void CWalletTx::AddSupportingTransactions(CTxDB& txdb)
                 setAlreadyDone.insert(hash);
 
                 CMerkleTx tx;
-                map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hash);
+                CHashMap<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hash);
                 if (mi != pwallet->mapWallet.end())
                 {
                     tx = (*mi).second;
@@ -903,30 +904,20 @@ bool CWalletTx::WriteToDisk()
 
 // Scan the block chain (starting in pindexStart) for transactions
 // from or to us. If fUpdate is true, found transactions that already
-// exist in the wallet will be updated.
-int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
-{
-    int ret = 0;
-
-    CBlockIndex* pindex = pindexStart;
-    {
-        LOCK(cs_wallet);
-        while (pindex)
-        {
-            if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey -7200))){
-                pindex = pindex->pnext;
-                continue;
-            }
-            CBlock block;
-            block.ReadFromDisk(pindex, true);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
-            {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
-            }
-            pindex = pindex->pnext;
-        }
-    }
+// exist in the wallet will be updated. pfFailed is set if a block could
+// not be read from disk.
+int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool* pfAborted, bool* pfFailed)
+{
+    // Blocks are read and filtered on other threads; cs_main and cs_wallet
+    // are only taken to add what was found, so the wallet stays usable
+    fAbortRescan = false;
+    bool fAborted, fFailed;
+    CWalletRescan rescan(this, fUpdate);
+    int ret = rescan.Scan(pindexStart, fAborted, fFailed);
+    if (pfAborted)
+        *pfAborted = fAborted;
+    if (pfFailed)
+        *pfFailed = fFailed;
     return ret;
 }
 
@@ -980,6 +971,7 @@ void CWallet::ReacceptWalletTransactions()
                     printf("ReacceptWalletTransactions found spent coin %snvc %s\n", FormatMoney(wtx.GetCredit()).c_str(), wtx.GetHash().ToString().c_str());
                     wtx.MarkDirty();
                     wtx.WriteToDisk();
+                    NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
                 }
             }
             else
@@ -1088,7 +1080,7 @@ int64 CWallet::GetBalance() const
     int64 nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsFinal() && pcoin->IsConfirmed())
@@ -1104,7 +1096,7 @@ int64 CWallet::GetUnconfirmedBalance() const
     int64 nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (!pcoin->IsFinal() || !pcoin->IsConfirmed())
@@ -1124,7 +1116,7 @@ int64 CWallet::GetImmatureBalance() const
     int64 nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx& pcoin = (*it).second;
             if ((pcoin.GetBlocksToMaturity() > 0) && (pcoin.IsInMainChain())) {
@@ -1145,7 +1137,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
 
@@ -1214,7 +1206,7 @@ int64 CWallet::GetStake() const
 {
     int64 nTotal = 0;
     LOCK(cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         const CWalletTx* pcoin = &(*it).second;
         if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
@@ -1223,12 +1215,81 @@ int64 CWallet::GetStake() const
     return nTotal;
 }
 
+bool CWallet::GetBalanceShare(const CWalletTx& wtx, CWalletBalances& share) const
+{
+    // Same conditions as the four totals above
+    share = CWalletBalances();
+    bool fFinal = wtx.IsFinal();
+    bool fConfirmed = fFinal && wtx.IsConfirmed();
+    int nDepth = wtx.GetDepthInMainChain();
+    int nBlocksToMaturity = wtx.GetBlocksToMaturity();
+
+    if (fConfirmed)
+        share.nBalance = wtx.GetAvailableCredit();
+    else
+        share.nUnconfirmed = wtx.GetAvailableCredit();
+
+    if (wtx.IsCoinStake() && nBlocksToMaturity > 0 && nDepth > 0)
+        share.nStake = GetCredit(wtx);
+
+    if (nBlocksToMaturity > 0 && nDepth > 0)
+    {
+        int64 nDebit = GetDebit(wtx);
+        if (nDebit > 0 && wtx.GetValueOut() - nDebit > 0)
+            share.nImmature = nDebit;
+    }
+
+    return fFinal && nDepth > 0 && nBlocksToMaturity == 0;
+}
+
+void CWalletBalanceShares::Update(const uint256& hash)
+{
+    CHashMap<uint256, CWalletBalances>::iterator mi = mapShares.find(hash);
+    if (mi != mapShares.end())
+    {
+        balances -= mi->second;
+        mapShares.erase(mi);
+    }
+    setUnsettled.erase(hash);
+
+    CHashMap<uint256, CWalletTx>::const_iterator it = pwallet->mapWallet.find(hash);
+    if (it == pwallet->mapWallet.end())
+        return;
+    CWalletBalances share;
+    if (!pwallet->GetBalanceShare(it->second, share))
+        setUnsettled.insert(hash);
+    mapShares.insert(make_pair(hash, share));
+    balances += share;
+}
+
+void CWalletBalanceShares::UpdateUnsettled()
+{
+    vector<uint256> vUnsettled(setUnsettled.begin(), setUnsettled.end());
+    BOOST_FOREACH(const uint256& hash, vUnsettled)
+        Update(hash);
+}
+
+void CWalletBalanceShares::UpdateAll()
+{
+    mapShares.clear();
+    setUnsettled.clear();
+    balances = CWalletBalances();
+    for (CHashMap<uint256, CWalletTx>::const_iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+    {
+        CWalletBalances share;
+        if (!pwallet->GetBalanceShare(it->second, share))
+            setUnsettled.insert(it->first);
+        mapShares.insert(make_pair(it->first, share));
+        balances += share;
+    }
+}
+
 // redundant with GetStake
 int64 CWallet::GetNewMint() const
 {
     int64 nTotal = 0;
     LOCK(cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         const CWalletTx* pcoin = &(*it).second;
         if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
@@ -1368,7 +1429,7 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSp
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
 
@@ -1516,10 +1577,13 @@ bool CWallet::CreateTransaction(const vector<pair<CScript, int64> >& vecSend, CW
                 BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
                 wtxNew.vin.push_back(CTxIn(coin.first->GetHash(),coin.second));
 
-                int nIn = 0;
-                BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
-                if (!SignSignature(*this, *coin.first, wtxNew, nIn++))
-                    return false;
+                {
+                    CSignatureHashCache sighashcache(wtxNew);
+                    int nIn = 0;
+                    BOOST_FOREACH(const PAIRTYPE(const CWalletTx*,unsigned int)& coin, setCoins)
+                    if (!SignSignature(*this, *coin.first, wtxNew, nIn++))
+                        return false;
+                }
 
                 unsigned int nBytes = ::GetSerializeSize(*(CTransaction*)&wtxNew, SER_NETWORK, PROTOCOL_VERSION);
                 if (nBytes >= MAX_BLOCK_SIZE_GEN/5)
@@ -2041,6 +2105,133 @@ bool CWallet::SendStealthMoneyToDestination(CStealthAddress& sxAddress, int64 nV
     return true;
 }
 
+bool CWallet::UpdateStealthScanner()
+{
+    return stealthScanner.SetAddresses(stealthAddresses);
+};
+
+void CWallet::SetStealthPrescan(const std::vector<CTransaction>& vtx, const std::vector<CStealthMatch>& vMatches,
+                                const std::vector<unsigned int>& vScanned)
+{
+    LOCK(cs_wallet);
+    mapStealthPrescan.clear();
+    BOOST_FOREACH(unsigned int nTx, vScanned)
+        mapStealthPrescan[vtx[nTx].GetHash()];
+    BOOST_FOREACH(const CStealthMatch& match, vMatches)
+        mapStealthPrescan[vtx[match.nTx].GetHash()].push_back(match);
+};
+
+void CWallet::ScanBlockForStealth(const std::vector<CTransaction>& vtx)
+{
+    LOCK(cs_wallet);
+    mapStealthPrescan.clear();
+    if (!UpdateStealthScanner())
+        return;
+
+    std::vector<const CTransaction*> vptx;
+    vptx.reserve(vtx.size());
+    BOOST_FOREACH(const CTransaction& tx, vtx)
+        vptx.push_back(&tx);
+
+    std::vector<CStealthMatch> vMatches;
+    std::vector<unsigned int> vScanned;
+    stealthScanner.Scan(vptx, vMatches, &vScanned);
+    SetStealthPrescan(vtx, vMatches, vScanned);
+};
+
+bool CWallet::AddStealthMatch(const CStealthAddress& sxAddr, const CStealthMatch& match)
+{
+    CPubKey cpkE(match.pkExtracted);
+    if (!cpkE.IsValid())
+        return false;
+
+    if (fDebug)
+        printf("Found stealth txn to address %s\n", sxAddr.Encoded().c_str());
+
+    if (IsLocked())
+    {
+        if (fDebug)
+            printf("Wallet is locked, adding key without secret.\n");
+
+        // -- add key without secret
+        std::vector<uint8_t> vchEmpty;
+        AddCryptedKey(cpkE, vchEmpty);
+        CKeyID keyId = cpkE.GetID();
+        CBitcoinAddress coinAddress(keyId);
+        std::string sLabel = sxAddr.Encoded();
+        SetAddressBookName(keyId, sLabel);
+
+        CPubKey cpkEphem(match.pkEphem);
+        CPubKey cpkScan(sxAddr.scan_pubkey);
+        CStealthKeyMetadata lockedSkMeta(cpkEphem, cpkScan);
+
+        if (!CWalletDB(strWalletFile).WriteStealthKeyMeta(keyId, lockedSkMeta))
+            printf("WriteStealthKeyMeta failed for %s\n", coinAddress.ToString().c_str());
+
+        mapStealthKeyMeta[keyId] = lockedSkMeta;
+        nFoundStealth++;
+        return true;
+    };
+
+    if (sxAddr.spend_secret.size() != ec_secret_size)
+        return false;
+
+    ec_secret sShared = match.sShared;
+    ec_secret sSpend;
+    ec_secret sSpendR;
+    memcpy(&sSpend.e[0], &sxAddr.spend_secret[0], ec_secret_size);
+
+    if (StealthSharedToSecretSpend(sShared, sSpend, sSpendR) != 0)
+    {
+        printf("StealthSharedToSecretSpend() failed.\n");
+        return false;
+    };
+
+    CSecret vchSecret;
+    vchSecret.resize(ec_secret_size);
+
+    memcpy(&vchSecret[0], &sSpendR.e[0], ec_secret_size);
+    CKey ckey;
+
+    try {
+        ckey.SetSecret(vchSecret, true);
+    } catch (std::exception& e) {
+        printf("ckey.SetSecret() threw: %s.\n", e.what());
+        return false;
+    };
+
+    CPubKey cpkT = ckey.GetPubKey();
+    if (!cpkT.IsValid())
+    {
+        printf("cpkT is invalid.\n");
+        return false;
+    };
+
+    if (!ckey.IsValid())
+    {
+        printf("Reconstructed key is invalid.\n");
+        return false;
+    };
+
+    CKeyID keyID = cpkT.GetID();
+    if (fDebug)
+    {
+        CBitcoinAddress coinAddress(keyID);
+        printf("Adding key %s.\n", coinAddress.ToString().c_str());
+    };
+
+    if (!AddKey(ckey))
+    {
+        printf("AddKey failed.\n");
+        return false;
+    };
+
+    std::string sLabel = sxAddr.Encoded();
+    SetAddressBookName(keyID, sLabel);
+    nFoundStealth++;
+    return true;
+};
+
 bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNarr)
 {
     if (fDebug)
@@ -2049,26 +2240,19 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
     mapNarr.clear();
 
     LOCK(cs_wallet);
-    ec_secret sSpendR;
-    ec_secret sSpend;
-    ec_secret sScan;
-    ec_secret sShared;
-
-    ec_point pkExtracted;
 
     std::vector<uint8_t> vchEphemPK;
-    std::vector<uint8_t> vchDataB;
     std::vector<uint8_t> vchENarr;
     opcodetype opCode;
     char cbuf[256];
 
+    bool fEphem = false;
     int32_t nOutputIdOuter = -1;
     BOOST_FOREACH(const CTxOut& txout, tx.vout)
     {
         nOutputIdOuter++;
         // -- for each OP_RETURN need to check all other valid outputs
 
-        //printf("txout scriptPubKey %s\n",  txout.scriptPubKey.ToString().c_str());
         CScript::const_iterator itTxA = txout.scriptPubKey.begin();
 
         if (!txout.scriptPubKey.GetOp(itTxA, opCode, vchEphemPK)
@@ -2101,169 +2285,43 @@ bool CWallet::FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNar
             continue;
         }
 
-        int32_t nOutputId = -1;
         nStealth++;
-        BOOST_FOREACH(const CTxOut& txoutB, tx.vout)
-        {
-            nOutputId++;
-
-            if (&txoutB == &txout)
-                continue;
-
-            bool txnMatch = false; // only 1 txn will match an ephem pk
-            //printf("txoutB scriptPubKey %s\n",  txoutB.scriptPubKey.ToString().c_str());
-
-            CTxDestination address;
-            if (!ExtractDestination(txoutB.scriptPubKey, address))
-                continue;
-
-            if (address.type() != typeid(CKeyID))
-                continue;
-
-            CKeyID ckidMatch = boost::get<CKeyID>(address);
-
-            if (HaveKey(ckidMatch)) // no point checking if already have key
-                continue;
-
-            std::set<CStealthAddress>::iterator it;
-            for (it = stealthAddresses.begin(); it != stealthAddresses.end(); ++it)
-            {
-                if (it->scan_secret.size() != ec_secret_size)
-                    continue; // TimeVortex Address is not owned
-
-                //printf("it->Encodeded() %s\n",  it->Encoded().c_str());
-                memcpy(&sScan.e[0], &it->scan_secret[0], ec_secret_size);
-
-                if (StealthSecret(sScan, vchEphemPK, it->spend_pubkey, sShared, pkExtracted) != 0)
-                {
-                    printf("StealthSecret failed.\n");
-                    continue;
-                };
-                //printf("pkExtracted %"PRIszu": %s\n", pkExtracted.size(), HexStr(pkExtracted).c_str());
-
-                CPubKey cpkE(pkExtracted);
-
-                if (!cpkE.IsValid())
-                    continue;
-                CKeyID ckidE = cpkE.GetID();
-
-                if (ckidMatch != ckidE)
-                    continue;
-
-                if (fDebug)
-                    printf("Found stealth txn to address %s\n", it->Encoded().c_str());
-
-                if (IsLocked())
-                {
-                    if (fDebug)
-                        printf("Wallet is locked, adding key without secret.\n");
-
-                    // -- add key without secret
-                    std::vector<uint8_t> vchEmpty;
-                    AddCryptedKey(cpkE, vchEmpty);
-                    CKeyID keyId = cpkE.GetID();
-                    CBitcoinAddress coinAddress(keyId);
-                    std::string sLabel = it->Encoded();
-                    SetAddressBookName(keyId, sLabel);
-
-                    CPubKey cpkEphem(vchEphemPK);
-                    CPubKey cpkScan(it->scan_pubkey);
-                    CStealthKeyMetadata lockedSkMeta(cpkEphem, cpkScan);
-
-                    if (!CWalletDB(strWalletFile).WriteStealthKeyMeta(keyId, lockedSkMeta))
-                        printf("WriteStealthKeyMeta failed for %s\n", coinAddress.ToString().c_str());
-
-                    mapStealthKeyMeta[keyId] = lockedSkMeta;
-                    nFoundStealth++;
-                } else
-                {
-                    if (it->spend_secret.size() != ec_secret_size)
-                        continue;
-                    memcpy(&sSpend.e[0], &it->spend_secret[0], ec_secret_size);
-
-
-                    if (StealthSharedToSecretSpend(sShared, sSpend, sSpendR) != 0)
-                    {
-                        printf("StealthSharedToSecretSpend() failed.\n");
-                        continue;
-                    };
-
-                    ec_point pkTestSpendR;
-                    if (SecretToPublicKey(sSpendR, pkTestSpendR) != 0)
-                    {
-                        printf("SecretToPublicKey() failed.\n");
-                        continue;
-                    };
-
-                    CSecret vchSecret;
-                    vchSecret.resize(ec_secret_size);
-
-                    memcpy(&vchSecret[0], &sSpendR.e[0], ec_secret_size);
-                    CKey ckey;
-
-                    try {
-                        ckey.SetSecret(vchSecret, true);
-                    } catch (std::exception& e) {
-                        printf("ckey.SetSecret() threw: %s.\n", e.what());
-                        continue;
-                    };
-
-                    CPubKey cpkT = ckey.GetPubKey();
-                    if (!cpkT.IsValid())
-                    {
-                        printf("cpkT is invalid.\n");
-                        continue;
-                    };
+        fEphem = true;
+    };
 
-                    if (!ckey.IsValid())
-                    {
-                        printf("Reconstructed key is invalid.\n");
-                        continue;
-                    };
+    if (!fEphem)
+        return true;
 
-                    CKeyID keyID = cpkT.GetID();
-                    if (fDebug)
-                    {
-                        CBitcoinAddress coinAddress(keyID);
-                        printf("Adding key %s.\n", coinAddress.ToString().c_str());
-                    };
+    // -- the shared secrets were usually derived with the rest of the block
+    std::vector<CStealthMatch> vMatches;
+    std::map<uint256, std::vector<CStealthMatch> >::iterator mi = mapStealthPrescan.find(tx.GetHash());
+    if (mi != mapStealthPrescan.end())
+    {
+        vMatches.swap(mi->second);
+        mapStealthPrescan.erase(mi);
+    } else
+    if (UpdateStealthScanner())
+    {
+        std::vector<const CTransaction*> vtx(1, &tx);
+        stealthScanner.Scan(vtx, vMatches);
+    };
 
-                    if (!AddKey(ckey))
-                    {
-                        printf("AddKey failed.\n");
-                        continue;
-                    };
+    std::set<unsigned int> setEphemDone; // only 1 txn will match an ephem pk
+    BOOST_FOREACH(const CStealthMatch& match, vMatches)
+    {
+        if (setEphemDone.count(match.nEphemOut))
+            continue;
 
-                    std::string sLabel = it->Encoded();
-                    SetAddressBookName(keyID, sLabel);
-                    nFoundStealth++;
-                };
+        if (HaveKey(CPubKey(match.pkExtracted).GetID())) // no point checking if already have key
+            continue;
 
-                if (txout.scriptPubKey.GetOp(itTxA, opCode, vchENarr)
-                    && opCode == OP_RETURN
-                    && txout.scriptPubKey.GetOp(itTxA, opCode, vchENarr)
-                    && vchENarr.size() > 0)
-                {
-                    //SecMsgCrypter crypter;
-                    //crypter.SetKey(&sShared.e[0], &vchEphemPK[0]);
-                    //std::vector<uint8_t> vchNarr;
-                    //if (!crypter.Decrypt(&vchENarr[0], vchENarr.size(), vchNarr))
-                    //{
-                    //    printf("Decrypt narration failed.\n");
-                    //    continue;
-                    //};
-                    //std::string sNarr = std::string(vchNarr.begin(), vchNarr.end());
-
-                    //snprintf(cbuf, sizeof(cbuf), "n_%d", nOutputId);
-                    //mapNarr[cbuf] = sNarr;
-                };
+        // The scanner's copy may predate unlocking
+        std::set<CStealthAddress>::iterator it = stealthAddresses.find(match.address);
+        if (it == stealthAddresses.end())
+            continue;
 
-                txnMatch = true;
-                break;
-            };
-            if (txnMatch)
-                break;
-        };
+        if (AddStealthMatch(*it, match))
+            setEphemDone.insert(match.nEphemOut);
     };
 
     return true;
@@ -2529,6 +2587,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         // pos: set tx out ]
 
         // Sign
+        CSignatureHashCache sighashcache(txNew);
         int nIn = 0;
         BOOST_FOREACH(const CWalletTx* pcoin, vwtxPrev)
         {
@@ -2578,9 +2637,9 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
         LOCK2(cs_main, cs_wallet);
         printf("CommitTransaction:\n%s", wtxNew.ToString().c_str());
         {
-            // This is only to keep the database open to defeat the auto-flush for the
-            // duration of this scope.  This is the only place where this optimization
-            // maybe makes sense; please don't do it anywhere else.
+            // This is only to keep the database open for the duration of this
+            // scope, so the writes below share one journal commit and the
+            // auto-flush stays away.
             CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile,"r") : NULL;
 
             // Take key pair from key pool so it won't be used again
@@ -2823,7 +2882,7 @@ bool CWallet::GetTransaction(const uint256 &hashTx, CWalletTx& wtx)
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hashTx);
+        CHashMap<uint256, CWalletTx>::iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end())
         {
             wtx = (*mi).second;
@@ -3067,7 +3126,10 @@ set< set<CTxDestination> > CWallet::GetAddressGroupings()
             BOOST_FOREACH(CTxIn txin, pcoin->vin)
             {
                 CTxDestination address;
-                if(!ExtractDestination(mapWallet[txin.prevout.hash].vout[txin.prevout.n].scriptPubKey, address))
+                CHashMap<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+                if (mi == mapWallet.end())
+                    continue;
+                if(!ExtractDestination(mi->second.vout[txin.prevout.n].scriptPubKey, address))
                     continue;
                 grouping.insert(address);
             }
@@ -3145,7 +3207,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, int64& nBalanceInQuestion, bool
     LOCK(cs_wallet);
     vector<CWalletTx*> vCoins;
     vCoins.reserve(mapWallet.size());
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         vCoins.push_back(&(*it).second);
 
     CTxDB txdb("r");
@@ -3167,6 +3229,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, int64& nBalanceInQuestion, bool
                 {
                     pcoin->MarkUnspent(n);
                     pcoin->WriteToDisk();
+                    NotifyTransactionChanged(this, pcoin->GetHash(), CT_UPDATED);
                 }
             }
             else if (IsMine(pcoin->vout[n]) && !pcoin->IsSpent(n) && (txindex.vSpent.size() > n && !txindex.vSpent[n].IsNull()))
@@ -3179,6 +3242,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, int64& nBalanceInQuestion, bool
                 {
                     pcoin->MarkSpent(n);
                     pcoin->WriteToDisk();
+                    NotifyTransactionChanged(this, pcoin->GetHash(), CT_UPDATED);
                 }
             }
         }
@@ -3194,7 +3258,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
     LOCK(cs_wallet);
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
     {
-        map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+        CHashMap<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             CWalletTx& prev = (*mi).second;
@@ -3202,6 +3266,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
             {
                 prev.MarkUnspent(txin.prevout.n);
                 prev.WriteToDisk();
+                NotifyTransactionChanged(this, prev.GetHash(), CT_UPDATED);
             }
         }
     }
@@ -3270,7 +3335,7 @@ void CWallet::UpdatedTransaction(const uint256 &hashTx)
     {
         LOCK(cs_wallet);
         // Only notify UI if this transaction is in this wallet
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
+        CHashMap<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end())
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
     }
@@ -3300,10 +3365,10 @@ void CWallet::GetKeyBirthTimes(std::map<CKeyID, int64> &mapKeyBirth) const {
 
     // find first block that affects those keys, if there are any left
     std::vector<CKeyID> vAffected;
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
+    for (CHashMap<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
         // iterate over all wallet transactions...
         const CWalletTx &wtx = (*it).second;
-        std::map<uint256, CBlockIndex*>::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
+        CHashMap<uint256, CBlockIndex*>::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
         if (blit != mapBlockIndex.end() && blit->second->IsInMainChain()) {
             // ... which are already in a block
             int nHeight = blit->second->nHeight;
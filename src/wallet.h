@@ -71,6 +71,75 @@ public:
     )
 };
 
+/** The balances a wallet reports to the GUI, or one transaction's share of them */
+class CWalletBalances
+{
+public:
+    int64 nBalance;
+    int64 nStake;
+    int64 nUnconfirmed;
+    int64 nImmature;
+
+    CWalletBalances() : nBalance(0), nStake(0), nUnconfirmed(0), nImmature(0) { }
+
+    CWalletBalances& operator+=(const CWalletBalances& b)
+    {
+        nBalance += b.nBalance;
+        nStake += b.nStake;
+        nUnconfirmed += b.nUnconfirmed;
+        nImmature += b.nImmature;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& b)
+    {
+        nBalance -= b.nBalance;
+        nStake -= b.nStake;
+        nUnconfirmed -= b.nUnconfirmed;
+        nImmature -= b.nImmature;
+        return *this;
+    }
+
+    friend bool operator==(const CWalletBalances& a, const CWalletBalances& b)
+    {
+        return (a.nBalance == b.nBalance && a.nStake == b.nStake &&
+                a.nUnconfirmed == b.nUnconfirmed && a.nImmature == b.nImmature);
+    }
+
+    friend bool operator!=(const CWalletBalances& a, const CWalletBalances& b)
+    {
+        return !(a == b);
+    }
+};
+
+/** What each wallet transaction adds to the balances, kept so the totals
+ * can follow changed transactions and new blocks without a pass over the
+ * wallet. All calls need cs_main and the wallet's cs_wallet held.
+ */
+class CWalletBalanceShares
+{
+private:
+    const CWallet* pwallet;
+    CHashMap<uint256, CWalletBalances> mapShares;
+    // Transactions whose share can change with new blocks
+    std::set<uint256> setUnsettled;
+    CWalletBalances balances;
+
+public:
+    CWalletBalanceShares(const CWallet* pwalletIn) : pwallet(pwalletIn) { }
+
+    // Replace the share of one transaction, dropping it if it left the wallet
+    void Update(const uint256& hash);
+    // Recompute the shares new blocks can change
+    void UpdateUnsettled();
+    // Recompute every share, after a reorganization
+    void UpdateAll();
+
+    const CWalletBalances& GetBalances() const { return balances; }
+    bool IsUnsettled(const uint256& hash) const { return setUnsettled.count(hash) > 0; }
+    size_t size() const { return mapShares.size(); }
+};
+
 /** A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
@@ -100,6 +169,10 @@ public:
     std::set<CStealthAddress> stealthAddresses;
     StealthKeyMetaMap mapStealthKeyMeta;
     uint32_t nStealth, nFoundStealth;
+    CStealthScanner stealthScanner;
+    // Stealth payments of the transactions with ephemeral keys in the block
+    // last given to ScanBlockForStealth or SetStealthPrescan
+    std::map<uint256, std::vector<CStealthMatch> > mapStealthPrescan;
 
     typedef std::map<unsigned int, CMasterKey> MasterKeyMap;
     MasterKeyMap mapMasterKeys;
@@ -130,9 +203,11 @@ public:
         pwalletdbEncryption = NULL;
         nOrderPosNext = 0;
         nTimeFirstKey =0;
+        fAbortRescan = false;
+        nRescanProgress = -1;
     }
 
-    std::map<uint256, CWalletTx> mapWallet;
+    CHashMap<uint256, CWalletTx> mapWallet;
     int64 nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
 
@@ -141,6 +216,10 @@ public:
     CPubKey vchDefaultKey;
     int64 nTimeFirstKey;
 
+    // Set to stop a running rescan; percent done of it, or -1
+    bool fAbortRescan;
+    int nRescanProgress;
+
     // check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf) { return nWalletMaxVersion >= wf; }
 
@@ -188,7 +267,7 @@ public:
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate = false, bool fFindBlock = false);
     bool EraseFromWallet(uint256 hash);
     void WalletUpdateSpent(const CTransaction& prevout, bool fBlock = false);
-    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool* pfAborted = NULL, bool* pfFailed = NULL);
     int ScanForWalletTransaction(const uint256& hashTx);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(bool fForce = false);
@@ -197,6 +276,11 @@ public:
     int64 GetImmatureBalance() const;
     int64 GetStake() const;
     int64 GetNewMint() const;
+    // wtx's share of GetBalance, GetStake, GetUnconfirmedBalance and
+    // GetImmatureBalance. Returns false while new blocks can still change
+    // it (unconfirmed or immature); otherwise only wtx changing or a
+    // reorganization does.
+    bool GetBalanceShare(const CWalletTx& wtx, CWalletBalances& share) const;
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey);
     bool GetStakeWeight(const CKeyStore& keystore, uint64& nMinWeight, uint64& nMaxWeight, uint64& nWeight);
     bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64 nSearchInterval, CTransaction& txNew);
@@ -216,6 +300,13 @@ public:
     std::string SendStealthMoney(CScript scriptPubKey, int64 nValue, std::vector<uint8_t>& P, std::vector<uint8_t>& narr, std::string& sNarr, CWalletTx& wtxNew, bool fAskFee=false);
     bool SendStealthMoneyToDestination(CStealthAddress& sxAddress, int64 nValue, std::string& sNarr, CWalletTx& wtxNew, std::string& sError, bool fAskFee=false);
     bool FindStealthTransactions(const CTransaction& tx, mapValue_t& mapNarr);
+    bool AddStealthMatch(const CStealthAddress& sxAddr, const CStealthMatch& match);
+    bool UpdateStealthScanner();
+    // Find the stealth payments of a block's transactions in one batch,
+    // for FindStealthTransactions to pick up
+    void ScanBlockForStealth(const std::vector<CTransaction>& vtx);
+    void SetStealthPrescan(const std::vector<CTransaction>& vtx, const std::vector<CStealthMatch>& vMatches,
+                           const std::vector<unsigned int>& vScanned);
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int nSize = 0);
@@ -7,12 +7,15 @@
 #include "wallet.h"
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace boost;
 
 
 static uint64 nAccountingEntryNumber = 0;
+// Fewer wallet records than this are decoded on the loading thread only
+static const unsigned int WALLET_LOAD_PARALLEL_MIN = 1000;
 extern bool fWalletUnlockMintOnly;
 
 //
@@ -122,7 +125,7 @@ CWalletDB::ReorderTransactions(CWallet* pwallet)
     typedef multimap<int64, TxPair > TxItems;
     TxItems txByTime;
 
-    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+    for (CHashMap<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
     {
         CWalletTx* wtx = &((*it).second);
         txByTime.insert(make_pair(wtx->nTimeReceived, TxPair(wtx, (CAccountingEntry*)0)));
@@ -155,12 +158,9 @@ CWalletDB::ReorderTransactions(CWallet* pwallet)
         }
         else
         {
-            int64 nOrderPosOff = 0;
-            BOOST_FOREACH(const int64& nOffsetStart, nOrderPosOffsets)
-            {
-                if (nOrderPos >= nOffsetStart)
-                    ++nOrderPosOff;
-            }
+            // Offsets are pushed in increasing order, so the ones at or
+            // below nOrderPos are a prefix
+            int64 nOrderPosOff = std::upper_bound(nOrderPosOffsets.begin(), nOrderPosOffsets.end(), nOrderPos) - nOrderPosOffsets.begin();
             nOrderPos += nOrderPosOff;
             nOrderPosNext = std::max(nOrderPosNext, nOrderPos + 1);
 
@@ -200,17 +200,101 @@ public:
     }
 };
 
+/** What LoadWallet can read of a record ahead, without the wallet: the
+ * transactions and plaintext keys, which cost the most to decode, are
+ * decoded on several threads before the records are applied in order.
+ */
+class CWalletRecordDecoded
+{
+public:
+    bool fDone;
+    bool fOK;
+    std::string strType;
+    std::string strErr;
+    uint256 hash;
+    boost::shared_ptr<CWalletTx> pwtx;
+    boost::shared_ptr<CKey> pkey;
+
+    CWalletRecordDecoded() : fDone(false), fOK(false) {}
+};
+
+// fCheckKeys also checks that each secret gives its public key, which is
+// one EC multiplication a key; the keystore does that at first use instead
+static void DecodeKeyValue(CDataStream& ssKey, CDataStream& ssValue, CWalletRecordDecoded& decoded, bool fCheckKeys)
+{
+    decoded.fDone = true;
+    decoded.fOK = false;
+    try {
+        const string& strType = decoded.strType;
+        if (strType == "tx")
+        {
+            ssKey >> decoded.hash;
+            decoded.pwtx.reset(new CWalletTx());
+            CWalletTx& wtx = *decoded.pwtx;
+            ssValue >> wtx;
+            if (!wtx.CheckTransaction() || wtx.GetHash() != decoded.hash)
+                return;
+        }
+        else if (strType == "key" || strType == "wkey")
+        {
+            vector<unsigned char> vchPubKey;
+            ssKey >> vchPubKey;
+            CPrivKey pkey;
+            if (strType == "key")
+                ssValue >> pkey;
+            else
+            {
+                CWalletKey wkey;
+                ssValue >> wkey;
+                pkey = wkey.vchPrivKey;
+            }
+            const char* pszWhat = (strType == "key" ? "CPrivKey" : "CWalletKey");
+            decoded.pkey.reset(new CKey());
+            CKey& key = *decoded.pkey;
+            key.SetPubKey(vchPubKey);
+            if (!key.SetPrivKey(pkey, !fCheckKeys))
+            {
+                decoded.strErr = "Error reading wallet database: CPrivKey corrupt";
+                return;
+            }
+            if (key.GetPubKey() != vchPubKey)
+            {
+                decoded.strErr = strprintf("Error reading wallet database: %s pubkey inconsistency", pszWhat);
+                return;
+            }
+            if (fCheckKeys && !key.IsValid())
+            {
+                decoded.strErr = strprintf("Error reading wallet database: invalid %s", pszWhat);
+                return;
+            }
+        }
+    } catch (...)
+    {
+        return;
+    }
+    decoded.fOK = true;
+}
+
+static bool IsDecodedType(const string& strType)
+{
+    return (strType == "tx" || strType == "key" || strType == "wkey");
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              //int& nFileVersion, vector<uint256>& vWalletUpgrade,
              //bool& fIsEncrypted,  bool& fAnyUnordered, string& strType, string& strErr)
-             CWalletScanState &wss, string& strType, string& strErr)
+             CWalletScanState &wss, string& strType, string& strErr,
+             CWalletRecordDecoded* pdecoded = NULL)
 {
     try {
         // Unserialize
         // Taking advantage of the fact that pair serialization
         // is just the two items serialized one after the other
-        ssKey >> strType;
+        if (pdecoded && pdecoded->fDone)
+            strType = pdecoded->strType;
+        else
+            ssKey >> strType;
         if (strType == "name")
         {
             string strAddress;
@@ -219,17 +303,20 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
-            CWalletTx& wtx = pwallet->mapWallet[hash];
-            ssValue >> wtx;
-            if (wtx.CheckTransaction() && (wtx.GetHash() == hash))
-                wtx.BindWallet(pwallet);
-            else
+            CWalletRecordDecoded decodedHere;
+            CWalletRecordDecoded& decoded = pdecoded ? *pdecoded : decodedHere;
+            if (!decoded.fDone)
             {
-                pwallet->mapWallet.erase(hash);
-                return false;
+                decoded.strType = strType;
+                DecodeKeyValue(ssKey, ssValue, decoded, true);
             }
+            if (!decoded.fOK)
+                return false;
+
+            uint256 hash = decoded.hash;
+            CWalletTx& wtx = pwallet->mapWallet[hash];
+            wtx = *decoded.pwtx;
+            wtx.BindWallet(pwallet);
 
             // Undo serialize changes in 31600
             if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
@@ -290,52 +377,21 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "key" || strType == "wkey")
         {
-            vector<unsigned char> vchPubKey;
-            ssKey >> vchPubKey;
-            CKey key;
             if (strType == "key")
-            {
                 wss.nKeys++;
-                CPrivKey pkey;
-                ssValue >> pkey;
-                key.SetPubKey(vchPubKey);
-                if (!key.SetPrivKey(pkey))
-                {
-                    strErr = "Error reading wallet database: CPrivKey corrupt";
-                    return false;
-                }
-                if (key.GetPubKey() != vchPubKey)
-                {
-                    strErr = "Error reading wallet database: CPrivKey pubkey inconsistency";
-                    return false;
-                }
-                if (!key.IsValid())
-                {
-                    strErr = "Error reading wallet database: invalid CPrivKey";
-                    return false;
-                }
+            CWalletRecordDecoded decodedHere;
+            CWalletRecordDecoded& decoded = pdecoded ? *pdecoded : decodedHere;
+            if (!decoded.fDone)
+            {
+                decoded.strType = strType;
+                DecodeKeyValue(ssKey, ssValue, decoded, true);
             }
-            else
+            if (!decoded.fOK)
             {
-                CWalletKey wkey;
-                ssValue >> wkey;
-                key.SetPubKey(vchPubKey);
-                if (!key.SetPrivKey(wkey.vchPrivKey))
-                {
-                    strErr = "Error reading wallet database: CPrivKey corrupt";
-                    return false;
-                }
-                if (key.GetPubKey() != vchPubKey)
-                {
-                    strErr = "Error reading wallet database: CWalletKey pubkey inconsistency";
-                    return false;
-                }
-                if (!key.IsValid())
-                {
-                    strErr = "Error reading wallet database: invalid CWalletKey";
-                    return false;
-                }
+                strErr = decoded.strErr;
+                return false;
             }
+            const CKey& key = *decoded.pkey;
             if (!pwallet->LoadKey(key))
             {
                 strErr = "Error reading wallet database: LoadKey failed";
@@ -448,6 +504,35 @@ static bool IsKeyType(string strType)
             strType == "mkey" || strType == "ckey");
 }
 
+// A record as read from the cursor, and what was decoded of it ahead
+struct CWalletRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+    CWalletRecordDecoded decoded;
+
+    CWalletRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION) {}
+};
+
+static void ThreadDecodeWalletRecords(deque<CWalletRecord>* pvRecords, unsigned int nThread, unsigned int nThreads)
+{
+    RenameThread("bitcoin-walletload");
+    for (unsigned int i = nThread; i < pvRecords->size(); i += nThreads)
+    {
+        CWalletRecord& record = (*pvRecords)[i];
+        try {
+            record.ssKey >> record.decoded.strType;
+        } catch (...) {
+            // ReadKeyValue finds the record corrupt
+            continue;
+        }
+        if (IsDecodedType(record.decoded.strType))
+            DecodeKeyValue(record.ssKey, record.ssValue, record.decoded, false);
+        else
+            record.decoded.fDone = true;
+    }
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
@@ -458,6 +543,10 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     CWalletScanState wss;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
+    int64 nStart = GetTimeMillis();
+    int64 nRead = 0, nDecode = 0, nApply = 0;
+    int nThreads = 1;
+    unsigned int nRecords = 0;
 
     try {
         LOCK(pwallet->cs_wallet);
@@ -477,25 +566,53 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        // Read every record first, so the cursor is done with quickly and
+        // the records can be decoded in parallel
+        deque<CWalletRecord> vRecords;
         while (true)
         {
             // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = ReadAtCursor(pcursor, ssKey, ssValue);
+            vRecords.push_back(CWalletRecord());
+            CWalletRecord& record = vRecords.back();
+            int ret = ReadAtCursor(pcursor, record.ssKey, record.ssValue);
             if (ret == DB_NOTFOUND)
+            {
+                vRecords.pop_back();
                 break;
+            }
             else if (ret != 0)
             {
                 printf("Error reading next record from wallet database\n");
+                pcursor->close();
                 return DB_CORRUPT;
             }
+        }
+        pcursor->close();
+        nRecords = vRecords.size();
+        nRead = GetTimeMillis() - nStart;
 
+        // Transactions and keys are decoded on as many threads as there
+        // are cores, other records as they are applied
+        if (vRecords.size() >= WALLET_LOAD_PARALLEL_MIN)
+        {
+            nThreads = boost::thread::hardware_concurrency();
+            nThreads = max(1, min(nThreads, 8));
+        }
+        boost::thread_group threads;
+        for (int i = 1; i < nThreads; i++)
+            threads.create_thread(boost::bind(&ThreadDecodeWalletRecords, &vRecords, i, nThreads));
+        ThreadDecodeWalletRecords(&vRecords, 0, nThreads);
+        threads.join_all();
+        nDecode = GetTimeMillis() - nStart - nRead;
+
+        // Applied in cursor order, as before
+        BOOST_FOREACH(CWalletRecord& record, vRecords)
+        {
             // Try to be tolerant of single corrupt records:
             string strType, strErr;
             //if (!ReadKeyValue(pwallet, ssKey, ssValue, nFileVersion,
             //                  vWalletUpgrade, fIsEncrypted, fAnyUnordered, strType, strErr))
-            if (!ReadKeyValue(pwallet,ssKey,ssValue,wss,strType,strErr))
+            if (!ReadKeyValue(pwallet,record.ssKey,record.ssValue,wss,strType,strErr,&record.decoded))
             {
                 // losing keys is considered a catastrophic error, anything else
                 // we assume the user can live with:
@@ -513,13 +630,16 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 printf("%s\n", strErr.c_str());
         }
-        pcursor->close();
+        nApply = GetTimeMillis() - nStart - nRead - nDecode;
     }
     catch (...)
     {
         result = DB_CORRUPT;
     }
 
+    printf("LoadWallet: %u records, read %"PRI64d"ms, decode %"PRI64d"ms (%d threads), apply %"PRI64d"ms\n",
+           nRecords, nRead, nDecode, nThreads, nApply);
+
     if (fNoncriticalErrors && result == DB_LOAD_OK)
         result = DB_NONCRITICAL_ERROR;
 
@@ -549,7 +669,11 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         WriteVersion(CLIENT_VERSION);
 
     if (wss.fAnyUnordered)
+    {
+        int64 nReorderStart = GetTimeMillis();
         result = ReorderTransactions(pwallet);
+        printf("LoadWallet: reordered transactions  %"PRI64d"ms\n", GetTimeMillis() - nReorderStart);
+    }
 
     return result;
 }
@@ -580,7 +704,9 @@ void ThreadFlushWalletDB(void* parg)
             nLastWalletUpdate = GetTime();
         }
 
-        if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
+        // Merge the journal when the wallet goes idle, or before it grows large
+        if (nLastFlushed != nWalletDBUpdated &&
+            (GetTime() - nLastWalletUpdate >= 2 || bitdb.GetJournalSize(strFile) >= DB_JOURNAL_COMPACT_SIZE))
         {
             TRY_LOCK(bitdb.cs_db,lockDb);
             if (lockDb)
@@ -604,8 +730,11 @@ void ThreadFlushWalletDB(void* parg)
                         int64 nStart = GetTimeMillis();
 
                         // Flush wallet.dat so it's self contained
+                        bool fJournalApplied = bitdb.ApplyJournal(strFile);
                         bitdb.CloseDb(strFile);
                         bitdb.CheckpointLSN(strFile);
+                        if (fJournalApplied)
+                            bitdb.TruncateJournal(strFile);
 
                         bitdb.mapFileUseCount.erase(mi++);
                         printf("Flushed wallet.dat %"PRI64d"ms\n", GetTimeMillis() - nStart);
@@ -626,9 +755,12 @@ bool BackupWallet(const CWallet& wallet, const string& strDest)
             LOCK(bitdb.cs_db);
             if (!bitdb.mapFileUseCount.count(wallet.strWalletFile) || bitdb.mapFileUseCount[wallet.strWalletFile] == 0)
             {
-                // Flush log data to the dat file
+                // Flush journal and log data to the dat file
+                if (!bitdb.ApplyJournal(wallet.strWalletFile))
+                    return false;
                 bitdb.CloseDb(wallet.strWalletFile);
                 bitdb.CheckpointLSN(wallet.strWalletFile);
+                bitdb.TruncateJournal(wallet.strWalletFile);
                 bitdb.mapFileUseCount.erase(wallet.strWalletFile);
 
                 // Copy wallet.dat
@@ -82,7 +82,7 @@ public:
 class CWalletDB : public CDB
 {
 public:
-    CWalletDB(std::string strFilename, const char* pszMode="r+") : CDB(strFilename.c_str(), pszMode)
+    CWalletDB(std::string strFilename, const char* pszMode="r+") : CDB(strFilename.c_str(), pszMode, true)
     {
     }
 private:
@@ -96,7 +96,7 @@ public:
 
         Dbc* GetTxnCursor()
         {
-            if (!pdb)
+            if (!pdb || !CanIterate())
                 return NULL;
 
             DbTxn* ptxnid = activeTxn; // call TxnBegin first
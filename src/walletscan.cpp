@@ -0,0 +1,372 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "walletscan.h"
+#include "main.h"
+#include "wallet.h"
+
+#include <deque>
+
+#include <boost/thread.hpp>
+
+using namespace std;
+
+CWalletScanFilter::CWalletScanFilter(const CWallet* pwallet) :
+    filter(1, 0.000001)
+{
+    set<CKeyID> setKeys;
+    set<CScriptID> setScripts;
+    pwallet->GetKeys(setKeys);
+    pwallet->GetCScripts(setScripts);
+
+    // Sized so that nothing rolls out
+    filter = CRollingBloomFilter(setKeys.size() + setScripts.size() + 1, 0.000001);
+    BOOST_FOREACH(const CKeyID& keyID, setKeys)
+        filter.insert(keyID);
+    BOOST_FOREACH(const CScriptID& scriptID, setScripts)
+        filter.insert(scriptID);
+}
+
+bool CWalletScanFilter::IsRelevant(const CTransaction& tx) const
+{
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+    {
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        if (!Solver(txout.scriptPubKey, whichType, vSolutions))
+            continue;
+
+        switch (whichType)
+        {
+        case TX_PUBKEY:
+            if (filter.contains(CPubKey(vSolutions[0]).GetID()))
+                return true;
+            break;
+        case TX_PUBKEYHASH:
+        case TX_SCRIPTHASH:
+            if (filter.contains(uint160(vSolutions[0])))
+                return true;
+            break;
+        case TX_MULTISIG:
+        {
+            bool fAll = true;
+            for (unsigned int i = 1; i + 1 < vSolutions.size() && fAll; i++)
+                fAll = filter.contains(CPubKey(vSolutions[i]).GetID());
+            if (fAll)
+                return true;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+// Whether the apply stage has to look at a transaction the filter passed
+// over: it is in the wallet already or spends a wallet transaction
+static bool TouchesWallet(const CWallet* pwallet, const CTransaction& tx, const uint256& hash)
+{
+    if (pwallet->mapWallet.count(hash))
+        return true;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        if (pwallet->mapWallet.count(txin.prevout.hash))
+            return true;
+    return false;
+}
+
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fClaimed;
+    bool fFiltered;
+    std::vector<bool> vRelevant;
+    // Filter generation vRelevant was computed with
+    unsigned int nGeneration;
+    std::vector<CStealthMatch> vStealthMatches;
+    std::vector<unsigned int> vStealthScanned;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fClaimed(false), fFiltered(false), nGeneration(0) {}
+};
+
+/** State shared by the reader, the filter workers and the apply stage.
+ * Blocks enter at the back in chain order and leave at the front once
+ * filtered, so the apply stage sees them in chain order.
+ */
+class CRescanPipeline
+{
+public:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<CRescanBlock*> queue;
+    bool fReadDone;
+    bool fStop;
+    // Block the reader could not read, which stops the scan
+    CBlockIndex* pindexReadFailed;
+    boost::shared_ptr<const CWalletScanFilter> filter;
+    unsigned int nGeneration;
+    // The wallet's stealth addresses, fixed for the scan
+    std::set<CStealthAddress> setStealthAddresses;
+
+    CRescanPipeline() : fReadDone(false), fStop(false), pindexReadFailed(NULL), nGeneration(0) {}
+
+    ~CRescanPipeline()
+    {
+        BOOST_FOREACH(CRescanBlock* pitem, queue)
+            delete pitem;
+    }
+
+    void Stop()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+    }
+};
+
+static void ThreadRescanRead(CRescanPipeline* pipeline, const vector<CBlockIndex*>* pvBlocks)
+{
+    RenameThread("bitcoin-rescanread");
+    BOOST_FOREACH(CBlockIndex* pindex, *pvBlocks)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(pipeline->mutex);
+            while (pipeline->queue.size() >= DEFAULT_RESCAN_PREFETCH && !pipeline->fStop)
+                pipeline->cond.wait(lock);
+            if (pipeline->fStop)
+                break;
+        }
+
+        // Block files are append only, so no lock is needed to read
+        CRescanBlock* pitem = new CRescanBlock(pindex);
+        if (!pitem->block.ReadFromDisk(pindex, true))
+        {
+            delete pitem;
+            {
+                boost::unique_lock<boost::mutex> lock(pipeline->mutex);
+                pipeline->pindexReadFailed = pindex;
+                pipeline->fStop = true;
+            }
+            break;
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(pipeline->mutex);
+            pipeline->queue.push_back(pitem);
+        }
+        pipeline->cond.notify_all();
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(pipeline->mutex);
+        pipeline->fReadDone = true;
+    }
+    pipeline->cond.notify_all();
+}
+
+static void ThreadRescanFilter(CRescanPipeline* pipeline)
+{
+    RenameThread("bitcoin-rescanfilter");
+
+    // Each worker has its own curve context
+    CStealthScanner stealthScanner;
+    bool fStealth = stealthScanner.SetAddresses(pipeline->setStealthAddresses);
+
+    while (true)
+    {
+        CRescanBlock* pitem = NULL;
+        boost::shared_ptr<const CWalletScanFilter> filter;
+        unsigned int nGeneration;
+        {
+            boost::unique_lock<boost::mutex> lock(pipeline->mutex);
+            while (true)
+            {
+                if (pipeline->fStop)
+                    return;
+                BOOST_FOREACH(CRescanBlock* pitemQueued, pipeline->queue)
+                {
+                    if (!pitemQueued->fClaimed)
+                    {
+                        pitem = pitemQueued;
+                        break;
+                    }
+                }
+                if (pitem)
+                    break;
+                if (pipeline->fReadDone)
+                    return;
+                pipeline->cond.wait(lock);
+            }
+            pitem->fClaimed = true;
+            filter = pipeline->filter;
+            nGeneration = pipeline->nGeneration;
+        }
+
+        vector<bool> vRelevant(pitem->block.vtx.size(), true);
+        vector<CStealthMatch> vStealthMatches;
+        vector<unsigned int> vStealthScanned;
+        try
+        {
+            for (unsigned int i = 0; i < pitem->block.vtx.size(); i++)
+                vRelevant[i] = filter->IsRelevant(pitem->block.vtx[i]);
+
+            if (fStealth)
+            {
+                vector<const CTransaction*> vptx;
+                BOOST_FOREACH(const CTransaction& tx, pitem->block.vtx)
+                    vptx.push_back(&tx);
+                stealthScanner.Scan(vptx, vStealthMatches, &vStealthScanned);
+                BOOST_FOREACH(const CStealthMatch& match, vStealthMatches)
+                    vRelevant[match.nTx] = true;
+            }
+        }
+        catch (std::exception& e) {
+            // Leave it to the apply stage to look at every transaction
+            PrintExceptionContinue(&e, "ThreadRescanFilter()");
+            vRelevant.assign(pitem->block.vtx.size(), true);
+            vStealthMatches.clear();
+            vStealthScanned.clear();
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(pipeline->mutex);
+            pitem->vRelevant.swap(vRelevant);
+            pitem->vStealthMatches.swap(vStealthMatches);
+            pitem->vStealthScanned.swap(vStealthScanned);
+            pitem->nGeneration = nGeneration;
+            pitem->fFiltered = true;
+        }
+        pipeline->cond.notify_all();
+    }
+}
+
+int CWalletRescan::Scan(CBlockIndex* pindexStart, bool& fAborted, bool& fFailed)
+{
+    fAborted = false;
+    fFailed = false;
+    int64 nStart = GetTimeMillis();
+
+    // Blocks are fixed up front so the reader never needs cs_main; the
+    // ones before the oldest key cannot hold wallet transactions
+    vector<CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        for (CBlockIndex* pindex = pindexStart; pindex; pindex = pindex->pnext)
+            if (!pwallet->nTimeFirstKey || pindex->nTime >= pwallet->nTimeFirstKey - 7200)
+                vBlocks.push_back(pindex);
+    }
+    if (vBlocks.empty())
+        return 0;
+
+    CRescanPipeline pipeline;
+    uint32_t nFoundStealth;
+    {
+        LOCK(pwallet->cs_wallet);
+        pipeline.filter.reset(new CWalletScanFilter(pwallet));
+        pipeline.setStealthAddresses = pwallet->stealthAddresses;
+        nFoundStealth = pwallet->nFoundStealth;
+    }
+
+    int nThreads = boost::thread::hardware_concurrency();
+    nThreads = max(1, min(nThreads, 8));
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&ThreadRescanRead, &pipeline, &vBlocks));
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&ThreadRescanFilter, &pipeline));
+
+    int ret = 0;
+    unsigned int nApplied = 0;
+    unsigned int nApplyAll = 0;
+    int64 nLastProgress = GetTime();
+    pwallet->nRescanProgress = 0;
+    while (true)
+    {
+        vector<CRescanBlock*> vBatch;
+        {
+            boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+            while ((pipeline.queue.empty() || !pipeline.queue.front()->fFiltered)
+                   && !(pipeline.queue.empty() && pipeline.fReadDone))
+            {
+                if (fShutdown || pwallet->fAbortRescan || pipeline.fStop)
+                    break;
+                pipeline.cond.timed_wait(lock, boost::posix_time::milliseconds(250));
+            }
+            while (!pipeline.queue.empty() && pipeline.queue.front()->fFiltered && vBatch.size() < RESCAN_APPLY_BATCH)
+            {
+                vBatch.push_back(pipeline.queue.front());
+                pipeline.queue.pop_front();
+            }
+            fFailed = (pipeline.pindexReadFailed != NULL);
+        }
+        // Room for the reader
+        pipeline.cond.notify_all();
+
+        if (fShutdown || pwallet->fAbortRescan || fFailed)
+        {
+            fAborted = !fFailed;
+            BOOST_FOREACH(CRescanBlock* pitem, vBatch)
+                delete pitem;
+            break;
+        }
+        if (vBatch.empty())
+            break;
+
+        {
+            // SetMerkleBranch looks the blocks up in the chain
+            LOCK2(cs_main, pwallet->cs_wallet);
+            // Held open so the batch's wallet writes share one journal commit
+            CWalletDB* pwalletdb = pwallet->fFileBacked ? new CWalletDB(pwallet->strWalletFile, "r") : NULL;
+            BOOST_FOREACH(CRescanBlock* pitem, vBatch)
+            {
+                bool fStale = (pitem->nGeneration != pipeline.nGeneration);
+                if (fStale)
+                    nApplyAll++;
+                pwallet->SetStealthPrescan(pitem->block.vtx, pitem->vStealthMatches, pitem->vStealthScanned);
+                for (unsigned int i = 0; i < pitem->block.vtx.size(); i++)
+                {
+                    const CTransaction& tx = pitem->block.vtx[i];
+                    if (fStale || pitem->vRelevant[i] || TouchesWallet(pwallet, tx, tx.GetHash()))
+                        if (pwallet->AddToWalletIfInvolvingMe(tx, &pitem->block, fUpdate))
+                            ret++;
+                }
+
+                // Keys learned from stealth payments are not in the filter
+                if (pwallet->nFoundStealth != nFoundStealth)
+                {
+                    nFoundStealth = pwallet->nFoundStealth;
+                    boost::shared_ptr<const CWalletScanFilter> filter(new CWalletScanFilter(pwallet));
+                    boost::unique_lock<boost::mutex> lock(pipeline.mutex);
+                    pipeline.filter = filter;
+                    pipeline.nGeneration++;
+                }
+            }
+            delete pwalletdb;
+        }
+
+        nApplied += vBatch.size();
+        BOOST_FOREACH(CRescanBlock* pitem, vBatch)
+            delete pitem;
+
+        pwallet->nRescanProgress = (int)((int64)nApplied * 100 / vBlocks.size());
+        if (GetTime() - nLastProgress >= 10)
+        {
+            nLastProgress = GetTime();
+            printf("Rescan: %u of %"PRIszu" blocks (%d%%)\n", nApplied, vBlocks.size(), pwallet->nRescanProgress);
+        }
+    }
+
+    pipeline.Stop();
+    threads.join_all();
+    pwallet->nRescanProgress = -1;
+
+    if (fFailed)
+        error("CWalletRescan::Scan() : failed to read block %s", pipeline.pindexReadFailed->GetBlockHash().ToString().c_str());
+
+    printf("Rescan: %u blocks, %d transactions, %u blocks applied in full  %"PRI64d"ms%s\n",
+           nApplied, ret, nApplyAll, GetTimeMillis() - nStart, fAborted ? "  (aborted)" : fFailed ? "  (failed)" : "");
+    return ret;
+}
@@ -0,0 +1,67 @@
+// Copyright (c) 2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_WALLETSCAN_H
+#define BITCOIN_WALLETSCAN_H
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "bloom.h"
+
+class CBlockIndex;
+class CTransaction;
+class CWallet;
+
+/** Blocks read ahead of the apply stage of a rescan */
+static const unsigned int DEFAULT_RESCAN_PREFETCH = 64;
+/** Most blocks applied under one hold of cs_main and cs_wallet */
+static const unsigned int RESCAN_APPLY_BATCH = 16;
+
+/** Snapshot of the wallet's keys and scripts for telling, without any wallet
+ * lock, which transactions cannot involve the wallet.
+ *
+ * Never rejects an output CWallet::IsMine would accept: pay-to-pubkey(-hash)
+ * is checked against the key IDs, pay-to-script-hash against the script IDs,
+ * and multisig needs every key. Spends of wallet coins are not its business;
+ * the apply stage checks inputs against mapWallet, which changes as the scan
+ * goes. Neither are stealth payments, which CStealthScanner finds.
+ */
+class CWalletScanFilter
+{
+private:
+    CRollingBloomFilter filter;
+
+public:
+    // Call with cs_wallet held
+    CWalletScanFilter(const CWallet* pwallet);
+
+    bool IsRelevant(const CTransaction& tx) const;
+};
+
+/** Finds the wallet transactions of a stretch of the block chain.
+ *
+ * A reader thread prefetches blocks in chain order, a pool of workers runs
+ * them through a CWalletScanFilter and a CStealthScanner each, and the
+ * calling thread hands what passes to AddToWalletIfInvolvingMe, taking
+ * cs_main and cs_wallet for RESCAN_APPLY_BATCH blocks at a time. If the wallet learns
+ * keys while scanning (stealth payments), blocks filtered before that are
+ * applied in full.
+ */
+class CWalletRescan
+{
+public:
+    CWalletRescan(CWallet* pwalletIn, bool fUpdateIn) : pwallet(pwalletIn), fUpdate(fUpdateIn) {}
+
+    // Returns the number of transactions added or updated. Call with no
+    // locks held. fFailed is set if a block could not be read, which stops
+    // the scan like an abort does.
+    int Scan(CBlockIndex* pindexStart, bool& fAborted, bool& fFailed);
+
+private:
+    CWallet* pwallet;
+    bool fUpdate;
+};
+
+#endif